@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_COMPRESS_H
+#define FLB_COMPRESS_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_config.h>
+#include <monkey/mk_core.h>
+
+#include <pthread.h>
+
+/* Compression algorithms */
+#define FLB_COMPRESS_NONE     0
+#define FLB_COMPRESS_GZIP     1
+#define FLB_COMPRESS_SNAPPY   2
+
+/* Pool of threads that run compression jobs for coroutines */
+struct flb_compress_pool {
+    int workers;               /* number of threads           */
+    int exit;                  /* set on shutdown             */
+    pthread_t *tids;           /* threads id                  */
+    pthread_mutex_t lock;      /* protect the jobs queue      */
+    pthread_cond_t cond;       /* signal new jobs / exit      */
+    struct mk_list jobs;       /* queued jobs                 */
+};
+
+int flb_compress_type(const char *name);
+const char *flb_compress_name(int type);
+
+int flb_compress(int type, void *in_data, size_t in_len,
+                 void **out_data, size_t *out_len);
+int flb_uncompress(int type, void *in_data, size_t in_len,
+                   void **out_data, size_t *out_len);
+int flb_compress_async(struct flb_config *config, int type,
+                       void *in_data, size_t in_len,
+                       void **out_data, size_t *out_len);
+
+struct flb_compress_pool *flb_compress_pool_create(struct flb_config *config,
+                                                   int workers);
+void flb_compress_pool_destroy(struct flb_compress_pool *pool);
+
+#endif
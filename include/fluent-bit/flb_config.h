@@ -110,6 +110,10 @@ struct flb_config {
     /* Filter instances */
     struct mk_list filters;
 
+    /* Routing cache: Tag -> matching filters and outputs (flb_hash) */
+    void *router_cache;
+    int route_mask_size;       /* routes mask elements (uint64_t) */
+
     struct mk_event_loop *evl;          /* the event loop (mk_core) */
 
     /* Proxies */
@@ -194,9 +198,20 @@ struct flb_config {
     char *storage_sync;             /* sync mode */
     int   storage_metrics;          /* enable/disable storage metrics */
     int   storage_checksum;         /* checksum enabled */
+    int   storage_index;            /* chunk index for fast restarts */
     int   storage_max_chunks_up;    /* max number of chunks 'up' in memory */
     char *storage_bl_mem_limit;     /* storage backlog memory limit */
+    int   storage_bl_workers;       /* storage backlog scan threads */
+    int   storage_bl_ratio;         /* backlog share of the data in flight (%) */
+    char *storage_mem_budget;       /* memory budget shared by the inputs */
+    int   storage_mem_budget_spill; /* spill chunks to disk over the budget */
+    size_t storage_mem_budget_size; /* memory budget in bytes (0: disabled) */
+    uint64_t storage_mem_budget_spilled; /* chunks put down over the budget */
+    int   storage_sync_interval;    /* group sync interval (milliseconds) */
+    char *storage_sync_bytes;       /* group sync pending bytes limit */
+    struct flb_storage_sync *storage_sync_ctx;       /* group sync context */
     struct flb_storage_metrics *storage_metrics_ctx; /* storage metrics context */
+    struct mk_event storage_async_event;  /* async file I/O completions */
 
     /* Embedded SQL Database support (SQLite3) */
 #ifdef FLB_HAVE_SQLDB
@@ -235,7 +250,18 @@ struct flb_config {
     unsigned int sched_cap;
     unsigned int sched_base;
 
-    struct flb_task_map tasks_map[2048];
+    /* Compression offload pool */
+    int compress_workers;
+    void *compress_pool;
+
+    /* Tasks: growable map of task IDs */
+    struct flb_task_map *tasks_map;
+    int tasks_map_size;        /* number of slots              */
+    int tasks_map_free;        /* first free slot or -1        */
+    int tasks_count;           /* tasks alive                  */
+    int tasks_paused;          /* inputs paused by soft limit  */
+    int task_soft_limit;       /* pause inputs, 0 = disabled   */
+    int task_hard_limit;       /* max number of tasks, 0 = off */
 
     int dry_run;
 };
@@ -296,8 +322,15 @@ enum conf_type {
 #define FLB_CONF_STORAGE_SYNC          "storage.sync"
 #define FLB_CONF_STORAGE_METRICS       "storage.metrics"
 #define FLB_CONF_STORAGE_CHECKSUM      "storage.checksum"
+#define FLB_CONF_STORAGE_INDEX         "storage.index"
 #define FLB_CONF_STORAGE_BL_MEM_LIMIT  "storage.backlog.mem_limit"
+#define FLB_CONF_STORAGE_BL_WORKERS    "storage.backlog.workers"
+#define FLB_CONF_STORAGE_BL_RATIO      "storage.backlog.ratio"
 #define FLB_CONF_STORAGE_MAX_CHUNKS_UP "storage.max_chunks_up"
+#define FLB_CONF_STORAGE_MEM_BUDGET    "storage.mem_budget"
+#define FLB_CONF_STORAGE_MEM_BUDGET_SPILL "storage.mem_budget.spill"
+#define FLB_CONF_STORAGE_SYNC_INTERVAL "storage.sync.interval"
+#define FLB_CONF_STORAGE_SYNC_BYTES    "storage.sync.bytes"
 
 /* Coroutines */
 #define FLB_CONF_STR_CORO_STACK_SIZE "Coro_Stack_Size"
@@ -306,4 +339,11 @@ enum conf_type {
 #define FLB_CONF_STR_SCHED_CAP        "scheduler.cap"
 #define FLB_CONF_STR_SCHED_BASE       "scheduler.base"
 
+/* Compression */
+#define FLB_CONF_STR_COMPRESS_WORKERS "compress.workers"
+
+/* Tasks */
+#define FLB_CONF_STR_TASK_SOFT_LIMIT  "task.soft_limit"
+#define FLB_CONF_STR_TASK_HARD_LIMIT  "task.hard_limit"
+
 #endif
@@ -101,9 +101,15 @@ void flb_coro_set(struct flb_coro *coro);
 
 static FLB_INLINE void flb_coro_resume(struct flb_coro *coro)
 {
+    struct flb_coro *prev;
+
+    prev = flb_coro_get();
     flb_coro_set(coro);
     coro->caller = co_active();
     co_switch(coro->callee);
+
+    /* the coroutine yielded, it's not the running one anymore */
+    flb_coro_set(prev);
 }
 
 static FLB_INLINE struct flb_coro *flb_coro_create(void *data)
@@ -26,6 +26,28 @@
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_task.h>
 
+/*
+ * A dispatch flow holds the routes of one input waiting for an output. On
+ * every round a flow can dispatch up to 'weight' routes (the input
+ * dispatch.weight) before the next flow of the same priority class.
+ */
+struct flb_dispatch_flow {
+    int active;                           /* linked in an active list ?   */
+    int deficit;                          /* routes left in this round    */
+    struct flb_input_instance *in;        /* input instance               */
+    struct mk_list queue;                 /* queued flb_task_route        */
+    struct mk_list _head_active;          /* link to ins->dispatch_active */
+    struct mk_list _head;                 /* link to ins->dispatch_flows  */
+};
+
+int flb_engine_dispatch_priority(const char *str);
+int flb_engine_dispatch_enqueue(struct flb_task_route *route, uint64_t ts);
+struct flb_task_route *flb_engine_dispatch_dequeue(struct flb_output_instance *ins);
+void flb_engine_dispatch_route_remove(struct flb_task_route *route);
+int flb_engine_dispatch_output(struct flb_output_instance *ins,
+                               struct flb_config *config);
+void flb_engine_dispatch_flows_destroy(struct flb_output_instance *ins);
+
 int flb_engine_dispatch(uint64_t id, struct flb_input_instance *in,
                         struct flb_config *config);
 int flb_engine_dispatch_retry(struct flb_task_retry *retry,
@@ -42,6 +42,9 @@
 #define FLB_FILTER_MODIFIED 1
 #define FLB_FILTER_NOTOUCH  2
 
+/* Tags shorter than this are copied to the stack by flb_filter_do() */
+#define FLB_FILTER_TAG_BUF_SIZE  256
+
 struct flb_input_instance;
 struct flb_filter_instance;
 
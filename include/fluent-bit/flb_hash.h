@@ -32,34 +32,53 @@
 #define FLB_HASH_EVICT_OLDER      1
 #define FLB_HASH_EVICT_LESS_USED  2
 #define FLB_HASH_EVICT_RANDOM     3
+#define FLB_HASH_EVICT_LRU        4
 
+/* Keys shorter than this are stored in the slot itself */
+#define FLB_HASH_KEY_INLINE       24
+
+/*
+ * The table uses open addressing: entries are stored in a flat array of
+ * slots probed linearly. A parallel array keeps one control byte per slot,
+ * it's either empty, deleted or a fingerprint of the key hash, so most
+ * of the slots that don't match are discarded without reading them.
+ */
 struct flb_hash_entry {
     time_t created;
     uint64_t hits;
-    char *key;
+    uint64_t hash;                /* full hash of the key              */
+    char *key;                    /* key_buf or a heap copy of the key */
     size_t key_len;
     void *val;
     ssize_t val_size;
-    struct flb_hash_table *table; /* link to parent flb_hash_table */
-    struct mk_list _head;         /* link to flb_hash_table->chains */
-    struct mk_list _head_parent;  /* link to flb_hash->entries */
-};
-
-struct flb_hash_table {
-    int count;
-    struct mk_list chains;
+    int prev;                     /* eviction order, previous slot */
+    int next;                     /* eviction order, next slot     */
+    char key_buf[FLB_HASH_KEY_INLINE];
 };
 
 struct flb_hash {
     int evict_mode;
     int max_entries;
     int total_count;
+    int deleted;                  /* slots marked as deleted          */
     int cache_ttl;
-    size_t size;
-    struct mk_list entries;
-    struct flb_hash_table *table;
+    int first;                    /* first slot in eviction order     */
+    int last;                     /* last slot in eviction order      */
+    size_t size;                  /* number of slots, a power of two  */
+    uint8_t *ctrl;                /* control byte of every slot       */
+    struct flb_hash_entry *table; /* slots                            */
 };
 
+/*
+ * Iterate the entries in eviction order: insertion order, or last access
+ * on FLB_HASH_EVICT_LRU. The current entry can be removed with
+ * flb_hash_del_entry() while iterating.
+ */
+#define flb_hash_foreach(entry, tmp, ht)                                \
+    for (entry = flb_hash_iter_first(ht);                               \
+         entry && ((tmp = flb_hash_iter_next(ht, entry)) || 1);         \
+         entry = tmp)
+
 struct flb_hash *flb_hash_create(int evict_mode, size_t size, int max_entries);
 struct flb_hash *flb_hash_create_with_ttl(int cache_ttl, int evict_mode, 
                                           size_t size, int max_entries);
@@ -82,4 +101,9 @@ int flb_hash_del(struct flb_hash *ht, const char *key);
 int flb_hash_del_ptr(struct flb_hash *ht, const char *key, int key_len,
                      void *ptr);
 
+struct flb_hash_entry *flb_hash_iter_first(struct flb_hash *ht);
+struct flb_hash_entry *flb_hash_iter_next(struct flb_hash *ht,
+                                          struct flb_hash_entry *entry);
+void flb_hash_del_entry(struct flb_hash *ht, struct flb_hash_entry *entry);
+
 #endif
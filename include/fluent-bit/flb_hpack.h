@@ -0,0 +1,81 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_HPACK_H
+#define FLB_HPACK_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+
+/* HPACK: Header Compression for HTTP/2 (RFC 7541) */
+
+#define FLB_HPACK_TABLE_SIZE     4096   /* default dynamic table size */
+#define FLB_HPACK_ENTRY_OVERHEAD   32   /* per entry overhead (4.1)   */
+
+/* Encoding flags */
+#define FLB_HPACK_NO_INDEX        1     /* don't add to the dynamic table  */
+#define FLB_HPACK_NEVER_INDEX     2     /* sensitive, intermediaries too   */
+
+struct flb_hpack_field {
+    char *name;
+    size_t name_len;
+    char *value;
+    size_t value_len;
+};
+
+/*
+ * Dynamic table, one for each direction of a connection: the encoder and
+ * the decoder contexts of the peers must always be in sync.
+ */
+struct flb_hpack {
+    struct flb_hpack_field *ring;   /* entries, newest at 'head'  */
+    int ring_size;
+    int head;
+    int count;
+    size_t size;                    /* current table size         */
+    size_t max_size;                /* current maximum table size */
+    size_t max_size_limit;          /* protocol limit (SETTINGS)  */
+    int size_update;                /* encoder: pending update    */
+};
+
+struct flb_hpack *flb_hpack_create(size_t max_size);
+void flb_hpack_destroy(struct flb_hpack *hp);
+
+/* Encoder */
+int flb_hpack_set_max_size(struct flb_hpack *hp, size_t max_size);
+int flb_hpack_encode_begin(struct flb_hpack *hp, flb_sds_t *buf);
+int flb_hpack_encode(struct flb_hpack *hp, flb_sds_t *buf,
+                     const char *name, size_t name_len,
+                     const char *value, size_t value_len, int flags);
+
+/* Decoder */
+int flb_hpack_decode(struct flb_hpack *hp, const char *buf, size_t len,
+                     int (*cb_header)(void *,
+                                      const char *, size_t,
+                                      const char *, size_t),
+                     void *data);
+
+/* Huffman */
+size_t flb_hpack_huffman_len(const char *str, size_t len);
+int flb_hpack_huffman_encode(const char *str, size_t len, flb_sds_t *buf);
+int flb_hpack_huffman_decode(const unsigned char *in, size_t len,
+                             flb_sds_t *buf);
+
+#endif
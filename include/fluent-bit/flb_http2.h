@@ -0,0 +1,171 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_HTTP2_H
+#define FLB_HTTP2_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_hpack.h>
+#include <monkey/mk_core.h>
+
+#include <stdint.h>
+
+struct flb_upstream_conn;
+struct flb_http_client;
+
+/* Connection preface sent by the client */
+#define FLB_HTTP2_PREFACE         "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define FLB_HTTP2_PREFACE_LEN     24
+
+/* ALPN protocols offered on TLS connections */
+#define FLB_HTTP2_ALPN            "h2,http/1.1"
+
+/* Frame types (RFC 7540, section 6) */
+#define FLB_HTTP2_DATA            0x0
+#define FLB_HTTP2_HEADERS         0x1
+#define FLB_HTTP2_PRIORITY        0x2
+#define FLB_HTTP2_RST_STREAM      0x3
+#define FLB_HTTP2_SETTINGS        0x4
+#define FLB_HTTP2_PUSH_PROMISE    0x5
+#define FLB_HTTP2_PING            0x6
+#define FLB_HTTP2_GOAWAY          0x7
+#define FLB_HTTP2_WINDOW_UPDATE   0x8
+#define FLB_HTTP2_CONTINUATION    0x9
+
+/* Frame flags */
+#define FLB_HTTP2_FLAG_END_STREAM   0x1
+#define FLB_HTTP2_FLAG_ACK          0x1
+#define FLB_HTTP2_FLAG_END_HEADERS  0x4
+#define FLB_HTTP2_FLAG_PADDED       0x8
+#define FLB_HTTP2_FLAG_PRIORITY     0x20
+
+/* Settings */
+#define FLB_HTTP2_SETTINGS_HEADER_TABLE_SIZE      0x1
+#define FLB_HTTP2_SETTINGS_ENABLE_PUSH            0x2
+#define FLB_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define FLB_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE    0x4
+#define FLB_HTTP2_SETTINGS_MAX_FRAME_SIZE         0x5
+#define FLB_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE   0x6
+
+/* Error codes */
+#define FLB_HTTP2_NO_ERROR            0x0
+#define FLB_HTTP2_PROTOCOL_ERROR      0x1
+#define FLB_HTTP2_INTERNAL_ERROR      0x2
+#define FLB_HTTP2_FLOW_CONTROL_ERROR  0x3
+#define FLB_HTTP2_FRAME_SIZE_ERROR    0x6
+#define FLB_HTTP2_REFUSED_STREAM      0x7
+#define FLB_HTTP2_CANCEL              0x8
+#define FLB_HTTP2_COMPRESSION_ERROR   0x9
+#define FLB_HTTP2_ENHANCE_YOUR_CALM   0xb
+
+/* Protocol defaults and limits */
+#define FLB_HTTP2_FRAME_HEADER_SIZE   9
+#define FLB_HTTP2_FRAME_SIZE          16384       /* default max frame size */
+#define FLB_HTTP2_FRAME_SIZE_MAX      16777215
+#define FLB_HTTP2_WINDOW_DEFAULT      65535
+#define FLB_HTTP2_WINDOW_MAX          0x7fffffff
+#define FLB_HTTP2_STREAM_ID_MAX       0x7fffffff
+#define FLB_HTTP2_MAX_CONCURRENT      100         /* until the peer says so */
+
+/* Receive window announced for the connection and every stream */
+#define FLB_HTTP2_WINDOW              (1024 * 1024)
+
+/* Largest response header list accepted, announced in SETTINGS */
+#define FLB_HTTP2_HEADER_LIST_MAX     (64 * 1024)
+
+/* Pending output before a stream stops queueing its body */
+#define FLB_HTTP2_OUT_MAX             (256 * 1024)
+
+/* Session status */
+#define FLB_HTTP2_SESSION_OK      0
+#define FLB_HTTP2_SESSION_GOAWAY  1   /* no new streams, active ones go on */
+#define FLB_HTTP2_SESSION_ERROR   2   /* the connection can't be used      */
+
+struct flb_http2_stream {
+    uint32_t id;
+    int status;                   /* response :status              */
+    int headers_done;             /* final response headers read   */
+    int end_stream;               /* response is complete          */
+    int local_end;                /* request is complete           */
+    int closed;                   /* reset or refused by the server */
+    int error;                    /* reset or connection failure   */
+    int32_t send_window;          /* peer flow control window      */
+    uint32_t recv_consumed;       /* received bytes to acknowledge */
+    int64_t content_length;       /* response content-length       */
+
+    /* response */
+    flb_sds_t headers;            /* 'name: value\r\n' lines       */
+    flb_sds_t body;
+    size_t body_max;              /* zero means no limit           */
+    size_t body_dropped;
+
+    struct mk_list _head;         /* link to session->streams      */
+};
+
+/* HTTP/2 client session, it lives as long as the upstream connection */
+struct flb_http2_session {
+    int status;
+    int async;                    /* connection driven by the event loop */
+    int ev_mask;                  /* events registered for the socket */
+    uint32_t next_stream_id;
+    uint32_t last_stream_id;      /* set by GOAWAY                 */
+    int active;                   /* number of open streams        */
+
+    /* peer settings */
+    uint32_t max_concurrent;
+    uint32_t max_frame_size;
+    int32_t initial_window;
+
+    /* flow control: connection level */
+    int32_t send_window;
+    uint32_t recv_consumed;
+
+    /* header compression, one context per direction */
+    struct flb_hpack *encoder;
+    struct flb_hpack *decoder;
+
+    /* output buffer */
+    flb_sds_t out;
+    size_t out_pos;
+    size_t out_retry;             /* TLS: pending write to retry   */
+
+    /* input buffer */
+    char *in;
+    size_t in_len;
+    size_t in_size;
+
+    /* header block in progress: HEADERS + CONTINUATION frames */
+    uint32_t hb_stream;
+    int hb_flags;
+    flb_sds_t hb_buf;
+
+    struct flb_upstream_conn *u_conn;
+    struct mk_list streams;
+};
+
+struct flb_http2_session *flb_http2_session_create(struct flb_upstream_conn *u_conn);
+void flb_http2_session_destroy(struct flb_http2_session *s);
+int flb_http2_session_available(struct flb_http2_session *s, int users);
+
+int flb_http2_check(struct flb_http_client *c);
+int flb_http2_do(struct flb_http_client *c, size_t *bytes);
+
+#endif
@@ -125,6 +125,15 @@ struct flb_http_client {
     int body_len;
     const char *body_buf;
 
+    /*
+     * payload segments: sent after 'body_buf', they are not copied. The
+     * request payload size is 'body_len' plus 'body_iov_len'.
+     */
+    struct mk_iovec *body_iov;
+    int body_iov_count;
+    int body_iov_size;
+    size_t body_iov_len;
+
     struct mk_list headers;
 
     /* Proxy */
@@ -149,6 +158,8 @@ struct flb_http_client *flb_http_client(struct flb_upstream_conn *u_conn,
 int flb_http_add_header(struct flb_http_client *c,
                         const char *key, size_t key_len,
                         const char *val, size_t val_len);
+int flb_http_add_body_segment(struct flb_http_client *c,
+                              const void *data, size_t len);
 int flb_http_basic_auth(struct flb_http_client *c,
                         const char *user, const char *passwd);
 int flb_http_proxy_auth(struct flb_http_client *c,
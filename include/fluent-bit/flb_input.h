@@ -161,6 +161,10 @@ struct flb_input_instance {
     /* flag to pause input when storage is full */
     int storage_pause_on_chunks_overlimit;
 
+    /* Dispatch: priority class and share of the outputs capacity */
+    int dispatch_priority;               /* FLB_TASK_PRIO_HIGH, ...      */
+    int dispatch_weight;                 /* routes per scheduling round  */
+
     /*
      * Input network info:
      *
@@ -184,6 +188,12 @@ struct flb_input_instance {
     /* Type of storage: CIO_STORE_FS (filesystem) or CIO_STORE_MEM (memory) */
     int storage_type;
 
+    /* Filesystem storage: sync and delete files asynchronously (io_uring) */
+    int storage_async;
+
+    /* Filesystem storage: compression of chunks that are down */
+    int storage_compress;
+
     /*
      * Buffers counter: it count the total of memory used by fixed and dynamic
      * messgage pack buffers used by the input plugin instance.
@@ -205,6 +215,14 @@ struct flb_input_instance {
      */
     size_t mem_buf_limit;
 
+    /*
+     * Weight of the instance when the global memory budget is set
+     * (storage.mem_budget): every instance gets a share of the budget
+     * proportional to its weight and it's only paused if the budget is
+     * exhausted while the instance is using more than its share.
+     */
+    int mem_buf_weight;
+
     /*
      * Define the buffer status:
      *
@@ -221,6 +239,12 @@ struct flb_input_instance {
      */
     int storage_buf_status;
 
+    /*
+     * Paused by the engine when the number of tasks reach the soft limit
+     * (FLB_INPUT_RUNNING or FLB_INPUT_PAUSED).
+     */
+    int task_limit_status;
+
     /*
      * Optional data passed to the plugin, this info is useful when
      * running Fluent Bit in library mode and the target plugin needs
@@ -520,6 +544,9 @@ static inline int flb_input_buf_paused(struct flb_input_instance *i)
     if (i->storage_buf_status == FLB_INPUT_PAUSED) {
         return FLB_TRUE;
     }
+    if (i->task_limit_status == FLB_INPUT_PAUSED) {
+        return FLB_TRUE;
+    }
 
     return FLB_FALSE;
 }
@@ -579,6 +606,8 @@ void flb_input_exit_all(struct flb_config *config);
 
 void *flb_input_flush(struct flb_input_instance *ins, size_t *size);
 int flb_input_pause_all(struct flb_config *config);
+int flb_input_task_limit_pause(struct flb_config *config);
+int flb_input_task_limit_resume(struct flb_config *config);
 const char *flb_input_name(struct flb_input_instance *ins);
 int flb_input_name_exists(const char *name, struct flb_config *config);
 
@@ -52,12 +52,12 @@ struct flb_input_chunk {
     int added_records;              /* recently added records */
 #endif
     void *chunk;                    /* context of struct cio_chunk */
+    uint64_t create_ts;             /* creation time (ns), 0 = backlog */
     off_t stream_off;               /* stream offset */
     msgpack_packer mp_pck;          /* msgpack packer */
     struct flb_input_instance *in;  /* reference to parent input instance */
     struct flb_task *task;          /* reference to the outgoing task */
-    uint64_t routes_mask
-        [FLB_ROUTES_MASK_ELEMENTS]; /* track the output plugins the chunk routes to */
+    uint64_t *routes_mask;          /* track the output plugins the chunk routes to */
     struct mk_list _head;
 };
 
@@ -76,12 +76,16 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
                                const void *buf, size_t buf_size);
 const void *flb_input_chunk_flush(struct flb_input_chunk *ic, size_t *size);
 int flb_input_chunk_release_lock(struct flb_input_chunk *ic);
+int flb_input_chunk_merge(struct flb_input_chunk *dst,
+                          struct flb_input_chunk *src);
 flb_sds_t flb_input_chunk_get_name(struct flb_input_chunk *ic);
 int flb_input_chunk_get_tag(struct flb_input_chunk *ic,
                             const char **tag_buf, int *tag_len);
 ssize_t flb_input_chunk_get_size(struct flb_input_chunk *ic);
 size_t flb_input_chunk_set_limits(struct flb_input_instance *in);
 size_t flb_input_chunk_total_size(struct flb_input_instance *in);
+size_t flb_input_chunk_mem_usage(struct flb_config *config);
+size_t flb_input_chunk_mem_allotment(struct flb_input_instance *in);
 struct flb_input_chunk *flb_input_chunk_map(struct flb_input_instance *in,
                                             void *chunk);
 int flb_input_chunk_set_up_down(struct flb_input_chunk *ic);
@@ -42,11 +42,21 @@
 /* Other features */
 #define FLB_IO_IPV6       32  /* network I/O uses IPv6                  */
 
+/* Vectored writes */
+#define FLB_IO_IOV_MAX    1024  /* segments per writev(2) call          */
+#define FLB_IO_IOV_STACK  16    /* segments copied without allocation   */
+
 int flb_io_net_connect(struct flb_upstream_conn *u_conn,
                        struct flb_coro *th);
 
 int flb_io_net_write(struct flb_upstream_conn *u, const void *data,
                      size_t len, size_t *out_len);
+int flb_io_net_writev(struct flb_upstream_conn *u_conn,
+                      const struct mk_iovec *iov, int iovcnt, size_t *out_len);
 ssize_t flb_io_net_read(struct flb_upstream_conn *u, void *buf, size_t len);
+ssize_t flb_io_net_try_read(struct flb_upstream_conn *u_conn,
+                            void *buf, size_t len);
+ssize_t flb_io_net_try_write(struct flb_upstream_conn *u_conn,
+                             const void *data, size_t len);
 
 #endif
@@ -46,6 +46,15 @@ struct flb_net_setup {
     /* maximum of times a keepalive connection can be used */
     int keepalive_max_recycle;
 
+    /* maximum number of connections, callers wait for a free one (0: no limit) */
+    int max_connections;
+
+    /* number of keepalive connections to open at startup */
+    int warmup_connections;
+
+    /* use HTTP/2, requests share the connections */
+    int http2;
+
     /* dns mode : TCP or UDP */
     char *dns_mode;
 };
@@ -50,6 +50,7 @@
 
 #include <cmetrics/cmetrics.h>
 #include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_gauge.h>
 
 #ifdef FLB_HAVE_REGEX
 #include <fluent-bit/flb_regex.h>
@@ -62,6 +63,9 @@
 #define FLB_OUTPUT_NO_MULTIPLEX  512
 #define FLB_OUTPUT_PRIVATE      1024
 
+/* Default time a small chunk can wait to be coalesced (seconds) */
+#define FLB_OUTPUT_COALESCE_WAIT   2
+
 
 /* Event type handlers */
 #define FLB_OUTPUT_LOGS        1
@@ -235,6 +239,10 @@ struct flb_output_instance {
 
     /* Plugin properties */
     int retry_limit;                     /* max of retries allowed       */
+    int dispatch_max_inflight;           /* max flushes running, 0 = off */
+    size_t dispatch_coalesce_size;       /* chunk size target, 0 = off   */
+    int dispatch_coalesce_records;       /* records target, 0 = off      */
+    uint64_t dispatch_coalesce_wait;     /* max time to hold chunks (ns) */
     int use_tls;                         /* bool, try to use TLS for I/O */
     char *match;                         /* match rule for tag/routing   */
 #ifdef FLB_HAVE_REGEX
@@ -250,6 +258,9 @@ struct flb_output_instance {
     char *tls_crt_file;                  /* Certificate                  */
     char *tls_key_file;                  /* Cert Key                     */
     char *tls_key_passwd;                /* Cert Key Password            */
+    int tls_session_cache;               /* Resume TLS sessions          */
+    int tls_session_lifetime;            /* Cached sessions lifetime     */
+    int tls_ktls;                        /* Kernel TLS offload           */
 #endif
 
     /*
@@ -312,6 +323,18 @@ struct flb_output_instance {
 
     struct mk_list _head;                /* link to config->inputs       */
 
+    /*
+     * Dispatch queues: routes of tasks waiting for the output to have
+     * capacity. Every input owns a flow (struct flb_dispatch_flow) and the
+     * flows with queued routes are linked by priority class, they are
+     * served in weighted round robin. Only the engine thread access them.
+     */
+    int dispatch_queued;                 /* routes waiting               */
+    int dispatch_inflight;               /* flushes running              */
+    int dispatch_retries;                /* retries pending              */
+    struct mk_list dispatch_flows;       /* flows, one per input         */
+    struct mk_list dispatch_active[FLB_TASK_PRIO_LEVELS];
+
     /*
      * CMetrics
      * --------
@@ -324,6 +347,19 @@ struct flb_output_instance {
     struct cmt_counter *cmt_retries_failed;  /* m: output_retries_failed  */
     struct cmt_counter *cmt_dropped_records; /* m: output_dropped_records */
     struct cmt_counter *cmt_retried_records; /* m: output_retried_records */
+    struct cmt_counter *cmt_compress_in;     /* m: output_compress_input_bytes  */
+    struct cmt_counter *cmt_compress_out;    /* m: output_compress_output_bytes */
+    struct cmt_counter *cmt_compress_time;   /* m: output_compress_seconds      */
+    struct cmt_gauge   *cmt_dispatch_queue;  /* m: output_dispatch_queue_length */
+    struct cmt_counter *cmt_dispatch_total;  /* m: output_dispatch_total        */
+    struct cmt_counter *cmt_dispatch_time;   /* m: output_dispatch_queue_seconds */
+    struct cmt_gauge   *cmt_upstream_busy;   /* m: output_upstream_busy_connections */
+    struct cmt_gauge   *cmt_upstream_idle;   /* m: output_upstream_idle_connections */
+    struct cmt_gauge   *cmt_upstream_waiters;   /* m: output_upstream_waiters */
+    struct cmt_counter *cmt_upstream_waits;     /* m: output_upstream_waits_total */
+    struct cmt_counter *cmt_upstream_wait_time; /* m: output_upstream_wait_seconds */
+    struct cmt_counter *cmt_tls_handshakes;     /* m: output_tls_handshakes_total */
+    struct cmt_counter *cmt_tls_resumed;        /* m: output_tls_resumed_total */
 
     /* OLD Metrics API */
 #ifdef FLB_HAVE_METRICS
@@ -606,7 +642,7 @@ struct flb_output_coro *flb_output_coro_create(struct flb_task *task,
 static inline void flb_output_return(int ret, struct flb_coro *co) {
     int n;
     int pipe_fd;
-    uint32_t set;
+    uint64_t set;
     uint64_t val;
     struct flb_task *task;
     struct flb_output_coro *out_coro;
@@ -625,10 +661,10 @@ static inline void flb_output_return(int ret, struct flb_coro *co) {
      * - Task ID
      * - Output Instance ID (struct flb_output_instance)->id
      *
-     * We put together the return value with the task_id on the 32 bits at right
+     * The event type goes on the 4 bits at left, see FLB_TASK_SET()
      */
     set = FLB_TASK_SET(ret, task->id, o_ins->id);
-    val = FLB_BITS_U64_SET(2 /* FLB_ENGINE_TASK */, set);
+    val = FLB_TASK_EVENT(2 /* FLB_ENGINE_TASK */, set);
 
     /*
      * Set the target pipe channel: if this return code is running inside a
@@ -752,4 +788,8 @@ int flb_output_task_flush(struct flb_task *task,
                           struct flb_output_instance *out_ins,
                           struct flb_config *config);
 
+int flb_output_compress(struct flb_output_instance *ins, int type,
+                        void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len);
+
 #endif
@@ -59,6 +59,19 @@ struct flb_pack_state {
     char *buf_data;       /* temporary buffer           */
     size_t buf_size;      /* temporary buffer size      */
     size_t buf_len;       /* temporary buffer length    */
+
+    /*
+     * Incomplete message: flb_pack_json_state() keeps what was decoded so
+     * the next call, with the same buffer plus new data, resumes the scan
+     * where it stopped.
+     */
+    int scan_resume;           /* resume the incomplete message? */
+    int scan_depth;            /* open containers                */
+    int scan_expect;           /* next expected token            */
+    int scan_type;             /* root type                      */
+    size_t scan_pos;           /* where the scan stopped         */
+    void *scan_stack;          /* open containers stack          */
+    msgpack_sbuffer scan_buf;  /* message packed so far          */
 };
 
 int flb_json_tokenise(const char *js, size_t len, struct flb_pack_state *state);
@@ -87,6 +100,8 @@ int flb_msgpack_to_json(char *json_str, size_t str_len,
                         const msgpack_object *obj);
 char* flb_msgpack_to_json_str(size_t size, const msgpack_object *obj);
 flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size);
+int flb_pack_json_append(flb_sds_t *s, const msgpack_object *obj);
+int flb_pack_json_append_str(flb_sds_t *s, const char *str, size_t len);
 
 int flb_pack_time_now(msgpack_packer *pck);
 int flb_msgpack_expand_map(char *map_data, size_t map_size,
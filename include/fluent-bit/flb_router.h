@@ -24,6 +24,38 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_routes_mask.h>
+
+/*
+ * Routing cache: for every Tag seen at runtime we keep the set of output
+ * instances (routes mask) and filter instances that matches it, so the
+ * wildcard and regex matchers runs only once per distinct Tag.
+ */
+#define FLB_ROUTER_CACHE_SIZE              1024  /* hash table size         */
+#define FLB_ROUTER_CACHE_ENTRIES           8192  /* max number of Tags      */
+
+/* Filters with an id greater than the mask capacity are matched directly */
+#define FLB_ROUTER_FILTERS_MASK_ELEMENTS   4
+#define FLB_ROUTER_FILTERS_MASK_MAX_VALUE  (FLB_ROUTER_FILTERS_MASK_ELEMENTS * \
+                                            FLB_ROUTES_MASK_ELEMENT_BITS)
+
+/*
+ * The routes mask is sized at runtime, the caller provides the buffer where
+ * it's copied (config->route_mask_size elements) or NULL if it's not needed.
+ */
+struct flb_router_cache_entry {
+    uint64_t *routes_mask;
+    uint64_t filters_mask[FLB_ROUTER_FILTERS_MASK_ELEMENTS];
+};
+
+static inline int flb_router_cache_filter_match(struct flb_router_cache_entry *e,
+                                                int filter_id)
+{
+    uint64_t bit;
+
+    bit = 1ULL << (filter_id % FLB_ROUTES_MASK_ELEMENT_BITS);
+    return (e->filters_mask[filter_id / FLB_ROUTES_MASK_ELEMENT_BITS] & bit) != 0;
+}
 
 struct flb_router_path {
     struct flb_output_instance *ins;
@@ -51,5 +83,11 @@ int flb_router_connect(struct flb_input_instance *in,
 int flb_router_match(const char *tag, int tag_len,
                      const char *match, void *match_regex);
 int flb_router_io_set(struct flb_config *config);
+
+int flb_router_cache_create(struct flb_config *config);
+void flb_router_cache_destroy(struct flb_config *config);
+int flb_router_cache_get(struct flb_config *config,
+                         const char *tag, int tag_len,
+                         struct flb_router_cache_entry *entry);
 void flb_router_exit(struct flb_config *config);
 #endif
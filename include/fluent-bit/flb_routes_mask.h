@@ -36,31 +36,38 @@
  * A value of 1 in the bitfield means that output plugin is selected
  * and a value of zero means that output is deselected.
  *
- * The size of the bitmask array limits the number of output plugins
- * The router can route to. For example: with a value of 4 using
- * 64-bit integers the bitmask can represent up to 256 output plugins
+ * The size of the bitmask array is not fixed: it's the number of 64-bit
+ * elements required to represent the highest output id configured, it's
+ * stored in config->route_mask_size and updated every time an output
+ * instance is created. Since every input chunk carries a mask, all the
+ * output instances must exist before the first chunk is created.
  */
-#define FLB_ROUTES_MASK_ELEMENTS		4
 
 /*
  * How many bits are in each element of the bitmask array
  */
 #define FLB_ROUTES_MASK_ELEMENT_BITS 	(sizeof(uint64_t) * CHAR_BIT)
 
-/*
- * The maximum number of routes that can be stored in the array
- */
-#define FLB_ROUTES_MASK_MAX_VALUE		(FLB_ROUTES_MASK_ELEMENTS * FLB_ROUTES_MASK_ELEMENT_BITS)
-
+/* Number of elements required to store 'n' bits */
+#define FLB_ROUTES_MASK_ELEMENTS(n)     (((n) + FLB_ROUTES_MASK_ELEMENT_BITS - 1) / \
+                                         FLB_ROUTES_MASK_ELEMENT_BITS)
 
 /* forward declaration */
+struct flb_config;
 struct flb_input_instance;
 
+/* Size in bytes of a routes mask */
+#define flb_routes_mask_bytes(config) \
+    ((config)->route_mask_size * sizeof(uint64_t))
 
+void flb_routes_mask_set_size(struct flb_config *config, int max_id);
 int flb_routes_mask_set_by_tag(uint64_t *routes_mask, const char *tag, int tag_len, struct flb_input_instance *in);
-int flb_routes_mask_get_bit(uint64_t *routes_mask, int value);
-void flb_routes_mask_set_bit(uint64_t *routes_mask, int value);
-void flb_routes_mask_clear_bit(uint64_t *routes_mask, int value);
-int flb_routes_mask_is_empty(uint64_t *routes_mask);
+int flb_routes_mask_get_bit(uint64_t *routes_mask, int value,
+                            struct flb_config *config);
+void flb_routes_mask_set_bit(uint64_t *routes_mask, int value,
+                             struct flb_config *config);
+void flb_routes_mask_clear_bit(uint64_t *routes_mask, int value,
+                               struct flb_config *config);
+int flb_routes_mask_is_empty(uint64_t *routes_mask, struct flb_config *config);
 
 #endif
@@ -24,14 +24,52 @@
 #include <fluent-bit/flb_info.h>
 #include <chunkio/chunkio.h>
 #include <chunkio/cio_stats.h>
+#include <chunkio/cio_async.h>
 
 #define FLB_STORAGE_BL_MEM_LIMIT   "100M"
+#define FLB_STORAGE_BL_WORKERS     4      /* backlog scan threads */
+#define FLB_STORAGE_BL_RATIO       100    /* backlog share, 100 = no limit */
 #define FLB_STORAGE_MAX_CHUNKS_UP  128
 
+/* Group sync defaults */
+#define FLB_STORAGE_SYNC_INTERVAL  1000   /* milliseconds */
+#define FLB_STORAGE_SYNC_BYTES     "4M"
+#define FLB_STORAGE_SYNC_BUCKETS   8      /* latency histogram buckets */
+
 struct flb_storage_metrics {
     int fd;
 };
 
+/*
+ * Group sync: chunks written are flushed to disk together every
+ * 'storage.sync.interval' milliseconds or once 'storage.sync.bytes' are
+ * pending, whatever comes first.
+ */
+struct flb_storage_sync {
+    size_t max_bytes;             /* pending bytes that trigger a sync     */
+
+    /* stats */
+    uint64_t syncs;               /* number of group syncs                 */
+    uint64_t chunks;              /* chunks synced                         */
+    uint64_t bytes;               /* bytes synced                          */
+    uint64_t errors;              /* failed group syncs                    */
+    uint64_t latency_sum;         /* total latency in microseconds         */
+    uint64_t latency[FLB_STORAGE_SYNC_BUCKETS + 1];  /* histogram + Inf    */
+};
+
+/*
+ * Progress of the replay of the chunks found in the storage path. Remaining
+ * chunks are the ones not delivered yet, including the ones being processed
+ * by the engine.
+ */
+struct flb_storage_backlog {
+    uint64_t chunks_total;        /* chunks found in the backlog           */
+    uint64_t bytes_total;         /* bytes found in the backlog            */
+    uint64_t chunks_remaining;    /* chunks not delivered yet              */
+    uint64_t bytes_remaining;     /* bytes not delivered yet               */
+    int64_t eta;                  /* estimated seconds to drain, -1: n/a   */
+};
+
 /*
  * The storage structure helps to associate the contexts between
  * input instances and the chunkio context and further streams.
@@ -52,4 +90,9 @@ void flb_storage_input_destroy(struct flb_input_instance *in);
 
 struct flb_storage_metrics *flb_storage_metrics_create(struct flb_config *ctx);
 
+int flb_storage_sync_create(struct flb_config *ctx);
+int flb_storage_sync(struct flb_config *ctx);
+
+int flb_storage_chunk_cmp(const void *a_arg, const void *b_arg);
+
 #endif
@@ -36,23 +36,41 @@
  *
  * The FLB_OUTPUT_RETURN macro lookup the current active 'engine coroutine' and
  * it 'engine task' associated, so it emits an event to the main event loop
- * indicating an output coroutine has finished. In order to specify return
- * values and the proper IDs an unsigned 32 bits number is used:
+ * indicating an output coroutine has finished. In order to specify the event
+ * type, return values and the proper IDs an unsigned 64 bits number is used:
  *
- *     AAAA     BBBBBBBBBBBBBB CCCCCCCCCCCCCC   > 32 bit number
- *       ^            ^              ^
- *    4 bits       14 bits        14 bits
- *  return val     task_id       output_id
+ *     TTTT RRRR  IIII..IIII  OOOO..OOOO   > 64 bit number
+ *      ^    ^        ^           ^
+ *   4 bits 4 bits  28 bits     28 bits
+ *   type  return   task_id    output_id
  */
 
-#define FLB_TASK_RET(val)  (val >> 28)
-#define FLB_TASK_ID(val)   (uint32_t) (val & 0xfffc000) >> 14
-#define FLB_TASK_OUT(val)  (val & 0x3fff)
-#define FLB_TASK_SET(ret, task_id, out_id)              \
-    (uint32_t) ((ret << 28) | (task_id << 14) | out_id)
+#define FLB_TASK_ID_MAX         0xfffffff
+
+#define FLB_TASK_EVENT_TYPE(val) (uint32_t) ((uint64_t) (val) >> 60)
+#define FLB_TASK_RET(val)        (int) (((uint64_t) (val) >> 56) & 0xf)
+#define FLB_TASK_ID(val)         (int) (((uint64_t) (val) >> 28) & 0xfffffff)
+#define FLB_TASK_OUT(val)        (int) ((uint64_t) (val) & 0xfffffff)
+#define FLB_TASK_SET(ret, task_id, out_id)                      \
+    (((uint64_t) (ret) << 56) | ((uint64_t) (task_id) << 28) |  \
+     (uint64_t) (out_id))
+#define FLB_TASK_EVENT(type, set) (((uint64_t) (type) << 60) | (set))
+
+/*
+ * Dispatch priority classes: routes of a class are only dispatched to an
+ * output when no route of a higher class is waiting for it.
+ */
+#define FLB_TASK_PRIO_HIGH      0
+#define FLB_TASK_PRIO_NORMAL    1
+#define FLB_TASK_PRIO_LOW       2
+#define FLB_TASK_PRIO_LEVELS    3
 
 struct flb_task_route {
+    int queued;                         /* waiting in a dispatch queue ?  */
+    uint64_t queued_ts;                 /* time it was queued (ns)        */
+    struct flb_task *task;              /* parent task                    */
     struct flb_output_instance *out;
+    struct mk_list _head_queue;         /* link to flb_dispatch_flow      */
     struct mk_list _head;
 };
 
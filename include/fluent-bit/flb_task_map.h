@@ -23,8 +23,24 @@
 
 #include <inttypes.h>
 
+/* Initial number of slots, the map doubles its size when it gets full */
+#define FLB_TASK_MAP_SIZE   256
+
+/*
+ * Every slot either references a task or, when unused, links to the next
+ * free slot so IDs are taken and released in constant time.
+ */
 struct flb_task_map {
     void    *task;
+    int     next_free;
 };
 
+struct flb_config;
+
+int flb_task_map_get_id(struct flb_config *config);
+void flb_task_map_set(struct flb_config *config, int id, void *task);
+void *flb_task_map_get(struct flb_config *config, int id);
+void flb_task_map_release_id(struct flb_config *config, int id);
+void flb_task_map_destroy(struct flb_config *config);
+
 #endif
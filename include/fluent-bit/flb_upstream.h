@@ -78,6 +78,20 @@ struct flb_upstream {
     void *parent_upstream;
     struct flb_upstream_queue queue;
 
+#ifdef FLB_HAVE_METRICS
+    /* Connection pool metrics, set by the output instance using it */
+    char *cmt_name;
+    struct cmt_gauge *cmt_busy;
+    struct cmt_gauge *cmt_idle;
+    struct cmt_gauge *cmt_waiters;
+    struct cmt_counter *cmt_waits;
+    struct cmt_counter *cmt_wait_time;
+
+    /* TLS handshakes and resumed sessions */
+    struct cmt_counter *cmt_tls_handshakes;
+    struct cmt_counter *cmt_tls_resumed;
+#endif
+
 #ifdef FLB_HAVE_TLS
     struct flb_tls *tls;
 #endif
@@ -29,6 +29,13 @@
 #include <mbedtls/net.h>
 #endif
 
+struct flb_http2_session;
+
+/* Connection state in the pool, used for accounting */
+#define FLB_UPSTREAM_CONN_NONE   0
+#define FLB_UPSTREAM_CONN_BUSY   1
+#define FLB_UPSTREAM_CONN_IDLE   2
+
 /* Upstream TCP connection */
 struct flb_upstream_conn {
     struct mk_event event;
@@ -64,6 +71,17 @@ struct flb_upstream_conn {
      */
     int busy_flag;
 
+    /* FLB_UPSTREAM_CONN_BUSY, FLB_UPSTREAM_CONN_IDLE or FLB_UPSTREAM_CONN_NONE */
+    int pool_state;
+
+    /*
+     * HTTP/2 session: the connection can be shared by concurrent requests,
+     * 'shared' is the number of extra users that got it, every release
+     * decrements it and the last one really releases the connection.
+     */
+    struct flb_http2_session *http2;
+    int shared;
+
     /* Timestamps */
     time_t ts_assigned;
     time_t ts_created;
@@ -102,6 +120,12 @@ int flb_upstream_conn_timeouts(struct mk_list *list);
 int flb_upstream_conn_pending_destroy(struct flb_upstream *u);
 int flb_upstream_conn_pending_destroy_list(struct mk_list *list);
 int flb_upstream_conn_active_destroy_list(struct mk_list *list);
+int flb_upstream_conn_waiters_resume(struct flb_upstream *u);
+int flb_upstream_conn_waiters_resume_list(struct mk_list *list);
+int flb_upstream_conn_warmup(struct flb_upstream *u);
+int flb_upstream_conn_warmup_list(struct mk_list *list);
+int flb_upstream_conn_wait(struct flb_upstream_conn *conn, struct flb_coro *coro);
+void flb_upstream_conn_notify(struct flb_upstream_conn *conn);
 
 
 #endif
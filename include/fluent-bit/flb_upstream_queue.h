@@ -43,6 +43,32 @@ struct flb_upstream_queue {
      * to avoid any race condition with a late event.
      */
     struct mk_list destroy_queue;
+
+    /*
+     * Coroutines waiting for a connection because the pool reached the
+     * 'net.max_connections' limit. They are served in order as soon as a
+     * connection is released. Coroutines waiting for activity on a shared
+     * connection (HTTP/2) are linked here too.
+     */
+    struct mk_list wait_queue;
+
+    /* number of connections slots handed over to waiters not yet resumed */
+    int reserved;
+};
+
+/* Waiter types */
+#define FLB_UPSTREAM_WAIT_POOL   0    /* waiting for a connection      */
+#define FLB_UPSTREAM_WAIT_CONN   1    /* waiting on a shared connection */
+
+/* A coroutine waiting for a connection, it lives in the coroutine stack */
+struct flb_upstream_waiter {
+    int type;
+    struct flb_coro *coro;
+    struct flb_upstream_conn *conn;   /* connection handed over, if any */
+    int ready;                        /* can be resumed */
+    int timeout;                      /* waited too much */
+    uint64_t ts_start;                /* start of the wait (nanoseconds) */
+    struct mk_list _head;
 };
 
 #endif
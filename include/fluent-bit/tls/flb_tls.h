@@ -24,8 +24,10 @@
 #ifdef FLB_HAVE_TLS
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_sds.h>
 #include <fluent-bit/flb_upstream.h>
 #include <stddef.h>
+#include <time.h>
 
 #define FLB_TLS_CLIENT   "Fluent Bit"
 
@@ -33,6 +35,13 @@
 #define FLB_TLS_WANT_READ   -0x7e4
 #define FLB_TLS_WANT_WRITE  -0x7e6
 
+/* Maximum plaintext size of a TLS record */
+#define FLB_TLS_RECORD_SIZE 16384
+
+/* Session resumption: default lifetime and number of cached servers */
+#define FLB_TLS_SESSION_LIFETIME   300
+#define FLB_TLS_SESSION_CACHE_MAX  64
+
 /* Cert Flags */
 #define FLB_TLS_CA_ROOT          1
 #define FLB_TLS_CERT             2
@@ -45,6 +54,14 @@ struct flb_tls_session {
     void *ptr;
 };
 
+/* Session saved to resume the next handshakes with the same server */
+struct flb_tls_cache_entry {
+    flb_sds_t key;                    /* 'host:port'               */
+    void *session;                    /* backend saved session     */
+    time_t ts;                        /* session start time        */
+    struct mk_list _head;
+};
+
 /*
  * Structure to connect a backend API library: every backend provided by
  * mbedtls.c or openssl.c use this structure to register it self.
@@ -71,6 +88,19 @@ struct flb_tls_backend {
     int (*net_write) (struct flb_upstream_conn *, const void *data,
                       size_t len);
     int (*net_handshake) (struct flb_tls *, void *);
+
+    /* ALPN protocol selected by the server (NULL if none) */
+    const char *(*session_alpn_get) (void *);
+
+    /* Session resumption: save, resume and release a session */
+    void *(*session_save) (void *);
+    int (*session_resume) (void *, void *);
+    void (*session_saved_destroy) (void *);
+    int (*session_reused) (void *);
+    time_t (*session_time) (void *);
+
+    /* Kernel TLS: FLB_TRUE if the kernel encrypts the records */
+    int (*session_ktls) (void *);
 };
 
 /* Main TLS context */
@@ -78,6 +108,16 @@ struct flb_tls {
     int verify;                       /* FLB_TRUE | FLB_FALSE      */
     int debug;                        /* mbedtls debug level       */
     char *vhost;                      /* Virtual hostname for SNI  */
+    char *alpn;                       /* ALPN protocols: 'h2,...'  */
+    int ktls;                         /* kernel TLS offload        */
+    int ktls_warned;                  /* fallback already reported */
+
+    /* Session resumption cache, shared by the connections */
+    int session_cache;                /* FLB_TRUE | FLB_FALSE      */
+    int session_lifetime;             /* seconds                   */
+    int session_count;
+    struct mk_list session_list;      /* oldest entries first      */
+    pthread_mutex_t session_mutex;
 
     /* Bakend library for TLS */
     void *ctx;                        /* TLS context created */
@@ -94,6 +134,19 @@ int flb_tls_session_create(struct flb_tls *tls,
                            struct flb_coro *th);
 int flb_tls_session_destroy(struct flb_tls *tls, struct flb_upstream_conn *u_conn);
 
+int flb_tls_set_alpn(struct flb_tls *tls, const char *alpn);
+int flb_tls_session_alpn_selected(struct flb_upstream_conn *u_conn,
+                                  const char *protocol);
+int flb_tls_set_session_cache(struct flb_tls *tls, int enabled, int lifetime);
+int flb_tls_set_ktls(struct flb_tls *tls, int enabled);
+
+/* Session resumption cache */
+void flb_tls_session_cache_save(struct flb_tls *tls, void *session,
+                                const char *key);
+int flb_tls_session_cache_resume(struct flb_tls *tls, void *session,
+                                 const char *key);
+void flb_tls_session_cache_remove(struct flb_tls *tls, const char *key);
+
 int flb_tls_load_system_certificates(struct flb_tls *tls);
 int flb_tls_net_read(struct flb_upstream_conn *u_conn, void *buf, size_t len);
 int flb_tls_net_read_async(struct flb_coro *th, struct flb_upstream_conn *u_conn,
@@ -102,6 +155,11 @@ int flb_tls_net_write(struct flb_upstream_conn *u_conn,
                       const void *data, size_t len, size_t *out_len);
 int flb_tls_net_write_async(struct flb_coro *th, struct flb_upstream_conn *u_conn,
                             const void *data, size_t len, size_t *out_len);
+int flb_tls_net_writev(struct flb_upstream_conn *u_conn,
+                       const struct mk_iovec *iov, int iovcnt, size_t *out_len);
+int flb_tls_net_writev_async(struct flb_coro *co, struct flb_upstream_conn *u_conn,
+                             const struct mk_iovec *iov, int iovcnt,
+                             size_t *out_len);
 struct mk_list *flb_tls_get_config_map(struct flb_config *config);
 
 #endif
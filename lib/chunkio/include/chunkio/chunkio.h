@@ -43,6 +43,11 @@
 #define CIO_OPEN_RD         2         /* open and read/mmap content if exists */
 #define CIO_CHECKSUM        4         /* enable checksum verification (crc32) */
 #define CIO_FULL_SYNC       8         /* force sync to fs through MAP_SYNC */
+#define CIO_GROUP_SYNC     16         /* track dirty chunks, cio_sync_dirty() */
+#define CIO_INDEX          32         /* keep an index of chunks at rest */
+
+/* Compression: types other than 'none' are defined by the callbacks */
+#define CIO_COMPRESS_NONE   0
 
 /* Return status */
 #define CIO_CORRUPTED      -3         /* Indicate that a chunk is corrupted */
@@ -54,6 +59,8 @@
 /* defaults */
 #define CIO_MAX_CHUNKS_UP  64   /* default limit for cio_ctx->max_chunks_up */
 
+struct cio_async;
+
 struct cio_ctx {
     int flags;
     int page_size;
@@ -63,6 +70,13 @@ struct cio_ctx {
     int log_level;
     void (*log_cb)(void *, int, const char *, int, const char *);
 
+    /*
+     * compression callbacks: they return 0 on success and a new buffer
+     * that is released with free(3).
+     */
+    int (*compress_cb)(int, void *, size_t, void **, size_t *);
+    int (*uncompress_cb)(int, void *, size_t, void **, size_t *);
+
     /*
      * Internal counters
      */
@@ -77,6 +91,16 @@ struct cio_ctx {
      */
     size_t max_chunks_up;
 
+    /* asynchronous file operations (io_uring), NULL if disabled */
+    struct cio_async *async;
+
+    /*
+     * Group sync: chunks written since the last call to cio_sync_dirty()
+     * and the number of bytes written to them.
+     */
+    struct mk_list dirty;
+    size_t dirty_bytes;
+
     /* streams */
     struct mk_list streams;
 };
@@ -91,8 +115,14 @@ int cio_load(struct cio_ctx *ctx, char *chunk_extension);
 int cio_qsort(struct cio_ctx *ctx, int (*compar)(const void *, const void *));
 
 void cio_set_log_callback(struct cio_ctx *ctx, void (*log_cb));
+void cio_set_compression_callback(struct cio_ctx *ctx,
+                                  int (*compress_cb)(int, void *, size_t,
+                                                     void **, size_t *),
+                                  int (*uncompress_cb)(int, void *, size_t,
+                                                       void **, size_t *));
 int cio_set_log_level(struct cio_ctx *ctx, int level);
 int cio_set_max_chunks_up(struct cio_ctx *ctx, int n);
+int cio_sync_dirty(struct cio_ctx *ctx);
 
 int cio_meta_write(struct cio_chunk *ch, char *buf, size_t size);
 int cio_meta_cmp(struct cio_chunk *ch, char *meta_buf, int meta_len);
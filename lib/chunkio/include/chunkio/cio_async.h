@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Chunk I/O
+ *  =========
+ *  Copyright 2018-2021 Eduardo Silva <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CIO_ASYNC_H
+#define CIO_ASYNC_H
+
+#include <chunkio/chunkio.h>
+
+/* default number of submission queue entries */
+#define CIO_ASYNC_ENTRIES  256
+
+/*
+ * Asynchronous file operations (Linux io_uring): file syncs and deletions
+ * of 'async' streams are queued in the kernel instead of blocking the
+ * caller. Completions are notified through an event file descriptor that
+ * the caller must watch and then call cio_async_process().
+ *
+ * When io_uring is not available every function returns an error and the
+ * operations are performed synchronously.
+ */
+int cio_async_create(struct cio_ctx *ctx, int entries);
+void cio_async_destroy(struct cio_ctx *ctx);
+int cio_async_fd(struct cio_ctx *ctx);
+int cio_async_process(struct cio_ctx *ctx);
+
+int cio_async_fsync(struct cio_ctx *ctx, int fd);
+int cio_async_unlink(struct cio_ctx *ctx, const char *path);
+
+#endif
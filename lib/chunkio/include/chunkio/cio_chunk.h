@@ -41,6 +41,10 @@ struct cio_chunk {
     /* error handling */
     int error_n;
 
+    /* group sync: bytes written since the last sync, 0 if clean */
+    size_t dirty_bytes;
+    struct mk_list _dirty_head;  /* link to ctx->dirty */
+
     /*
      * The state head links to the stream->chunks_up or stream->chunks_down
      * linked list.
@@ -58,6 +62,9 @@ int cio_chunk_write(struct cio_chunk *ch, const void *buf, size_t count);
 int cio_chunk_write_at(struct cio_chunk *ch, off_t offset,
                        const void *buf, size_t count);
 int cio_chunk_sync(struct cio_chunk *ch);
+int cio_chunk_datasync(struct cio_chunk *ch);
+void cio_chunk_dirty_add(struct cio_chunk *ch, size_t bytes);
+void cio_chunk_dirty_del(struct cio_chunk *ch);
 int cio_chunk_get_content(struct cio_chunk *ch, char **buf, size_t *size);
 int cio_chunk_get_content_copy(struct cio_chunk *ch,
                                void **out_buf, size_t *out_size);
@@ -70,6 +77,8 @@ char *cio_chunk_hash(struct cio_chunk *ch);
 int cio_chunk_lock(struct cio_chunk *ch);
 int cio_chunk_unlock(struct cio_chunk *ch);
 int cio_chunk_is_locked(struct cio_chunk *ch);
+int cio_chunk_verify(struct cio_chunk *ch, char **meta_buf, int *meta_len,
+                     size_t *size);
 
 /* transaction handling */
 int cio_chunk_tx_begin(struct cio_chunk *ch);
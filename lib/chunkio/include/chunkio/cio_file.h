@@ -24,6 +24,9 @@
 #include <chunkio/cio_file_st.h>
 #include <chunkio/cio_crc32.h>
 
+/* chunks with less data than this are not compressed */
+#define CIO_FILE_COMP_MIN  1024
+
 struct cio_file {
     int fd;                   /* file descriptor      */
     int flags;                /* open flags */
@@ -43,6 +46,12 @@ struct cio_file {
     char *st_content;
     crc_t crc_cur;            /* crc: current value calculated */
     int crc_reset;            /* crc: must recalculate from the beginning ? */
+
+    /* stream index (CIO_INDEX): metadata of a chunk at rest */
+    int indexed;
+    char *idx_meta;
+    int idx_meta_len;
+    size_t idx_size;
 };
 
 size_t cio_file_real_size(struct cio_file *cf);
@@ -56,6 +65,7 @@ void cio_file_close(struct cio_chunk *ch, int delete);
 int cio_file_write(struct cio_chunk *ch, const void *buf, size_t count);
 int cio_file_write_metadata(struct cio_chunk *ch, char *buf, size_t size);
 int cio_file_sync(struct cio_chunk *ch);
+int cio_file_datasync(struct cio_chunk *ch);
 int cio_file_fs_size_change(struct cio_file *cf, size_t new_size);
 char *cio_file_hash(struct cio_file *cf);
 void cio_file_hash_print(struct cio_file *cf);
@@ -64,6 +74,9 @@ void cio_file_scan_dump(struct cio_ctx *ctx, struct cio_stream *st);
 int cio_file_read_prepare(struct cio_ctx *ctx, struct cio_chunk *ch);
 int cio_file_content_copy(struct cio_chunk *ch,
                           void **out_buf, size_t *out_size);
+int cio_file_verify(struct cio_chunk *ch, char **meta_buf, int *meta_len,
+                    size_t *size);
+void cio_file_index_close(struct cio_chunk *ch, int delete);
 
 
 int cio_file_is_up(struct cio_chunk *ch, struct cio_file *cf);
@@ -53,12 +53,22 @@
  *    |  |                         |  |
  *    |  +-------------------------+  |
  *    +-------------------------------+
+ *
+ * Compressed chunks (chunks that are down in a stream with compression
+ * enabled) use 0xC1 0x01 as identification and two fields of the padding
+ * area: the compression type (1 byte, offset 6) and the size of the
+ * uncompressed user data (8 bytes big endian, offset 7). Metadata is kept
+ * as it is and the user data is compressed. The CRC32 covers the content
+ * section as stored in the file.
  */
 
 #define CIO_FILE_ID_00          0xc1    /* header: first byte */
 #define CIO_FILE_ID_01          0x00    /* header: second byte */
+#define CIO_FILE_ID_01_COMP     0x01    /* header: second byte, compressed */
 #define CIO_FILE_HEADER_MIN       24    /* 24 bytes for the header */
 #define CIO_FILE_CONTENT_OFFSET   22
+#define CIO_FILE_COMP_TYPE         6    /* compression type */
+#define CIO_FILE_COMP_SIZE         7    /* uncompressed data size */
 
 /* Return pointer to hash position */
 static inline char *cio_file_st_get_hash(char *map)
@@ -79,6 +89,29 @@ static inline void cio_file_st_set_meta_len(char *map, uint16_t len)
     map[23] = (uint8_t) len;
 }
 
+/* Return the size of the uncompressed data of a compressed chunk */
+static inline uint64_t cio_file_st_get_comp_size(char *map)
+{
+    int i;
+    uint64_t size = 0;
+
+    for (i = 0; i < 8; i++) {
+        size = (size << 8) | (uint8_t) map[CIO_FILE_COMP_SIZE + i];
+    }
+    return size;
+}
+
+/* Set the size of the uncompressed data of a compressed chunk */
+static inline void cio_file_st_set_comp_size(char *map, uint64_t size)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        map[CIO_FILE_COMP_SIZE + i] = (uint8_t) size;
+        size >>= 8;
+    }
+}
+
 /* Return pointer to start point of metadata */
 static inline char *cio_file_st_get_meta(char *map)
 {
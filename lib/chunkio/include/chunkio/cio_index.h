@@ -0,0 +1,82 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Chunk I/O
+ *  =========
+ *  Copyright 2018-2021 Eduardo Silva <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CIO_INDEX_H
+#define CIO_INDEX_H
+
+#include <chunkio/chunkio.h>
+#include <chunkio/cio_stream.h>
+
+/*
+ * Stream index: every file system stream keeps an append-only file with
+ * the chunks at rest (down or closed), so cio_load() can register them
+ * without opening every file. Each record has the following layout:
+ *
+ * - 4 bytes: CRC32 of the rest of the record (big endian)
+ * - 1 byte : operation, CIO_INDEX_ADD or CIO_INDEX_DEL
+ * - 2 bytes: chunk name length (big endian)
+ * - 2 bytes: metadata length (big endian)
+ * - 8 bytes: chunk size, uncompressed (big endian)
+ * - chunk name and metadata
+ *
+ * The last record of a chunk wins. A chunk gets a DEL record as soon as
+ * its file is mapped, so an entry never describes a file being written.
+ * Chunk files without a valid entry are scanned as usual.
+ *
+ * The index is rewritten with the live entries when it's loaded and once
+ * the records appended since the last rewrite reach CIO_INDEX_COMPACT_MIN
+ * or the number of live entries, whichever is greater.
+ */
+
+#define CIO_INDEX_FILE      ".index"
+#define CIO_INDEX_ADD       'A'
+#define CIO_INDEX_DEL       'D'
+#define CIO_INDEX_REC_HDR   17
+#define CIO_INDEX_COMPACT_MIN 4096
+
+struct cio_index_entry {
+    char *name;
+    int name_len;
+    char *meta;
+    int meta_len;
+    uint64_t size;
+    int op;
+    size_t seq;                    /* record position */
+};
+
+struct cio_index {
+    size_t count;
+    struct cio_index_entry *entries;  /* sorted by name */
+    char *buf;                        /* index content */
+};
+
+struct cio_index *cio_index_load(struct cio_ctx *ctx, struct cio_stream *st);
+struct cio_index_entry *cio_index_lookup(struct cio_index *idx,
+                                         const char *name);
+void cio_index_destroy(struct cio_index *idx);
+
+int cio_index_add(struct cio_chunk *ch, char *meta, int meta_len,
+                  uint64_t size);
+int cio_index_del(struct cio_chunk *ch);
+int cio_index_compact(struct cio_ctx *ctx, struct cio_stream *st);
+int cio_index_check(struct cio_ctx *ctx, struct cio_stream *st);
+int cio_index_sync(struct cio_stream *st);
+void cio_index_close(struct cio_stream *st);
+
+#endif
@@ -22,8 +22,16 @@
 
 #include <monkey/mk_core/mk_list.h>
 
+struct cio_index;
+
 struct cio_stream {
     int type;                   /* type: CIO_STORE_FS or CIO_STORE_MEM */
+    int async;                  /* sync and delete files asynchronously */
+    int compress;               /* compression type for chunks down */
+    int index_fd;               /* index file, appends (CIO_INDEX) */
+    size_t index_records;       /* records in the index file */
+    size_t index_limit;         /* records that trigger a compaction */
+    struct cio_index *index;    /* index entries, only while scanning */
     char *name;                 /* stream name */
     struct mk_list _head;       /* head link to ctx->streams list */
     struct mk_list chunks;      /* list of all chunks in the stream */
@@ -39,5 +47,7 @@ int cio_stream_delete(struct cio_stream *st);
 void cio_stream_destroy(struct cio_stream *st);
 void cio_stream_destroy_all(struct cio_ctx *ctx);
 size_t cio_stream_size_chunks_up(struct cio_stream *st);
+int cio_stream_set_async(struct cio_stream *st, int enabled);
+int cio_stream_set_compression(struct cio_stream *st, int type);
 
 #endif
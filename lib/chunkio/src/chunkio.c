@@ -28,6 +28,7 @@
 #include <chunkio/cio_stream.h>
 #include <chunkio/cio_scan.h>
 #include <chunkio/cio_utils.h>
+#include <chunkio/cio_async.h>
 
 #include <monkey/mk_core/mk_list.h>
 
@@ -88,10 +89,16 @@ struct cio_ctx *cio_create(const char *root_path,
         return NULL;
     }
     mk_list_init(&ctx->streams);
+    mk_list_init(&ctx->dirty);
     ctx->page_size = cio_getpagesize();
     ctx->max_chunks_up = CIO_MAX_CHUNKS_UP;
     ctx->flags = flags;
 
+#ifdef _WIN32
+    /* the stream index is only maintained by the POSIX file backend */
+    ctx->flags &= ~CIO_INDEX;
+#endif
+
     /* Counters */
     ctx->total_chunks = 0;
     ctx->total_chunks_up = 0;
@@ -199,6 +206,10 @@ void cio_destroy(struct cio_ctx *ctx)
     }
 
     cio_stream_destroy_all(ctx);
+
+    /* wait for pending file operations */
+    cio_async_destroy(ctx);
+
     free(ctx->root_path);
     free(ctx);
 }
@@ -208,6 +219,16 @@ void cio_set_log_callback(struct cio_ctx *ctx, void (*log_cb))
     ctx->log_cb = log_cb;
 }
 
+void cio_set_compression_callback(struct cio_ctx *ctx,
+                                  int (*compress_cb)(int, void *, size_t,
+                                                     void **, size_t *),
+                                  int (*uncompress_cb)(int, void *, size_t,
+                                                       void **, size_t *))
+{
+    ctx->compress_cb = compress_cb;
+    ctx->uncompress_cb = uncompress_cb;
+}
+
 int cio_set_log_level(struct cio_ctx *ctx, int level)
 {
     if (level < CIO_LOG_ERROR || level > CIO_LOG_TRACE) {
@@ -218,6 +239,38 @@ int cio_set_log_level(struct cio_ctx *ctx, int level)
     return 0;
 }
 
+/*
+ * Group sync: flush to disk every chunk written since the last call. Returns
+ * the number of chunks synced or -1 if any of them failed.
+ */
+int cio_sync_dirty(struct cio_ctx *ctx)
+{
+    int c = 0;
+    int ret;
+    int err = CIO_FALSE;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct cio_chunk *ch;
+
+    mk_list_foreach_safe(head, tmp, &ctx->dirty) {
+        ch = mk_list_entry(head, struct cio_chunk, _dirty_head);
+        ret = cio_chunk_datasync(ch);
+        if (ret == -1) {
+            cio_log_error(ctx, "[cio] cannot sync chunk %s:%s",
+                          ch->st->name, ch->name);
+            err = CIO_TRUE;
+        }
+        cio_chunk_dirty_del(ch);
+        c++;
+    }
+
+    if (err == CIO_TRUE) {
+        return -1;
+    }
+
+    return c;
+}
+
 int cio_set_max_chunks_up(struct cio_ctx *ctx, int n)
 {
     if (n < 1) {
@@ -0,0 +1,529 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Chunk I/O
+ *  =========
+ *  Copyright 2018-2021 Eduardo Silva <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <chunkio/chunkio.h>
+#include <chunkio/cio_log.h>
+#include <chunkio/cio_async.h>
+
+#ifdef CIO_HAVE_IO_URING
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* operation types, stored as the request user data */
+#define CIO_ASYNC_OP_FSYNC    1
+#define CIO_ASYNC_OP_UNLINK   2
+#define CIO_ASYNC_OP_CLOSE    3
+
+struct cio_async {
+    int ring_fd;                  /* io_uring instance                */
+    int event_fd;                 /* completions notification         */
+    int fsync;                    /* IORING_OP_CLOSE is supported     */
+    int unlinkat;                 /* IORING_OP_UNLINKAT is supported  */
+    unsigned int inflight;        /* requests not completed yet       */
+    unsigned int cq_entries;      /* completion queue size            */
+
+    /* submission queue */
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+
+    /* completion queue */
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* memory maps shared with the kernel */
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    /* chunks can be released from different threads */
+    pthread_mutex_t lock;
+};
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned int to_submit,
+                       unsigned int min_complete, unsigned int flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int opcode, void *arg,
+                          unsigned int nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void async_free(struct cio_async *ac)
+{
+    if (ac->sqes) {
+        munmap(ac->sqes, ac->sqes_size);
+    }
+    if (ac->cq_ring && ac->cq_ring != ac->sq_ring) {
+        munmap(ac->cq_ring, ac->cq_ring_size);
+    }
+    if (ac->sq_ring) {
+        munmap(ac->sq_ring, ac->sq_ring_size);
+    }
+    if (ac->event_fd >= 0) {
+        close(ac->event_fd);
+    }
+    if (ac->ring_fd >= 0) {
+        close(ac->ring_fd);
+    }
+    pthread_mutex_destroy(&ac->lock);
+    free(ac);
+}
+
+/*
+ * Syncs need IORING_OP_CLOSE (Linux >= 5.6) and deleting files needs
+ * IORING_OP_UNLINKAT (Linux >= 5.11).
+ */
+static void probe_ops(struct cio_async *ac)
+{
+    int ret;
+    size_t size;
+    struct io_uring_probe *probe;
+
+    size = sizeof(struct io_uring_probe) +
+           (256 * sizeof(struct io_uring_probe_op));
+    probe = calloc(1, size);
+    if (!probe) {
+        return;
+    }
+
+    ret = uring_register(ac->ring_fd, IORING_REGISTER_PROBE, probe, 256);
+    if (ret == 0) {
+        if (probe->last_op >= IORING_OP_CLOSE &&
+            (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED)) {
+            ac->fsync = CIO_TRUE;
+        }
+        if (probe->last_op >= IORING_OP_UNLINKAT &&
+            (probe->ops[IORING_OP_UNLINKAT].flags & IO_URING_OP_SUPPORTED)) {
+            ac->unlinkat = CIO_TRUE;
+        }
+    }
+
+    free(probe);
+}
+
+static void *ring_map(size_t size, int fd, off_t offset)
+{
+    void *p;
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             fd, offset);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+
+    return p;
+}
+
+int cio_async_create(struct cio_ctx *ctx, int entries)
+{
+    int ret;
+    char *p;
+    struct cio_async *ac;
+    struct io_uring_params params;
+
+    if (ctx->async) {
+        return 0;
+    }
+
+    ac = calloc(1, sizeof(struct cio_async));
+    if (!ac) {
+        cio_errno();
+        return -1;
+    }
+    ac->ring_fd = -1;
+    ac->event_fd = -1;
+    pthread_mutex_init(&ac->lock, NULL);
+
+    memset(&params, 0, sizeof(params));
+    ac->ring_fd = uring_setup(entries, &params);
+    if (ac->ring_fd < 0) {
+        cio_log_warn(ctx, "[cio async] io_uring is not available: %s",
+                     strerror(errno));
+        async_free(ac);
+        return -1;
+    }
+
+    /* map the rings */
+    ac->sq_ring_size = params.sq_off.array +
+                       (params.sq_entries * sizeof(unsigned int));
+    ac->cq_ring_size = params.cq_off.cqes +
+                       (params.cq_entries * sizeof(struct io_uring_cqe));
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ac->cq_ring_size > ac->sq_ring_size) {
+            ac->sq_ring_size = ac->cq_ring_size;
+        }
+        ac->cq_ring_size = ac->sq_ring_size;
+    }
+
+    ac->sq_ring = ring_map(ac->sq_ring_size, ac->ring_fd, IORING_OFF_SQ_RING);
+    if (!ac->sq_ring) {
+        goto error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ac->cq_ring = ac->sq_ring;
+    }
+    else {
+        ac->cq_ring = ring_map(ac->cq_ring_size, ac->ring_fd,
+                               IORING_OFF_CQ_RING);
+        if (!ac->cq_ring) {
+            goto error;
+        }
+    }
+
+    ac->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ac->sqes = ring_map(ac->sqes_size, ac->ring_fd, IORING_OFF_SQES);
+    if (!ac->sqes) {
+        goto error;
+    }
+
+    p = ac->sq_ring;
+    ac->sq_head  = (unsigned int *) (p + params.sq_off.head);
+    ac->sq_tail  = (unsigned int *) (p + params.sq_off.tail);
+    ac->sq_mask  = (unsigned int *) (p + params.sq_off.ring_mask);
+    ac->sq_array = (unsigned int *) (p + params.sq_off.array);
+
+    p = ac->cq_ring;
+    ac->cq_head = (unsigned int *) (p + params.cq_off.head);
+    ac->cq_tail = (unsigned int *) (p + params.cq_off.tail);
+    ac->cq_mask = (unsigned int *) (p + params.cq_off.ring_mask);
+    ac->cqes    = (struct io_uring_cqe *) (p + params.cq_off.cqes);
+    ac->cq_entries = params.cq_entries;
+
+    /* completions are notified through an eventfd */
+    ac->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ac->event_fd == -1) {
+        goto error;
+    }
+
+    ret = uring_register(ac->ring_fd, IORING_REGISTER_EVENTFD,
+                         &ac->event_fd, 1);
+    if (ret != 0) {
+        goto error;
+    }
+
+    probe_ops(ac);
+    ctx->async = ac;
+
+    cio_log_debug(ctx, "[cio async] io_uring ready, entries=%u sync=%s "
+                  "unlink=%s", params.sq_entries,
+                  ac->fsync ? "async" : "sync",
+                  ac->unlinkat ? "async" : "sync");
+    return 0;
+
+ error:
+    cio_log_warn(ctx, "[cio async] cannot initialize io_uring: %s",
+                 strerror(errno));
+    async_free(ac);
+    return -1;
+}
+
+static const char *op_name(uint64_t op)
+{
+    switch (op) {
+    case CIO_ASYNC_OP_FSYNC:
+        return "sync";
+    case CIO_ASYNC_OP_UNLINK:
+        return "unlink";
+    }
+
+    return "close";
+}
+
+/* Consume the available completions, the lock must be held */
+static int async_reap(struct cio_ctx *ctx, struct cio_async *ac)
+{
+    int c = 0;
+    unsigned int head;
+    unsigned int tail;
+    struct io_uring_cqe *cqe;
+
+    head = *ac->cq_head;
+    tail = __atomic_load_n(ac->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        cqe = &ac->cqes[head & *ac->cq_mask];
+        if (cqe->res < 0) {
+            cio_log_error(ctx, "[cio async] %s failed: %s",
+                          op_name(cqe->user_data), strerror(-cqe->res));
+        }
+        head++;
+        c++;
+    }
+
+    __atomic_store_n(ac->cq_head, head, __ATOMIC_RELEASE);
+    ac->inflight -= c;
+
+    return c;
+}
+
+/*
+ * Queue a chain of requests and hand them to the kernel right away. Paths
+ * are copied at submission so the caller can release them once this
+ * function returns; file descriptors are resolved when the request runs.
+ */
+static int async_submit(struct cio_ctx *ctx, struct io_uring_sqe *sqe, int n)
+{
+    int i;
+    int ret;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int index;
+    struct cio_async *ac = ctx->async;
+
+    pthread_mutex_lock(&ac->lock);
+
+    /* never overflow the completion queue */
+    if (ac->inflight + n > ac->cq_entries) {
+        async_reap(ctx, ac);
+        if (ac->inflight + n > ac->cq_entries) {
+            pthread_mutex_unlock(&ac->lock);
+            return -1;
+        }
+    }
+
+    tail = *ac->sq_tail;
+    head = __atomic_load_n(ac->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head + n > *ac->sq_mask + 1) {
+        pthread_mutex_unlock(&ac->lock);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        index = (tail + i) & *ac->sq_mask;
+        memcpy(&ac->sqes[index], &sqe[i], sizeof(struct io_uring_sqe));
+        ac->sq_array[index] = index;
+    }
+    __atomic_store_n(ac->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+    do {
+        ret = uring_enter(ac->ring_fd, n, 0, 0);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret != n) {
+        /* take back the entries not consumed by the kernel */
+        if (ret < 0) {
+            ret = 0;
+        }
+        __atomic_store_n(ac->sq_tail, tail + ret, __ATOMIC_RELEASE);
+        ac->inflight += ret;
+        pthread_mutex_unlock(&ac->lock);
+        return -1;
+    }
+
+    ac->inflight += n;
+    pthread_mutex_unlock(&ac->lock);
+
+    return 0;
+}
+
+/*
+ * The sync runs on a duplicate of the file descriptor that the ring closes
+ * once it's done, so the caller is free to close its own descriptor.
+ */
+int cio_async_fsync(struct cio_ctx *ctx, int fd)
+{
+    int ret;
+    int dup_fd;
+    struct io_uring_sqe sqe[2];
+    struct cio_async *ac = ctx->async;
+
+    if (!ac || ac->fsync == CIO_FALSE) {
+        return -1;
+    }
+
+    dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd == -1) {
+        cio_errno();
+        return -1;
+    }
+
+    memset(sqe, 0, sizeof(sqe));
+    sqe[0].opcode = IORING_OP_FSYNC;
+    sqe[0].fd = dup_fd;
+    sqe[0].fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe[0].flags = IOSQE_IO_HARDLINK;
+    sqe[0].user_data = CIO_ASYNC_OP_FSYNC;
+
+    /* a hard link runs the close even if the sync fails */
+    sqe[1].opcode = IORING_OP_CLOSE;
+    sqe[1].fd = dup_fd;
+    sqe[1].user_data = CIO_ASYNC_OP_CLOSE;
+
+    ret = async_submit(ctx, sqe, 2);
+    if (ret == -1) {
+        close(dup_fd);
+    }
+
+    return ret;
+}
+
+int cio_async_unlink(struct cio_ctx *ctx, const char *path)
+{
+    struct io_uring_sqe sqe;
+    struct cio_async *ac = ctx->async;
+
+    if (!ac || ac->unlinkat == CIO_FALSE) {
+        return -1;
+    }
+
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_UNLINKAT;
+    sqe.fd = AT_FDCWD;
+    sqe.addr = (uintptr_t) path;
+    sqe.user_data = CIO_ASYNC_OP_UNLINK;
+
+    return async_submit(ctx, &sqe, 1);
+}
+
+int cio_async_fd(struct cio_ctx *ctx)
+{
+    struct cio_async *ac = ctx->async;
+
+    if (!ac) {
+        return -1;
+    }
+
+    return ac->event_fd;
+}
+
+/* Process completed requests, returns the number of completions */
+int cio_async_process(struct cio_ctx *ctx)
+{
+    int c;
+    int ret;
+    uint64_t val;
+    struct cio_async *ac = ctx->async;
+
+    if (!ac) {
+        return 0;
+    }
+
+    /* reset the notification counter */
+    ret = read(ac->event_fd, &val, sizeof(val));
+    if (ret == -1 && errno != EAGAIN) {
+        cio_errno();
+    }
+
+    pthread_mutex_lock(&ac->lock);
+    c = async_reap(ctx, ac);
+    pthread_mutex_unlock(&ac->lock);
+
+    return c;
+}
+
+/* Wait for the pending requests and release the ring */
+void cio_async_destroy(struct cio_ctx *ctx)
+{
+    int ret;
+    struct cio_async *ac = ctx->async;
+
+    if (!ac) {
+        return;
+    }
+
+    pthread_mutex_lock(&ac->lock);
+    while (ac->inflight > 0) {
+        async_reap(ctx, ac);
+        if (ac->inflight == 0) {
+            break;
+        }
+
+        ret = uring_enter(ac->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret == -1 && errno != EINTR) {
+            cio_errno();
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ac->lock);
+
+    async_free(ac);
+    ctx->async = NULL;
+}
+
+#else
+
+int cio_async_create(struct cio_ctx *ctx, int entries)
+{
+    (void) entries;
+
+    cio_log_warn(ctx, "[cio async] io_uring support is not available");
+    return -1;
+}
+
+void cio_async_destroy(struct cio_ctx *ctx)
+{
+    (void) ctx;
+}
+
+int cio_async_fd(struct cio_ctx *ctx)
+{
+    (void) ctx;
+    return -1;
+}
+
+int cio_async_process(struct cio_ctx *ctx)
+{
+    (void) ctx;
+    return 0;
+}
+
+int cio_async_fsync(struct cio_ctx *ctx, int fd)
+{
+    (void) ctx;
+    (void) fd;
+    return -1;
+}
+
+int cio_async_unlink(struct cio_ctx *ctx, const char *path)
+{
+    (void) ctx;
+    (void) path;
+    return -1;
+}
+
+#endif
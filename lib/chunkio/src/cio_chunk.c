@@ -71,6 +71,7 @@ struct cio_chunk *cio_chunk_open(struct cio_ctx *ctx, struct cio_stream *st,
     ch->tx_crc = 0;
     ch->tx_content_length = 0;
     ch->backend = NULL;
+    ch->dirty_bytes = 0;
 
     mk_list_add(&ch->_head, &st->chunks);
 
@@ -121,10 +122,22 @@ void cio_chunk_close(struct cio_chunk *ch, int delete)
 
     ctx = ch->ctx;
     type = ch->st->type;
+
+    /* Group sync: flush pending data unless the chunk is being deleted */
+    if (ch->dirty_bytes > 0) {
+        if (delete == CIO_FALSE) {
+            cio_chunk_datasync(ch);
+        }
+        cio_chunk_dirty_del(ch);
+    }
+
     if (type == CIO_STORE_MEM) {
         cio_memfs_close(ch);
     }
     else if (type == CIO_STORE_FS) {
+        if (ctx->flags & CIO_INDEX) {
+            cio_file_index_close(ch, delete);
+        }
         cio_file_close(ch, delete);
     }
 
@@ -181,6 +194,9 @@ int cio_chunk_write(struct cio_chunk *ch, const void *buf, size_t count)
     }
     else if (type == CIO_STORE_FS) {
         ret = cio_file_write(ch, buf, count);
+        if (ret == 0 && (ch->ctx->flags & CIO_GROUP_SYNC)) {
+            cio_chunk_dirty_add(ch, count);
+        }
     }
 
     return ret;
@@ -201,6 +217,69 @@ int cio_chunk_sync(struct cio_chunk *ch)
     return ret;
 }
 
+/*
+ * Flush the chunk content to the storage device, not just to the page
+ * cache like cio_chunk_sync() does in normal mode.
+ */
+int cio_chunk_datasync(struct cio_chunk *ch)
+{
+    int ret;
+
+    if (ch->st->type != CIO_STORE_FS) {
+        return 0;
+    }
+
+    /* A chunk that is down was synced before releasing its map */
+    if (cio_chunk_is_up(ch) == CIO_TRUE) {
+        ret = cio_file_sync(ch);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    return cio_file_datasync(ch);
+}
+
+/*
+ * Validate the content of a file chunk without bringing it up, it returns a
+ * copy of the metadata and the chunk size (see cio_file_verify()). It does
+ * not modify the chunk or the context.
+ */
+int cio_chunk_verify(struct cio_chunk *ch, char **meta_buf, int *meta_len,
+                     size_t *size)
+{
+    if (ch->st->type != CIO_STORE_FS) {
+        return CIO_ERROR;
+    }
+
+    return cio_file_verify(ch, meta_buf, meta_len, size);
+}
+
+/* Group sync: register data written to a chunk */
+void cio_chunk_dirty_add(struct cio_chunk *ch, size_t bytes)
+{
+    struct cio_ctx *ctx = ch->ctx;
+
+    if (ch->dirty_bytes == 0) {
+        mk_list_add(&ch->_dirty_head, &ctx->dirty);
+    }
+    ch->dirty_bytes += bytes;
+    ctx->dirty_bytes += bytes;
+}
+
+void cio_chunk_dirty_del(struct cio_chunk *ch)
+{
+    struct cio_ctx *ctx = ch->ctx;
+
+    if (ch->dirty_bytes == 0) {
+        return;
+    }
+
+    mk_list_del(&ch->_dirty_head);
+    ctx->dirty_bytes -= ch->dirty_bytes;
+    ch->dirty_bytes = 0;
+}
+
 int cio_chunk_get_content(struct cio_chunk *ch, char **buf, size_t *size)
 {
     int ret = 0;
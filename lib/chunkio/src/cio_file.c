@@ -40,6 +40,8 @@
 #include <chunkio/cio_stream.h>
 #include <chunkio/cio_error.h>
 #include <chunkio/cio_utils.h>
+#include <chunkio/cio_async.h>
+#include <chunkio/cio_index.h>
 
 char cio_file_init_bytes[] =   {
     /* file type (2 bytes)    */
@@ -60,6 +62,8 @@ char cio_file_init_bytes[] =   {
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
 
+static void file_index_invalidate(struct cio_chunk *ch, struct cio_file *cf);
+
 /* Get the number of bytes in the Content section */
 static size_t content_len(struct cio_file *cf)
 {
@@ -239,6 +243,393 @@ static int cio_file_format_check(struct cio_chunk *ch,
     return 0;
 }
 
+/* Compute the finalized checksum of the content section of a file buffer */
+static void buf_checksum(char *buf, size_t size)
+{
+    crc_t crc;
+    uint32_t val;
+
+    crc = cio_crc32_init();
+    crc = cio_crc32_update(crc, (unsigned char *) buf + CIO_FILE_CONTENT_OFFSET,
+                           size - CIO_FILE_CONTENT_OFFSET);
+    crc = cio_crc32_finalize(crc);
+
+    /* crc_t can be wider than the 4 bytes field */
+    val = htonl((uint32_t) crc);
+    memcpy(buf + 2, &val, sizeof(val));
+}
+
+/*
+ * Replace the content of the chunk file: the new content is written to a
+ * temporary hidden file (skipped by the scanner) that is synced and renamed
+ * over the chunk file, then the parent directory is synced so the rename is
+ * durable. A crash never leaves a partially written chunk.
+ */
+static int file_replace(struct cio_chunk *ch, struct cio_file *cf,
+                        char *buf, size_t size)
+{
+    int fd;
+    int ret;
+    int len;
+    char *p;
+    char *tmp;
+    ssize_t bytes;
+    size_t total = 0;
+
+    len = strlen(cf->path) + 6;
+    tmp = malloc(len);
+    if (!tmp) {
+        cio_errno();
+        return -1;
+    }
+
+    p = strrchr(cf->path, '/');
+    snprintf(tmp, len, "%.*s/.%s.tmp", (int) (p - cf->path), cf->path, p + 1);
+
+    fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, (mode_t) 0600);
+    if (fd == -1) {
+        cio_errno();
+        free(tmp);
+        return -1;
+    }
+
+    while (total < size) {
+        bytes = write(fd, buf + total, size - total);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cio_errno();
+            break;
+        }
+        total += bytes;
+    }
+
+    /*
+     * The content must be on disk before the rename, otherwise the rename
+     * can be persisted first and a crash leaves an empty or truncated chunk.
+     */
+    ret = (total == size) ? 0 : -1;
+    if (ret == 0) {
+        ret = fsync(fd);
+    }
+    close(fd);
+
+    if (ret == 0) {
+        ret = rename(tmp, cf->path);
+    }
+    if (ret == -1) {
+        cio_errno();
+        unlink(tmp);
+        cio_log_error(ch->ctx, "[cio file] cannot replace file %s:%s",
+                      ch->st->name, ch->name);
+        free(tmp);
+        return -1;
+    }
+
+    /*
+     * Persist the directory entry, 'tmp' is reused for the stream path. The
+     * chunk is already replaced at this point so a failure is only reported.
+     */
+    tmp[p - cf->path] = '\0';
+    fd = open(tmp, O_RDONLY);
+    if (fd == -1 || fsync(fd) == -1) {
+        cio_errno();
+        cio_log_warn(ch->ctx, "[cio file] cannot sync stream directory %s",
+                     tmp);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    free(tmp);
+
+    return 0;
+}
+
+/* Read 'size' bytes of the file starting at 'offset' */
+static int file_read(int fd, char *buf, size_t size, off_t offset)
+{
+    ssize_t bytes;
+    size_t total = 0;
+
+    while (total < size) {
+        bytes = pread(fd, buf + total, size - total, offset + total);
+        if (bytes <= 0) {
+            if (bytes == -1 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += bytes;
+    }
+
+    return 0;
+}
+
+/* Check if the file header identifies a compressed chunk */
+static int file_is_compressed(int fd)
+{
+    ssize_t ret;
+    unsigned char id[2];
+
+    ret = pread(fd, id, sizeof(id), 0);
+    if (ret != sizeof(id)) {
+        return CIO_FALSE;
+    }
+
+    if (id[0] == CIO_FILE_ID_00 && id[1] == CIO_FILE_ID_01_COMP) {
+        return CIO_TRUE;
+    }
+
+    return CIO_FALSE;
+}
+
+/*
+ * Size of the chunk once uncompressed, for a compressed chunk file that is
+ * not mapped, this is what callers account as the chunk size.
+ */
+static size_t file_logical_size(struct cio_file *cf, size_t fs_size)
+{
+    int fd;
+    ssize_t ret;
+    char hdr[CIO_FILE_HEADER_MIN];
+
+    if (fs_size < CIO_FILE_HEADER_MIN) {
+        return fs_size;
+    }
+
+    fd = open(cf->path, O_RDONLY);
+    if (fd == -1) {
+        return fs_size;
+    }
+
+    ret = pread(fd, hdr, sizeof(hdr), 0);
+    close(fd);
+
+    if (ret != sizeof(hdr) ||
+        hdr[0] != (char) CIO_FILE_ID_00 || hdr[1] != CIO_FILE_ID_01_COMP) {
+        return fs_size;
+    }
+
+    return CIO_FILE_HEADER_MIN + cio_file_st_get_meta_len(hdr) +
+           cio_file_st_get_comp_size(hdr);
+}
+
+/*
+ * Compress the user data of a mapped chunk into its file. The chunk must
+ * be synced and it's expected to be unmapped right after. Returns 1 if
+ * the file was compressed, 0 if it was not worth it and -1 on error.
+ */
+static int file_compress(struct cio_chunk *ch, struct cio_file *cf)
+{
+    int ret;
+    int meta_len;
+    char *buf;
+    char *data;
+    void *out;
+    size_t size;
+    size_t out_size;
+    struct cio_ctx *ctx = ch->ctx;
+
+    if (cf->data_size < CIO_FILE_COMP_MIN) {
+        return 0;
+    }
+
+    meta_len = cio_file_st_get_meta_len(cf->map);
+    data = cio_file_st_get_content(cf->map);
+
+    ret = ctx->compress_cb(ch->st->compress, data, cf->data_size,
+                           &out, &out_size);
+    if (ret != 0) {
+        cio_log_warn(ctx, "[cio file] cannot compress %s:%s",
+                     ch->st->name, ch->name);
+        return -1;
+    }
+
+    if (out_size >= cf->data_size) {
+        free(out);
+        return 0;
+    }
+
+    size = CIO_FILE_HEADER_MIN + meta_len + out_size;
+    buf = calloc(1, size);
+    if (!buf) {
+        cio_errno();
+        free(out);
+        return -1;
+    }
+
+    /* header, metadata and compressed data */
+    buf[0] = CIO_FILE_ID_00;
+    buf[1] = CIO_FILE_ID_01_COMP;
+    buf[CIO_FILE_COMP_TYPE] = (uint8_t) ch->st->compress;
+    cio_file_st_set_comp_size(buf, cf->data_size);
+    memcpy(buf + CIO_FILE_CONTENT_OFFSET, cf->map + CIO_FILE_CONTENT_OFFSET,
+           2 + meta_len);
+    memcpy(buf + CIO_FILE_HEADER_MIN + meta_len, out, out_size);
+    free(out);
+
+    if (ctx->flags & CIO_CHECKSUM) {
+        buf_checksum(buf, size);
+    }
+
+    ret = file_replace(ch, cf, buf, size);
+    free(buf);
+    if (ret == -1) {
+        return -1;
+    }
+
+    cio_log_debug(ctx, "[cio file] %s:%s compressed %lu -> %lu bytes",
+                  ch->st->name, ch->name, cf->data_size, out_size);
+    return 1;
+}
+
+/*
+ * Restore a compressed chunk file to the regular layout so it can be
+ * mapped, the file descriptor is reopened.
+ */
+static int file_uncompress(struct cio_chunk *ch, struct cio_file *cf,
+                           size_t fs_size)
+{
+    int ret;
+    int type;
+    int meta_len;
+    char *buf;
+    char *raw;
+    void *out = NULL;
+    size_t size;
+    size_t out_size;
+    size_t comp_size;
+    uint64_t raw_size;
+    char crc[4];
+    struct cio_ctx *ctx = ch->ctx;
+
+    if ((cf->flags & CIO_OPEN_RW) == 0 || !ctx->uncompress_cb) {
+        cio_log_error(ctx, "[cio file] cannot restore compressed chunk %s:%s",
+                      ch->st->name, ch->name);
+        cio_error_set(ch, CIO_ERR_PERMISSION);
+        return CIO_ERROR;
+    }
+
+    buf = malloc(fs_size);
+    if (!buf) {
+        cio_errno();
+        return CIO_ERROR;
+    }
+
+    ret = file_read(cf->fd, buf, fs_size, 0);
+    if (ret == -1) {
+        cio_errno();
+        free(buf);
+        return CIO_ERROR;
+    }
+
+    /* validate stored checksum and layout */
+    if (ctx->flags & CIO_CHECKSUM) {
+        memcpy(crc, buf + 2, sizeof(crc));
+        buf_checksum(buf, fs_size);
+        if (memcmp(crc, buf + 2, sizeof(crc)) != 0) {
+            cio_log_debug(ctx, "[cio file] invalid crc32 at %s/%s",
+                          ch->name, cf->path);
+            cio_error_set(ch, CIO_ERR_BAD_CHECKSUM);
+            free(buf);
+            return CIO_CORRUPTED;
+        }
+    }
+
+    type = (uint8_t) buf[CIO_FILE_COMP_TYPE];
+    meta_len = cio_file_st_get_meta_len(buf);
+    raw_size = cio_file_st_get_comp_size(buf);
+    if (CIO_FILE_HEADER_MIN + meta_len > fs_size) {
+        cio_error_set(ch, CIO_ERR_BAD_LAYOUT);
+        free(buf);
+        return CIO_CORRUPTED;
+    }
+    comp_size = fs_size - CIO_FILE_HEADER_MIN - meta_len;
+
+    ret = ctx->uncompress_cb(type, buf + CIO_FILE_HEADER_MIN + meta_len,
+                             comp_size, &out, &out_size);
+    if (ret != 0 || out_size != raw_size) {
+        cio_log_error(ctx, "[cio file] cannot uncompress %s:%s",
+                      ch->st->name, ch->name);
+        cio_error_set(ch, CIO_ERR_BAD_LAYOUT);
+        if (ret == 0) {
+            free(out);
+        }
+        free(buf);
+        return CIO_CORRUPTED;
+    }
+
+    /* regular layout: header, metadata and data */
+    size = CIO_FILE_HEADER_MIN + meta_len + out_size;
+    raw = calloc(1, size);
+    if (!raw) {
+        cio_errno();
+        free(out);
+        free(buf);
+        return CIO_ERROR;
+    }
+    raw[0] = CIO_FILE_ID_00;
+    raw[1] = CIO_FILE_ID_01;
+    memcpy(raw + CIO_FILE_CONTENT_OFFSET, buf + CIO_FILE_CONTENT_OFFSET,
+           2 + meta_len);
+    memcpy(raw + CIO_FILE_HEADER_MIN + meta_len, out, out_size);
+    free(out);
+    free(buf);
+
+    if (ctx->flags & CIO_CHECKSUM) {
+        buf_checksum(raw, size);
+    }
+
+    ret = file_replace(ch, cf, raw, size);
+    free(raw);
+    if (ret == -1) {
+        return CIO_ERROR;
+    }
+
+    /* the descriptor refers to the replaced file */
+    close(cf->fd);
+    cf->fd = open(cf->path, O_RDWR);
+    if (cf->fd == -1) {
+        cio_errno();
+        return CIO_ERROR;
+    }
+    cf->fs_size = size;
+
+    cio_log_debug(ctx, "[cio file] %s:%s uncompressed %lu -> %lu bytes",
+                  ch->st->name, ch->name, comp_size, out_size);
+    return CIO_OK;
+}
+
+/*
+ * Sync and compress a mapped chunk that is about to be unmapped. Returns
+ * the uncompressed file size if it was compressed, otherwise zero.
+ */
+static size_t file_compress_synced(struct cio_chunk *ch, struct cio_file *cf)
+{
+    int ret;
+    size_t size;
+
+    if (cf->flags & CIO_OPEN_RD) {
+        return 0;
+    }
+
+    ret = cio_file_sync(ch);
+    if (ret == -1) {
+        return 0;
+    }
+
+    size = CIO_FILE_HEADER_MIN + cio_file_st_get_meta_len(cf->map) +
+           cf->data_size;
+
+    ret = file_compress(ch, cf);
+    if (ret != 1) {
+        return 0;
+    }
+
+    return size;
+}
+
 /*
  * Unmap the memory for the opened file in question. It make sure
  * to sync changes to disk first.
@@ -319,6 +710,15 @@ static int mmap_file(struct cio_ctx *ctx, struct cio_chunk *ch, size_t size)
         fs_size = fst.st_size;
     }
 
+    /* Compressed chunks are restored before being mapped */
+    if (fs_size > CIO_FILE_HEADER_MIN && file_is_compressed(cf->fd)) {
+        ret = file_uncompress(ch, cf, fs_size);
+        if (ret != CIO_OK) {
+            return ret;
+        }
+        fs_size = cf->fs_size;
+    }
+
     /* Mmap */
     if (cf->flags & CIO_OPEN_RW) {
         oflags = PROT_READ | PROT_WRITE;
@@ -368,7 +768,18 @@ static int mmap_file(struct cio_ctx *ctx, struct cio_chunk *ch, size_t size)
         cio_log_error(ctx, "cannot mmap/read chunk '%s'", cf->path);
         return CIO_ERROR;
     }
-    cf->alloc_size = size;
+
+    /*
+     * The tail of the last page is not backed by the file: writing there
+     * would be lost once the file grows, so only account for the real file
+     * size and let cio_file_write() resize it.
+     */
+    if (fs_size > 0) {
+        cf->alloc_size = fs_size;
+    }
+    else {
+        cf->alloc_size = size;
+    }
 
     /* check content data size */
     if (fs_size > 0) {
@@ -404,6 +815,9 @@ static int mmap_file(struct cio_ctx *ctx, struct cio_chunk *ch, size_t size)
     cf->st_content = cio_file_st_get_content(cf->map);
     cio_log_debug(ctx, "%s:%s mapped OK", ch->st->name, ch->name);
 
+    /* the index entry is not valid once the file can be modified */
+    file_index_invalidate(ch, cf);
+
     /* The mmap succeeded, adjust the counters */
     cio_chunk_counter_total_up_add(ctx);
 
@@ -539,7 +953,278 @@ size_t cio_file_real_size(struct cio_file *cf)
         return 0;
     }
 
-    return st.st_size;
+    return file_logical_size(cf, st.st_size);
+}
+
+/* Read and validate a chunk file, see cio_file_verify() */
+static int file_verify(const char *path, int checksum,
+                       char **meta_buf, int *meta_len, size_t *size)
+{
+    int fd;
+    int ret;
+    int len;
+    int compressed;
+    char *buf;
+    char *meta = NULL;
+    char crc[4];
+    char hdr[CIO_FILE_HEADER_MIN];
+    size_t fs_size;
+    size_t read_size;
+    struct stat st;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return CIO_ERROR;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret == -1) {
+        close(fd);
+        return CIO_ERROR;
+    }
+    fs_size = st.st_size;
+
+    if (fs_size < CIO_FILE_HEADER_MIN) {
+        close(fd);
+        *meta_buf = NULL;
+        *meta_len = 0;
+        *size = 0;
+        return CIO_OK;
+    }
+
+    ret = file_read(fd, hdr, sizeof(hdr), 0);
+    if (ret == -1) {
+        close(fd);
+        return CIO_ERROR;
+    }
+
+    if (hdr[0] != (char) CIO_FILE_ID_00 ||
+        (hdr[1] != CIO_FILE_ID_01 && hdr[1] != CIO_FILE_ID_01_COMP)) {
+        close(fd);
+        return CIO_CORRUPTED;
+    }
+    compressed = (hdr[1] == CIO_FILE_ID_01_COMP);
+
+    len = cio_file_st_get_meta_len(hdr);
+    if (CIO_FILE_HEADER_MIN + len > fs_size) {
+        close(fd);
+        return CIO_CORRUPTED;
+    }
+
+    /* the checksum covers the whole content section */
+    if (checksum) {
+        read_size = fs_size;
+    }
+    else {
+        read_size = CIO_FILE_HEADER_MIN + len;
+    }
+
+    buf = malloc(read_size);
+    if (!buf) {
+        close(fd);
+        return CIO_ERROR;
+    }
+
+    ret = file_read(fd, buf, read_size, 0);
+    close(fd);
+    if (ret == -1) {
+        free(buf);
+        return CIO_ERROR;
+    }
+
+    if (checksum) {
+        memcpy(crc, buf + 2, sizeof(crc));
+        buf_checksum(buf, fs_size);
+        if (memcmp(crc, buf + 2, sizeof(crc)) != 0) {
+            free(buf);
+            return CIO_CORRUPTED;
+        }
+    }
+
+    if (len > 0) {
+        meta = malloc(len);
+        if (!meta) {
+            free(buf);
+            return CIO_ERROR;
+        }
+        memcpy(meta, buf + CIO_FILE_HEADER_MIN, len);
+    }
+    free(buf);
+
+    *meta_buf = meta;
+    *meta_len = len;
+
+    if (compressed) {
+        *size = CIO_FILE_HEADER_MIN + len + cio_file_st_get_comp_size(hdr);
+    }
+    else {
+        *size = fs_size;
+    }
+
+    return CIO_OK;
+}
+
+/*
+ * Validate a chunk file without mapping it: header, layout and checksum if
+ * it's enabled. On success it returns a copy of the metadata (release it
+ * with free(3)) and the size of the chunk once uncompressed, an empty file
+ * reports a zero size. Only a private file descriptor is used, so different
+ * chunks can be verified from concurrent threads.
+ *
+ * Chunks registered from the stream index are not read: the indexed
+ * metadata is returned and the file is validated when it's brought up.
+ */
+int cio_file_verify(struct cio_chunk *ch, char **meta_buf, int *meta_len,
+                    size_t *size)
+{
+    char *meta = NULL;
+    struct cio_file *cf = (struct cio_file *) ch->backend;
+
+    if (cf->indexed && !cf->map) {
+        if (cf->idx_meta_len > 0) {
+            meta = malloc(cf->idx_meta_len);
+            if (!meta) {
+                return CIO_ERROR;
+            }
+            memcpy(meta, cf->idx_meta, cf->idx_meta_len);
+        }
+
+        *meta_buf = meta;
+        *meta_len = cf->idx_meta_len;
+        *size = cf->fs_size;
+        return CIO_OK;
+    }
+
+    return file_verify(cf->path, ch->ctx->flags & CIO_CHECKSUM,
+                       meta_buf, meta_len, size);
+}
+
+/* Stream index: the chunk file is going to be modified, drop its entry */
+static void file_index_invalidate(struct cio_chunk *ch, struct cio_file *cf)
+{
+    if (!cf->indexed) {
+        return;
+    }
+
+    cio_index_del(ch);
+
+    cf->indexed = CIO_FALSE;
+    free(cf->idx_meta);
+    cf->idx_meta = NULL;
+    cf->idx_meta_len = 0;
+    cf->idx_size = 0;
+
+    cio_index_check(ch->ctx, ch->st);
+}
+
+/* Stream index: register a chunk at rest */
+static void file_index_add(struct cio_chunk *ch, struct cio_file *cf,
+                           char *meta, int meta_len, size_t size)
+{
+    int ret;
+    char *buf = NULL;
+
+    if ((ch->ctx->flags & CIO_INDEX) == 0) {
+        return;
+    }
+
+    if (meta_len > 0) {
+        buf = malloc(meta_len);
+        if (!buf) {
+            cio_errno();
+            return;
+        }
+        memcpy(buf, meta, meta_len);
+    }
+
+    ret = cio_index_add(ch, meta, meta_len, size);
+    if (ret == -1) {
+        free(buf);
+        return;
+    }
+
+    free(cf->idx_meta);
+    cf->idx_meta = buf;
+    cf->idx_meta_len = meta_len;
+    cf->idx_size = size;
+    cf->indexed = CIO_TRUE;
+
+    cio_index_check(ch->ctx, ch->st);
+}
+
+/* Stream index: register a mapped chunk that is going to be unmapped */
+static void file_index_add_mapped(struct cio_chunk *ch, struct cio_file *cf)
+{
+    int len;
+
+    len = cio_file_st_get_meta_len(cf->map);
+    file_index_add(ch, cf, cio_file_st_get_meta(cf->map), len,
+                   CIO_FILE_HEADER_MIN + len + cf->data_size);
+}
+
+/*
+ * Stream index: update the entry of a chunk that is being closed, chunks
+ * kept in the file system are registered so the next cio_load() does not
+ * need to open them.
+ */
+void cio_file_index_close(struct cio_chunk *ch, int delete)
+{
+    int ret;
+    int meta_len;
+    char *meta;
+    size_t size;
+    struct cio_file *cf = (struct cio_file *) ch->backend;
+
+    if (delete == CIO_TRUE) {
+        file_index_invalidate(ch, cf);
+        return;
+    }
+
+    if (cf->map) {
+        file_index_add_mapped(ch, cf);
+        return;
+    }
+
+    if (cf->indexed) {
+        return;
+    }
+
+    /* the chunk has been down since it was loaded */
+    ret = file_verify(cf->path, CIO_FALSE, &meta, &meta_len, &size);
+    if (ret == CIO_OK && size > 0) {
+        file_index_add(ch, cf, meta, meta_len, size);
+    }
+    if (ret == CIO_OK) {
+        free(meta);
+    }
+}
+
+/* Stream index: register a chunk from its entry, the file is not opened */
+static int file_index_restore(struct cio_stream *st, struct cio_chunk *ch,
+                              struct cio_file *cf)
+{
+    struct cio_index_entry *e;
+
+    e = cio_index_lookup(st->index, ch->name);
+    if (!e) {
+        return -1;
+    }
+
+    if (e->meta_len > 0) {
+        cf->idx_meta = malloc(e->meta_len);
+        if (!cf->idx_meta) {
+            cio_errno();
+            return -1;
+        }
+        memcpy(cf->idx_meta, e->meta, e->meta_len);
+    }
+
+    cf->idx_meta_len = e->meta_len;
+    cf->idx_size = e->size;
+    cf->fs_size = e->size;
+    cf->indexed = CIO_TRUE;
+
+    return 0;
 }
 
 /*
@@ -608,13 +1293,22 @@ struct cio_file *cio_file_open(struct cio_ctx *ctx,
     cf->map = NULL;
     ch->backend = cf;
 
+    /* Chunks found in the stream index are registered 'down' */
+    if (st->index) {
+        ret = file_index_restore(st, ch, cf);
+        if (ret == 0) {
+            *err = CIO_OK;
+            return cf;
+        }
+    }
+
     /* Should we open and put this file up ? */
     ret = open_and_up(ctx);
     if (ret == CIO_FALSE) {
         /* make sure to set the file size before to return */
         ret = stat(cf->path, &f_st);
         if (ret == 0) {
-            cf->fs_size = f_st.st_size;
+            cf->fs_size = file_logical_size(cf, f_st.st_size);
         }
 
         /* we reached our limit, let the file 'down' */
@@ -734,6 +1428,7 @@ int cio_file_up_force(struct cio_chunk *ch)
 int cio_file_down(struct cio_chunk *ch)
 {
     int ret;
+    size_t size = 0;
     struct stat st;
     struct cio_file *cf = (struct cio_file *) ch->backend;
 
@@ -743,6 +1438,13 @@ int cio_file_down(struct cio_chunk *ch)
         return -1;
     }
 
+    /* compress the content, the chunk keeps its uncompressed size */
+    if (ch->st->compress != CIO_COMPRESS_NONE) {
+        size = file_compress_synced(ch, cf);
+    }
+
+    file_index_add_mapped(ch, cf);
+
     /* unmap memory */
     munmap_file(ch->ctx, ch);
 
@@ -755,6 +1457,9 @@ int cio_file_down(struct cio_chunk *ch)
         cio_errno();
         cf->fs_size = 0;
     }
+    else if (size > 0) {
+        cf->fs_size = size;
+    }
     else {
         cf->fs_size = st.st_size;
     }
@@ -776,12 +1481,29 @@ void cio_file_close(struct cio_chunk *ch, int delete)
         return;
     }
 
+    /* No need to sync content that is going to be deleted */
+    if (delete == CIO_TRUE) {
+        cf->synced = CIO_TRUE;
+    }
+
+    /* Chunks kept in the file system are compressed */
+    if (delete == CIO_FALSE && cf->map &&
+        ch->st->compress != CIO_COMPRESS_NONE) {
+        file_compress_synced(ch, cf);
+    }
+
     /* Safe unmap of the file content */
     munmap_file(ch->ctx, ch);
 
     /* Should we delete the content from the file system ? */
     if (delete == CIO_TRUE) {
-        ret = unlink(cf->path);
+        ret = -1;
+        if (ch->st->async == CIO_TRUE) {
+            ret = cio_async_unlink(ch->ctx, cf->path);
+        }
+        if (ret == -1) {
+            ret = unlink(cf->path);
+        }
         if (ret == -1) {
             cio_errno();
             cio_log_error(ch->ctx,
@@ -795,6 +1517,7 @@ void cio_file_close(struct cio_chunk *ch, int delete)
         close(cf->fd);
     }
 
+    free(cf->idx_meta);
     free(cf->path);
     free(cf);
 }
@@ -1069,8 +1792,22 @@ int cio_file_sync(struct cio_chunk *ch)
         sync_mode = MS_ASYNC;
     }
 
-    /* Commit changes to disk */
-    ret = msync(cf->map, cf->alloc_size, sync_mode);
+    /* the index deletion records go first, see cio_index_sync() */
+    if (sync_mode == MS_SYNC && (ch->ctx->flags & CIO_INDEX)) {
+        cio_index_sync(ch->st);
+    }
+
+    /*
+     * Commit changes to disk. Async streams hand a full sync to the kernel
+     * so the caller is not blocked, fsync(2) writes back the mapped pages.
+     */
+    ret = -1;
+    if (sync_mode == MS_SYNC && ch->st->async == CIO_TRUE) {
+        ret = cio_async_fsync(ch->ctx, cf->fd);
+    }
+    if (ret == -1) {
+        ret = msync(cf->map, cf->alloc_size, sync_mode);
+    }
     if (ret == -1) {
         cio_errno();
         return -1;
@@ -1090,6 +1827,45 @@ int cio_file_sync(struct cio_chunk *ch)
     return 0;
 }
 
+/*
+ * Flush the file data to the storage device. If the chunk is down its file
+ * is opened just for the sync.
+ */
+int cio_file_datasync(struct cio_chunk *ch)
+{
+    int fd;
+    int ret;
+    struct cio_file *cf = (struct cio_file *) ch->backend;
+
+    if (cf->flags & CIO_OPEN_RD) {
+        return 0;
+    }
+
+    fd = cf->fd;
+    if (fd == -1) {
+        fd = open(cf->path, O_RDONLY);
+        if (fd == -1) {
+            cio_errno();
+            return -1;
+        }
+    }
+
+#ifdef __APPLE__
+    ret = fsync(fd);
+#else
+    ret = fdatasync(fd);
+#endif
+    if (ret == -1) {
+        cio_errno();
+    }
+
+    if (fd != cf->fd) {
+        close(fd);
+    }
+
+    return ret;
+}
+
 /*
  * Change the size of 'file' in the file system (not memory map). This function
  * MUST honor the required new size.
@@ -635,6 +635,24 @@ int cio_file_sync(struct cio_chunk *ch)
     return 0;
 }
 
+/* not supported, chunks are validated when they are brought up */
+int cio_file_verify(struct cio_chunk *ch, char **meta_buf, int *meta_len,
+                    size_t *size)
+{
+    return CIO_ERROR;
+}
+
+/* the stream index is not supported */
+void cio_file_index_close(struct cio_chunk *ch, int delete)
+{
+}
+
+/* cio_file_sync() already flushes the file buffers */
+int cio_file_datasync(struct cio_chunk *ch)
+{
+    return 0;
+}
+
 int cio_file_fs_size_change(struct cio_file *cf, size_t new_size)
 {
     if (seek_file(cf->h, new_size)) {
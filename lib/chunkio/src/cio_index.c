@@ -0,0 +1,541 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Chunk I/O
+ *  =========
+ *  Copyright 2018-2021 Eduardo Silva <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <chunkio/chunkio.h>
+#include <chunkio/chunkio_compat.h>
+#include <chunkio/cio_crc32.h>
+#include <chunkio/cio_chunk.h>
+#include <chunkio/cio_file.h>
+#include <chunkio/cio_log.h>
+#include <chunkio/cio_stream.h>
+#include <chunkio/cio_index.h>
+
+#include <monkey/mk_core/mk_list.h>
+
+static inline void put_u16(unsigned char *p, uint16_t val)
+{
+    p[0] = (val >> 8) & 0xff;
+    p[1] = val & 0xff;
+}
+
+static inline uint16_t get_u16(unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline void put_u32(unsigned char *p, uint32_t val)
+{
+    put_u16(p, val >> 16);
+    put_u16(p + 2, val & 0xffff);
+}
+
+static inline uint32_t get_u32(unsigned char *p)
+{
+    return ((uint32_t) get_u16(p) << 16) | get_u16(p + 2);
+}
+
+static inline void put_u64(unsigned char *p, uint64_t val)
+{
+    put_u32(p, val >> 32);
+    put_u32(p + 4, val & 0xffffffff);
+}
+
+static inline uint64_t get_u64(unsigned char *p)
+{
+    return ((uint64_t) get_u32(p) << 32) | get_u32(p + 4);
+}
+
+static uint32_t record_crc(unsigned char *rec, size_t size)
+{
+    crc_t crc;
+
+    crc = cio_crc32_init();
+    crc = cio_crc32_update(crc, rec + 4, size - 4);
+    crc = cio_crc32_finalize(crc);
+
+    return (uint32_t) crc;
+}
+
+/* Compose the path of the index file of a stream */
+static char *index_path(struct cio_ctx *ctx, struct cio_stream *st,
+                        const char *suffix)
+{
+    int len;
+    char *path;
+
+    len = strlen(ctx->root_path) + strlen(st->name) +
+          sizeof(CIO_INDEX_FILE) + strlen(suffix) + 2;
+
+    path = malloc(len);
+    if (!path) {
+        cio_errno();
+        return NULL;
+    }
+
+    snprintf(path, len, "%s/%s/%s%s",
+             ctx->root_path, st->name, CIO_INDEX_FILE, suffix);
+    return path;
+}
+
+/* Serialize a record, returns its size */
+static size_t record_pack(unsigned char *rec, int op, const char *name,
+                          int name_len, char *meta, int meta_len,
+                          uint64_t size)
+{
+    size_t len;
+
+    rec[4] = op;
+    put_u16(rec + 5, name_len);
+    put_u16(rec + 7, meta_len);
+    put_u64(rec + 9, size);
+    memcpy(rec + CIO_INDEX_REC_HDR, name, name_len);
+    if (meta_len > 0) {
+        memcpy(rec + CIO_INDEX_REC_HDR + name_len, meta, meta_len);
+    }
+
+    len = CIO_INDEX_REC_HDR + name_len + meta_len;
+    put_u32(rec, record_crc(rec, len));
+
+    return len;
+}
+
+static int write_all(int fd, unsigned char *buf, size_t size)
+{
+    ssize_t bytes;
+    size_t total = 0;
+
+    while (total < size) {
+        bytes = write(fd, buf + total, size - total);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += bytes;
+    }
+
+    return 0;
+}
+
+static int index_append(struct cio_chunk *ch, int op,
+                        char *meta, int meta_len, uint64_t size)
+{
+    int ret;
+    int name_len;
+    char *path;
+    size_t len;
+    unsigned char *rec;
+    struct cio_stream *st = ch->st;
+
+    if (st->index_fd == -1) {
+        path = index_path(ch->ctx, st, "");
+        if (!path) {
+            return -1;
+        }
+
+        st->index_fd = open(path, O_WRONLY | O_CREAT | O_APPEND,
+                            (mode_t) 0600);
+        free(path);
+        if (st->index_fd == -1) {
+            cio_errno();
+            return -1;
+        }
+    }
+
+    name_len = strlen(ch->name);
+    rec = malloc(CIO_INDEX_REC_HDR + name_len + meta_len);
+    if (!rec) {
+        cio_errno();
+        return -1;
+    }
+
+    len = record_pack(rec, op, ch->name, name_len, meta, meta_len, size);
+
+    /* one write(2) per record, a torn tail is detected by the CRC */
+    ret = write_all(st->index_fd, rec, len);
+    free(rec);
+
+    if (ret == -1) {
+        cio_errno();
+        cio_log_warn(ch->ctx, "[cio index] cannot update index of stream %s",
+                     st->name);
+        return -1;
+    }
+    st->index_records++;
+
+    return 0;
+}
+
+/* Register a chunk at rest */
+int cio_index_add(struct cio_chunk *ch, char *meta, int meta_len,
+                  uint64_t size)
+{
+    return index_append(ch, CIO_INDEX_ADD, meta, meta_len, size);
+}
+
+/* Invalidate the entry of a chunk: it's being written or deleted */
+int cio_index_del(struct cio_chunk *ch)
+{
+    return index_append(ch, CIO_INDEX_DEL, NULL, 0, 0);
+}
+
+static int entry_cmp_name(const char *name, int len,
+                          struct cio_index_entry *e)
+{
+    int ret;
+
+    ret = memcmp(name, e->name, len < e->name_len ? len : e->name_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return len - e->name_len;
+}
+
+static int entry_cmp(const void *a_arg, const void *b_arg)
+{
+    int ret;
+    struct cio_index_entry *a = (struct cio_index_entry *) a_arg;
+    struct cio_index_entry *b = (struct cio_index_entry *) b_arg;
+
+    ret = entry_cmp_name(a->name, a->name_len, b);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* keep records of the same chunk in the order they were written */
+    if (a->seq < b->seq) {
+        return -1;
+    }
+
+    return (a->seq > b->seq);
+}
+
+/*
+ * Read the index of a stream: it returns the last valid entry of every
+ * chunk, or NULL if the stream has no index. Parsing stops at the first
+ * invalid record, chunks described after it are scanned as usual.
+ */
+struct cio_index *cio_index_load(struct cio_ctx *ctx, struct cio_stream *st)
+{
+    int fd;
+    int ret;
+    int name_len;
+    int meta_len;
+    char *path;
+    size_t i;
+    size_t n;
+    size_t off = 0;
+    size_t len;
+    size_t size;
+    ssize_t bytes;
+    unsigned char *p;
+    struct stat fst;
+    struct cio_index *idx;
+    struct cio_index_entry *e;
+
+    path = index_path(ctx, st, "");
+    if (!path) {
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    ret = fstat(fd, &fst);
+    if (ret == -1 || fst.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    size = fst.st_size;
+
+    idx = calloc(1, sizeof(struct cio_index));
+    if (!idx) {
+        cio_errno();
+        close(fd);
+        return NULL;
+    }
+
+    idx->buf = malloc(size);
+    idx->entries = calloc(size / CIO_INDEX_REC_HDR,
+                          sizeof(struct cio_index_entry));
+    if (!idx->buf || !idx->entries) {
+        cio_errno();
+        close(fd);
+        cio_index_destroy(idx);
+        return NULL;
+    }
+
+    while (off < size) {
+        bytes = read(fd, idx->buf + off, size - off);
+        if (bytes <= 0) {
+            if (bytes == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        off += bytes;
+    }
+    close(fd);
+    size = off;
+
+    /* parse records */
+    off = 0;
+    while (off + CIO_INDEX_REC_HDR <= size) {
+        p = (unsigned char *) idx->buf + off;
+        name_len = get_u16(p + 5);
+        meta_len = get_u16(p + 7);
+        len = CIO_INDEX_REC_HDR + name_len + meta_len;
+
+        if (off + len > size || name_len == 0 ||
+            (p[4] != CIO_INDEX_ADD && p[4] != CIO_INDEX_DEL) ||
+            get_u32(p) != record_crc(p, len)) {
+            break;
+        }
+
+        e = &idx->entries[idx->count];
+        e->op = p[4];
+        e->name = (char *) p + CIO_INDEX_REC_HDR;
+        e->name_len = name_len;
+        e->meta = e->name + name_len;
+        e->meta_len = meta_len;
+        e->size = get_u64(p + 9);
+        e->seq = idx->count;
+        idx->count++;
+
+        off += len;
+    }
+
+    if (off != size) {
+        cio_log_warn(ctx, "[cio index] stream %s: invalid record at offset "
+                     "%zu, remaining chunks will be scanned", st->name, off);
+    }
+
+    /* keep the last record of each chunk, if it's not a deletion */
+    qsort(idx->entries, idx->count, sizeof(struct cio_index_entry), entry_cmp);
+
+    n = 0;
+    for (i = 0; i < idx->count; i++) {
+        e = &idx->entries[i];
+        if (i + 1 < idx->count &&
+            entry_cmp_name(e->name, e->name_len, &idx->entries[i + 1]) == 0) {
+            continue;
+        }
+        if (e->op == CIO_INDEX_DEL) {
+            continue;
+        }
+        idx->entries[n++] = *e;
+    }
+    idx->count = n;
+
+    cio_log_debug(ctx, "[cio index] stream %s: %zu chunks indexed",
+                  st->name, idx->count);
+    return idx;
+}
+
+struct cio_index_entry *cio_index_lookup(struct cio_index *idx,
+                                         const char *name)
+{
+    int ret;
+    int len;
+    size_t lo = 0;
+    size_t hi;
+    size_t mid;
+
+    if (!idx) {
+        return NULL;
+    }
+
+    len = strlen(name);
+    hi = idx->count;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        ret = entry_cmp_name(name, len, &idx->entries[mid]);
+        if (ret == 0) {
+            return &idx->entries[mid];
+        }
+        else if (ret < 0) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+void cio_index_destroy(struct cio_index *idx)
+{
+    if (!idx) {
+        return;
+    }
+
+    free(idx->entries);
+    free(idx->buf);
+    free(idx);
+}
+
+/*
+ * Rewrite the index of a stream with the entries of the chunks at rest, so
+ * it does not grow with the records of chunks already deleted or updated.
+ */
+int cio_index_compact(struct cio_ctx *ctx, struct cio_stream *st)
+{
+    int fd;
+    int ret;
+    char *tmp;
+    char *path;
+    size_t off = 0;
+    size_t size = 0;
+    size_t count = 0;
+    unsigned char *buf;
+    struct mk_list *head;
+    struct cio_chunk *ch;
+    struct cio_file *cf;
+
+    mk_list_foreach(head, &st->chunks) {
+        ch = mk_list_entry(head, struct cio_chunk, _head);
+        cf = (struct cio_file *) ch->backend;
+        if (cf->indexed) {
+            size += CIO_INDEX_REC_HDR + strlen(ch->name) + cf->idx_meta_len;
+        }
+    }
+
+    buf = malloc(size + 1);
+    if (!buf) {
+        cio_errno();
+        return -1;
+    }
+
+    mk_list_foreach(head, &st->chunks) {
+        ch = mk_list_entry(head, struct cio_chunk, _head);
+        cf = (struct cio_file *) ch->backend;
+        if (cf->indexed) {
+            off += record_pack(buf + off, CIO_INDEX_ADD,
+                               ch->name, strlen(ch->name),
+                               cf->idx_meta, cf->idx_meta_len, cf->idx_size);
+            count++;
+        }
+    }
+
+    path = index_path(ctx, st, "");
+    tmp = index_path(ctx, st, ".tmp");
+    if (!path || !tmp) {
+        free(path);
+        free(tmp);
+        free(buf);
+        return -1;
+    }
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, (mode_t) 0600);
+    if (fd == -1) {
+        cio_errno();
+        ret = -1;
+    }
+    else {
+        ret = write_all(fd, buf, off);
+        if (ret == 0) {
+            ret = fsync(fd);
+        }
+        close(fd);
+        if (ret == 0) {
+            ret = rename(tmp, path);
+        }
+        if (ret == -1) {
+            cio_errno();
+            unlink(tmp);
+        }
+    }
+
+    free(buf);
+    free(path);
+    free(tmp);
+
+    /* appends go to the new file */
+    cio_index_close(st);
+
+    if (ret == 0) {
+        st->index_records = count;
+        st->index_limit = count + (count > CIO_INDEX_COMPACT_MIN ?
+                                   count : CIO_INDEX_COMPACT_MIN);
+    }
+    else {
+        /* retry once as many records are appended */
+        st->index_limit = st->index_records + CIO_INDEX_COMPACT_MIN;
+        cio_log_warn(ctx, "[cio index] cannot compact index of stream %s",
+                     st->name);
+    }
+
+    return ret;
+}
+
+/* Compact the index of a stream if it reached its records limit */
+int cio_index_check(struct cio_ctx *ctx, struct cio_stream *st)
+{
+    if (st->index_records < st->index_limit) {
+        return 0;
+    }
+
+    cio_log_debug(ctx, "[cio index] stream %s: compacting %zu records",
+                  st->name, st->index_records);
+    return cio_index_compact(ctx, st);
+}
+
+/*
+ * Flush the index records to disk: a deletion record must be persisted
+ * before the chunk file it invalidates is modified on disk.
+ */
+int cio_index_sync(struct cio_stream *st)
+{
+    int ret;
+
+    if (st->index_fd == -1) {
+        return 0;
+    }
+
+    ret = fsync(st->index_fd);
+    if (ret == -1) {
+        cio_errno();
+    }
+
+    return ret;
+}
+
+void cio_index_close(struct cio_stream *st)
+{
+    if (st->index_fd != -1) {
+        close(st->index_fd);
+        st->index_fd = -1;
+    }
+}
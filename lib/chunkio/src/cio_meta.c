@@ -45,6 +45,7 @@
 
 int cio_meta_write(struct cio_chunk *ch, char *buf, size_t size)
 {
+    int ret;
     struct cio_memfs *mf;
 
     if (size > 65535) {
@@ -67,7 +68,11 @@ int cio_meta_write(struct cio_chunk *ch, char *buf, size_t size)
         return 0;
     }
     else if (ch->st->type == CIO_STORE_FS) {
-        return cio_file_write_metadata(ch, buf, size);
+        ret = cio_file_write_metadata(ch, buf, size);
+        if (ret == 0 && (ch->ctx->flags & CIO_GROUP_SYNC)) {
+            cio_chunk_dirty_add(ch, size);
+        }
+        return ret;
     }
     return -1;
 }
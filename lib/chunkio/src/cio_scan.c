@@ -29,6 +29,7 @@
 #include <chunkio/cio_memfs.h>
 #include <chunkio/cio_chunk.h>
 #include <chunkio/cio_log.h>
+#include <chunkio/cio_index.h>
 
 #ifdef _WIN32
 #include "win32/dirent.h"
@@ -74,6 +75,13 @@ static int cio_scan_stream_files(struct cio_ctx *ctx, struct cio_stream *st,
 
     cio_log_debug(ctx, "[cio scan] opening stream %s", st->name);
 
+#ifndef _WIN32
+    /* chunks found in the index are registered without opening them */
+    if (ctx->flags & CIO_INDEX) {
+        st->index = cio_index_load(ctx, st);
+    }
+#endif
+
     /* Iterate the root_path */
     while ((ent = readdir(dir)) != NULL) {
         if ((ent->d_name[0] == '.') || (strcmp(ent->d_name, "..") == 0)) {
@@ -105,6 +113,14 @@ static int cio_scan_stream_files(struct cio_ctx *ctx, struct cio_stream *st,
     closedir(dir);
     free(path);
 
+#ifndef _WIN32
+    if (ctx->flags & CIO_INDEX) {
+        cio_index_destroy(st->index);
+        st->index = NULL;
+        cio_index_compact(ctx, st);
+    }
+#endif
+
     return 0;
 }
 
@@ -28,6 +28,7 @@
 #include <chunkio/cio_chunk.h>
 #include <chunkio/cio_stream.h>
 #include <chunkio/cio_utils.h>
+#include <chunkio/cio_index.h>
 
 #include <monkey/mk_core/mk_list.h>
 
@@ -160,6 +161,12 @@ struct cio_stream *cio_stream_create(struct cio_ctx *ctx, const char *name,
         return NULL;
     }
     st->type = type;
+    st->async = CIO_FALSE;
+    st->compress = CIO_COMPRESS_NONE;
+    st->index_fd = -1;
+    st->index_records = 0;
+    st->index_limit = CIO_INDEX_COMPACT_MIN;
+    st->index = NULL;
     st->name = strdup(name);
     if (!st->name) {
         cio_errno();
@@ -185,6 +192,10 @@ void cio_stream_destroy(struct cio_stream *st)
     /* close all files */
     cio_chunk_close_stream(st);
 
+#ifndef _WIN32
+    cio_index_close(st);
+#endif
+
     /* destroy stream */
     mk_list_del(&st->_head);
     free(st->name);
@@ -209,6 +220,10 @@ int cio_stream_delete(struct cio_stream *st)
         cio_chunk_close(ch, CIO_TRUE);
     }
 
+#ifndef _WIN32
+    cio_index_close(st);
+#endif
+
 #ifdef CIO_HAVE_BACKEND_FILESYSTEM
     /* If the stream is filesystem based, destroy the real directory */
     if (st->type == CIO_STORE_FS) {
@@ -274,3 +289,46 @@ size_t cio_stream_size_chunks_up(struct cio_stream *st)
 
     return total;
 }
+
+/*
+ * Make file based chunks of the stream use the asynchronous operations
+ * of the context, if they are available.
+ */
+int cio_stream_set_async(struct cio_stream *st, int enabled)
+{
+    struct cio_ctx *ctx = st->parent;
+
+    if (enabled && (st->type != CIO_STORE_FS || !ctx->async)) {
+        return -1;
+    }
+
+    st->async = enabled ? CIO_TRUE : CIO_FALSE;
+    return 0;
+}
+
+/*
+ * Compress file based chunks of the stream with the given algorithm when
+ * they are put down, the context must have compression callbacks.
+ */
+int cio_stream_set_compression(struct cio_stream *st, int type)
+{
+    struct cio_ctx *ctx = st->parent;
+
+    if (type < 0 || type > 255) {
+        return -1;
+    }
+
+#ifdef _WIN32
+    if (type != CIO_COMPRESS_NONE) {
+        return -1;
+    }
+#endif
+
+    if (type != CIO_COMPRESS_NONE &&
+        (st->type != CIO_STORE_FS || !ctx->compress_cb)) {
+        return -1;
+    }
+
+    st->compress = type;
+    return 0;
+}
@@ -33,6 +33,8 @@
 #include <chunkio/cio_stream.h>
 #include <chunkio/cio_utils.h>
 #include <chunkio/cio_error.h>
+#include <chunkio/cio_async.h>
+#include <chunkio/cio_index.h>
 
 #include "cio_tests_internal.h"
 
@@ -660,6 +662,586 @@ void test_issue_write_at()
     TEST_CHECK(cf->fd <= 0);
 }
 
+/* Syncs and deletions handed to io_uring, or done in place as a fallback */
+void test_fs_async()
+{
+    int i;
+    int ret;
+    int err;
+    char path[1024];
+    char line[] = "this is a test line\n";
+    struct stat st;
+    struct cio_ctx *ctx;
+    struct cio_chunk *chunk;
+    struct cio_stream *stream;
+
+    cio_utils_recursive_delete(CIO_ENV);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_FULL_SYNC);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_async", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    ret = cio_async_create(ctx, CIO_ASYNC_ENTRIES);
+    if (ret == -1) {
+        /* no io_uring: the stream keeps the synchronous mode */
+        TEST_CHECK(cio_stream_set_async(stream, CIO_TRUE) == -1);
+        TEST_CHECK(cio_async_fd(ctx) == -1);
+    }
+    else {
+        TEST_CHECK(cio_stream_set_async(stream, CIO_TRUE) == 0);
+        TEST_CHECK(cio_async_fd(ctx) >= 0);
+    }
+
+    chunk = cio_chunk_open(ctx, stream, "test", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL);
+    if (!chunk) {
+        exit(1);
+    }
+
+    for (i = 0; i < 100; i++) {
+        ret = cio_chunk_write(chunk, line, sizeof(line) - 1);
+        TEST_CHECK(ret == CIO_OK);
+    }
+
+    /* sync, down and up again: content must be there */
+    ret = cio_chunk_sync(chunk);
+    TEST_CHECK(ret == 0);
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_up(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(cio_chunk_get_content_size(chunk) == 100 * (sizeof(line) - 1));
+
+    /* delete it */
+    snprintf(path, sizeof(path), "%s/test_async/test", CIO_ENV);
+    cio_chunk_close(chunk, CIO_TRUE);
+
+    /* wait for the completions */
+    for (i = 0; i < 100 && stat(path, &st) == 0; i++) {
+        usleep(10000);
+        cio_async_process(ctx);
+    }
+    TEST_CHECK(stat(path, &st) == -1);
+
+    cio_destroy(ctx);
+}
+
+/* Group sync: written chunks are tracked until cio_sync_dirty() */
+void test_fs_group_sync()
+{
+    int ret;
+    int err;
+    char line[] = "this is a test line\n";
+    struct cio_ctx *ctx;
+    struct cio_chunk *c1;
+    struct cio_chunk *c2;
+    struct cio_chunk *c3;
+    struct cio_stream *stream;
+
+    cio_utils_recursive_delete(CIO_ENV);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_GROUP_SYNC);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_group", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    c1 = cio_chunk_open(ctx, stream, "c1", CIO_OPEN, 1000, &err);
+    c2 = cio_chunk_open(ctx, stream, "c2", CIO_OPEN, 1000, &err);
+    c3 = cio_chunk_open(ctx, stream, "c3", CIO_OPEN, 1000, &err);
+    TEST_CHECK(c1 != NULL && c2 != NULL && c3 != NULL);
+    if (!c1 || !c2 || !c3) {
+        exit(1);
+    }
+    TEST_CHECK(mk_list_size(&ctx->dirty) == 0);
+
+    cio_chunk_write(c1, line, sizeof(line) - 1);
+    cio_chunk_write(c1, line, sizeof(line) - 1);
+    cio_chunk_write(c2, line, sizeof(line) - 1);
+    cio_chunk_write(c3, line, sizeof(line) - 1);
+    TEST_CHECK(mk_list_size(&ctx->dirty) == 3);
+    TEST_CHECK(ctx->dirty_bytes == 4 * (sizeof(line) - 1));
+
+    /* a deleted chunk does not need a sync */
+    cio_chunk_close(c3, CIO_TRUE);
+    TEST_CHECK(mk_list_size(&ctx->dirty) == 2);
+    TEST_CHECK(ctx->dirty_bytes == 3 * (sizeof(line) - 1));
+
+    /* chunks that are up and down are synced */
+    ret = cio_chunk_down(c2);
+    TEST_CHECK(ret == CIO_OK);
+
+    ret = cio_sync_dirty(ctx);
+    TEST_CHECK(ret == 2);
+    TEST_CHECK(mk_list_size(&ctx->dirty) == 0);
+    TEST_CHECK(ctx->dirty_bytes == 0);
+
+    ret = cio_chunk_up(c2);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(cio_chunk_get_content_size(c2) == sizeof(line) - 1);
+
+    /* nothing left */
+    ret = cio_sync_dirty(ctx);
+    TEST_CHECK(ret == 0);
+
+    cio_destroy(ctx);
+}
+
+/* Run-length codec for the compression tests: (count, byte) pairs */
+static int rle_compress(int type, void *in, size_t in_size,
+                        void **out, size_t *out_size)
+{
+    size_t i = 0;
+    size_t n = 0;
+    unsigned char c;
+    unsigned char *buf;
+    unsigned char *data = in;
+
+    buf = malloc(in_size * 2);
+    if (!buf || type != 1) {
+        free(buf);
+        return -1;
+    }
+
+    while (i < in_size) {
+        c = 1;
+        while (i + c < in_size && c < 255 && data[i + c] == data[i]) {
+            c++;
+        }
+        buf[n++] = c;
+        buf[n++] = data[i];
+        i += c;
+    }
+
+    *out = buf;
+    *out_size = n;
+    return 0;
+}
+
+static int rle_uncompress(int type, void *in, size_t in_size,
+                          void **out, size_t *out_size)
+{
+    size_t i;
+    size_t n = 0;
+    unsigned char *buf;
+    unsigned char *data = in;
+
+    for (i = 0; i + 1 < in_size; i += 2) {
+        n += data[i];
+    }
+
+    buf = malloc(n);
+    if (!buf || type != 1) {
+        free(buf);
+        return -1;
+    }
+
+    n = 0;
+    for (i = 0; i + 1 < in_size; i += 2) {
+        memset(buf + n, data[i + 1], data[i]);
+        n += data[i];
+    }
+
+    *out = buf;
+    *out_size = n;
+    return 0;
+}
+
+/* Chunks are compressed when they go down and restored when up */
+void test_fs_compress()
+{
+    int i;
+    int ret;
+    int err;
+    char *buf;
+    size_t size;
+    size_t raw_size;
+    char data[1024];
+    char path[1024];
+    struct stat st;
+    struct cio_ctx *ctx;
+    struct cio_chunk *chunk;
+    struct cio_stream *stream;
+
+    cio_utils_recursive_delete(CIO_ENV);
+    memset(data, 'a', sizeof(data));
+    snprintf(path, sizeof(path), "%s/test_compress/test", CIO_ENV);
+    raw_size = CIO_FILE_HEADER_MIN + (64 * sizeof(data));
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_CHECKSUM);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_compress", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    /* no codec */
+    TEST_CHECK(cio_stream_set_compression(stream, 1) == -1);
+
+    cio_set_compression_callback(ctx, rle_compress, rle_uncompress);
+    TEST_CHECK(cio_stream_set_compression(stream, 1) == 0);
+
+    chunk = cio_chunk_open(ctx, stream, "test", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL);
+    if (!chunk) {
+        exit(1);
+    }
+
+    for (i = 0; i < 64; i++) {
+        ret = cio_chunk_write(chunk, data, sizeof(data));
+        TEST_CHECK(ret == CIO_OK);
+    }
+
+    /* down: the file is compressed, the chunk keeps the logical size */
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(stat(path, &st) == 0);
+    TEST_CHECK(st.st_size < 1024);
+    TEST_CHECK(cio_chunk_get_real_size(chunk) == raw_size);
+
+    /* up: content is restored */
+    ret = cio_chunk_up(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(cio_chunk_get_content_size(chunk) == 64 * sizeof(data));
+
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == 64 * sizeof(data));
+    TEST_CHECK(buf[0] == 'a' && buf[size - 1] == 'a');
+
+    /* close without deleting: it's compressed on disk */
+    cio_chunk_write(chunk, data, sizeof(data));
+    cio_chunk_close(chunk, CIO_FALSE);
+    TEST_CHECK(stat(path, &st) == 0);
+    TEST_CHECK(st.st_size < 1024);
+    cio_destroy(ctx);
+
+    /* load it again with checksum validation */
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN | CIO_CHECKSUM);
+    TEST_CHECK(ctx != NULL);
+    cio_set_compression_callback(ctx, rle_compress, rle_uncompress);
+
+    ret = cio_load(ctx, NULL);
+    TEST_CHECK(ret == 0);
+
+    stream = cio_stream_get(ctx, "test_compress");
+    TEST_CHECK(stream != NULL);
+    TEST_CHECK(mk_list_size(&stream->chunks) == 1);
+    if (!stream || mk_list_size(&stream->chunks) != 1) {
+        exit(1);
+    }
+
+    chunk = mk_list_entry_first(&stream->chunks, struct cio_chunk, _head);
+    TEST_CHECK(cio_chunk_is_up(chunk) == CIO_TRUE);
+    TEST_CHECK(cio_chunk_get_content_size(chunk) == 65 * sizeof(data));
+
+    cio_destroy(ctx);
+}
+
+/* Validate chunk files without bringing them up */
+void test_fs_verify()
+{
+    int fd;
+    int ret;
+    int err;
+    int meta_len;
+    char *meta;
+    size_t size;
+    char data[1024];
+    char path[1024];
+    struct cio_ctx *ctx;
+    struct cio_chunk *chunk;
+    struct cio_stream *stream;
+
+    cio_utils_recursive_delete(CIO_ENV);
+    memset(data, 'a', sizeof(data));
+    snprintf(path, sizeof(path), "%s/test_verify/test", CIO_ENV);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_CHECKSUM);
+    TEST_CHECK(ctx != NULL);
+    cio_set_compression_callback(ctx, rle_compress, rle_uncompress);
+
+    stream = cio_stream_create(ctx, "test_verify", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    chunk = cio_chunk_open(ctx, stream, "test", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL);
+    if (!chunk) {
+        exit(1);
+    }
+
+    ret = cio_meta_write(chunk, "tag.a", 5);
+    TEST_CHECK(ret == 0);
+    ret = cio_chunk_write(chunk, data, sizeof(data));
+    TEST_CHECK(ret == CIO_OK);
+
+    /* regular layout */
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == CIO_OK);
+
+    ret = cio_chunk_verify(chunk, &meta, &meta_len, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(meta_len == 5 && memcmp(meta, "tag.a", 5) == 0);
+    TEST_CHECK(size == CIO_FILE_HEADER_MIN + 5 + sizeof(data));
+    free(meta);
+
+    /* compressed layout reports the uncompressed size */
+    cio_stream_set_compression(stream, 1);
+    cio_chunk_up(chunk);
+    cio_chunk_down(chunk);
+
+    ret = cio_chunk_verify(chunk, &meta, &meta_len, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(meta_len == 5 && memcmp(meta, "tag.a", 5) == 0);
+    TEST_CHECK(size == CIO_FILE_HEADER_MIN + 5 + sizeof(data));
+    free(meta);
+
+    /* corrupt the last byte */
+    fd = open(path, O_WRONLY);
+    TEST_CHECK(fd != -1);
+    TEST_CHECK(pwrite(fd, "x", 1, lseek(fd, 0, SEEK_END) - 1) == 1);
+    close(fd);
+
+    ret = cio_chunk_verify(chunk, &meta, &meta_len, &size);
+    TEST_CHECK(ret == CIO_CORRUPTED);
+
+    cio_destroy(ctx);
+}
+
+/* Chunks at rest are registered from the stream index */
+void test_fs_index()
+{
+    int i;
+    int fd;
+    int ret;
+    int err;
+    int meta_len;
+    char *meta;
+    char *buf;
+    size_t size;
+    char tag[32];
+    char name[32];
+    char data[1024];
+    char path[1024];
+    struct mk_list *head;
+    struct cio_ctx *ctx;
+    struct cio_chunk *chunk;
+    struct cio_stream *stream;
+
+    cio_utils_recursive_delete(CIO_ENV);
+    memset(data, 'a', sizeof(data));
+    snprintf(path, sizeof(path), "%s/test_index/.index", CIO_ENV);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN | CIO_INDEX);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_index", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    for (i = 0; i < 3; i++) {
+        snprintf(name, sizeof(name), "chunk-%i", i);
+        snprintf(tag, sizeof(tag), "tag.%i", i);
+
+        chunk = cio_chunk_open(ctx, stream, name, CIO_OPEN, 1000, &err);
+        TEST_CHECK(chunk != NULL);
+        if (!chunk) {
+            exit(1);
+        }
+        cio_meta_write(chunk, tag, strlen(tag));
+        cio_chunk_write(chunk, data, sizeof(data));
+    }
+
+    /* chunks are closed and registered in the index */
+    cio_destroy(ctx);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN | CIO_INDEX);
+    TEST_CHECK(ctx != NULL);
+    ret = cio_load(ctx, NULL);
+    TEST_CHECK(ret == 0);
+
+    stream = cio_stream_get(ctx, "test_index");
+    TEST_CHECK(stream != NULL);
+    TEST_CHECK(mk_list_size(&stream->chunks) == 3);
+    TEST_CHECK(mk_list_size(&stream->chunks_down) == 3);
+
+    mk_list_foreach(head, &stream->chunks) {
+        chunk = mk_list_entry(head, struct cio_chunk, _head);
+        TEST_CHECK(cio_chunk_get_real_size(chunk) ==
+                   CIO_FILE_HEADER_MIN + 5 + sizeof(data));
+
+        ret = cio_chunk_verify(chunk, &meta, &meta_len, &size);
+        TEST_CHECK(ret == CIO_OK);
+        TEST_CHECK(meta_len == 5 && memcmp(meta, "tag.", 4) == 0);
+        TEST_CHECK(meta[4] == chunk->name[6]);
+        free(meta);
+    }
+
+    /* validated when it's brought up */
+    chunk = mk_list_entry_first(&stream->chunks, struct cio_chunk, _head);
+    ret = cio_chunk_up(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK && size == sizeof(data));
+
+    /* deleted chunk is not registered again */
+    cio_chunk_close(chunk, CIO_TRUE);
+    cio_destroy(ctx);
+
+    /* a torn record at the end of the index is ignored */
+    fd = open(path, O_WRONLY | O_APPEND);
+    TEST_CHECK(fd != -1);
+    TEST_CHECK(write(fd, "garbage-record-tail", 19) == 19);
+    close(fd);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN | CIO_INDEX);
+    TEST_CHECK(ctx != NULL);
+    ret = cio_load(ctx, NULL);
+    TEST_CHECK(ret == 0);
+
+    stream = cio_stream_get(ctx, "test_index");
+    TEST_CHECK(stream != NULL);
+    TEST_CHECK(mk_list_size(&stream->chunks) == 2);
+    TEST_CHECK(mk_list_size(&stream->chunks_down) == 2);
+    cio_destroy(ctx);
+
+    /* without a valid index, chunks are scanned as usual */
+    unlink(path);
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN | CIO_INDEX);
+    TEST_CHECK(ctx != NULL);
+    ret = cio_load(ctx, NULL);
+    TEST_CHECK(ret == 0);
+
+    stream = cio_stream_get(ctx, "test_index");
+    TEST_CHECK(stream != NULL);
+    TEST_CHECK(mk_list_size(&stream->chunks) == 2);
+    TEST_CHECK(mk_list_size(&stream->chunks_up) == 2);
+    cio_destroy(ctx);
+}
+
+/* The index is compacted at runtime as chunks go up and down */
+void test_fs_index_compact()
+{
+    int i;
+    int ret;
+    int err;
+    char data[128];
+    char path[1024];
+    struct stat st;
+    struct cio_ctx *ctx;
+    struct cio_chunk *chunk;
+    struct cio_stream *stream;
+
+    cio_utils_recursive_delete(CIO_ENV);
+    memset(data, 'a', sizeof(data));
+    snprintf(path, sizeof(path), "%s/test_index/.index", CIO_ENV);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN | CIO_INDEX);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_index", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    chunk = cio_chunk_open(ctx, stream, "chunk", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL);
+    if (!chunk) {
+        exit(1);
+    }
+    cio_meta_write(chunk, "tag", 3);
+
+    /* every cycle appends an ADD and a DEL record */
+    for (i = 0; i < CIO_INDEX_COMPACT_MIN; i++) {
+        ret = cio_chunk_write(chunk, data, sizeof(data));
+        TEST_CHECK(ret == 0);
+        ret = cio_chunk_down(chunk);
+        TEST_CHECK(ret == 0);
+        ret = cio_chunk_up_force(chunk);
+        TEST_CHECK(ret == 0);
+    }
+    TEST_CHECK(stream->index_records < CIO_INDEX_COMPACT_MIN);
+
+    ret = cio_chunk_down(chunk);
+    TEST_CHECK(ret == 0);
+
+    ret = stat(path, &st);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(st.st_size < CIO_INDEX_COMPACT_MIN * (CIO_INDEX_REC_HDR + 8));
+    cio_destroy(ctx);
+
+    /* the chunk is registered from the compacted index */
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN | CIO_INDEX);
+    TEST_CHECK(ctx != NULL);
+    ret = cio_load(ctx, NULL);
+    TEST_CHECK(ret == 0);
+
+    stream = cio_stream_get(ctx, "test_index");
+    TEST_CHECK(stream != NULL);
+    TEST_CHECK(mk_list_size(&stream->chunks_down) == 1);
+
+    chunk = mk_list_entry_first(&stream->chunks, struct cio_chunk, _head);
+    TEST_CHECK(cio_chunk_get_real_size(chunk) ==
+               CIO_FILE_HEADER_MIN + 3 + CIO_INDEX_COMPACT_MIN * sizeof(data));
+    cio_destroy(ctx);
+}
+
+/*
+ * Append to a chunk that goes down and up between every write: the data
+ * written after the end of the file (in the last mapped page) must not be
+ * lost when the file grows.
+ */
+static void test_fs_up_down_write()
+{
+    int i;
+    int ret;
+    int err;
+    char *buf;
+    size_t size;
+    char data[26];
+    struct cio_ctx *ctx;
+    struct cio_stream *stream;
+    struct cio_chunk *chunk;
+
+    memset(data, 'x', sizeof(data));
+
+    cio_utils_recursive_delete(CIO_ENV);
+
+    ctx = cio_create(CIO_ENV, log_cb, CIO_LOG_INFO, CIO_OPEN);
+    TEST_CHECK(ctx != NULL);
+
+    stream = cio_stream_create(ctx, "test_up_down_write", CIO_STORE_FS);
+    TEST_CHECK(stream != NULL);
+
+    chunk = cio_chunk_open(ctx, stream, "test", CIO_OPEN, 1000, &err);
+    TEST_CHECK(chunk != NULL);
+    ret = cio_meta_write(chunk, "tag", 3);
+    TEST_CHECK(ret == CIO_OK);
+
+    for (i = 0; i < 100; i++) {
+        if (cio_chunk_is_up(chunk) == CIO_FALSE) {
+            ret = cio_chunk_up_force(chunk);
+            TEST_CHECK(ret == CIO_OK);
+        }
+        ret = cio_chunk_write(chunk, data, sizeof(data));
+        TEST_CHECK(ret == CIO_OK);
+        ret = cio_chunk_down(chunk);
+        TEST_CHECK(ret == CIO_OK);
+    }
+
+    ret = cio_chunk_up(chunk);
+    TEST_CHECK(ret == CIO_OK);
+    ret = cio_chunk_get_content(chunk, &buf, &size);
+    TEST_CHECK(ret == CIO_OK);
+    TEST_CHECK(size == sizeof(data) * 100);
+    for (i = 0; i < size; i++) {
+        if (buf[i] != 'x') {
+            break;
+        }
+    }
+    TEST_CHECK(i == size);
+
+    cio_destroy(ctx);
+}
+
 TEST_LIST = {
     {"fs_write",   test_fs_write},
     {"fs_checksum",  test_fs_checksum},
@@ -668,5 +1250,12 @@ TEST_LIST = {
     {"issue_51",   test_issue_51},
     {"issue_flb_2025", test_issue_flb_2025},
     {"issue_write_at", test_issue_write_at},
+    {"fs_async", test_fs_async},
+    {"fs_group_sync", test_fs_group_sync},
+    {"fs_compress", test_fs_compress},
+    {"fs_verify", test_fs_verify},
+    {"fs_index", test_fs_index},
+    {"fs_index_compact", test_fs_index_compact},
+    {"fs_up_down_write", test_fs_up_down_write},
     { 0 }
 };
@@ -200,28 +200,14 @@ struct throttle_size_table *create_throttle_size_table(size_t size)
 
 void destroy_throttle_size_table(struct throttle_size_table *ht)
 {
-    int i;
-    struct mk_list *tmp;
-    struct mk_list *head;
+    struct flb_hash_entry *tmp;
     struct flb_hash_entry *entry;
-    struct flb_hash_table *table;
-
-    for (i = 0; i < ht->windows->size; i++) {
-        table = &ht->windows->table[i];
-        mk_list_foreach_safe(head, tmp, &table->chains) {
-            entry = mk_list_entry(head, struct flb_hash_entry, _head);
-            free_stw_content((struct throttle_size_window *) entry->val);
-            mk_list_del(&entry->_head);
-            mk_list_del(&entry->_head_parent);
-            entry->table->count--;
-            ht->windows->total_count--;
-            flb_free(entry->key);
-            flb_free(entry->val);
-            flb_free(entry);
-        }
+
+    /* the hash table owns the windows, only their content is freed here */
+    flb_hash_foreach(entry, tmp, ht->windows) {
+        free_stw_content((struct throttle_size_window *) entry->val);
     }
     destroy_throttle_size_table_lock(ht);
-    flb_free(ht->windows->table);
-    flb_free(ht->windows);
+    flb_hash_destroy(ht->windows);
     flb_free(ht);
 }
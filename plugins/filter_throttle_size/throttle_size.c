@@ -81,7 +81,7 @@ static bool apply_suffix(double *x, char suffix_char)
 inline static void add_new_pane_to_each(struct throttle_size_table *ht,
                                         double timestamp)
 {
-    struct mk_list *head;
+    struct flb_hash_entry *tmp;
     struct flb_hash_entry *entry;
     struct throttle_size_window *current_window;
     struct flb_time ftm;
@@ -91,8 +91,7 @@ inline static void add_new_pane_to_each(struct throttle_size_table *ht,
         timestamp = flb_time_to_double(&ftm);
     }
 
-    mk_list_foreach(head, &ht->windows->entries) {
-        entry = mk_list_entry(head, struct flb_hash_entry, _head_parent);
+    flb_hash_foreach(entry, tmp, ht->windows) {
         current_window = (struct throttle_size_window *) (entry->val);
         add_new_pane(current_window, timestamp);
         flb_debug
@@ -107,11 +106,8 @@ inline static void delete_older_than_n_seconds(struct throttle_size_table *ht,
                                                long seconds,
                                                double current_timestamp)
 {
-    int i;
-    struct mk_list *tmp;
-    struct mk_list *head;
+    struct flb_hash_entry *tmp;
     struct flb_hash_entry *entry;
-    struct flb_hash_table *table;
     struct throttle_size_window *current_window;
     struct flb_time ftm;
     long time_treshold;
@@ -122,39 +118,28 @@ inline static void delete_older_than_n_seconds(struct throttle_size_table *ht,
     }
 
     time_treshold = current_timestamp - seconds;
-    for (i = 0; i < ht->windows->size; i++) {
-        table = &ht->windows->table[i];
-        mk_list_foreach_safe(head, tmp, &table->chains) {
-            entry = mk_list_entry(head, struct flb_hash_entry, _head);
-            current_window = (struct throttle_size_window *) entry->val;
-
-            if (time_treshold > current_window->timestamp) {
-                free_stw_content(current_window);
-                mk_list_del(&entry->_head);
-                mk_list_del(&entry->_head_parent);
-                entry->table->count--;
-                ht->windows->total_count--;
-                flb_free(entry->key);
-                flb_free(entry->val);
-                flb_free(entry);
-                flb_info
-                    ("[%s] Window \"%s\" was deleted. CT%ld   TT%ld   T%ld  ",
-                     PLUGIN_NAME, current_window->name,
-                     (long) current_timestamp, time_treshold,
-                     current_window->timestamp);
-            }
+    flb_hash_foreach(entry, tmp, ht->windows) {
+        current_window = (struct throttle_size_window *) entry->val;
+
+        if (time_treshold > current_window->timestamp) {
+            flb_info
+                ("[%s] Window \"%s\" was deleted. CT%ld   TT%ld   T%ld  ",
+                 PLUGIN_NAME, current_window->name,
+                 (long) current_timestamp, time_treshold,
+                 current_window->timestamp);
+            free_stw_content(current_window);
+            flb_hash_del_entry(ht->windows, entry);
         }
     }
 }
 
 inline static void print_all(struct throttle_size_table *ht)
 {
-    struct mk_list *head;
+    struct flb_hash_entry *tmp;
     struct flb_hash_entry *entry;
     struct throttle_size_window *current_window;
 
-    mk_list_foreach(head, &ht->windows->entries) {
-        entry = mk_list_entry(head, struct flb_hash_entry, _head_parent);
+    flb_hash_foreach(entry, tmp, ht->windows) {
         current_window = (struct throttle_size_window *) entry->val;
         printf("[%s] Name %s\n", PLUGIN_NAME, current_window->name);
         printf("[%s] Timestamp %ld\n", PLUGIN_NAME,
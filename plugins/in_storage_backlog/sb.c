@@ -23,6 +23,7 @@
 #include <fluent-bit/flb_input_chunk.h>
 #include <fluent-bit/flb_storage.h>
 #include <fluent-bit/flb_utils.h>
+#include <fluent-bit/flb_worker.h>
 #include <chunkio/chunkio.h>
 
 #include <sys/types.h>
@@ -45,12 +46,41 @@ struct sb_out_queue {
     struct mk_list              _head;
 };
 
+/* Chunk found in the storage path, checked by the scan workers */
+struct sb_scan_chunk {
+    struct cio_chunk  *chunk;
+    char              *tag;
+    int                tag_len;
+    size_t             size;
+    int                status;
+};
+
+struct sb_scan {
+    int                   workers;
+    size_t                count;
+    struct sb_scan_chunk *chunks;
+};
+
+struct sb_scan_worker {
+    int             id;
+    struct sb_scan *scan;
+};
+
 struct flb_sb {
     int coll_fd;                    /* collector id */
     size_t mem_limit;               /* memory limit */
+    int workers;                    /* number of scan threads */
+    int ratio;                      /* backlog share of the data in flight (%) */
     struct flb_input_instance *ins; /* input instance */
     struct cio_ctx *cio;            /* chunk i/o instance */
     struct mk_list backlogs;        /* list of all pending chunks segregated by output plugin */
+
+    /* replay progress */
+    time_t start;                   /* time the backlog was registered */
+    uint64_t chunks_total;          /* chunks registered */
+    uint64_t bytes_total;           /* bytes registered */
+    uint64_t chunks_pending;        /* chunks not queued yet */
+    uint64_t bytes_pending;         /* bytes not queued yet */
 };
 
 
@@ -72,9 +102,9 @@ static struct sb_out_queue *sb_find_segregated_backlog_by_output_plugin_instance
                                 struct flb_output_instance *output_plugin,
                                 struct flb_sb              *context);
 
-static void sb_remove_chunk_from_segregated_backlog(struct cio_chunk    *target_chunk,
-                                                    struct sb_out_queue *backlog,
-                                                    int                  destroy);
+static ssize_t sb_remove_chunk_from_segregated_backlog(struct cio_chunk    *target_chunk,
+                                                       struct sb_out_queue *backlog,
+                                                       int                  destroy);
 
 static void sb_remove_chunk_from_segregated_backlogs(struct cio_chunk *chunk,
                                                      struct flb_sb    *context);
@@ -86,6 +116,9 @@ static int sb_append_chunk_to_segregated_backlog(struct cio_chunk    *target_chu
 
 static int sb_append_chunk_to_segregated_backlogs(struct cio_chunk  *target_chunk,
                                                   struct cio_stream *stream,
+                                                  const char        *tag_buf,
+                                                  int                tag_len,
+                                                  size_t             chunk_size,
                                                   struct flb_sb     *context);
 
 int sb_segregate_chunks(struct flb_config *config);
@@ -96,6 +129,8 @@ int sb_release_output_queue_space(struct flb_output_instance *output_plugin,
 ssize_t sb_get_releasable_output_queue_space(struct flb_output_instance *output_plugin,
                                              size_t                      required_space);
 
+int sb_get_progress(struct flb_config *config, struct flb_storage_backlog *progress);
+
 
 static inline struct flb_sb *sb_get_context(struct flb_config *config)
 {
@@ -210,13 +245,15 @@ static struct sb_out_queue *sb_find_segregated_backlog_by_output_plugin_instance
     return NULL;
 }
 
-static void sb_remove_chunk_from_segregated_backlog(struct cio_chunk    *target_chunk,
-                                                    struct sb_out_queue *backlog,
-                                                    int                  destroy)
+/* Returns the size of the removed chunk, or -1 if it was not in the backlog */
+static ssize_t sb_remove_chunk_from_segregated_backlog(struct cio_chunk    *target_chunk,
+                                                       struct sb_out_queue *backlog,
+                                                       int                  destroy)
 {
     struct mk_list      *chunk_iterator_tmp;
     struct mk_list      *chunk_iterator;
     struct sb_out_chunk *chunk;
+    ssize_t              size;
 
     mk_list_foreach_safe(chunk_iterator, chunk_iterator_tmp, &backlog->chunks) {
         chunk = mk_list_entry(chunk_iterator, struct sb_out_chunk, _head);
@@ -224,15 +261,18 @@ static void sb_remove_chunk_from_segregated_backlog(struct cio_chunk    *target_
         if (chunk->chunk == target_chunk) {
             mk_list_del(&chunk->_head);
 
-            backlog->ins->fs_backlog_chunks_size -= cio_chunk_get_real_size(target_chunk);
+            backlog->ins->fs_backlog_chunks_size -= chunk->size;
+            size = chunk->size;
 
             if (destroy) {
                 sb_destroy_chunk(chunk);
             }
 
-            break;
+            return size;
         }
     }
+
+    return -1;
 }
 
 static void sb_remove_chunk_from_segregated_backlogs(struct cio_chunk *target_chunk,
@@ -240,11 +280,25 @@ static void sb_remove_chunk_from_segregated_backlogs(struct cio_chunk *target_ch
 {
     struct mk_list      *backlog_iterator;
     struct sb_out_queue *backlog;
+    ssize_t              size;
+    ssize_t              removed;
+
+    removed = -1;
 
     mk_list_foreach(backlog_iterator, &context->backlogs) {
         backlog = mk_list_entry(backlog_iterator, struct sb_out_queue, _head);
 
-        sb_remove_chunk_from_segregated_backlog(target_chunk, backlog, FLB_TRUE);
+        size = sb_remove_chunk_from_segregated_backlog(target_chunk, backlog, FLB_TRUE);
+
+        if (size >= 0) {
+            removed = size;
+        }
+    }
+
+    /* the chunk is not pending anymore */
+    if (removed >= 0) {
+        context->chunks_pending--;
+        context->bytes_pending -= removed;
     }
 }
 
@@ -271,64 +325,196 @@ static int sb_append_chunk_to_segregated_backlog(struct cio_chunk    *target_chu
 
 static int sb_append_chunk_to_segregated_backlogs(struct cio_chunk  *target_chunk,
                                                   struct cio_stream *stream,
+                                                  const char        *tag_buf,
+                                                  int                tag_len,
+                                                  size_t             chunk_size,
                                                   struct flb_sb     *context)
 {
-    struct flb_input_chunk  dummy_input_chunk;
+    uint64_t               *routes_mask;
     struct mk_list         *backlog_iterator;
-    size_t                  chunk_size;
     struct sb_out_queue    *backlog;
-    int                     tag_len;
-    const char *            tag_buf;
+    int                     appended;
     int                     result;
 
-    memset(&dummy_input_chunk, 0, sizeof(struct flb_input_chunk));
-
-    dummy_input_chunk.in    = context->ins;
-    dummy_input_chunk.chunk = target_chunk;
-
-    chunk_size = cio_chunk_get_real_size(target_chunk);
-
-    if (chunk_size < 0) {
-        flb_warn("[storage backlog] could not retrieve chunk real size");
-
-        return -1;
-    }
-
-    result = flb_input_chunk_get_tag(&dummy_input_chunk, &tag_buf, &tag_len);
+    appended = FLB_FALSE;
 
-    if (result == -1) {
-        flb_error("[storage backlog] could not retrieve chunk tag");
+    routes_mask = flb_calloc(1, flb_routes_mask_bytes(context->ins->config));
+    if (!routes_mask) {
+        flb_errno();
 
-        return -2;
+        return -3;
     }
 
-    flb_routes_mask_set_by_tag(dummy_input_chunk.routes_mask, tag_buf, tag_len,
-                               context->ins);
+    flb_routes_mask_set_by_tag(routes_mask, tag_buf, tag_len, context->ins);
 
     mk_list_foreach(backlog_iterator, &context->backlogs) {
         backlog = mk_list_entry(backlog_iterator, struct sb_out_queue, _head);
 
-        if (flb_routes_mask_get_bit(dummy_input_chunk.routes_mask,
-                                    backlog->ins->id)) {
+        if (flb_routes_mask_get_bit(routes_mask, backlog->ins->id,
+                                    context->ins->config)) {
             result = sb_append_chunk_to_segregated_backlog(target_chunk, stream,
                                                            chunk_size, backlog);
             if (result) {
+                flb_free(routes_mask);
+
                 return -3;
             }
+
+            appended = FLB_TRUE;
+        }
+    }
+
+    flb_free(routes_mask);
+
+    if (appended) {
+        context->chunks_total++;
+        context->bytes_total += chunk_size;
+        context->chunks_pending++;
+        context->bytes_pending += chunk_size;
+    }
+
+    return 0;
+}
+
+/*
+ * Scan worker: validate a share of the chunks and read their tag and size
+ * from the file system, chunks are not brought up.
+ */
+static void sb_scan_worker(void *data)
+{
+    size_t                 index;
+    struct sb_scan_chunk  *entry;
+    struct sb_scan_worker *worker;
+
+    worker = (struct sb_scan_worker *) data;
+
+    for (index = worker->id ;
+         index < worker->scan->count ;
+         index += worker->scan->workers) {
+        entry = &worker->scan->chunks[index];
+
+        entry->status = cio_chunk_verify(entry->chunk, &entry->tag,
+                                         &entry->tag_len, &entry->size);
+    }
+}
+
+static int sb_scan_chunks(struct sb_scan *scan, struct flb_config *config)
+{
+    int                    index;
+    int                    result;
+    int                    spawned;
+    pthread_t             *tids;
+    struct sb_scan_worker *workers;
+
+    if (scan->workers <= 1) {
+        scan->workers = 1;
+    }
+    else if (scan->workers > scan->count) {
+        scan->workers = scan->count;
+    }
+
+    workers = flb_calloc(scan->workers, sizeof(struct sb_scan_worker));
+
+    if (workers == NULL) {
+        flb_errno();
+        return -1;
+    }
+
+    tids = flb_calloc(scan->workers, sizeof(pthread_t));
+
+    if (tids == NULL) {
+        flb_errno();
+        flb_free(workers);
+        return -1;
+    }
+
+    for (index = 0 ; index < scan->workers ; index++) {
+        workers[index].id = index;
+        workers[index].scan = scan;
+    }
+
+    /* the calling thread takes care of the first share */
+    spawned = 0;
+
+    for (index = 1 ; index < scan->workers ; index++) {
+        result = flb_worker_create(sb_scan_worker, &workers[index],
+                                   &tids[index], config);
+        if (result == -1) {
+            break;
         }
+
+        spawned++;
     }
 
+    /* shares of workers that could not be spawned are scanned here */
+    for (index = spawned + 1 ; index < scan->workers ; index++) {
+        sb_scan_worker(&workers[index]);
+    }
+
+    sb_scan_worker(&workers[0]);
+
+    for (index = 1 ; index <= spawned ; index++) {
+        pthread_join(tids[index], NULL);
+    }
+
+    flb_free(tids);
+    flb_free(workers);
+
     return 0;
 }
 
+/*
+ * Chunks that could not be verified from the file system are brought up
+ * to read their tag, as it was done before the scan workers.
+ */
+static void sb_scan_chunk_up(struct sb_scan_chunk *entry)
+{
+    int   result;
+    int   tag_len;
+    char *tag_buf;
+
+    if (!cio_chunk_is_up(entry->chunk)) {
+        cio_chunk_up_force(entry->chunk);
+    }
+
+    if (!cio_chunk_is_up(entry->chunk)) {
+        entry->status = CIO_CORRUPTED;
+        return;
+    }
+
+    result = cio_meta_read(entry->chunk, &tag_buf, &tag_len);
+
+    if (result == -1) {
+        entry->status = CIO_CORRUPTED;
+        return;
+    }
+
+    /* released with free(3), as the tags returned by chunkio */
+    entry->tag = malloc(tag_len + 1);
+
+    if (entry->tag == NULL) {
+        flb_errno();
+        return;
+    }
+
+    memcpy(entry->tag, tag_buf, tag_len);
+    entry->tag_len = tag_len;
+    entry->size    = cio_chunk_get_real_size(entry->chunk);
+    entry->status  = CIO_OK;
+}
+
 int sb_segregate_chunks(struct flb_config *config)
 {
-    struct mk_list    *stream_iterator;
-    struct mk_list    *chunk_iterator;
-    struct flb_sb     *context;
-    int                result;
-    struct cio_stream *stream;
-    struct cio_chunk  *chunk;
+    struct mk_list       *stream_iterator;
+    struct mk_list       *chunk_iterator;
+    struct cio_chunk    **chunks;
+    struct sb_scan_chunk *entry;
+    struct flb_sb        *context;
+    struct sb_scan        scan;
+    int                   result;
+    size_t                index;
+    struct cio_stream    *stream;
+    struct cio_chunk     *chunk;
 
     context = sb_get_context(config);
 
@@ -342,36 +528,128 @@ int sb_segregate_chunks(struct flb_config *config)
         return -2;
     }
 
+    context->start = time(NULL);
+
+    scan.count = 0;
+
+    mk_list_foreach(stream_iterator, &context->cio->streams) {
+        stream = mk_list_entry(stream_iterator, struct cio_stream, _head);
+
+        scan.count += mk_list_size(&stream->chunks);
+    }
+
+    if (scan.count == 0) {
+        return 0;
+    }
+
+    /* replay the chunks of every stream by age */
+    chunks = flb_calloc(scan.count, sizeof(struct cio_chunk *));
+
+    if (chunks == NULL) {
+        flb_errno();
+        return -3;
+    }
+
+    index = 0;
+
     mk_list_foreach(stream_iterator, &context->cio->streams) {
         stream = mk_list_entry(stream_iterator, struct cio_stream, _head);
 
         mk_list_foreach(chunk_iterator, &stream->chunks) {
-            chunk = mk_list_entry(chunk_iterator, struct cio_chunk, _head);
+            chunks[index++] = mk_list_entry(chunk_iterator, struct cio_chunk, _head);
+        }
+    }
 
-            if (!cio_chunk_is_up(chunk)) {
-                cio_chunk_up_force(chunk);
-            }
+    qsort(chunks, scan.count, sizeof(struct cio_chunk *), flb_storage_chunk_cmp);
 
-            if (!cio_chunk_is_up(chunk)) {
-                return -3;
-            }
+    scan.chunks = flb_calloc(scan.count, sizeof(struct sb_scan_chunk));
+
+    if (scan.chunks == NULL) {
+        flb_errno();
+        flb_free(chunks);
+        return -3;
+    }
+
+    for (index = 0 ; index < scan.count ; index++) {
+        scan.chunks[index].chunk  = chunks[index];
+        scan.chunks[index].status = CIO_ERROR;
+    }
 
-            result = sb_append_chunk_to_segregated_backlogs(chunk, stream, context);
+    flb_free(chunks);
 
-            if (result) {
-                flb_error("[storage backlog] error distributing chunk references");
-                return -4;
-            }
+    scan.workers = context->workers;
 
-            /* lock the chunk */
-            flb_plg_info(context->ins, "register %s/%s", stream->name, chunk->name);
+    result = sb_scan_chunks(&scan, config);
 
-            cio_chunk_lock(chunk);
+    if (result) {
+        flb_free(scan.chunks);
+        return -3;
+    }
+
+    flb_plg_info(context->ins, "%zu chunks scanned by %i workers",
+                 scan.count, scan.workers);
+
+    result = 0;
+
+    for (index = 0 ; index < scan.count ; index++) {
+        entry = &scan.chunks[index];
+        chunk = entry->chunk;
+        stream = chunk->st;
+
+        if (result) {
+            free(entry->tag);
+            continue;
+        }
+
+        if (entry->status == CIO_ERROR) {
+            sb_scan_chunk_up(entry);
+        }
+
+        if (entry->status == CIO_CORRUPTED) {
+            flb_plg_error(context->ins, "removing corrupted chunk %s:%s",
+                          stream->name, chunk->name);
+            cio_chunk_close(chunk, FLB_FALSE);
+            continue;
+        }
+        else if (entry->status != CIO_OK) {
+            flb_plg_error(context->ins, "could not read chunk %s:%s",
+                          stream->name, chunk->name);
+            continue;
+        }
+
+        if (entry->size == 0) {
+            flb_plg_error(context->ins, "removing empty chunk %s:%s",
+                          stream->name, chunk->name);
+            cio_chunk_close(chunk, FLB_TRUE);
+            continue;
+        }
+
+        result = sb_append_chunk_to_segregated_backlogs(chunk, stream,
+                                                        entry->tag,
+                                                        entry->tag_len,
+                                                        entry->size,
+                                                        context);
+        free(entry->tag);
+
+        if (result) {
+            flb_error("[storage backlog] error distributing chunk references");
+            result = -4;
+            continue;
+        }
+
+        /* lock the chunk */
+        flb_plg_info(context->ins, "register %s/%s", stream->name, chunk->name);
+
+        cio_chunk_lock(chunk);
+
+        if (cio_chunk_is_up(chunk)) {
             cio_chunk_down(chunk);
         }
     }
 
-    return 0;
+    flb_free(scan.chunks);
+
+    return result;
 }
 
 ssize_t sb_get_releasable_output_queue_space(struct flb_output_instance *output_plugin,
@@ -458,6 +736,102 @@ int sb_release_output_queue_space(struct flb_output_instance *output_plugin,
     return 0;
 }
 
+/* Replay progress, it returns -1 if there is no backlog instance */
+int sb_get_progress(struct flb_config *config, struct flb_storage_backlog *progress)
+{
+    struct mk_list         *head;
+    struct flb_input_chunk *ic;
+    struct flb_sb          *context;
+    uint64_t                done;
+    time_t                  elapsed;
+    ssize_t                 size;
+
+    context = sb_get_context(config);
+
+    if (context == NULL) {
+        return -1;
+    }
+
+    progress->chunks_total     = context->chunks_total;
+    progress->bytes_total      = context->bytes_total;
+    progress->chunks_remaining = context->chunks_pending;
+    progress->bytes_remaining  = context->bytes_pending;
+
+    /* chunks queued into the engine but not delivered yet */
+    mk_list_foreach(head, &context->ins->chunks) {
+        ic = mk_list_entry(head, struct flb_input_chunk, _head);
+
+        size = cio_chunk_get_real_size(ic->chunk);
+
+        progress->chunks_remaining++;
+
+        if (size > 0) {
+            progress->bytes_remaining += size;
+        }
+    }
+
+    if (progress->bytes_remaining > progress->bytes_total) {
+        progress->bytes_remaining = progress->bytes_total;
+    }
+
+    /* estimate based on the average drain rate since the start */
+    done = progress->bytes_total - progress->bytes_remaining;
+    elapsed = time(NULL) - context->start;
+
+    if (progress->bytes_remaining == 0) {
+        progress->eta = 0;
+    }
+    else if (done == 0 || elapsed <= 0) {
+        progress->eta = -1;
+    }
+    else {
+        progress->eta = (progress->bytes_remaining * elapsed) / done;
+    }
+
+    return 0;
+}
+
+/*
+ * Number of bytes the backlog can have in the engine: while other inputs
+ * have data in memory the backlog is limited to 'storage.backlog.ratio'
+ * percent of the data in flight.
+ */
+static size_t sb_get_queue_limit(struct flb_sb *ctx, struct flb_config *config)
+{
+    struct mk_list            *head;
+    struct flb_input_instance *in;
+    size_t                     live;
+    size_t                     limit;
+
+    if (ctx->ratio >= 100) {
+        return ctx->mem_limit;
+    }
+
+    live = 0;
+
+    mk_list_foreach(head, &config->inputs) {
+        in = mk_list_entry(head, struct flb_input_instance, _head);
+
+        if (in == ctx->ins || in->storage == NULL) {
+            continue;
+        }
+
+        live += flb_input_chunk_total_size(in);
+    }
+
+    if (live == 0) {
+        return ctx->mem_limit;
+    }
+
+    limit = (live * ctx->ratio) / (100 - ctx->ratio);
+
+    if (limit > ctx->mem_limit) {
+        return ctx->mem_limit;
+    }
+
+    return limit;
+}
+
 /* Collection callback */
 static int cb_queue_chunks(struct flb_input_instance *in,
                            struct flb_config *config, void *data)
@@ -470,6 +844,7 @@ static int cb_queue_chunks(struct flb_input_instance *in,
     struct flb_input_chunk *ic;
     void                   *ch;
     size_t                  total = 0;
+    size_t                  limit;
     ssize_t                 size;
     int                     ret;
 
@@ -479,14 +854,17 @@ static int cb_queue_chunks(struct flb_input_instance *in,
     /* Get the total number of bytes already enqueued */
     total = flb_input_chunk_total_size(in);
 
+    /* Share of the data in flight available for the backlog */
+    limit = sb_get_queue_limit(ctx, config);
+
     /* If we already hitted our limit, just wait and re-check later */
-    if (total >= ctx->mem_limit) {
+    if (total >= limit) {
         return 0;
     }
 
     empty_output_queue_count = 0;
 
-    while (total < ctx->mem_limit &&
+    while (total < limit &&
            empty_output_queue_count < mk_list_size(&ctx->backlogs)) {
         empty_output_queue_count = 0;
 
@@ -589,7 +967,7 @@ static int cb_sb_init(struct flb_input_instance *in,
     char mem[32];
     struct flb_sb *ctx;
 
-    ctx = flb_malloc(sizeof(struct flb_sb));
+    ctx = flb_calloc(1, sizeof(struct flb_sb));
     if (!ctx) {
         flb_errno();
         return -1;
@@ -598,12 +976,19 @@ static int cb_sb_init(struct flb_input_instance *in,
     ctx->cio = data;
     ctx->ins = in;
     ctx->mem_limit = flb_utils_size_to_bytes(config->storage_bl_mem_limit);
+    ctx->workers = config->storage_bl_workers;
+    ctx->ratio = config->storage_bl_ratio;
 
     mk_list_init(&ctx->backlogs);
 
     flb_utils_bytes_to_human_readable_size(ctx->mem_limit, mem, sizeof(mem) - 1);
     flb_plg_info(ctx->ins, "queue memory limit: %s", mem);
 
+    if (ctx->ratio < 100) {
+        flb_plg_info(ctx->ins, "backlog share of the data in flight: %i%%",
+                     ctx->ratio);
+    }
+
     /* export plugin context */
     flb_input_set_context(in, ctx);
 
@@ -42,6 +42,7 @@
 #include "tail_config.h"
 #include "tail_dockermode.h"
 #include "tail_multiline.h"
+#include "tail_worker.h"
 
 static inline int consume_byte(flb_pipefd_t fd)
 {
@@ -74,6 +75,14 @@ static int in_tail_collect_pending(struct flb_input_instance *ins,
     mk_list_foreach_safe(head, tmp, &ctx->files_event) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
 
+        /*
+         * Worker threads: a busy file is dispatched again when it's handed
+         * back with pending bytes.
+         */
+        if (file->worker_busy == FLB_TRUE) {
+            continue;
+        }
+
         /* Gather current file size */
         ret = fstat(file->fd, &st);
         if (ret == -1) {
@@ -88,6 +97,11 @@ static int in_tail_collect_pending(struct flb_input_instance *ins,
             continue;
         }
 
+        if (ctx->workers > 0) {
+            flb_tail_worker_dispatch(file);
+            continue;
+        }
+
         ret = flb_tail_file_chunk(file);
         switch (ret) {
         case FLB_TAIL_ERROR:
@@ -133,6 +147,23 @@ static int in_tail_collect_static(struct flb_input_instance *ins,
     struct flb_tail_config *ctx = in_context;
     struct flb_tail_file *file;
 
+    /*
+     * Worker threads: hand every idle file to its worker. Processed files
+     * come back through flb_tail_worker_collect(), which signals the
+     * manager again while static files remain.
+     */
+    if (ctx->workers > 0) {
+        mk_list_foreach(head, &ctx->files_static) {
+            file = mk_list_entry(head, struct flb_tail_file, _head);
+            if (file->worker_busy == FLB_FALSE) {
+                flb_tail_worker_dispatch(file);
+            }
+        }
+        consume_byte(ctx->ch_manager[0]);
+        ctx->ch_reads++;
+        return 0;
+    }
+
     /* Do a data chunk collection for each file */
     mk_list_foreach_safe(head, tmp, &ctx->files_static) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
@@ -233,6 +264,10 @@ static int in_tail_watcher_callback(struct flb_input_instance *ins,
 
     mk_list_foreach_safe(head, tmp, &ctx->files_event) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
+        if (file->worker_busy == FLB_TRUE) {
+            /* owned by a worker thread, check it in the next round */
+            continue;
+        }
         if (file->is_link == FLB_TRUE) {
             ret = flb_tail_file_is_rotated(ctx, file);
             if (ret == FLB_FALSE) {
@@ -258,6 +293,12 @@ int in_tail_collect_event(void *file, struct flb_config *config)
         return 0;
     }
 
+    /* Worker threads: the file is read by its worker */
+    if (f->config->workers > 0) {
+        flb_tail_worker_dispatch(f);
+        return 0;
+    }
+
     ret = flb_tail_file_chunk(f);
     switch (ret) {
     case FLB_TAIL_ERROR:
@@ -293,6 +334,15 @@ static int in_tail_init(struct flb_input_instance *in,
         return -1;
     }
 
+    /* Spawn workers: files are assigned to them when they are appended */
+    if (ctx->workers > 0) {
+        ret = flb_tail_worker_create_all(ctx, config);
+        if (ret == -1) {
+            flb_tail_config_destroy(ctx);
+            return -1;
+        }
+    }
+
     /* Scan path */
     flb_tail_scan(ctx->path_list, ctx);
 
@@ -316,6 +366,33 @@ static int in_tail_init(struct flb_input_instance *in,
     }
     ctx->coll_fd_static = ret;
 
+    /* Register the collector of files processed by the workers */
+    if (ctx->workers > 0) {
+        ret = flb_input_set_collector_event(in, flb_tail_worker_collect,
+                                            ctx->ch_workers[0], config);
+        if (ret == -1) {
+            flb_tail_config_destroy(ctx);
+            return -1;
+        }
+        ctx->coll_fd_workers = ret;
+
+#ifdef FLB_HAVE_PARSER
+        /* Multiline core: flush the streams of the workers */
+        if (ctx->ml_ctx) {
+            ret = flb_input_set_collector_time(in, flb_tail_worker_ml_flush,
+                                               ctx->ml_ctx->flush_ms / 1000,
+                                               (ctx->ml_ctx->flush_ms % 1000) *
+                                               1000000,
+                                               config);
+            if (ret == -1) {
+                flb_tail_config_destroy(ctx);
+                return -1;
+            }
+            ctx->coll_fd_workers_ml = ret;
+        }
+#endif
+    }
+
     /* Register re-scan: time managed by 'refresh_interval' property */
     ret = flb_input_set_collector_time(in, flb_tail_scan_callback,
                                        ctx->refresh_interval_sec,
@@ -347,6 +424,20 @@ static int in_tail_init(struct flb_input_instance *in,
     }
     ctx->coll_fd_rotated = ret;
 
+#ifdef FLB_HAVE_SQLDB
+    /* Register callback to commit the database offsets journal */
+    if (ctx->db && ctx->db_commit_interval > 0) {
+        ret = flb_input_set_collector_time(in, flb_tail_db_commit_callback,
+                                           ctx->db_commit_interval, 0,
+                                           config);
+        if (ret == -1) {
+            flb_tail_config_destroy(ctx);
+            return -1;
+        }
+        ctx->coll_fd_db_commit = ret;
+    }
+#endif
+
     /* Register callback to process pending bytes in promoted files */
     ret = flb_input_set_collector_event(in, in_tail_collect_pending,
                                         ctx->ch_pending[0], config);//1, 0, config);
@@ -409,6 +500,9 @@ static int in_tail_exit(void *data, struct flb_config *config)
     (void) *config;
     struct flb_tail_config *ctx = data;
 
+    /* Take back the files owned by worker threads */
+    flb_tail_worker_stop_all(ctx);
+
     flb_tail_file_remove_all(ctx);
     flb_tail_fs_exit(ctx);
     flb_tail_config_destroy(ctx);
@@ -424,10 +518,15 @@ static void in_tail_pause(void *data, struct flb_config *config)
      * Pause general collectors:
      *
      * - static : static files lookup before promotion
+     * - workers: files handed back by the worker threads
      */
     flb_input_collector_pause(ctx->coll_fd_static, ctx->ins);
     flb_input_collector_pause(ctx->coll_fd_pending, ctx->ins);
 
+    if (ctx->workers > 0) {
+        flb_input_collector_pause(ctx->coll_fd_workers, ctx->ins);
+    }
+
     if (ctx->docker_mode == FLB_TRUE) {
         flb_input_collector_pause(ctx->coll_fd_dmode_flush, ctx->ins);
         if (config->is_ingestion_active == FLB_FALSE) {
@@ -455,6 +554,10 @@ static void in_tail_resume(void *data, struct flb_config *config)
     flb_input_collector_resume(ctx->coll_fd_static, ctx->ins);
     flb_input_collector_resume(ctx->coll_fd_pending, ctx->ins);
 
+    if (ctx->workers > 0) {
+        flb_input_collector_resume(ctx->coll_fd_workers, ctx->ins);
+    }
+
     if (ctx->docker_mode == FLB_TRUE) {
         flb_input_collector_resume(ctx->coll_fd_dmode_flush, ctx->ins);
     }
@@ -561,6 +664,26 @@ static struct flb_config_map config_map[] = {
      "restrict how much the memory buffer can grow. If reading a file exceed "
      "this limit, the file is removed from the monitored file list."
     },
+    {
+     FLB_CONFIG_MAP_STR, "read_mode", "read",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, read_mode_str),
+     "set how the content of the files is consumed: 'read' copies the data "
+     "into the file buffer, 'mmap' maps the pending content of static files "
+     "(files being read from an old position, e.g: on catch-up) and parse "
+     "the lines in place."
+    },
+    {
+     FLB_CONFIG_MAP_SIZE, "mmap_window_size", FLB_TAIL_MMAP_WINDOW,
+     0, FLB_TRUE, offsetof(struct flb_tail_config, mmap_window_size),
+     "set the maximum number of bytes mapped at once when 'read_mode' is "
+     "'mmap'."
+    },
+    {
+     FLB_CONFIG_MAP_INT, "workers", "0",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, workers),
+     "set the number of worker threads used to read, parse and pack the "
+     "content of the files, files are assigned to a worker by inode."
+    },
     {
      FLB_CONFIG_MAP_BOOL, "skip_long_lines", "false",
      0, FLB_TRUE, offsetof(struct flb_tail_config, skip_long_lines),
@@ -626,6 +749,23 @@ static struct flb_config_map config_map[] = {
      "provides higher performance. Note that WAL is not compatible with "
      "shared network file systems."
     },
+    {
+     FLB_CONFIG_MAP_TIME, "db.commit_interval", "0",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, db_commit_interval),
+     "keep file offsets in memory and write them in a single transaction "
+     "at this interval. On a crash, at most the records consumed within "
+     "this interval are read again. The default (0) writes every offset "
+     "update right away."
+    },
+    {
+     FLB_CONFIG_MAP_SIZE, "db.commit_bytes", "0",
+     0, FLB_TRUE, offsetof(struct flb_tail_config, db_commit_bytes),
+     "write the pending file offsets once this amount of bytes has been "
+     "consumed across all files, regardless of 'db.commit_interval'. If "
+     "it's used without 'db.commit_interval' there is no time bound: the "
+     "offsets are written when the threshold is reached, when a file is "
+     "removed and on exit."
+    },
 #endif
 
     /* Multiline Options */
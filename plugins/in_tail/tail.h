@@ -34,11 +34,21 @@
 #define FLB_TAIL_STATIC  0  /* Data is being consumed through read(2) */
 #define FLB_TAIL_EVENT   1  /* Data is being consumed through inotify */
 
+/* Read modes */
+#define FLB_TAIL_READ_MODE_READ  0  /* read(2) into the file buffer        */
+#define FLB_TAIL_READ_MODE_MMAP  1  /* map static files and parse in place */
+
 /* Config */
 #define FLB_TAIL_CHUNK        "32768"    /* buffer chunk = 32KB            */
+#define FLB_TAIL_LINES_BATCH  128        /* raw lines packed per batch     */
+#define FLB_TAIL_MMAP_WINDOW  "1M"       /* mmap window for read_mode mmap */
 #define FLB_TAIL_REFRESH      60         /* refresh every 60 seconds       */
 #define FLB_TAIL_ROTATE_WAIT  "5"        /* time to monitor after rotation */
 
+/* Workers */
+#define FLB_TAIL_WORKER_BATCH     1048576  /* packed bytes per file dispatch */
+#define FLB_TAIL_WORKER_INFLIGHT  4096     /* max files owned by workers     */
+
 int in_tail_collect_event(void *file, struct flb_config *config);
 
 #endif
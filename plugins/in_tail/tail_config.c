@@ -32,27 +32,30 @@
 #include "tail_scan.h"
 #include "tail_sql.h"
 #include "tail_dockermode.h"
+#include "tail_worker.h"
 
 #ifdef FLB_HAVE_PARSER
 #include "tail_multiline.h"
 #endif
 
-static int multiline_load_parsers(struct flb_tail_config *ctx)
+/*
+ * Create a Multiline context with the 'multiline.parser' entries. Every
+ * worker thread gets its own context, so the streams of its files are not
+ * shared with other threads.
+ */
+struct flb_ml *flb_tail_config_ml_create(struct flb_tail_config *ctx)
 {
     struct mk_list *head;
     struct mk_list *head_p;
+    struct flb_ml *ml;
     struct flb_config_map_val *mv;
     struct flb_slist_entry *val = NULL;
     struct flb_ml_parser_ins *parser_i;
 
-    if (!ctx->multiline_parsers) {
-        return 0;
-    }
-
     /* Create Multiline context using the plugin instance name */
-    ctx->ml_ctx = flb_ml_create(ctx->config, ctx->ins->name);
-    if (!ctx->ml_ctx) {
-        return -1;
+    ml = flb_ml_create(ctx->config, ctx->ins->name);
+    if (!ml) {
+        return NULL;
     }
 
     /*
@@ -64,13 +67,28 @@ static int multiline_load_parsers(struct flb_tail_config *ctx)
             val = mk_list_entry(head_p, struct flb_slist_entry, _head);
 
             /* Create an instance of the defined parser */
-            parser_i = flb_ml_parser_instance_create(ctx->ml_ctx, val->str);
+            parser_i = flb_ml_parser_instance_create(ml, val->str);
             if (!parser_i) {
-                return -1;
+                flb_ml_destroy(ml);
+                return NULL;
             }
         }
     }
 
+    return ml;
+}
+
+static int multiline_load_parsers(struct flb_tail_config *ctx)
+{
+    if (!ctx->multiline_parsers) {
+        return 0;
+    }
+
+    ctx->ml_ctx = flb_tail_config_ml_create(ctx);
+    if (!ctx->ml_ctx) {
+        return -1;
+    }
+
     return 0;
 }
 
@@ -207,6 +225,29 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
         return NULL;
     }
 
+    /* Read mode */
+    ctx->read_mode = FLB_TAIL_READ_MODE_READ;
+    if (ctx->read_mode_str) {
+        if (strcasecmp(ctx->read_mode_str, "mmap") == 0) {
+#ifdef FLB_SYSTEM_WINDOWS
+            flb_plg_warn(ctx->ins, "read_mode 'mmap' is not supported on this "
+                         "platform, using 'read'");
+#else
+            ctx->read_mode = FLB_TAIL_READ_MODE_MMAP;
+#endif
+        }
+        else if (strcasecmp(ctx->read_mode_str, "read") != 0) {
+            flb_plg_error(ctx->ins, "invalid read_mode '%s'", ctx->read_mode_str);
+            flb_tail_config_destroy(ctx);
+            return NULL;
+        }
+    }
+
+    if (ctx->read_mode == FLB_TAIL_READ_MODE_MMAP &&
+        ctx->mmap_window_size < ctx->buf_chunk_size) {
+        ctx->mmap_window_size = ctx->buf_chunk_size;
+    }
+
 #ifdef FLB_HAVE_REGEX
     /* Parser / Format */
     tmp = flb_input_get_property("parser", ins);
@@ -223,6 +264,7 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
     mk_list_init(&ctx->files_rotated);
 #ifdef FLB_HAVE_SQLDB
     ctx->db = NULL;
+    mk_list_init(&ctx->db_journal);
 #endif
 
 #ifdef FLB_HAVE_REGEX
@@ -370,17 +412,26 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
             return NULL;
         }
 
-        /* Enable auto-flush routine */
-        ret = flb_ml_auto_flush_init(ctx->ml_ctx);
-        if (ret == -1) {
-            flb_plg_error(ctx->ins, "could not start multiline auto-flush");
-            flb_tail_config_destroy(ctx);
-            return NULL;
+        /*
+         * Enable auto-flush routine. With workers the streams live in the
+         * context of each worker, their flush is registered by the plugin.
+         */
+        if (ctx->workers <= 0) {
+            ret = flb_ml_auto_flush_init(ctx->ml_ctx);
+            if (ret == -1) {
+                flb_plg_error(ctx->ins, "could not start multiline auto-flush");
+                flb_tail_config_destroy(ctx);
+                return NULL;
+            }
         }
         flb_plg_info(ctx->ins, "multiline core started");
     }
 #endif
 
+    if (ctx->workers < 0) {
+        ctx->workers = 0;
+    }
+
 #ifdef FLB_HAVE_METRICS
     name = (char *) flb_input_name(ins);
 
@@ -402,6 +453,29 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
                                                 "Total number of rotated files",
                                                 1, (char *[]) {"name"});
 
+#ifdef FLB_HAVE_SQLDB
+    ctx->cmt_db_commits = cmt_counter_create(ins->cmt,
+                                             "fluentbit", "input",
+                                             "db_commits_total",
+                                             "Total number of database "
+                                             "offset commits",
+                                             1, (char *[]) {"name"});
+
+    ctx->cmt_db_commit_offsets = cmt_counter_create(ins->cmt,
+                                                    "fluentbit", "input",
+                                                    "db_commit_offsets_total",
+                                                    "Total number of file "
+                                                    "offsets committed",
+                                                    1, (char *[]) {"name"});
+
+    ctx->cmt_db_commit_seconds = cmt_counter_create(ins->cmt,
+                                                    "fluentbit", "input",
+                                                    "db_commit_seconds_total",
+                                                    "Total time spent "
+                                                    "committing offsets",
+                                                    1, (char *[]) {"name"});
+#endif
+
     /* OLD metrics */
     flb_metrics_add(FLB_TAIL_METRIC_F_OPENED,
                     "files_opened", ctx->ins->metrics);
@@ -416,6 +490,7 @@ struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
 
 int flb_tail_config_destroy(struct flb_tail_config *config)
 {
+    flb_tail_worker_destroy_all(config);
 
 #ifdef FLB_HAVE_PARSER
     flb_tail_mult_destroy(config);
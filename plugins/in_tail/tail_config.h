@@ -42,6 +42,8 @@
 #define FLB_TAIL_METRIC_F_ROTATED 102  /* number of rotated files */
 #endif
 
+struct flb_tail_worker;
+
 struct flb_tail_config {
     int fd_notify;             /* inotify fd               */
     flb_pipefd_t ch_manager[2];    /* pipe: channel manager    */
@@ -53,6 +55,17 @@ struct flb_tail_config {
     size_t buf_chunk_size;     /* allocation chunks        */
     size_t buf_max_size;       /* max size of a buffer     */
 
+    /* Read mode */
+    int read_mode;             /* FLB_TAIL_READ_MODE_*     */
+    flb_sds_t read_mode_str;   /* read_mode property       */
+    size_t mmap_window_size;   /* max bytes mapped at once */
+
+    /* Workers */
+    int workers;                   /* number of worker threads */
+    int workers_inflight;          /* files owned by workers   */
+    struct flb_tail_worker *worker_list;
+    flb_pipefd_t ch_workers[2];    /* pipe: processed files    */
+
     /* Collectors */
     int coll_fd_static;
     int coll_fd_scan;
@@ -62,6 +75,9 @@ struct flb_tail_config {
     int coll_fd_inactive;
     int coll_fd_dmode_flush;
     int coll_fd_mult_flush;
+    int coll_fd_workers;
+    int coll_fd_workers_ml;
+    int coll_fd_db_commit;
 
     /* Backend collectors */
     int coll_fd_fs1;           /* used by fs_inotify & fs_stat */
@@ -97,6 +113,10 @@ struct flb_tail_config {
     int db_sync;
     int db_locking;
     flb_sds_t db_journal_mode;
+    int db_commit_interval;    /* seconds between offset commits  */
+    size_t db_commit_bytes;    /* consumed bytes forcing a commit */
+    size_t db_pending_bytes;   /* bytes consumed since last commit */
+    struct mk_list db_journal; /* files with uncommitted offsets  */
     sqlite3_stmt *stmt_get_file;
     sqlite3_stmt *stmt_insert_file;
     sqlite3_stmt *stmt_delete_file;
@@ -139,6 +159,9 @@ struct flb_tail_config {
     struct cmt_counter *cmt_files_opened;
     struct cmt_counter *cmt_files_closed;
     struct cmt_counter *cmt_files_rotated;
+    struct cmt_counter *cmt_db_commits;
+    struct cmt_counter *cmt_db_commit_offsets;
+    struct cmt_counter *cmt_db_commit_seconds;
 
     struct flb_config *config;
 };
@@ -146,5 +169,6 @@ struct flb_tail_config {
 struct flb_tail_config *flb_tail_config_create(struct flb_input_instance *ins,
                                                struct flb_config *config);
 int flb_tail_config_destroy(struct flb_tail_config *config);
+struct flb_ml *flb_tail_config_ml_create(struct flb_tail_config *ctx);
 
 #endif
@@ -21,6 +21,7 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input_plugin.h>
 #include <fluent-bit/flb_sqldb.h>
+#include <fluent-bit/flb_time.h>
 
 #include "tail_db.h"
 #include "tail_sql.h"
@@ -193,13 +194,14 @@ int flb_tail_db_file_set(struct flb_tail_file *file,
         file->db_id = id;
         file->offset = offset;
     }
+    file->db_offset = file->offset;
 
     return 0;
 }
 
 /* Update Offset v2 */
-int flb_tail_db_file_offset(struct flb_tail_file *file,
-                            struct flb_tail_config *ctx)
+static int db_file_offset_update(struct flb_tail_file *file,
+                                 struct flb_tail_config *ctx)
 {
     int ret;
 
@@ -231,6 +233,137 @@ int flb_tail_db_file_offset(struct flb_tail_file *file,
     return 0;
 }
 
+/*
+ * Register the file offset. With 'db.commit_interval' or 'db.commit_bytes'
+ * set the offset is kept in the journal (write-behind) and written in the
+ * next commit, otherwise it's written right away.
+ */
+int flb_tail_db_file_offset(struct flb_tail_file *file,
+                            struct flb_tail_config *ctx)
+{
+    if (ctx->db_commit_interval <= 0 && ctx->db_commit_bytes == 0) {
+        return db_file_offset_update(file, ctx);
+    }
+
+    return flb_tail_db_file_journal(file, ctx);
+}
+
+/* Keep the file offset in the journal, it's written by the next commit */
+int flb_tail_db_file_journal(struct flb_tail_file *file,
+                             struct flb_tail_config *ctx)
+{
+    if (file->offset > file->db_offset) {
+        ctx->db_pending_bytes += (file->offset - file->db_offset);
+    }
+    file->db_offset = file->offset;
+
+    if (file->db_dirty == FLB_FALSE) {
+        mk_list_add(&file->_db_head, &ctx->db_journal);
+        file->db_dirty = FLB_TRUE;
+    }
+
+    if (ctx->db_commit_bytes > 0 &&
+        ctx->db_pending_bytes >= ctx->db_commit_bytes) {
+        return flb_tail_db_commit(ctx);
+    }
+
+    return 0;
+}
+
+/* Write the offsets of the journal in a single transaction */
+int flb_tail_db_commit(struct flb_tail_config *ctx)
+{
+    int ret;
+    int count = 0;
+    double latency;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tail_file *file;
+    struct flb_time t0;
+    struct flb_time t1;
+    struct flb_time diff;
+#ifdef FLB_HAVE_METRICS
+    uint64_t ts;
+    char *name;
+#endif
+
+    if (mk_list_is_empty(&ctx->db_journal) == 0) {
+        return 0;
+    }
+
+    flb_time_get(&t0);
+
+    ret = flb_sqldb_query(ctx->db, SQL_BEGIN, NULL, NULL);
+    if (ret != FLB_OK) {
+        flb_plg_error(ctx->ins, "db: could not begin offsets transaction");
+        return -1;
+    }
+
+    mk_list_foreach(head, &ctx->db_journal) {
+        file = mk_list_entry(head, struct flb_tail_file, _db_head);
+        ret = db_file_offset_update(file, ctx);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "db: could not update offset of %s",
+                          file->name);
+            goto rollback;
+        }
+        count++;
+    }
+
+    ret = flb_sqldb_query(ctx->db, SQL_COMMIT, NULL, NULL);
+    if (ret != FLB_OK) {
+        flb_plg_error(ctx->ins, "db: could not commit offsets transaction");
+        goto rollback;
+    }
+
+    /* the offsets are persisted, empty the journal */
+    mk_list_foreach_safe(head, tmp, &ctx->db_journal) {
+        file = mk_list_entry(head, struct flb_tail_file, _db_head);
+        mk_list_del(&file->_db_head);
+        file->db_dirty = FLB_FALSE;
+    }
+    ctx->db_pending_bytes = 0;
+
+    flb_time_get(&t1);
+    flb_time_diff(&t1, &t0, &diff);
+    latency = flb_time_to_double(&diff);
+
+    flb_plg_debug(ctx->ins, "db: committed %i offsets in %.6f seconds",
+                  count, latency);
+
+#ifdef FLB_HAVE_METRICS
+    name = (char *) flb_input_name(ctx->ins);
+    ts = cmt_time_now();
+    cmt_counter_inc(ctx->cmt_db_commits, ts, 1, (char *[]) {name});
+    cmt_counter_add(ctx->cmt_db_commit_offsets, ts, count,
+                    1, (char *[]) {name});
+    cmt_counter_add(ctx->cmt_db_commit_seconds, ts, latency,
+                    1, (char *[]) {name});
+#endif
+
+    return 0;
+
+ rollback:
+    /* keep the journal, the offsets are written in the next commit */
+    ret = flb_sqldb_query(ctx->db, SQL_ROLLBACK, NULL, NULL);
+    if (ret != FLB_OK) {
+        flb_plg_error(ctx->ins, "db: could not rollback offsets transaction");
+    }
+    return -1;
+}
+
+/* cb_collect callback: commit the offsets journal every 'db.commit_interval' */
+int flb_tail_db_commit_callback(struct flb_input_instance *ins,
+                                struct flb_config *config, void *context)
+{
+    struct flb_tail_config *ctx = context;
+    (void) ins;
+    (void) config;
+
+    flb_tail_db_commit(ctx);
+    return 0;
+}
+
 /* Mark a file as rotated v2 */
 int flb_tail_db_file_rotate(const char *new_name,
                             struct flb_tail_file *file,
@@ -394,6 +394,11 @@ static void file_pending_flush(struct flb_tail_config *ctx,
     msgpack_sbuffer mp_sbuf;
     msgpack_packer mp_pck;
 
+    /* owned by a worker thread, it's flushed in the next round */
+    if (file->worker_busy == FLB_TRUE) {
+        return;
+    }
+
     if (file->dmode_flush_timeout > now) {
         return;
     }
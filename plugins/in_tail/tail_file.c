@@ -22,6 +22,11 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
+#ifndef FLB_SYSTEM_WINDOWS
+#include <sys/mman.h>
+#include <signal.h>
+#include <setjmp.h>
+#endif
 
 #include <fluent-bit/flb_compat.h>
 #include <fluent-bit/flb_info.h>
@@ -40,6 +45,7 @@
 #include "tail_dockermode.h"
 #include "tail_multiline.h"
 #include "tail_scan.h"
+#include "tail_worker.h"
 
 #ifdef FLB_SYSTEM_WINDOWS
 #include "win32.h"
@@ -284,6 +290,124 @@ int flb_tail_file_pack_line(msgpack_sbuffer *mp_sbuf, msgpack_packer *mp_pck,
     return 0;
 }
 
+/* Reference to a raw line pending to be packed */
+struct tail_line {
+    char *data;
+    size_t len;
+    size_t processed_bytes;   /* offset of the line in the read buffer */
+};
+
+/*
+ * Pack a batch of raw lines: all the records share the same timestamp and
+ * the keys that are the same for every record of the file (map header,
+ * path key and the offset/log key names) are packed once and then copied
+ * into each record.
+ */
+static void pack_lines(msgpack_sbuffer *mp_sbuf, msgpack_packer *mp_pck,
+                       struct tail_line *lines, int count,
+                       struct flb_tail_file *file)
+{
+    int i;
+    int map_num = 1;
+    size_t head_size;
+    struct flb_time out_time;
+    struct tail_line *line;
+    msgpack_sbuffer keys_sbuf;
+    msgpack_packer keys_pck;
+    struct flb_tail_config *ctx = file->config;
+
+    if (count <= 0) {
+        return;
+    }
+
+    if (ctx->path_key != NULL) {
+        map_num++;
+    }
+    if (ctx->offset_key != NULL) {
+        map_num++;
+    }
+
+    /* keys that precedes the offset value (if any) */
+    msgpack_sbuffer_init(&keys_sbuf);
+    msgpack_packer_init(&keys_pck, &keys_sbuf, msgpack_sbuffer_write);
+
+    msgpack_pack_map(&keys_pck, map_num);
+    if (ctx->path_key != NULL) {
+        msgpack_pack_str(&keys_pck, flb_sds_len(ctx->path_key));
+        msgpack_pack_str_body(&keys_pck, ctx->path_key,
+                              flb_sds_len(ctx->path_key));
+        msgpack_pack_str(&keys_pck, file->name_len);
+        msgpack_pack_str_body(&keys_pck, file->name, file->name_len);
+    }
+    if (ctx->offset_key != NULL) {
+        msgpack_pack_str(&keys_pck, flb_sds_len(ctx->offset_key));
+        msgpack_pack_str_body(&keys_pck, ctx->offset_key,
+                              flb_sds_len(ctx->offset_key));
+    }
+    head_size = keys_sbuf.size;
+
+    /* log key name */
+    msgpack_pack_str(&keys_pck, flb_sds_len(ctx->key));
+    msgpack_pack_str_body(&keys_pck, ctx->key, flb_sds_len(ctx->key));
+
+    flb_time_get(&out_time);
+
+    for (i = 0; i < count; i++) {
+        line = &lines[i];
+
+        msgpack_pack_array(mp_pck, 2);
+        flb_time_append_to_msgpack(&out_time, mp_pck, 0);
+        msgpack_sbuffer_write(mp_sbuf, keys_sbuf.data, head_size);
+        if (ctx->offset_key != NULL) {
+            msgpack_pack_uint64(mp_pck, file->offset + line->processed_bytes);
+        }
+        msgpack_sbuffer_write(mp_sbuf, keys_sbuf.data + head_size,
+                              keys_sbuf.size - head_size);
+        msgpack_pack_str(mp_pck, line->len);
+        msgpack_pack_str_body(mp_pck, line->data, line->len);
+    }
+
+    msgpack_sbuffer_destroy(&keys_sbuf);
+}
+
+/*
+ * Register the records into the engine. A file owned by a worker thread
+ * keeps them in its worker buffer, the engine thread appends them once
+ * the worker hands the file back.
+ */
+static void file_append_raw(struct flb_tail_file *file,
+                            const void *buf, size_t size)
+{
+    struct flb_tail_config *ctx = file->config;
+
+    if (file->worker_busy == FLB_TRUE) {
+        msgpack_sbuffer_write(&file->worker_sbuf, buf, size);
+        return;
+    }
+
+    flb_input_chunk_append_raw(ctx->ins, file->tag_buf, file->tag_len,
+                               buf, size);
+}
+
+/* Save the file offset, deferred to the engine thread for worker threads */
+static inline void file_db_offset(struct flb_tail_file *file)
+{
+#ifdef FLB_HAVE_SQLDB
+    if (file->config->db && file->worker_busy == FLB_FALSE) {
+        flb_tail_db_file_offset(file, file->config);
+    }
+#endif
+}
+
+/* Multiline core context of the file: every worker thread has its own */
+static inline struct flb_ml *file_ml_ctx(struct flb_tail_file *file)
+{
+    if (file->worker) {
+        return file->worker->ml_ctx;
+    }
+    return file->config->ml_ctx;
+}
+
 static int process_content(struct flb_tail_file *file, size_t *bytes)
 {
     size_t len;
@@ -300,6 +424,9 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
     size_t line_len;
     char *repl_line;
     size_t repl_line_len;
+    int raw;
+    int raw_count = 0;
+    struct tail_line raw_lines[FLB_TAIL_LINES_BATCH];
     time_t now = time(NULL);
     struct flb_time out_time = {0};
     msgpack_sbuffer mp_sbuf;
@@ -308,12 +435,25 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
     msgpack_packer *out_pck;
     struct flb_tail_config *ctx = file->config;
 
-    /* Create a temporary msgpack buffer */
-    msgpack_sbuffer_init(&mp_sbuf);
-    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    /*
+     * Create a temporary msgpack buffer. A mapped window uses the one of
+     * file_chunk_mmap() so it can be released if the parsing is aborted.
+     */
     out_sbuf = &mp_sbuf;
+    if (file->buf_mapped == FLB_TRUE) {
+        out_sbuf = file->mmap_sbuf;
+    }
+    msgpack_sbuffer_init(out_sbuf);
+    msgpack_packer_init(&mp_pck, out_sbuf, msgpack_sbuffer_write);
     out_pck  = &mp_pck;
 
+    /*
+     * When no parser, multiline or docker mode is set, lines are packed as
+     * they are: collect them and pack in batches.
+     */
+    raw = (ctx->ml_ctx == NULL && ctx->docker_mode == FLB_FALSE &&
+           ctx->multiline == FLB_FALSE && ctx->parser == NULL);
+
     /* Parse the data content */
     data = file->buf_data;
     end = data + file->buf_len;
@@ -327,6 +467,16 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
     while (data < end && (p = memchr(data, '\n', end - data))) {
         len = (p - data);
         crlf = 0;
+
+        /*
+         * A mapped window is not limited by buffer_max_size: stop before a
+         * line that would not fit in the buffer, so the read(2) path applies
+         * the long lines handling to it.
+         */
+        if (file->buf_mapped == FLB_TRUE && len + 1 >= ctx->buf_max_size) {
+            break;
+        }
+
         if (file->skip_next == FLB_TRUE) {
             data += len + 1;
             processed_bytes += len + 1;
@@ -371,8 +521,20 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
         line_len = len - crlf;
         repl_line = NULL;
 
-        if (ctx->ml_ctx) {
-            ret = flb_ml_append(ctx->ml_ctx, file->ml_stream_id,
+        if (raw) {
+            raw_lines[raw_count].data = line;
+            raw_lines[raw_count].len = line_len;
+            raw_lines[raw_count].processed_bytes = processed_bytes;
+            raw_count++;
+
+            if (raw_count == FLB_TAIL_LINES_BATCH) {
+                pack_lines(out_sbuf, out_pck, raw_lines, raw_count, file);
+                raw_count = 0;
+            }
+            goto go_next;
+        }
+        else if (ctx->ml_ctx) {
+            ret = flb_ml_append(file_ml_ctx(file), file->ml_stream_id,
                                 FLB_ML_TYPE_TEXT,
                                 &out_time, line, line_len);
             goto go_next;
@@ -468,27 +630,22 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
     }
     file->parsed = file->buf_len;
 
+    /* pack remaining raw lines */
+    pack_lines(out_sbuf, out_pck, raw_lines, raw_count, file);
+
     if (lines > 0) {
         /* Append buffer content to a chunk */
         *bytes = processed_bytes;
 
         if (out_sbuf->size > 0) {
-            flb_input_chunk_append_raw(ctx->ins,
-                                       file->tag_buf,
-                                       file->tag_len,
-                                       out_sbuf->data,
-                                       out_sbuf->size);
+            file_append_raw(file, out_sbuf->data, out_sbuf->size);
         }
         else if (ctx->ml_ctx && file->mult_sbuf.size > 0) {
             /* If no extra keys are needed, just enqueue the buffer */
             if (file->config->path_key == NULL &&
                 file->config->offset_key == NULL) {
-                flb_input_chunk_append_raw(ctx->ins,
-                                           file->tag_buf,
-                                           file->tag_len,
-                                           file->mult_sbuf.data,
-                                           file->mult_sbuf.size);
-
+                file_append_raw(file, file->mult_sbuf.data,
+                                file->mult_sbuf.size);
             }
             else {
                 char *mult_buf = NULL;
@@ -501,11 +658,7 @@ static int process_content(struct flb_tail_file *file, size_t *bytes)
                                           file->mult_sbuf.size,
                                           &mult_buf, &mult_size);
 
-                flb_input_chunk_append_raw(ctx->ins,
-                                           file->tag_buf,
-                                           file->tag_len,
-                                           mult_buf,
-                                           mult_size);
+                file_append_raw(file, mult_buf, mult_size);
                 flb_free(mult_buf);
             }
             file->mult_sbuf.size = 0;
@@ -869,6 +1022,14 @@ int flb_tail_file_append(char *path, struct stat *st, int mode,
     msgpack_packer_init(&file->mult_pck, &file->mult_sbuf,
                         msgpack_sbuffer_write);
 
+    /* worker thread: picked by inode, the file always lands in the same */
+    if (ctx->workers > 0) {
+        file->worker = &ctx->worker_list[file->inode % ctx->workers];
+    }
+    file->worker_busy = FLB_FALSE;
+    file->worker_events = 0;
+    msgpack_sbuffer_init(&file->worker_sbuf);
+
     /* docker mode */
     file->dmode_flush_timeout = 0;
     file->dmode_complete = true;
@@ -894,10 +1055,16 @@ int flb_tail_file_append(char *path, struct stat *st, int mode,
         inode_str = flb_sds_create_size(64);
         flb_sds_printf(&inode_str, "%"PRIu64, file->inode);
         /* Create a stream for this file */
-        ret = flb_ml_stream_create(ctx->ml_ctx,
+        if (file->worker) {
+            pthread_mutex_lock(&file->worker->ml_lock);
+        }
+        ret = flb_ml_stream_create(file_ml_ctx(file),
                                    inode_str, flb_sds_len(inode_str),
                                    ml_flush_callback, file,
                                    &stream_id);
+        if (file->worker) {
+            pthread_mutex_unlock(&file->worker->ml_lock);
+        }
         if (ret != 0) {
             flb_plg_error(ctx->ins,
                           "could not create multiline stream for file: %s",
@@ -1016,9 +1183,25 @@ void flb_tail_file_remove(struct flb_tail_file *file)
     flb_plg_debug(ctx->ins, "inode=%"PRIu64" removing file name %s",
                   file->inode, file->name);
 
+#ifdef FLB_HAVE_SQLDB
+    /* Persist the offset still pending in the journal */
+    if (file->db_dirty == FLB_TRUE) {
+        flb_tail_db_commit(ctx);
+        if (file->db_dirty == FLB_TRUE) {
+            mk_list_del(&file->_db_head);
+        }
+    }
+#endif
+
     /* remove the multiline.core stream */
     if (ctx->ml_ctx && file->ml_stream_id > 0) {
-        flb_ml_stream_id_destroy_all(ctx->ml_ctx, file->ml_stream_id);
+        if (file->worker) {
+            pthread_mutex_lock(&file->worker->ml_lock);
+        }
+        flb_ml_stream_id_destroy_all(file_ml_ctx(file), file->ml_stream_id);
+        if (file->worker) {
+            pthread_mutex_unlock(&file->worker->ml_lock);
+        }
     }
 
     if (file->rotated > 0) {
@@ -1035,6 +1218,7 @@ void flb_tail_file_remove(struct flb_tail_file *file)
     }
 
     msgpack_sbuffer_destroy(&file->mult_sbuf);
+    msgpack_sbuffer_destroy(&file->worker_sbuf);
 
     flb_sds_destroy(file->dmode_buf);
     flb_sds_destroy(file->dmode_lastline);
@@ -1113,11 +1297,7 @@ static int adjust_counters(struct flb_tail_config *ctx, struct flb_tail_file *fi
         file->buf_len = 0;
 
         /* Update offset in the database file */
-#ifdef FLB_HAVE_SQLDB
-        if (ctx->db) {
-            flb_tail_db_file_offset(file, ctx);
-        }
-#endif
+        file_db_offset(file);
     }
     else {
         file->size = st.st_size;
@@ -1127,6 +1307,173 @@ static int adjust_counters(struct flb_tail_config *ctx, struct flb_tail_file *fi
     return FLB_TAIL_OK;
 }
 
+#ifndef FLB_SYSTEM_WINDOWS
+/*
+ * A file truncated while it's mapped (e.g: copytruncate rotation) raises
+ * SIGBUS when the pages past the new end of file are read. The thread
+ * parsing a mapped window sets its guard so the handler can jump back to
+ * file_chunk_mmap(), any other SIGBUS gets the previous disposition.
+ */
+struct mmap_guard {
+    char *map;
+    size_t len;
+    sigjmp_buf jmp;
+};
+
+static pthread_once_t mmap_guard_once = PTHREAD_ONCE_INIT;
+static struct sigaction mmap_guard_prev;
+FLB_TLS_DEFINE(struct mmap_guard, tail_mmap_guard);
+
+static void mmap_guard_handler(int sig, siginfo_t *info, void *ucontext)
+{
+    char *addr = info->si_addr;
+    struct mmap_guard *guard = FLB_TLS_GET(tail_mmap_guard);
+
+    if (guard && addr >= guard->map && addr < guard->map + guard->len) {
+        siglongjmp(guard->jmp, 1);
+    }
+
+    /* not ours: the faulting access is retried with the previous handler */
+    sigaction(SIGBUS, &mmap_guard_prev, NULL);
+}
+
+static void mmap_guard_init()
+{
+    struct sigaction sa;
+
+    FLB_TLS_INIT(tail_mmap_guard);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = mmap_guard_handler;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, &mmap_guard_prev);
+}
+
+/*
+ * Consume the pending content of a static file by mapping a window of it
+ * and parsing the lines in place, avoiding the copy into the file buffer.
+ *
+ * The window length is validated against the current file size right
+ * before mapping, so it never covers bytes beyond the end of the file. The
+ * mapping only lives for the duration of process_content(): if the file is
+ * truncated meanwhile the parsing is aborted and the window discarded (a
+ * few per-line allocations of the parser can leak). Returns FLB_TAIL_BUSY
+ * when the caller must use the read(2) path instead: e.g: no complete line
+ * in the window or pending buffered data.
+ */
+static int file_chunk_mmap(struct flb_tail_file *file)
+{
+    int ret;
+    char *map;
+    char *buf_data;
+    size_t buf_size;
+    size_t len;
+    size_t delta;
+    size_t map_len;
+    size_t processed_bytes = 0;
+    off_t map_off;
+    off_t offset;
+    long page_size;
+    struct stat st;
+    struct mmap_guard guard;
+    msgpack_sbuffer sbuf;
+    struct flb_tail_config *ctx = file->config;
+
+    if (file->buf_len > 0 || file->skip_next == FLB_TRUE) {
+        return FLB_TAIL_BUSY;
+    }
+
+    pthread_once(&mmap_guard_once, mmap_guard_init);
+
+    ret = fstat(file->fd, &st);
+    if (ret == -1) {
+        flb_errno();
+        return FLB_TAIL_ERROR;
+    }
+
+    /* only worth it if there is more than a read(2) worth of content */
+    if (file->offset >= st.st_size ||
+        st.st_size - file->offset <= ctx->buf_chunk_size) {
+        return FLB_TAIL_BUSY;
+    }
+
+    len = st.st_size - file->offset;
+    if (len > ctx->mmap_window_size) {
+        len = ctx->mmap_window_size;
+    }
+
+    /* mmap(2) offset must be page aligned */
+    page_size = sysconf(_SC_PAGESIZE);
+    map_off = file->offset - (file->offset % page_size);
+    delta = file->offset - map_off;
+    map_len = len + delta;
+
+    map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, file->fd, map_off);
+    if (map == MAP_FAILED) {
+        flb_errno();
+        flb_plg_debug(ctx->ins, "inode=%"PRIu64" cannot map file %s, "
+                      "using read(2)", file->inode, file->name);
+        return FLB_TAIL_BUSY;
+    }
+
+    /* let process_content() work on top of the mapped window */
+    buf_data = file->buf_data;
+    buf_size = file->buf_size;
+    file->buf_data = map + delta;
+    file->buf_size = len;
+    file->buf_len = len;
+    file->buf_mapped = FLB_TRUE;
+    file->mmap_sbuf = &sbuf;
+
+    guard.map = map;
+    guard.len = map_len;
+    if (sigsetjmp(guard.jmp, 1) == 0) {
+        FLB_TLS_SET(tail_mmap_guard, &guard);
+        ret = process_content(file, &processed_bytes);
+    }
+    else {
+        /* SIGBUS: the records packed so far are gone with the window */
+        msgpack_sbuffer_destroy(&sbuf);
+        ret = 0;
+        processed_bytes = 0;
+        flb_plg_debug(ctx->ins, "inode=%"PRIu64" file=%s was truncated while "
+                      "mapped, using read(2)", file->inode, file->name);
+    }
+    FLB_TLS_SET(tail_mmap_guard, NULL);
+
+    file->buf_data = buf_data;
+    file->buf_size = buf_size;
+    file->buf_len = 0;
+    file->buf_mapped = FLB_FALSE;
+    file->mmap_sbuf = NULL;
+    munmap(map, map_len);
+
+    if (ret < 0) {
+        flb_plg_debug(ctx->ins, "inode=%"PRIu64" file=%s process content ERROR",
+                      file->inode, file->name);
+        return FLB_TAIL_ERROR;
+    }
+
+    if (processed_bytes == 0) {
+        /* no complete line in the window: long line, go through the buffer */
+        return FLB_TAIL_BUSY;
+    }
+
+    /* the read(2) path continues from the new position */
+    file->offset += processed_bytes;
+    offset = lseek(file->fd, file->offset, SEEK_SET);
+    if (offset == -1) {
+        flb_errno();
+        return FLB_TAIL_ERROR;
+    }
+
+    file_db_offset(file);
+
+    return adjust_counters(ctx, file);
+}
+#endif
+
 int flb_tail_file_chunk(struct flb_tail_file *file)
 {
     int ret;
@@ -1144,6 +1491,16 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
         return FLB_TAIL_BUSY;
     }
 
+#ifndef FLB_SYSTEM_WINDOWS
+    if (ctx->read_mode == FLB_TAIL_READ_MODE_MMAP &&
+        file->tail_mode == FLB_TAIL_STATIC) {
+        ret = file_chunk_mmap(file);
+        if (ret != FLB_TAIL_BUSY) {
+            return ret;
+        }
+    }
+#endif
+
     capacity = (file->buf_size - file->buf_len) - 1;
     if (capacity < 1) {
         /*
@@ -1221,11 +1578,7 @@ int flb_tail_file_chunk(struct flb_tail_file *file)
         file->buf_len -= processed_bytes;
         file->buf_data[file->buf_len] = '\0';
 
-#ifdef FLB_HAVE_SQLDB
-        if (file->config->db) {
-            flb_tail_db_file_offset(file, file->config);
-        }
-#endif
+        file_db_offset(file);
 
         ret = fstat(file->fd, &st);
         if (ret == -1) {
@@ -1607,6 +1960,10 @@ int flb_tail_file_purge(struct flb_input_instance *ins,
     now = time(NULL);
     mk_list_foreach_safe(head, tmp, &ctx->files_rotated) {
         file = mk_list_entry(head, struct flb_tail_file, _rotate_head);
+        if (file->worker_busy == FLB_TRUE) {
+            /* owned by a worker thread, check it in the next round */
+            continue;
+        }
         if ((file->rotated + ctx->rotate_wait) <= now) {
             ret = fstat(file->fd, &st);
             if (ret == 0) {
@@ -1639,10 +1996,17 @@ int flb_tail_file_purge(struct flb_input_instance *ins,
      */
     mk_list_foreach_safe(head, tmp, &ctx->files_static) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
+        if (file->worker_busy == FLB_TRUE) {
+            /* owned by a worker thread, check it in the next round */
+            continue;
+        }
         check_purge_deleted_file(ctx, file, now);
     }
     mk_list_foreach_safe(head, tmp, &ctx->files_event) {
         file = mk_list_entry(head, struct flb_tail_file, _head);
+        if (file->worker_busy == FLB_TRUE) {
+            continue;
+        }
         check_purge_deleted_file(ctx, file, now);
     }
 
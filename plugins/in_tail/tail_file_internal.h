@@ -79,6 +79,8 @@ struct flb_tail_file {
     size_t buf_len;
     size_t buf_size;
     char *buf_data;
+    int buf_mapped;             /* buf_data points to a mapped window    */
+    msgpack_sbuffer *mmap_sbuf; /* records packed from the mapped window */
 
     /*
      * Long-lines handling: this flag is enabled when a previous line was
@@ -92,11 +94,27 @@ struct flb_tail_file {
     /* Did the plugin already warn the user about long lines ? */
     int skip_warn;
 
+    /*
+     * Worker threads: every file is assigned to a 'worker' by inode. While
+     * 'worker_busy' is set the file is owned by it, the worker packs the
+     * records into 'worker_sbuf' and leaves the return value of the last
+     * read in 'worker_ret'. File system events received in the meantime
+     * are kept in 'worker_events' and processed when it's handed back.
+     */
+    struct flb_tail_worker *worker;
+    int worker_busy;
+    int worker_ret;
+    uint32_t worker_events;
+    msgpack_sbuffer worker_sbuf;
+
     /* Opaque data type for specific fs-event backend data */
     void *fs_backend;
 
     /* database reference */
     uint64_t db_id;
+    int64_t db_offset;          /* last offset registered in the journal */
+    int db_dirty;               /* offset pending in the db journal      */
+    struct mk_list _db_head;    /* link to config->db_journal            */
 
     /* reference */
     int tail_mode;
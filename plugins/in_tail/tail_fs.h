@@ -83,6 +83,23 @@ static inline int flb_tail_fs_remove(struct flb_tail_config *ctx, struct flb_tai
     return flb_tail_fs_stat_remove(file);
 }
 
+/*
+ * Process the events received while a worker thread owned the file. The
+ * stat(2) backend polls the files, it finds the changes in the next round.
+ */
+static inline int flb_tail_fs_replay(struct flb_tail_config *ctx,
+                                     struct flb_tail_file *file,
+                                     struct flb_config *config)
+{
+#ifdef FLB_HAVE_INOTIFY
+    if (ctx->inotify_watcher) {
+        return flb_tail_fs_inotify_replay(file, config);
+    }
+#endif
+    file->worker_events = 0;
+    return 0;
+}
+
 static inline int flb_tail_fs_exit(struct flb_tail_config *ctx)
 {
 #ifdef FLB_HAVE_INOTIFY
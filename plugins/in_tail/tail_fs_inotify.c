@@ -155,49 +155,24 @@ static int flb_tail_fs_add_rotated(struct flb_tail_file *file)
     return tail_fs_add(file, FLB_FALSE);
 }
 
-static int tail_fs_event(struct flb_input_instance *ins,
-                         struct flb_config *config, void *in_context)
+/* Process the events of a watched file */
+static int tail_fs_file_event(struct flb_tail_config *ctx,
+                              struct flb_tail_file *file, uint32_t mask,
+                              struct flb_config *config)
 {
     int ret;
     int64_t offset;
-    struct mk_list *head;
-    struct mk_list *tmp;
-    struct flb_tail_config *ctx = in_context;
-    struct flb_tail_file *file = NULL;
-    struct inotify_event ev;
+    struct flb_input_instance *ins = ctx->ins;
     struct stat st;
 
-    /* Read the event */
-    ret = read(ctx->fd_notify, &ev, sizeof(struct inotify_event));
-    if (ret < 1) {
-        return -1;
-    }
-
-    /* Lookup watched file */
-    mk_list_foreach_safe(head, tmp, &ctx->files_event) {
-        file = mk_list_entry(head, struct flb_tail_file, _head);
-        if (file->watch_fd != ev.wd) {
-            file = NULL;
-            continue;
-        }
-        break;
-    }
-
-    if (!file) {
-        return -1;
-    }
-
-    /* Debug event */
-    debug_event_mask(ctx, file, ev.mask);
-
-    if (ev.mask & IN_IGNORED) {
+    if (mask & IN_IGNORED) {
         flb_plg_debug(ctx->ins, "inode=%"PRIu64" watch_fd=%i IN_IGNORED",
-                      file->inode, ev.wd);
+                      file->inode, file->watch_fd);
         return -1;
     }
 
     /* Check file rotation (only if it has not been rotated before) */
-    if (ev.mask & IN_MOVE_SELF && file->rotated == 0) {
+    if (mask & IN_MOVE_SELF && file->rotated == 0) {
         flb_plg_debug(ins, "inode=%"PRIu64" rotated IN_MOVE SELF '%s'",
                       file->inode, file->name);
 
@@ -218,7 +193,7 @@ static int tail_fs_event(struct flb_input_instance *ins,
     file->pending_bytes = (file->size - file->offset);
 
     /* File was removed ? */
-    if (ev.mask & IN_ATTRIB) {
+    if (mask & IN_ATTRIB) {
         /* Check if the file have been deleted */
         if (st.st_nlink == 0) {
             flb_plg_debug(ins, "inode=%"PRIu64" file has been deleted: %s",
@@ -236,7 +211,7 @@ static int tail_fs_event(struct flb_input_instance *ins,
         }
     }
 
-    if (ev.mask & IN_MODIFY) {
+    if (mask & IN_MODIFY) {
         /*
          * The file was modified, check how many new bytes do
          * we have.
@@ -290,6 +265,60 @@ static int tail_fs_event(struct flb_input_instance *ins,
     return 0;
 }
 
+static int tail_fs_event(struct flb_input_instance *ins,
+                         struct flb_config *config, void *in_context)
+{
+    int ret;
+    struct mk_list *head;
+    struct mk_list *tmp;
+    struct flb_tail_config *ctx = in_context;
+    struct flb_tail_file *file = NULL;
+    struct inotify_event ev;
+
+    /* Read the event */
+    ret = read(ctx->fd_notify, &ev, sizeof(struct inotify_event));
+    if (ret < 1) {
+        return -1;
+    }
+
+    /* Lookup watched file */
+    mk_list_foreach_safe(head, tmp, &ctx->files_event) {
+        file = mk_list_entry(head, struct flb_tail_file, _head);
+        if (file->watch_fd != ev.wd) {
+            file = NULL;
+            continue;
+        }
+        break;
+    }
+
+    if (!file) {
+        return -1;
+    }
+
+    /* Debug event */
+    debug_event_mask(ctx, file, ev.mask);
+
+    /* Owned by a worker thread: process the events once it's handed back */
+    if (file->worker_busy == FLB_TRUE) {
+        file->worker_events |= ev.mask;
+        return 0;
+    }
+
+    return tail_fs_file_event(ctx, file, ev.mask, config);
+}
+
+/* Process the events received while a worker thread owned the file */
+int flb_tail_fs_inotify_replay(struct flb_tail_file *file,
+                               struct flb_config *config)
+{
+    uint32_t mask;
+
+    mask = file->worker_events;
+    file->worker_events = 0;
+
+    return tail_fs_file_event(file->config, file, mask, config);
+}
+
 /* File System events based on Inotify(2). Linux >= 2.6.32 is suggested */
 int flb_tail_fs_inotify_init(struct flb_input_instance *in,
                      struct flb_tail_config *ctx, struct flb_config *config)
@@ -34,5 +34,7 @@ int flb_tail_fs_inotify_remove(struct flb_tail_file *file);
 int flb_tail_fs_inotify_exit(struct flb_tail_config *ctx);
 void flb_tail_fs_inotify_pause(struct flb_tail_config *ctx);
 void flb_tail_fs_inotify_resume(struct flb_tail_config *ctx);
+int flb_tail_fs_inotify_replay(struct flb_tail_file *file,
+                               struct flb_config *config);
 
 #endif
@@ -62,6 +62,11 @@ static int tail_fs_event(struct flb_input_instance *ins,
         file = mk_list_entry(head, struct flb_tail_file, _head);
         fst = file->fs_backend;
 
+        /* Owned by a worker thread, the change is found in the next round */
+        if (file->worker_busy == FLB_TRUE) {
+            continue;
+        }
+
         /* Check current status of the file */
         ret = fstat(file->fd, &st);
         if (ret == -1) {
@@ -100,6 +105,11 @@ static int tail_fs_check(struct flb_input_instance *ins,
         file = mk_list_entry(head, struct flb_tail_file, _head);
         fst = file->fs_backend;
 
+        /* Owned by a worker thread, check it in the next round */
+        if (file->worker_busy == FLB_TRUE) {
+            continue;
+        }
+
         ret = fstat(file->fd, &st);
         if (ret == -1) {
             flb_plg_debug(ctx->ins, "error stat(2) %s, removing", file->name);
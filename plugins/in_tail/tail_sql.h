@@ -54,6 +54,15 @@
 #define SQL_DELETE_FILE                                                 \
     "DELETE FROM in_tail_files WHERE id=@id;"
 
+#define SQL_BEGIN                                                       \
+    "BEGIN;"
+
+#define SQL_COMMIT                                                      \
+    "COMMIT;"
+
+#define SQL_ROLLBACK                                                    \
+    "ROLLBACK;"
+
 #define SQL_PRAGMA_SYNC                         \
     "PRAGMA synchronous=%i;"
 
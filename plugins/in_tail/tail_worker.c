@@ -0,0 +1,381 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_worker.h>
+#include <fluent-bit/flb_input_plugin.h>
+
+#include "tail.h"
+#include "tail_fs.h"
+#include "tail_db.h"
+#include "tail_file.h"
+#include "tail_signal.h"
+#include "tail_config.h"
+#include "tail_worker.h"
+
+/*
+ * Worker thread: it receives references of files through its own channel,
+ * reads and packs their content and hands them back to the engine thread
+ * through the shared 'ch_workers' channel. While a file is owned by a
+ * worker the engine thread does not touch it.
+ */
+static void tail_worker(void *data)
+{
+    int n;
+    int ret;
+    char tmp[64];
+    struct flb_tail_file *file;
+    struct flb_tail_worker *worker = data;
+    struct flb_tail_config *ctx = worker->ctx;
+
+    snprintf(tmp, sizeof(tmp) - 1, "flb-in-%s-w%i", ctx->ins->name, worker->id);
+    mk_utils_worker_rename(tmp);
+
+    while (1) {
+        n = flb_pipe_r(worker->ch_files[0], &file, sizeof(file));
+        if (n <= 0) {
+            flb_errno();
+            break;
+        }
+
+        /* a NULL reference means the worker must stop */
+        if (!file) {
+            break;
+        }
+
+        if (worker->ml_ctx) {
+            pthread_mutex_lock(&worker->ml_lock);
+        }
+
+        /* read until the file is drained or the batch is big enough */
+        do {
+            ret = flb_tail_file_chunk(file);
+        } while (ret == FLB_TAIL_OK && file->pending_bytes > 0 &&
+                 file->worker_sbuf.size < FLB_TAIL_WORKER_BATCH);
+
+        if (worker->ml_ctx) {
+            pthread_mutex_unlock(&worker->ml_lock);
+        }
+
+        file->worker_ret = ret;
+
+        n = flb_pipe_w(ctx->ch_workers[1], &file, sizeof(file));
+        if (n == -1) {
+            flb_errno();
+        }
+    }
+}
+
+int flb_tail_worker_create_all(struct flb_tail_config *ctx,
+                               struct flb_config *config)
+{
+    int i;
+    int ret;
+    struct flb_tail_worker *worker;
+
+    ctx->worker_list = flb_calloc(ctx->workers, sizeof(struct flb_tail_worker));
+    if (!ctx->worker_list) {
+        flb_errno();
+        return -1;
+    }
+
+    /* Channel used by the workers to hand back processed files */
+    ret = flb_pipe_create(ctx->ch_workers);
+    if (ret == -1) {
+        flb_errno();
+        flb_free(ctx->worker_list);
+        ctx->worker_list = NULL;
+        return -1;
+    }
+
+    ret = flb_pipe_set_nonblocking(ctx->ch_workers[0]);
+    if (ret == -1) {
+        flb_errno();
+        flb_tail_worker_destroy_all(ctx);
+        return -1;
+    }
+
+    for (i = 0; i < ctx->workers; i++) {
+        worker = &ctx->worker_list[i];
+        worker->id = i;
+
+        ret = flb_pipe_create(worker->ch_files);
+        if (ret == -1) {
+            flb_errno();
+            flb_tail_worker_destroy_all(ctx);
+            return -1;
+        }
+        pthread_mutex_init(&worker->ml_lock, NULL);
+        worker->ctx = ctx;
+
+#ifdef FLB_HAVE_PARSER
+        /* Multiline core: every worker has its own streams */
+        if (ctx->ml_ctx) {
+            worker->ml_ctx = flb_tail_config_ml_create(ctx);
+            if (!worker->ml_ctx) {
+                flb_plg_error(ctx->ins, "could not create multiline context "
+                              "for worker #%i", i);
+                flb_tail_worker_destroy_all(ctx);
+                return -1;
+            }
+        }
+#endif
+
+        ret = flb_worker_create(tail_worker, worker, &worker->tid, config);
+        if (ret == -1) {
+            flb_plg_error(ctx->ins, "could not spawn worker #%i", i);
+            flb_tail_worker_destroy_all(ctx);
+            return -1;
+        }
+        worker->running = FLB_TRUE;
+    }
+
+    flb_plg_info(ctx->ins, "%i workers started", ctx->workers);
+    return 0;
+}
+
+/* Stop the threads, the files already dispatched are finished before */
+void flb_tail_worker_stop_all(struct flb_tail_config *ctx)
+{
+    int i;
+    int n;
+    struct flb_tail_file *stop = NULL;
+    struct flb_tail_worker *worker;
+
+    if (!ctx->worker_list) {
+        return;
+    }
+
+    for (i = 0; i < ctx->workers; i++) {
+        worker = &ctx->worker_list[i];
+        if (worker->running == FLB_FALSE) {
+            continue;
+        }
+
+        n = flb_pipe_w(worker->ch_files[1], &stop, sizeof(stop));
+        if (n == -1) {
+            flb_errno();
+        }
+        else {
+            pthread_join(worker->tid, NULL);
+        }
+        worker->running = FLB_FALSE;
+    }
+}
+
+void flb_tail_worker_destroy_all(struct flb_tail_config *ctx)
+{
+    int i;
+    struct flb_tail_worker *worker;
+
+    if (!ctx->worker_list) {
+        return;
+    }
+
+    flb_tail_worker_stop_all(ctx);
+
+    for (i = 0; i < ctx->workers; i++) {
+        worker = &ctx->worker_list[i];
+        if (!worker->ctx) {
+            continue;
+        }
+
+        flb_pipe_destroy(worker->ch_files);
+#ifdef FLB_HAVE_PARSER
+        if (worker->ml_ctx) {
+            flb_ml_destroy(worker->ml_ctx);
+        }
+#endif
+        pthread_mutex_destroy(&worker->ml_lock);
+    }
+
+    flb_pipe_destroy(ctx->ch_workers);
+    flb_free(ctx->worker_list);
+    ctx->worker_list = NULL;
+}
+
+/*
+ * Hand a file to its worker, files are assigned by inode so the same file
+ * always lands in the same thread. Returns -1 if the file must be processed
+ * later.
+ */
+int flb_tail_worker_dispatch(struct flb_tail_file *file)
+{
+    int n;
+    struct flb_tail_worker *worker = file->worker;
+    struct flb_tail_config *ctx = file->config;
+
+    if (file->worker_busy == FLB_TRUE ||
+        ctx->workers_inflight >= FLB_TAIL_WORKER_INFLIGHT) {
+        return -1;
+    }
+
+    file->worker_busy = FLB_TRUE;
+
+    n = flb_pipe_w(worker->ch_files[1], &file, sizeof(file));
+    if (n == -1) {
+        flb_errno();
+        file->worker_busy = FLB_FALSE;
+        return -1;
+    }
+    ctx->workers_inflight++;
+
+    return 0;
+}
+
+/* Take back a file from a worker: register its records and state */
+static void worker_file_done(struct flb_tail_file *file,
+                             struct flb_config *config)
+{
+    int ret;
+    struct flb_tail_config *ctx = file->config;
+
+    file->worker_busy = FLB_FALSE;
+    ctx->workers_inflight--;
+
+    if (file->worker_sbuf.size > 0) {
+        flb_input_chunk_append_raw(ctx->ins,
+                                   file->tag_buf,
+                                   file->tag_len,
+                                   file->worker_sbuf.data,
+                                   file->worker_sbuf.size);
+    }
+
+    /* release the buffer: there might be thousands of files */
+    msgpack_sbuffer_destroy(&file->worker_sbuf);
+    msgpack_sbuffer_init(&file->worker_sbuf);
+
+#ifdef FLB_HAVE_SQLDB
+    /* the offsets of a collect round are written together */
+    if (ctx->db) {
+        flb_tail_db_file_journal(file, ctx);
+    }
+#endif
+
+    if (file->worker_ret == FLB_TAIL_ERROR) {
+        /* Could not longer read the file */
+        flb_plg_debug(ctx->ins, "inode=%"PRIu64" collect ERROR", file->inode);
+        flb_tail_file_remove(file);
+        return;
+    }
+
+    if (file->tail_mode == FLB_TAIL_STATIC) {
+        if (file->worker_ret != FLB_TAIL_WAIT) {
+            /* dispatched again by the static collector */
+            return;
+        }
+
+        if (ctx->exit_on_eof) {
+            flb_plg_info(ctx->ins, "inode=%"PRIu64" file=%s ended, stop",
+                         file->inode, file->name);
+            if (mk_list_size(&ctx->files_static) == 1) {
+                flb_engine_exit(config);
+            }
+        }
+        /* Promote file to 'events' type handler */
+        flb_plg_debug(ctx->ins, "inode=%"PRIu64" file=%s promote to TAIL_EVENT",
+                      file->inode, file->name);
+        ret = flb_tail_file_to_event(file);
+        if (ret == -1) {
+            flb_plg_debug(ctx->ins, "file=%s cannot promote, unregistering",
+                          file->name);
+            flb_tail_file_remove(file);
+        }
+        return;
+    }
+
+    /* Events received while the worker owned the file (rotation, delete) */
+    if (file->worker_events != 0) {
+        flb_tail_fs_replay(ctx, file, config);
+        return;
+    }
+
+    /* Keep reading while new content is pending */
+    if (file->pending_bytes > 0) {
+        flb_tail_worker_dispatch(file);
+    }
+}
+
+/* cb_collect callback: files handed back by the workers */
+int flb_tail_worker_collect(struct flb_input_instance *ins,
+                            struct flb_config *config, void *context)
+{
+    int n;
+    struct flb_tail_file *file;
+    struct flb_tail_config *ctx = context;
+    (void) ins;
+
+    while (1) {
+        n = flb_pipe_r(ctx->ch_workers[0], &file, sizeof(file));
+        if (n <= 0) {
+            if (!FLB_PIPE_WOULDBLOCK()) {
+                flb_errno();
+            }
+            break;
+        }
+        worker_file_done(file, config);
+    }
+
+#ifdef FLB_HAVE_SQLDB
+    /* Without a commit policy, write the offsets of the round at once */
+    if (ctx->db && ctx->db_commit_interval <= 0 && ctx->db_commit_bytes == 0) {
+        flb_tail_db_commit(ctx);
+    }
+#endif
+
+    /* Files still pending in the static list need a new dispatch round */
+    if (mk_list_size(&ctx->files_static) > 0) {
+        tail_signal_manager(ctx);
+    }
+
+    return 0;
+}
+
+/*
+ * cb_collect callback: flush the multiline streams of the workers. A worker
+ * processing a file holds its lock, it's flushed in the next round.
+ */
+int flb_tail_worker_ml_flush(struct flb_input_instance *ins,
+                             struct flb_config *config, void *context)
+{
+    int i;
+    struct flb_tail_worker *worker;
+    struct flb_tail_config *ctx = context;
+    (void) ins;
+    (void) config;
+
+    for (i = 0; i < ctx->workers; i++) {
+        worker = &ctx->worker_list[i];
+        if (!worker->ml_ctx) {
+            continue;
+        }
+
+        if (pthread_mutex_trylock(&worker->ml_lock) != 0) {
+            continue;
+        }
+        flb_ml_flush_pending_now(worker->ml_ctx);
+        pthread_mutex_unlock(&worker->ml_lock);
+    }
+
+    return 0;
+}
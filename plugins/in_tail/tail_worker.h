@@ -0,0 +1,58 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_TAIL_WORKER_H
+#define FLB_TAIL_WORKER_H
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_pipe.h>
+
+#include "tail_config.h"
+#include "tail_file.h"
+
+struct flb_tail_worker {
+    int id;                    /* worker number                   */
+    int running;               /* thread started                  */
+    pthread_t tid;             /* thread ID                       */
+    flb_pipefd_t ch_files[2];  /* pipe: files dispatched to it    */
+
+    /*
+     * Multiline core: streams of the files of this worker. The worker holds
+     * the lock while it processes a file, the engine thread takes it to
+     * create, destroy and flush streams.
+     */
+    struct flb_ml *ml_ctx;
+    pthread_mutex_t ml_lock;
+
+    struct flb_tail_config *ctx;
+};
+
+int flb_tail_worker_create_all(struct flb_tail_config *ctx,
+                               struct flb_config *config);
+void flb_tail_worker_stop_all(struct flb_tail_config *ctx);
+void flb_tail_worker_destroy_all(struct flb_tail_config *ctx);
+int flb_tail_worker_dispatch(struct flb_tail_file *file);
+int flb_tail_worker_collect(struct flb_input_instance *ins,
+                            struct flb_config *config, void *context);
+int flb_tail_worker_ml_flush(struct flb_input_instance *ins,
+                             struct flb_config *config, void *context);
+
+#endif
@@ -212,8 +212,12 @@ int tcp_conn_event(void *data)
         conn->buf_len += bytes;
         conn->buf_data[conn->buf_len] = '\0';
 
-        /* Strip CR or LF if found at first byte */
-        if (conn->buf_data[0] == '\r' || conn->buf_data[0] == '\n') {
+        /*
+         * Strip CR or LF if found at first byte, unless the JSON parser is
+         * resuming an incomplete message that starts in the buffer.
+         */
+        if (!conn->pack_state.scan_resume &&
+            (conn->buf_data[0] == '\r' || conn->buf_data[0] == '\n')) {
             /* Skip message with one byte with CR or LF */
             flb_plg_trace(ctx->ins, "skip one byte message with ASCII code=%i",
                       conn->buf_data[0]);
@@ -24,7 +24,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_config_map.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
 #include <mbedtls/sha256.h>
 #include <mbedtls/base64.h>
 
@@ -128,8 +128,9 @@ static int send_blob(struct flb_config *config,
     payload_size = out_size;
 
     if (ctx->compress_gzip == FLB_TRUE || ctx->compress_blob == FLB_TRUE) {
-        ret = flb_gzip_compress((void *) out_buf, out_size,
-                                &payload_buf, &payload_size);
+        ret = flb_output_compress(ctx->ins, FLB_COMPRESS_GZIP,
+                                  (void *) out_buf, out_size,
+                                  &payload_buf, &payload_size);
         if (ret == -1) {
             flb_plg_error(ctx->ins,
                           "cannot gzip payload, disabling compression");
@@ -24,7 +24,7 @@
 #include <fluent-bit/flb_http_client.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_time.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
 
 #include <msgpack.h>
 
@@ -332,8 +332,9 @@ static void cb_datadog_flush(const void *data, size_t bytes,
 
     /* Should we compress the payload ? */
     if (ctx->compress_gzip == FLB_TRUE) {
-        ret = flb_gzip_compress((void *) payload_buf, payload_size,
-                                &final_payload_buf, &final_payload_size);
+        ret = flb_output_compress(ctx->ins, FLB_COMPRESS_GZIP,
+                                  (void *) payload_buf, payload_size,
+                                  &final_payload_buf, &final_payload_size);
         if (ret == -1) {
             flb_error("[out_http] cannot gzip payload, disabling compression");
         } else {
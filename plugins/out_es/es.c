@@ -238,13 +238,9 @@ static flb_sds_t es_get_id_value(struct flb_elasticsearch *ctx,
  *
  * 'Sadly' this process involves to convert from Msgpack to JSON.
  */
-static int elasticsearch_format(struct flb_config *config,
-                                struct flb_input_instance *ins,
-                                void *plugin_context,
-                                void *flush_ctx,
-                                const char *tag, int tag_len,
-                                const void *data, size_t bytes,
-                                void **out_data, size_t *out_size)
+static struct es_bulk *elasticsearch_bulk(struct flb_elasticsearch *ctx,
+                                          const char *tag, int tag_len,
+                                          const void *data, size_t bytes)
 {
     int ret;
     int len;
@@ -252,7 +248,6 @@ static int elasticsearch_format(struct flb_config *config,
     int index_len = 0;
     size_t s = 0;
     size_t off = 0;
-    size_t off_prev = 0;
     char *p;
     char *es_index;
     char logstash_index[256];
@@ -273,7 +268,6 @@ static int elasticsearch_format(struct flb_config *config,
     msgpack_packer tmp_pck;
     uint16_t hash[8];
     int es_index_custom_len;
-    struct flb_elasticsearch *ctx = plugin_context;
 
     /* Iterate the original buffer and perform adjustments */
     msgpack_unpacked_init(&result);
@@ -282,7 +276,7 @@ static int elasticsearch_format(struct flb_config *config,
     ret = msgpack_unpack_next(&result, data, bytes, &off);
     if (ret != MSGPACK_UNPACK_SUCCESS) {
         msgpack_unpacked_destroy(&result);
-        return -1;
+        return NULL;
     }
 
     /* We 'should' get an array */
@@ -292,18 +286,18 @@ static int elasticsearch_format(struct flb_config *config,
          * doing, we just duplicate the content in a new buffer and cleanup.
          */
         msgpack_unpacked_destroy(&result);
-        return -1;
+        return NULL;
     }
 
     root = result.data;
     if (root.via.array.size == 0) {
-        return -1;
+        return NULL;
     }
 
     /* Create the bulk composer */
-    bulk = es_bulk_create(bytes);
+    bulk = es_bulk_create();
     if (!bulk) {
-        return -1;
+        return NULL;
     }
 
     off = 0;
@@ -483,7 +477,7 @@ static int elasticsearch_format(struct flb_config *config,
             msgpack_unpacked_destroy(&result);
             msgpack_sbuffer_destroy(&tmp_sbuf);
             es_bulk_destroy(bulk);
-            return -1;
+            return NULL;
         }
 
         if (ctx->generate_id == FLB_TRUE) {
@@ -531,37 +525,47 @@ static int elasticsearch_format(struct flb_config *config,
         if (!out_buf) {
             msgpack_unpacked_destroy(&result);
             es_bulk_destroy(bulk);
-            return -1;
+            return NULL;
         }
 
-        ret = es_bulk_append(bulk, j_index, index_len,
-                             out_buf, flb_sds_len(out_buf),
-                             bytes, off_prev);
-        flb_sds_destroy(out_buf);
-        off_prev = off;
+        /* the bulk takes the JSON buffer, it's not copied */
+        ret = es_bulk_append(bulk, j_index, index_len, out_buf);
         if (ret == -1) {
             /* We likely ran out of memory, abort here */
             msgpack_unpacked_destroy(&result);
-            *out_size = 0;
             es_bulk_destroy(bulk);
-            return -1;
+            return NULL;
         }
     }
     msgpack_unpacked_destroy(&result);
 
-    /* Set outgoing data */
-    *out_data = bulk->ptr;
-    *out_size = bulk->len;
-
-    /*
-     * Note: we don't destroy the bulk as we need to keep the allocated
-     * buffer with the data. Instead we just release the bulk context and
-     * return the bulk->ptr buffer
-     */
-    flb_free(bulk);
     if (ctx->trace_output) {
-        fwrite(*out_data, 1, *out_size, stdout);
-        fflush(stdout);
+        es_bulk_write(bulk, stdout);
+    }
+
+    return bulk;
+}
+
+/* Test formatter: the bulk payload in a single buffer */
+static int elasticsearch_format(struct flb_config *config,
+                                struct flb_input_instance *ins,
+                                void *plugin_context,
+                                void *flush_ctx,
+                                const char *tag, int tag_len,
+                                const void *data, size_t bytes,
+                                void **out_data, size_t *out_size)
+{
+    struct es_bulk *bulk;
+
+    bulk = elasticsearch_bulk(plugin_context, tag, tag_len, data, bytes);
+    if (!bulk) {
+        return -1;
+    }
+
+    *out_data = es_bulk_flatten(bulk, out_size);
+    es_bulk_destroy(bulk);
+    if (!*out_data) {
+        return -1;
     }
 
     return 0;
@@ -752,11 +756,10 @@ static void cb_es_flush(const void *data, size_t bytes,
                         struct flb_config *config)
 {
     int ret;
-    size_t pack_size;
     char *pack;
-    void *out_buf;
-    size_t out_size;
+    size_t pack_size;
     size_t b_sent;
+    struct es_bulk *bulk;
     struct flb_elasticsearch *ctx = out_context;
     struct flb_upstream_conn *u_conn;
     struct flb_http_client *c;
@@ -769,22 +772,25 @@ static void cb_es_flush(const void *data, size_t bytes,
     }
 
     /* Convert format */
-    ret = elasticsearch_format(config, ins,
-                               ctx, NULL,
-                               tag, tag_len,
-                               data, bytes,
-                               &out_buf, &out_size);
-    if (ret != 0) {
+    bulk = elasticsearch_bulk(ctx, tag, tag_len, data, bytes);
+    if (!bulk) {
         flb_upstream_conn_release(u_conn);
         FLB_OUTPUT_RETURN(FLB_ERROR);
     }
 
-    pack = (char *) out_buf;
-    pack_size = out_size;
-
-    /* Compose HTTP Client request */
+    /* Compose HTTP Client request, the bulk records are the body segments */
     c = flb_http_client(u_conn, FLB_HTTP_POST, ctx->uri,
-                        pack, pack_size, NULL, 0, NULL, 0);
+                        NULL, 0, NULL, 0, NULL, 0);
+    if (!c) {
+        es_bulk_destroy(bulk);
+        flb_upstream_conn_release(u_conn);
+        FLB_OUTPUT_RETURN(FLB_RETRY);
+    }
+
+    ret = es_bulk_http_body(bulk, c);
+    if (ret == -1) {
+        goto retry;
+    }
 
     flb_http_buffer_size(c, ctx->buffer_size);
 
@@ -849,8 +855,12 @@ static void cb_es_flush(const void *data, size_t bytes,
                      * If trace_error is set, trace the actual
                      * input/output to Elasticsearch that caused the problem.
                      */
-                    flb_plg_debug(ctx->ins, "error caused by: Input\n%s\n",
-                                  pack);
+                    pack = es_bulk_flatten(bulk, &pack_size);
+                    if (pack) {
+                        flb_plg_debug(ctx->ins,
+                                      "error caused by: Input\n%s\n", pack);
+                        flb_free(pack);
+                    }
                     flb_plg_error(ctx->ins, "error: Output\n%s",
                                   c->resp.payload);
                 }
@@ -868,7 +878,7 @@ static void cb_es_flush(const void *data, size_t bytes,
 
     /* Cleanup */
     flb_http_client_destroy(c);
-    flb_free(pack);
+    es_bulk_destroy(bulk);
     flb_upstream_conn_release(u_conn);
     if (signature) {
         flb_sds_destroy(signature);
@@ -878,7 +888,7 @@ static void cb_es_flush(const void *data, size_t bytes,
     /* Issue a retry */
  retry:
     flb_http_client_destroy(c);
-    flb_free(pack);
+    es_bulk_destroy(bulk);
     flb_upstream_conn_release(u_conn);
     FLB_OUTPUT_RETURN(FLB_RETRY);
 }
@@ -25,87 +25,171 @@
 #include <fluent-bit.h>
 #include "es_bulk.h"
 
-struct es_bulk *es_bulk_create(size_t estimated_size)
+struct es_bulk *es_bulk_create()
 {
     struct es_bulk *b;
 
-    if (estimated_size < ES_BULK_CHUNK) {
-        estimated_size = ES_BULK_CHUNK;
-    }
-
-    b = flb_malloc(sizeof(struct es_bulk));
+    b = flb_calloc(1, sizeof(struct es_bulk));
     if (!b) {
-        perror("calloc");
+        flb_errno();
         return NULL;
     }
-    b->ptr = flb_malloc(estimated_size);
-    if (b->ptr == NULL) {
-        perror("malloc");
+
+    b->ptr = flb_malloc(ES_BULK_CHUNK);
+    if (!b->ptr) {
+        flb_errno();
         flb_free(b);
         return NULL;
     }
-
-    b->size = estimated_size;
-    b->len  = 0;
+    b->size = ES_BULK_CHUNK;
 
     return b;
 }
 
 void es_bulk_destroy(struct es_bulk *bulk)
 {
-    if (bulk->size > 0) {
-        flb_free(bulk->ptr);
+    int i;
+
+    for (i = 0; i < bulk->records_count; i++) {
+        flb_sds_destroy(bulk->records[i].json);
     }
+    flb_free(bulk->records);
+    flb_free(bulk->ptr);
     flb_free(bulk);
 }
 
-int es_bulk_append(struct es_bulk *bulk, char *index, int i_len,
-                   char *json, size_t j_len,
-                   size_t whole_size, size_t converted_size)
+/* Store the index line, unless it's the one of the previous record */
+static int bulk_index_add(struct es_bulk *bulk, char *index, int i_len,
+                          uint32_t *off)
 {
-    int available;
-    int append_size;
-    int required;
     char *ptr;
+    struct es_bulk_record *prev;
 
-    required = j_len + ES_BULK_HEADER + 1;
-    available = (bulk->size - bulk->len);
-
-    if (available < required) {
-        /*
-         *  estimate a converted size of json
-         *  calculate
-         *    1. rest of msgpack data size
-         *    2. ratio from bulk json size and processed msgpack size.
-         */
-        if (converted_size == 0) {
-            /* converted_size = 0 causes div/0 */
-            flb_debug("[out_es] converted_size is 0");
-            append_size = ES_BULK_CHUNK;
-        } else {
-            append_size = (whole_size - converted_size) /* rest of size to convert */
-                        * (bulk->size / converted_size); /* = json size / msgpack size */
-            if (append_size < ES_BULK_CHUNK) {
-                /* append at least ES_BULK_CHUNK size */
-                append_size = ES_BULK_CHUNK;
-            }
+    if (bulk->records_count > 0) {
+        prev = &bulk->records[bulk->records_count - 1];
+        if (prev->index_len == i_len &&
+            memcmp(bulk->ptr + prev->index_off, index, i_len) == 0) {
+            *off = prev->index_off;
+            return 0;
         }
-        ptr = flb_realloc(bulk->ptr, bulk->size + append_size);
+    }
+
+    if (bulk->size - bulk->len < i_len) {
+        ptr = flb_realloc(bulk->ptr, bulk->size + ES_BULK_CHUNK);
         if (!ptr) {
             flb_errno();
             return -1;
         }
-        bulk->ptr  = ptr;
-        bulk->size += append_size;
+        bulk->ptr = ptr;
+        bulk->size += ES_BULK_CHUNK;
     }
 
     memcpy(bulk->ptr + bulk->len, index, i_len);
+    *off = bulk->len;
     bulk->len += i_len;
 
-    memcpy(bulk->ptr + bulk->len, json, j_len);
-    bulk->len += j_len;
-    bulk->ptr[bulk->len] = '\n';
-    bulk->len++;
+    return 0;
+}
+
+/*
+ * Append a record with its index line. The bulk takes the ownership of
+ * the 'json' buffer, it's released on error too.
+ */
+int es_bulk_append(struct es_bulk *bulk, char *index, int i_len,
+                   flb_sds_t json)
+{
+    int ret;
+    int size;
+    uint32_t off;
+    struct es_bulk_record *records;
+    struct es_bulk_record *r;
+
+    if (bulk->records_count == bulk->records_size) {
+        size = bulk->records_size == 0 ? 64 : bulk->records_size * 2;
+        records = flb_realloc(bulk->records,
+                              sizeof(struct es_bulk_record) * size);
+        if (!records) {
+            flb_errno();
+            flb_sds_destroy(json);
+            return -1;
+        }
+        bulk->records = records;
+        bulk->records_size = size;
+    }
+
+    ret = bulk_index_add(bulk, index, i_len, &off);
+    if (ret == -1 || flb_sds_cat_safe(&json, "\n", 1) == -1) {
+        flb_sds_destroy(json);
+        return -1;
+    }
+
+    r = &bulk->records[bulk->records_count++];
+    r->index_off = off;
+    r->index_len = i_len;
+    r->json = json;
+    bulk->payload_size += i_len + flb_sds_len(json);
 
     return 0;
-};
+}
+
+/* Set the bulk as the request body, the buffers are not copied */
+int es_bulk_http_body(struct es_bulk *bulk, struct flb_http_client *c)
+{
+    int i;
+    int ret;
+    struct es_bulk_record *r;
+
+    for (i = 0; i < bulk->records_count; i++) {
+        r = &bulk->records[i];
+        ret = flb_http_add_body_segment(c, bulk->ptr + r->index_off,
+                                        r->index_len);
+        if (ret == 0) {
+            ret = flb_http_add_body_segment(c, r->json, flb_sds_len(r->json));
+        }
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Return the payload in one buffer (e.g: test formatter or error traces) */
+char *es_bulk_flatten(struct es_bulk *bulk, size_t *out_size)
+{
+    int i;
+    char *buf;
+    size_t len = 0;
+    struct es_bulk_record *r;
+
+    buf = flb_malloc(bulk->payload_size + 1);
+    if (!buf) {
+        flb_errno();
+        return NULL;
+    }
+
+    for (i = 0; i < bulk->records_count; i++) {
+        r = &bulk->records[i];
+        memcpy(buf + len, bulk->ptr + r->index_off, r->index_len);
+        len += r->index_len;
+        memcpy(buf + len, r->json, flb_sds_len(r->json));
+        len += flb_sds_len(r->json);
+    }
+    buf[len] = '\0';
+
+    *out_size = len;
+    return buf;
+}
+
+void es_bulk_write(struct es_bulk *bulk, FILE *fp)
+{
+    int i;
+    struct es_bulk_record *r;
+
+    for (i = 0; i < bulk->records_count; i++) {
+        r = &bulk->records[i];
+        fwrite(bulk->ptr + r->index_off, 1, r->index_len, fp);
+        fwrite(r->json, 1, flb_sds_len(r->json), fp);
+    }
+    fflush(fp);
+}
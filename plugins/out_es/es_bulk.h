@@ -21,7 +21,10 @@
 #ifndef FLB_OUT_ES_BULK_H
 #define FLB_OUT_ES_BULK_H
 
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_http_client.h>
 #include <inttypes.h>
+#include <stdio.h>
 
 #define ES_BULK_CHUNK      4096  /* Size of buffer chunks    */
 #define ES_BULK_HEADER      165  /* ES Bulk API prefix line  */
@@ -30,16 +33,37 @@
 #define ES_BULK_INDEX_FMT_WITHOUT_TYPE  "{\"create\":{\"_index\":\"%s\"}}\n"
 #define ES_BULK_INDEX_FMT_ID_WITHOUT_TYPE "{\"create\":{\"_index\":\"%s\",\"_id\":\"%s\"}}\n"
 
+/* A record of the bulk: its index line and its JSON */
+struct es_bulk_record {
+    uint32_t index_off;          /* index line offset in bulk->ptr */
+    uint32_t index_len;
+    flb_sds_t json;              /* JSON record and its '\n' */
+};
+
+/*
+ * The bulk payload is not concatenated: the records keep their JSON buffer
+ * and the HTTP client sends everything as body segments. The index lines
+ * are stored once in 'ptr', consecutive records with the same index line
+ * share it.
+ */
 struct es_bulk {
     char *ptr;
     uint32_t len;
     uint32_t size;
+
+    struct es_bulk_record *records;
+    int records_count;
+    int records_size;
+
+    size_t payload_size;         /* index lines plus records */
 };
 
-struct es_bulk *es_bulk_create(size_t estimated_size);
+struct es_bulk *es_bulk_create();
 int es_bulk_append(struct es_bulk *bulk, char *index, int i_len,
-                   char *json, size_t j_len,
-                   size_t whole_size, size_t curr_size);
+                   flb_sds_t json);
+int es_bulk_http_body(struct es_bulk *bulk, struct flb_http_client *c);
+char *es_bulk_flatten(struct es_bulk *bulk, size_t *out_size);
+void es_bulk_write(struct es_bulk *bulk, FILE *fp);
 void es_bulk_destroy(struct es_bulk *bulk);
 
 #endif
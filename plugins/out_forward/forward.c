@@ -962,8 +962,10 @@ static int flush_forward_mode(struct flb_forward *ctx,
 {
     int ret;
     int entries;
+    int iov_count;
     size_t off = 0;
     size_t bytes_sent;
+    struct mk_iovec iov[3];
     msgpack_object root;
     msgpack_object chunk;
     msgpack_unpacked result;
@@ -1002,39 +1004,27 @@ static int flush_forward_mode(struct flb_forward *ctx,
         msgpack_pack_array(&mp_pck, entries);
     }
 
-    /* Write message header */
-    ret = flb_io_net_write(u_conn, mp_sbuf.data, mp_sbuf.size, &bytes_sent);
-    if (ret == -1) {
-        flb_plg_error(ctx->ins, "could not write forward header");
-        msgpack_sbuffer_destroy(&mp_sbuf);
-        if (fc->compress == COMPRESS_GZIP) {
-            flb_free(final_data);
-        }
-        return FLB_RETRY;
-    }
-    msgpack_sbuffer_destroy(&mp_sbuf);
+    /* Write message header, entries and options at once */
+    iov[0].iov_base = mp_sbuf.data;
+    iov[0].iov_len = mp_sbuf.size;
+    iov[1].iov_base = (void *) final_data;
+    iov[1].iov_len = final_bytes;
+    iov_count = 2;
 
-    /* Write entries */
-    ret = flb_io_net_write(u_conn, final_data, final_bytes, &bytes_sent);
-    if (ret == -1) {
-        flb_plg_error(ctx->ins, "could not write forward entries");
-        if (fc->compress == COMPRESS_GZIP) {
-            flb_free(final_data);
-        }
-        return FLB_RETRY;
+    if (fc->send_options == FLB_TRUE) {
+        iov[2].iov_base = opts_buf;
+        iov[2].iov_len = opts_size;
+        iov_count++;
     }
 
+    ret = flb_io_net_writev(u_conn, iov, iov_count, &bytes_sent);
+    msgpack_sbuffer_destroy(&mp_sbuf);
     if (fc->compress == COMPRESS_GZIP) {
         flb_free(final_data);
     }
-
-    /* Write options */
-    if (fc->send_options == FLB_TRUE) {
-        ret = flb_io_net_write(u_conn, opts_buf, opts_size, &bytes_sent);
-        if (ret == -1) {
-            flb_plg_error(ctx->ins, "could not write forward options");
-            return FLB_RETRY;
-        }
+    if (ret == -1) {
+        flb_plg_error(ctx->ins, "could not write forward entries");
+        return FLB_RETRY;
     }
 
     /* If the sender requires 'ack' from the remote end-point */
@@ -27,7 +27,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_sds.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
 #include <msgpack.h>
 
 #include <stdio.h>
@@ -96,8 +96,9 @@ static int http_post(struct flb_out_http *ctx,
 
     /* Should we compress the payload ? */
     if (ctx->compress_gzip == FLB_TRUE) {
-        ret = flb_gzip_compress((void *) body, body_len,
-                                &payload_buf, &payload_size);
+        ret = flb_output_compress(ctx->ins, FLB_COMPRESS_GZIP,
+                                  (void *) body, body_len,
+                                  &payload_buf, &payload_size);
         if (ret == -1) {
             flb_plg_error(ctx->ins,
                           "cannot gzip payload, disabling compression");
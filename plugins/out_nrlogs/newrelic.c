@@ -21,7 +21,7 @@
 #include <fluent-bit/flb_output_plugin.h>
 #include <fluent-bit/flb_version.h>
 #include <fluent-bit/flb_pack.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_http_client.h>
@@ -373,8 +373,9 @@ static void cb_newrelic_flush(const void *data, size_t bytes,
 
     /* Should we compress the payload ? */
     if (ctx->compress_gzip == FLB_TRUE) {
-        ret = flb_gzip_compress(payload, flb_sds_len(payload),
-                                &payload_buf, &payload_size);
+        ret = flb_output_compress(ctx->ins, FLB_COMPRESS_GZIP,
+                                  payload, flb_sds_len(payload),
+                                  &payload_buf, &payload_size);
         if (ret == -1) {
             flb_plg_error(ctx->ins,
                           "cannot gzip payload, disabling compression");
@@ -149,7 +149,7 @@ static flb_sds_t hash_format_metrics(struct prom_exporter *ctx)
     int size = 2048;
     flb_sds_t buf;
 
-    struct mk_list *head;
+    struct flb_hash_entry *tmp;
     struct flb_hash_entry *entry;
 
 
@@ -159,8 +159,7 @@ static flb_sds_t hash_format_metrics(struct prom_exporter *ctx)
     }
 
     /* Take every hash entry and compose one buffer with the whole content */
-    mk_list_foreach(head, &ctx->ht_metrics->entries) {
-        entry = mk_list_entry(head, struct flb_hash_entry, _head_parent);
+    flb_hash_foreach(entry, tmp, ctx->ht_metrics) {
         flb_sds_cat_safe(&buf, entry->val, entry->val_size);
     }
 
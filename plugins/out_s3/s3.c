@@ -27,7 +27,7 @@
 #include <fluent-bit/flb_aws_util.h>
 #include <fluent-bit/flb_signv4.h>
 #include <fluent-bit/flb_scheduler.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <mbedtls/base64.h>
@@ -1273,7 +1273,9 @@ static int s3_put_object(struct flb_s3 *ctx, const char *tag, time_t create_time
     uri = tmp;
 
     if (ctx->compression == COMPRESS_GZIP) {
-        ret = flb_gzip_compress(body, body_size, &compressed_body, &final_body_size);
+        ret = flb_output_compress(ctx->ins, FLB_COMPRESS_GZIP,
+                                  body, body_size,
+                                  &compressed_body, &final_body_size);
         if (ret == -1) {
             flb_plg_error(ctx->ins, "Failed to compress data");
             flb_sds_destroy(uri);
@@ -24,7 +24,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_mp.h>
 #include <fluent-bit/flb_time.h>
-#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_compress.h>
 #include <fluent-bit/flb_ra_key.h>
 
 #include <msgpack.h>
@@ -465,8 +465,9 @@ static void cb_splunk_flush(const void *data, size_t bytes,
 
     /* Should we compress the payload ? */
     if (ctx->compress_gzip == FLB_TRUE) {
-        ret = flb_gzip_compress((void *) buf_data, buf_size,
-                                &payload_buf, &payload_size);
+        ret = flb_output_compress(ctx->ins, FLB_COMPRESS_GZIP,
+                                  (void *) buf_data, buf_size,
+                                  &payload_buf, &payload_size);
         if (ret == -1) {
             flb_plg_error(ctx->ins,
                           "cannot gzip payload, disabling compression");
@@ -0,0 +1,289 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_pipe.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_worker.h>
+#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_snappy.h>
+#include <fluent-bit/flb_compress.h>
+
+/*
+ * A compression job submitted by a coroutine. The coroutine waits on the
+ * read end of the job channel, registered in the event loop of its own
+ * thread, and the worker writes a byte once the job is done.
+ */
+struct flb_compress_job {
+    struct mk_event event;     /* event loop notification, must be first */
+    struct flb_coro *coro;     /* coroutine waiting for the result       */
+    flb_pipefd_t ch[2];        /* completion channel                     */
+
+    int type;
+    void *in_data;
+    size_t in_len;
+    void *out_data;
+    size_t out_len;
+    int ret;
+
+    struct mk_list _head;      /* link to flb_compress_pool->jobs        */
+};
+
+int flb_compress_type(const char *name)
+{
+    if (strcasecmp(name, "gzip") == 0) {
+        return FLB_COMPRESS_GZIP;
+    }
+    else if (strcasecmp(name, "snappy") == 0) {
+        return FLB_COMPRESS_SNAPPY;
+    }
+    else if (strcasecmp(name, "none") == 0 || strcasecmp(name, "off") == 0) {
+        return FLB_COMPRESS_NONE;
+    }
+
+    return -1;
+}
+
+const char *flb_compress_name(int type)
+{
+    switch (type) {
+    case FLB_COMPRESS_GZIP:
+        return "gzip";
+    case FLB_COMPRESS_SNAPPY:
+        return "snappy";
+    }
+
+    return "none";
+}
+
+/* Compress a buffer in the calling thread */
+int flb_compress(int type, void *in_data, size_t in_len,
+                 void **out_data, size_t *out_len)
+{
+    int ret;
+
+    switch (type) {
+    case FLB_COMPRESS_GZIP:
+        return flb_gzip_compress(in_data, in_len, out_data, out_len);
+    case FLB_COMPRESS_SNAPPY:
+        ret = flb_snappy_compress(in_data, in_len, out_data, out_len);
+        return (ret == 0) ? 0 : -1;
+    }
+
+    return -1;
+}
+
+/* Uncompress a buffer in the calling thread */
+int flb_uncompress(int type, void *in_data, size_t in_len,
+                   void **out_data, size_t *out_len)
+{
+    int ret;
+
+    switch (type) {
+    case FLB_COMPRESS_GZIP:
+        return flb_gzip_uncompress(in_data, in_len, out_data, out_len);
+    case FLB_COMPRESS_SNAPPY:
+        ret = flb_snappy_uncompress(in_data, in_len, out_data, out_len);
+        return (ret == 0) ? 0 : -1;
+    }
+
+    return -1;
+}
+
+static void compress_worker(void *data)
+{
+    int n;
+    char c = 0;
+    struct flb_compress_job *job;
+    struct flb_compress_pool *pool = data;
+
+    mk_utils_worker_rename("flb-compress");
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (mk_list_is_empty(&pool->jobs) == 0 && !pool->exit) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        if (mk_list_is_empty(&pool->jobs) == 0) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        job = mk_list_entry_first(&pool->jobs, struct flb_compress_job, _head);
+        mk_list_del(&job->_head);
+        pthread_mutex_unlock(&pool->lock);
+
+        job->ret = flb_compress(job->type, job->in_data, job->in_len,
+                                &job->out_data, &job->out_len);
+
+        /* wake up the coroutine */
+        n = flb_pipe_w(job->ch[1], &c, sizeof(c));
+        if (n == -1) {
+            flb_errno();
+        }
+    }
+}
+
+/* Event loop callback: the job finished, resume its coroutine */
+static int compress_job_resume(void *data)
+{
+    int n;
+    char c;
+    struct flb_compress_job *job = data;
+
+    n = flb_pipe_r(job->ch[0], &c, sizeof(c));
+    if (n <= 0) {
+        flb_errno();
+    }
+
+    /* the coroutine owns and releases the job */
+    flb_coro_resume(job->coro);
+    return 0;
+}
+
+/*
+ * Compress a buffer. When a compression pool exists and the caller runs
+ * inside a coroutine, the work is handed to the pool and the coroutine
+ * yields until it's done so the event loop keeps running; otherwise the
+ * buffer is compressed in place.
+ */
+int flb_compress_async(struct flb_config *config, int type,
+                       void *in_data, size_t in_len,
+                       void **out_data, size_t *out_len)
+{
+    int ret;
+    struct flb_coro *coro;
+    struct mk_event_loop *evl;
+    struct flb_compress_job *job;
+    struct flb_compress_pool *pool = config->compress_pool;
+
+    /* outside of a coroutine (e.g: a timer callback) compress in place */
+    coro = flb_coro_get();
+    evl = flb_engine_evl_get();
+    if (!pool || !coro || !evl) {
+        return flb_compress(type, in_data, in_len, out_data, out_len);
+    }
+
+    job = flb_calloc(1, sizeof(struct flb_compress_job));
+    if (!job) {
+        flb_errno();
+        return -1;
+    }
+    job->type = type;
+    job->coro = coro;
+    job->in_data = in_data;
+    job->in_len = in_len;
+    job->ret = -1;
+
+    ret = flb_pipe_create(job->ch);
+    if (ret == -1) {
+        flb_errno();
+        flb_free(job);
+        return flb_compress(type, in_data, in_len, out_data, out_len);
+    }
+
+    MK_EVENT_INIT(&job->event, job->ch[0], job, compress_job_resume);
+    ret = mk_event_add(evl, job->ch[0], FLB_ENGINE_EV_CUSTOM,
+                       MK_EVENT_READ, &job->event);
+    if (ret == -1) {
+        flb_pipe_destroy(job->ch);
+        flb_free(job);
+        return flb_compress(type, in_data, in_len, out_data, out_len);
+    }
+    job->event.type = FLB_ENGINE_EV_CUSTOM;
+
+    pthread_mutex_lock(&pool->lock);
+    mk_list_add(&job->_head, &pool->jobs);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    flb_coro_yield(coro, FLB_FALSE);
+
+    mk_event_del(evl, &job->event);
+    flb_pipe_destroy(job->ch);
+
+    ret = job->ret;
+    if (ret == 0) {
+        *out_data = job->out_data;
+        *out_len = job->out_len;
+    }
+    flb_free(job);
+
+    return ret;
+}
+
+struct flb_compress_pool *flb_compress_pool_create(struct flb_config *config,
+                                                   int workers)
+{
+    int i;
+    int ret;
+    struct flb_compress_pool *pool;
+
+    pool = flb_calloc(1, sizeof(struct flb_compress_pool));
+    if (!pool) {
+        flb_errno();
+        return NULL;
+    }
+    mk_list_init(&pool->jobs);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    pool->tids = flb_calloc(workers, sizeof(pthread_t));
+    if (!pool->tids) {
+        flb_errno();
+        flb_compress_pool_destroy(pool);
+        return NULL;
+    }
+
+    for (i = 0; i < workers; i++) {
+        ret = flb_worker_create(compress_worker, pool, &pool->tids[i], config);
+        if (ret == -1) {
+            flb_error("[compress] could not spawn worker #%i", i);
+            flb_compress_pool_destroy(pool);
+            return NULL;
+        }
+        pool->workers++;
+    }
+
+    flb_info("[compress] %i workers started", workers);
+    return pool;
+}
+
+/* Stop the workers once the queued jobs are done */
+void flb_compress_pool_destroy(struct flb_compress_pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->exit = FLB_TRUE;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->workers; i++) {
+        pthread_join(pool->tids[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    flb_free(pool->tids);
+    flb_free(pool);
+}
@@ -124,12 +124,33 @@ struct flb_service_config service_configs[] = {
     {FLB_CONF_STORAGE_CHECKSUM,
      FLB_CONF_TYPE_BOOL,
      offsetof(struct flb_config, storage_checksum)},
+    {FLB_CONF_STORAGE_INDEX,
+     FLB_CONF_TYPE_BOOL,
+     offsetof(struct flb_config, storage_index)},
     {FLB_CONF_STORAGE_BL_MEM_LIMIT,
      FLB_CONF_TYPE_STR,
      offsetof(struct flb_config, storage_bl_mem_limit)},
+    {FLB_CONF_STORAGE_BL_WORKERS,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, storage_bl_workers)},
+    {FLB_CONF_STORAGE_BL_RATIO,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, storage_bl_ratio)},
     {FLB_CONF_STORAGE_MAX_CHUNKS_UP,
      FLB_CONF_TYPE_INT,
      offsetof(struct flb_config, storage_max_chunks_up)},
+    {FLB_CONF_STORAGE_MEM_BUDGET,
+     FLB_CONF_TYPE_STR,
+     offsetof(struct flb_config, storage_mem_budget)},
+    {FLB_CONF_STORAGE_MEM_BUDGET_SPILL,
+     FLB_CONF_TYPE_BOOL,
+     offsetof(struct flb_config, storage_mem_budget_spill)},
+    {FLB_CONF_STORAGE_SYNC_INTERVAL,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, storage_sync_interval)},
+    {FLB_CONF_STORAGE_SYNC_BYTES,
+     FLB_CONF_TYPE_STR,
+     offsetof(struct flb_config, storage_sync_bytes)},
 
     /* Coroutines */
     {FLB_CONF_STR_CORO_STACK_SIZE,
@@ -144,6 +165,19 @@ struct flb_service_config service_configs[] = {
      FLB_CONF_TYPE_INT,
      offsetof(struct flb_config, sched_base)},
 
+    /* Compression */
+    {FLB_CONF_STR_COMPRESS_WORKERS,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, compress_workers)},
+
+    /* Tasks */
+    {FLB_CONF_STR_TASK_SOFT_LIMIT,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, task_soft_limit)},
+    {FLB_CONF_STR_TASK_HARD_LIMIT,
+     FLB_CONF_TYPE_INT,
+     offsetof(struct flb_config, task_hard_limit)},
+
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     {FLB_CONF_STR_STREAMS_FILE,
      FLB_CONF_TYPE_STR,
@@ -246,7 +280,17 @@ struct flb_config *flb_config_init()
     mk_list_init(&config->upstreams);
     mk_list_init(&config->cmetrics);
 
-    memset(&config->tasks_map, '\0', sizeof(config->tasks_map));
+    /* Routes mask grows with the number of outputs */
+    config->route_mask_size = 1;
+
+    /* Tasks map is allocated on demand */
+    config->tasks_map = NULL;
+    config->tasks_map_size = 0;
+    config->tasks_map_free = -1;
+    config->tasks_count = 0;
+    config->tasks_paused = FLB_FALSE;
+    config->task_soft_limit = 0;
+    config->task_hard_limit = 0;
 
     /* Environment */
     config->env = flb_env_create();
@@ -410,6 +454,12 @@ void flb_config_exit(struct flb_config *config)
     if (config->storage_bl_mem_limit) {
         flb_free(config->storage_bl_mem_limit);
     }
+    if (config->storage_mem_budget) {
+        flb_free(config->storage_mem_budget);
+    }
+    if (config->storage_sync_bytes) {
+        flb_free(config->storage_sync_bytes);
+    }
 
 #ifdef FLB_HAVE_STREAM_PROCESSOR
     if (config->stream_processor_file) {
@@ -423,6 +473,7 @@ void flb_config_exit(struct flb_config *config)
         mk_event_loop_destroy(config->evl);
     }
 
+    flb_task_map_destroy(config);
     flb_plugins_unregister(config);
     flb_free(config);
 }
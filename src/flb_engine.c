@@ -35,6 +35,7 @@
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_compress.h>
 #include <fluent-bit/flb_engine_dispatch.h>
 #include <fluent-bit/flb_network.h>
 #include <fluent-bit/flb_task.h>
@@ -137,7 +138,6 @@ static inline int handle_output_event(flb_pipefd_t fd, uint64_t ts,
     int retries;
     int retry_seconds;
     uint32_t type;
-    uint32_t key;
     uint64_t val;
     char *name;
     struct flb_task *task;
@@ -150,9 +150,8 @@ static inline int handle_output_event(flb_pipefd_t fd, uint64_t ts,
         return -1;
     }
 
-    /* Get type and key */
-    type = FLB_BITS_U64_HIGH(val);
-    key  = FLB_BITS_U64_LOW(val);
+    /* Get type */
+    type = FLB_TASK_EVENT_TYPE(val);
 
     if (type != FLB_ENGINE_TASK) {
         flb_error("[engine] invalid event type %i for output handler",
@@ -164,9 +163,9 @@ static inline int handle_output_event(flb_pipefd_t fd, uint64_t ts,
      * The notion of ENGINE_TASK is associated to outputs. All thread
      * references below belongs to flb_output_coro's.
      */
-    ret     = FLB_TASK_RET(key);
-    task_id = FLB_TASK_ID(key);
-    out_id  = FLB_TASK_OUT(key);
+    ret     = FLB_TASK_RET(val);
+    task_id = FLB_TASK_ID(val);
+    out_id  = FLB_TASK_OUT(val);
 
 #ifdef FLB_HAVE_TRACE
     char *trace_st = NULL;
@@ -186,13 +185,20 @@ static inline int handle_output_event(flb_pipefd_t fd, uint64_t ts,
               task_id, out_id, trace_st);
 #endif
 
-    task = config->tasks_map[task_id].task;
+    task = flb_task_map_get(config, task_id);
+    if (!task) {
+        flb_error("[engine] invalid task_id=%i for output handler", task_id);
+        return -1;
+    }
     ins  = flb_output_get_instance(config, out_id);
     if (flb_output_is_threaded(ins) == FLB_FALSE) {
         flb_output_flush_finished(config, out_id);
     }
     name = (char *) flb_output_name(ins);
 
+    /* The output has room for one more flush */
+    ins->dispatch_inflight--;
+
     /* A task has finished, delete it */
     if (ret == FLB_OK) {
         /* cmetrics */
@@ -249,6 +255,7 @@ static inline int handle_output_event(flb_pipefd_t fd, uint64_t ts,
                      flb_input_name(task->i_ins),
                      flb_output_name(ins), out_id);
             flb_task_users_dec(task, FLB_TRUE);
+            flb_engine_dispatch_output(ins, config);
             return 0;
         }
 
@@ -281,6 +288,7 @@ static inline int handle_output_event(flb_pipefd_t fd, uint64_t ts,
                      flb_output_name(ins));
 
             flb_task_users_dec(task, FLB_TRUE);
+            flb_engine_dispatch_output(ins, config);
             return 0;
         }
 
@@ -342,6 +350,9 @@ static inline int handle_output_event(flb_pipefd_t fd, uint64_t ts,
         flb_task_users_dec(task, FLB_TRUE);
     }
 
+    /* Flush the next routes waiting for this output */
+    flb_engine_dispatch_output(ins, config);
+
     return 0;
 }
 
@@ -582,6 +593,15 @@ int flb_engine_start(struct flb_config *config)
     flb_sched_ctx_init();
     flb_sched_ctx_set(sched);
 
+    /* Compression offload pool */
+    if (config->compress_workers > 0) {
+        config->compress_pool = flb_compress_pool_create(config,
+                                                         config->compress_workers);
+        if (!config->compress_pool) {
+            flb_error("[engine] compression pool could not start");
+            return -1;
+        }
+    }
 
     /* Initialize input plugins */
     ret = flb_input_init_all(config);
@@ -607,6 +627,9 @@ int flb_engine_start(struct flb_config *config)
     /* Outputs pre-run */
     flb_output_pre_run(config);
 
+    /* Open the keepalive connections requested by 'net.warmup_connections' */
+    flb_upstream_conn_warmup_list(&config->upstreams);
+
     /* Create and register the timer fd for flush procedure */
     event = &config->event_flush;
     event->mask = MK_EVENT_EMPTY;
@@ -628,6 +651,12 @@ int flb_engine_start(struct flb_config *config)
     }
 #endif
 
+    /* Storage group sync */
+    ret = flb_storage_sync_create(config);
+    if (ret == -1) {
+        return -1;
+    }
+
     /* Initialize collectors */
     flb_input_collectors_start(config);
 
@@ -774,6 +803,7 @@ int flb_engine_start(struct flb_config *config)
         if (config->is_running == FLB_TRUE) {
             flb_net_dns_lookup_context_cleanup(&dns_ctx);
             flb_sched_timer_cleanup(config->sched);
+            flb_upstream_conn_waiters_resume_list(&config->upstreams);
             flb_upstream_conn_pending_destroy_list(&config->upstreams);
 
             /*
@@ -811,6 +841,12 @@ int flb_engine_shutdown(struct flb_config *config)
     flb_output_exit(config);
     flb_custom_exit(config);
 
+    /* compression pool, no coroutines are left waiting on it */
+    if (config->compress_pool) {
+        flb_compress_pool_destroy(config->compress_pool);
+        config->compress_pool = NULL;
+    }
+
     /* Destroy the storage context */
     flb_storage_destroy(config);
 
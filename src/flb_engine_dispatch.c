@@ -29,6 +29,10 @@
 #include <fluent-bit/flb_coro.h>
 #include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_engine_dispatch.h>
+
+#include <chunkio/chunkio.h>
+#include <cmetrics/cmt_time.h>
 
 /* It creates a new output thread using a 'Retry' context */
 int flb_engine_dispatch_retry(struct flb_task_retry *retry,
@@ -76,9 +80,264 @@ int flb_engine_dispatch_retry(struct flb_task_retry *retry,
         flb_task_retry_destroy(retry);
         return -1;
     }
+    retry->o_ins->dispatch_inflight++;
+    return 0;
+}
+
+/* Convert a priority class name to it numeric value */
+int flb_engine_dispatch_priority(const char *str)
+{
+    if (strcasecmp(str, "high") == 0) {
+        return FLB_TASK_PRIO_HIGH;
+    }
+    else if (strcasecmp(str, "normal") == 0) {
+        return FLB_TASK_PRIO_NORMAL;
+    }
+    else if (strcasecmp(str, "low") == 0) {
+        return FLB_TASK_PRIO_LOW;
+    }
+
+    return -1;
+}
+
+static struct flb_dispatch_flow *flow_get(struct flb_output_instance *ins,
+                                          struct flb_input_instance *in)
+{
+    struct mk_list *head;
+    struct flb_dispatch_flow *flow;
+
+    mk_list_foreach(head, &ins->dispatch_flows) {
+        flow = mk_list_entry(head, struct flb_dispatch_flow, _head);
+        if (flow->in == in) {
+            return flow;
+        }
+    }
+
+    flow = flb_calloc(1, sizeof(struct flb_dispatch_flow));
+    if (!flow) {
+        flb_errno();
+        return NULL;
+    }
+    flow->in = in;
+    mk_list_init(&flow->queue);
+    mk_list_add(&flow->_head, &ins->dispatch_flows);
+
+    return flow;
+}
+
+static void flow_queue(struct flb_dispatch_flow *flow,
+                       struct flb_task_route *route, int first)
+{
+    int prio;
+    struct flb_output_instance *ins = route->out;
+
+    if (first == FLB_TRUE) {
+        __mk_list_add(&route->_head_queue, &flow->queue, flow->queue.next);
+    }
+    else {
+        mk_list_add(&route->_head_queue, &flow->queue);
+    }
+    route->queued = FLB_TRUE;
+    ins->dispatch_queued++;
+
+    if (flow->active == FLB_FALSE) {
+        prio = flow->in->dispatch_priority;
+        mk_list_add(&flow->_head_active, &ins->dispatch_active[prio]);
+        flow->active = FLB_TRUE;
+        flow->deficit = 0;
+    }
+}
+
+static void flow_unqueue(struct flb_dispatch_flow *flow,
+                         struct flb_task_route *route)
+{
+    mk_list_del(&route->_head_queue);
+    route->queued = FLB_FALSE;
+    route->out->dispatch_queued--;
+
+    if (mk_list_is_empty(&flow->queue) == 0) {
+        mk_list_del(&flow->_head_active);
+        flow->active = FLB_FALSE;
+        flow->deficit = 0;
+    }
+}
+
+/*
+ * Queue a task route in the output dispatch queue. A queued route holds a
+ * reference to the task so it's not released before being flushed.
+ */
+int flb_engine_dispatch_enqueue(struct flb_task_route *route, uint64_t ts)
+{
+    struct flb_dispatch_flow *flow;
+
+    flow = flow_get(route->out, route->task->i_ins);
+    if (!flow) {
+        return -1;
+    }
+
+    route->queued_ts = ts;
+    flow_queue(flow, route, FLB_FALSE);
+    flb_task_users_inc(route->task);
+
     return 0;
 }
 
+/*
+ * Take the next route to flush: the highest priority class with queued
+ * routes is served first, inside a class the flows take turns dispatching
+ * up to their weight (deficit round robin with unit cost).
+ */
+struct flb_task_route *flb_engine_dispatch_dequeue(struct flb_output_instance *ins)
+{
+    int prio;
+    struct flb_dispatch_flow *flow = NULL;
+    struct flb_task_route *route;
+
+    for (prio = 0; prio < FLB_TASK_PRIO_LEVELS; prio++) {
+        if (mk_list_is_empty(&ins->dispatch_active[prio]) != 0) {
+            flow = mk_list_entry_first(&ins->dispatch_active[prio],
+                                       struct flb_dispatch_flow, _head_active);
+            break;
+        }
+    }
+    if (!flow) {
+        return NULL;
+    }
+
+    if (flow->deficit <= 0) {
+        flow->deficit = flow->in->dispatch_weight;
+    }
+
+    route = mk_list_entry_first(&flow->queue, struct flb_task_route,
+                                _head_queue);
+    flow_unqueue(flow, route);
+    flow->deficit--;
+
+    /* the turn is over, move the flow to the end of its class */
+    if (flow->active == FLB_TRUE && flow->deficit <= 0) {
+        mk_list_del(&flow->_head_active);
+        mk_list_add(&flow->_head_active, &ins->dispatch_active[prio]);
+    }
+
+    return route;
+}
+
+/* Remove a queued route, used when the task is destroyed */
+void flb_engine_dispatch_route_remove(struct flb_task_route *route)
+{
+    struct flb_dispatch_flow *flow;
+    struct flb_output_instance *ins = route->out;
+
+    flow = flow_get(ins, route->task->i_ins);
+    if (!flow) {
+        return;
+    }
+    flow_unqueue(flow, route);
+
+    cmt_gauge_set(ins->cmt_dispatch_queue, cmt_time_now(),
+                  ins->dispatch_queued,
+                  1, (char *[]) {(char *) flb_output_name(ins)});
+}
+
+static inline int output_has_capacity(struct flb_output_instance *ins)
+{
+    /*
+     * If the plugin don't allow multiplexing Tasks, check if it's
+     * running or retrying something.
+     */
+    if (ins->flags & FLB_OUTPUT_NO_MULTIPLEX) {
+        if (ins->dispatch_inflight > 0 || ins->dispatch_retries > 0) {
+            return FLB_FALSE;
+        }
+    }
+
+    if (ins->dispatch_max_inflight > 0 &&
+        ins->dispatch_inflight >= ins->dispatch_max_inflight) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
+/*
+ * Flush the queued routes of an output while it has capacity. It's invoked
+ * after new tasks are queued and every time a flush of the output finish.
+ */
+int flb_engine_dispatch_output(struct flb_output_instance *ins,
+                               struct flb_config *config)
+{
+    int ret;
+    int count = 0;
+    uint64_t ts;
+    char *name;
+    struct flb_task *task;
+    struct flb_task_route *route;
+    struct flb_dispatch_flow *flow;
+
+    if (ins->dispatch_queued == 0) {
+        return 0;
+    }
+
+    name = (char *) flb_output_name(ins);
+    ts = cmt_time_now();
+
+    while (ins->dispatch_queued > 0 && output_has_capacity(ins)) {
+        route = flb_engine_dispatch_dequeue(ins);
+        if (!route) {
+            break;
+        }
+        task = route->task;
+
+        /*
+         * We have the Task and the Route, created a coroutine context for
+         * the data handling.
+         */
+        ret = flb_output_task_flush(task, ins, config);
+        if (ret == -1) {
+            /* keep it first in line and try again on the next wake up */
+            flow = flow_get(ins, task->i_ins);
+            if (flow) {
+                flow_queue(flow, route, FLB_TRUE);
+                break;
+            }
+            flb_error("[engine] task_id=%i could not be dispatched to %s",
+                      task->id, name);
+        }
+        else {
+            ins->dispatch_inflight++;
+            count++;
+
+            cmt_counter_inc(ins->cmt_dispatch_total, ts, 1, (char *[]) {name});
+            if (ts > route->queued_ts) {
+                cmt_counter_add(ins->cmt_dispatch_time, ts,
+                                (double) (ts - route->queued_ts) / 1000000000.0,
+                                1, (char *[]) {name});
+            }
+        }
+
+        /* release the reference held by the queue */
+        flb_task_users_dec(task, FLB_TRUE);
+    }
+
+    cmt_gauge_set(ins->cmt_dispatch_queue, ts, ins->dispatch_queued,
+                  1, (char *[]) {name});
+
+    return count;
+}
+
+void flb_engine_dispatch_flows_destroy(struct flb_output_instance *ins)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_dispatch_flow *flow;
+
+    mk_list_foreach_safe(head, tmp, &ins->dispatch_flows) {
+        flow = mk_list_entry(head, struct flb_dispatch_flow, _head);
+        mk_list_del(&flow->_head);
+        flb_free(flow);
+    }
+}
+
 static void test_run_formatter(struct flb_config *config,
                                struct flb_input_instance *i_ins,
                                struct flb_output_instance *o_ins,
@@ -117,8 +376,8 @@ static void test_run_formatter(struct flb_config *config,
 static int tasks_start(struct flb_input_instance *in,
                        struct flb_config *config)
 {
-    int hits = 0;
-    int retry = 0;
+    int ret;
+    uint64_t ts;
     struct mk_list *tmp;
     struct mk_list *head;
     struct mk_list *r_head;
@@ -127,14 +386,12 @@ static int tasks_start(struct flb_input_instance *in,
     struct flb_task_route *route;
     struct flb_output_instance *out;
 
+    ts = cmt_time_now();
+
     /* At this point the input instance should have some tasks linked */
     mk_list_foreach_safe(head, tmp, &in->tasks) {
         task = mk_list_entry(head, struct flb_task, _head);
 
-        if (mk_list_is_empty(&task->retries) != 0) {
-            retry++;
-        }
-
         /* Only process recently created tasks */
         if (task->status != FLB_TASK_NEW) {
             continue;
@@ -164,45 +421,222 @@ static int tasks_start(struct flb_input_instance *in,
                 continue;
             }
 
-            /*
-             * If the plugin don't allow multiplexing Tasks, check if it's
-             * running something.
-             */
-            if (out->flags & FLB_OUTPUT_NO_MULTIPLEX) {
-                if (flb_output_coros_size(route->out) > 0 || retry > 0) {
-                    continue;
-                }
+            /* Wait in the output queue until it can take it */
+            ret = flb_engine_dispatch_enqueue(route, ts);
+            if (ret == -1) {
+                flb_error("[engine] task_id=%i could not be queued for %s",
+                          task->id, flb_output_name(out));
             }
+        }
+    }
 
-            hits++;
+    /* Flush what the outputs can take now */
+    mk_list_foreach(head, &config->outputs) {
+        out = mk_list_entry(head, struct flb_output_instance, _head);
+        flb_engine_dispatch_output(out, config);
+    }
 
-            /*
-             * We have the Task and the Route, created a thread context for the
-             * data handling.
-             */
-            flb_output_task_flush(task, route->out, config);
+    return 0;
+}
 
-            /*
-            th = flb_output_thread(task,
-                                   in,
-                                   route->out,
-                                   config,
-                                   task->buf, task->size,
-                                   task->tag,
-                                   task->tag_len);
-            flb_task_add_thread(th, task);
-            flb_thread_resume(th);
-            */
+/* Check if any output instance wants small chunks to be coalesced */
+static int coalesce_enabled(struct flb_config *config)
+{
+    struct mk_list *head;
+    struct flb_output_instance *o_ins;
+
+    mk_list_foreach(head, &config->outputs) {
+        o_ins = mk_list_entry(head, struct flb_output_instance, _head);
+        if (o_ins->dispatch_coalesce_size > 0 ||
+            o_ins->dispatch_coalesce_records > 0) {
+            return FLB_TRUE;
+        }
+    }
+
+    return FLB_FALSE;
+}
+
+/*
+ * Get the coalescing targets of a chunk: the lowest ones among the output
+ * instances it routes to. If one of them does not coalesce chunks the
+ * chunk must be dispatched right away.
+ */
+static int coalesce_targets(struct flb_input_chunk *ic,
+                            size_t *size, int *records, uint64_t *wait,
+                            struct flb_config *config)
+{
+    int routes = 0;
+    struct mk_list *head;
+    struct flb_output_instance *o_ins;
+
+    *size = 0;
+    *records = 0;
+    *wait = 0;
+
+    mk_list_foreach(head, &config->outputs) {
+        o_ins = mk_list_entry(head, struct flb_output_instance, _head);
+        if (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id, config) == 0) {
+            continue;
         }
 
-        if (hits == 0) {
-            task->status = FLB_TASK_NEW;
+        if (o_ins->dispatch_coalesce_size == 0 &&
+            o_ins->dispatch_coalesce_records == 0) {
+            return FLB_FALSE;
         }
 
-        hits = 0;
+        if (o_ins->dispatch_coalesce_size > 0 &&
+            (*size == 0 || o_ins->dispatch_coalesce_size < *size)) {
+            *size = o_ins->dispatch_coalesce_size;
+        }
+        if (o_ins->dispatch_coalesce_records > 0 &&
+            (*records == 0 || o_ins->dispatch_coalesce_records < *records)) {
+            *records = o_ins->dispatch_coalesce_records;
+        }
+        if (routes == 0 || o_ins->dispatch_coalesce_wait < *wait) {
+            *wait = o_ins->dispatch_coalesce_wait;
+        }
+        routes++;
     }
 
-    return 0;
+    if (routes == 0) {
+        return FLB_FALSE;
+    }
+
+    /* a chunk cannot grow beyond this size */
+    if (*size == 0 || *size > FLB_INPUT_CHUNK_FS_MAX_SIZE) {
+        *size = FLB_INPUT_CHUNK_FS_MAX_SIZE;
+    }
+
+    return FLB_TRUE;
+}
+
+static inline int coalesce_done(size_t bytes, int records,
+                                size_t size, int target_records)
+{
+    if (bytes >= size) {
+        return FLB_TRUE;
+    }
+    if (target_records > 0 && records >= target_records) {
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+/*
+ * Coalesce small chunks before creating a task: the newer idle chunks with
+ * the same Tag and routes are merged into 'ic' until the targets are
+ * reached. If the result is still small and the chunk is younger than the
+ * latency budget, it's kept so it can receive more records: returns
+ * FLB_TRUE if the chunk must not be dispatched yet.
+ */
+static int chunk_coalesce(struct flb_input_chunk *ic, uint64_t now,
+                          struct flb_config *config)
+{
+    int ret;
+    int records = 0;
+    int c_records = 0;
+    int target_records;
+    int tag_len;
+    int c_tag_len;
+    int merged = 0;
+    size_t bytes;
+    size_t c_bytes;
+    size_t size;
+    uint64_t wait;
+    const char *tag_buf;
+    const char *c_tag_buf;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_input_chunk *c;
+    struct flb_input_instance *in = ic->in;
+
+    ret = coalesce_targets(ic, &size, &target_records, &wait, config);
+    if (ret == FLB_FALSE || flb_input_chunk_is_up(ic) == FLB_FALSE) {
+        return FLB_FALSE;
+    }
+
+    bytes = flb_input_chunk_get_size(ic);
+#ifdef FLB_HAVE_METRICS
+    records = ic->total_records;
+#endif
+
+    ret = flb_input_chunk_get_tag(ic, &tag_buf, &tag_len);
+    if (ret == -1 || cio_chunk_is_locked(ic->chunk)) {
+        return FLB_FALSE;
+    }
+
+    /* chunks are sorted by creation time, merge the newer ones */
+    head = ic->_head.next;
+    while (head != &in->chunks &&
+           coalesce_done(bytes, records, size, target_records) == FLB_FALSE) {
+        tmp = head->next;
+        c = mk_list_entry(head, struct flb_input_chunk, _head);
+        head = tmp;
+
+        /* backlog chunks are shared with the storage backlog queues */
+        if (c->busy == FLB_TRUE || c->fs_backlog == FLB_TRUE ||
+            c->event_type != ic->event_type ||
+            flb_input_chunk_is_up(c) == FLB_FALSE) {
+            continue;
+        }
+
+        c_bytes = flb_input_chunk_get_size(c);
+        if (bytes + c_bytes > size) {
+            continue;
+        }
+
+        if (memcmp(c->routes_mask, ic->routes_mask,
+                   flb_routes_mask_bytes(config)) != 0) {
+            continue;
+        }
+
+        ret = flb_input_chunk_get_tag(c, &c_tag_buf, &c_tag_len);
+        if (ret == -1 || c_tag_len != tag_len ||
+            memcmp(c_tag_buf, tag_buf, tag_len) != 0) {
+            continue;
+        }
+
+#ifdef FLB_HAVE_METRICS
+        c_records = c->total_records;
+#endif
+        ret = flb_input_chunk_merge(ic, c);
+        if (ret == -1) {
+            continue;
+        }
+        bytes += c_bytes;
+        records += c_records;
+        merged++;
+    }
+
+    if (merged > 0) {
+        flb_debug("[dispatch] %s coalesced %i chunks into %s (%zu bytes)",
+                  flb_input_name(in), merged, flb_input_chunk_get_name(ic),
+                  bytes);
+        flb_input_chunk_set_limits(in);
+    }
+
+    if (coalesce_done(bytes, records, size, target_records) == FLB_TRUE) {
+        return FLB_FALSE;
+    }
+
+    /*
+     * Dispatch right away chunks loaded from the backlog, or if no more
+     * records can come in: the service is stopping or the input is paused.
+     */
+    if (ic->create_ts == 0 ||
+        config->is_ingestion_active == FLB_FALSE ||
+        flb_input_buf_paused(in) == FLB_TRUE ||
+        cio_chunk_is_locked(ic->chunk)) {
+        return FLB_FALSE;
+    }
+
+    /* latency budget */
+    if (now < ic->create_ts || now - ic->create_ts >= wait) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
 }
 
 /*
@@ -217,6 +651,8 @@ int flb_engine_dispatch(uint64_t id, struct flb_input_instance *in,
 {
     int ret;
     int t_err;
+    int coalesce;
+    uint64_t now = 0;
     const char *buf_data;
     size_t buf_size = 0;
     const char *tag_buf;
@@ -232,6 +668,11 @@ int flb_engine_dispatch(uint64_t id, struct flb_input_instance *in,
         return 0;
     }
 
+    coalesce = coalesce_enabled(config);
+    if (coalesce == FLB_TRUE) {
+        now = cmt_time_now();
+    }
+
     /* Look for chunks ready to go */
     mk_list_foreach_safe(head, tmp, &in->chunks) {
         ic = mk_list_entry(head, struct flb_input_chunk, _head);
@@ -239,6 +680,16 @@ int flb_engine_dispatch(uint64_t id, struct flb_input_instance *in,
             continue;
         }
 
+        if (coalesce == FLB_TRUE) {
+            ret = chunk_coalesce(ic, now, config);
+
+            /* the next chunk might have been merged */
+            tmp = head->next;
+            if (ret == FLB_TRUE) {
+                continue;
+            }
+        }
+
         /* There is a match, get the buffer */
         buf_data = flb_input_chunk_flush(ic, &buf_size);
         if (buf_size == 0) {
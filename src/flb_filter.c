@@ -68,30 +68,50 @@ void flb_filter_do(struct flb_input_chunk *ic,
     uint64_t ts;
     char *name;
 #endif
+    int cached;
+    int matched;
     char *ntag;
+    char ntag_buf[FLB_FILTER_TAG_BUF_SIZE];
     const char *work_data;
     size_t work_size;
+    void *work_buf = NULL;
     void *out_buf;
-    size_t cur_size;
     size_t out_size;
     ssize_t content_size;
     ssize_t write_at;
     struct mk_list *head;
     struct flb_filter_instance *f_ins;
-
-    /* For the incoming Tag make sure to create a NULL terminated reference */
-    ntag = flb_malloc(tag_len + 1);
-    if (!ntag) {
-        flb_errno();
-        flb_error("[filter] could not filter record due to memory problems");
-        return;
+    struct flb_router_cache_entry route;
+
+    /*
+     * For the incoming Tag make sure to create a NULL terminated reference,
+     * short tags (the common case) uses a stack buffer.
+     */
+    if (tag_len < sizeof(ntag_buf)) {
+        ntag = ntag_buf;
+    }
+    else {
+        ntag = flb_malloc(tag_len + 1);
+        if (!ntag) {
+            flb_errno();
+            flb_error("[filter] could not filter record due to memory problems");
+            return;
+        }
     }
     memcpy(ntag, tag, tag_len);
     ntag[tag_len] = '\0';
 
+    /* Get the precomputed list of filters matching the Tag */
+    route.routes_mask = NULL;
+    cached = (flb_router_cache_get(config, ntag, tag_len, &route) == 0);
+
     work_data = (const char *) data;
     work_size = bytes;
 
+    /* where to position the new content if modified ? */
+    content_size = cio_chunk_get_content_size(ic->chunk);
+    write_at = (content_size - bytes);
+
 #ifdef FLB_HAVE_METRICS
     /* timestamp */
     ts = cmt_time_now();
@@ -101,25 +121,31 @@ void flb_filter_do(struct flb_input_chunk *ic,
     pre_records = ic->total_records - in_records;
 #endif
 
-    /* Iterate filters */
+    /*
+     * Iterate filters: the output of a filter that modified the records is
+     * passed in memory to the next one, the chunk content is overwritten only
+     * once when the whole chain has been processed.
+     */
     mk_list_foreach(head, &config->filters) {
         f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
-        if (flb_router_match(ntag, tag_len, f_ins->match
+        if (cached && f_ins->id < FLB_ROUTER_FILTERS_MASK_MAX_VALUE) {
+            matched = flb_router_cache_filter_match(&route, f_ins->id);
+        }
+        else {
+            matched = flb_router_match(ntag, tag_len, f_ins->match
 #ifdef FLB_HAVE_REGEX
-        , f_ins->match_regex
+                                       , f_ins->match_regex
 #else
-        , NULL
+                                       , NULL
 #endif
-           )) {
+                                       );
+        }
+
+        if (matched) {
             /* Reset filtered buffer */
             out_buf = NULL;
             out_size = 0;
 
-            content_size = cio_chunk_get_content_size(ic->chunk);
-
-            /* where to position the new content if modified ? */
-            write_at = (content_size - work_size);
-
             /* Invoke the filter callback */
             ret = f_ins->p->cb_filter(work_data,      /* msgpack buffer   */
                                       work_size,      /* msgpack size     */
@@ -136,10 +162,19 @@ void flb_filter_do(struct flb_input_chunk *ic,
 
             /* Override buffer just if it was modified */
             if (ret == FLB_FILTER_MODIFIED) {
+                /* release the output of the previous filter (if any) */
+                if (work_buf) {
+                    flb_free(work_buf);
+                    work_buf = NULL;
+                }
+
                 /* all records removed, no data to continue processing */
                 if (out_size == 0) {
-                    /* reset data content length */
-                    flb_input_chunk_write_at(ic, write_at, "", 0);
+                    if (out_buf) {
+                        flb_free(out_buf);
+                    }
+                    work_data = NULL;
+                    work_size = 0;
 
 #ifdef FLB_HAVE_METRICS
                     ic->total_records = pre_records;
@@ -185,31 +220,40 @@ void flb_filter_do(struct flb_input_chunk *ic,
                     ic->total_records = pre_records + in_records;
 #endif
                 }
-                ret = flb_input_chunk_write_at(ic, write_at,
-                                               out_buf, out_size);
-                if (ret == -1) {
-                    flb_error("[filter] could not write data to storage. "
-                              "Skipping filtering.");
-                    flb_free(out_buf);
-                    continue;
-                }
 
-                /* Point back the 'data' pointer to the new address */
-                ret = cio_chunk_get_content(ic->chunk,
-                                            (char **) &work_data, &cur_size);
-                if (ret != CIO_OK) {
-                    flb_error("[filter] error retrieving data chunk");
-                }
-                else {
-                    work_data += (cur_size - out_size);
-                    work_size = out_size;
-                }
-                flb_free(out_buf);
+                /* the next filter works on top of the new buffer */
+                work_buf = out_buf;
+                work_data = (const char *) out_buf;
+                work_size = out_size;
             }
         }
     }
 
-    flb_free(ntag);
+    /* Commit the filtered content (if any) into the chunk */
+    if (work_data != data) {
+        if (work_size == 0) {
+            /* reset data content length */
+            flb_input_chunk_write_at(ic, write_at, "", 0);
+        }
+        else {
+            ret = flb_input_chunk_write_at(ic, write_at, work_data, work_size);
+            if (ret == -1) {
+                flb_error("[filter] could not write data to storage. "
+                          "Skipping filtering.");
+#ifdef FLB_HAVE_METRICS
+                ic->total_records = pre_records + ic->added_records;
+#endif
+            }
+        }
+    }
+
+    if (work_buf) {
+        flb_free(work_buf);
+    }
+
+    if (ntag != ntag_buf) {
+        flb_free(ntag);
+    }
 }
 
 int flb_filter_set_property(struct flb_filter_instance *ins,
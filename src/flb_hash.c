@@ -25,54 +25,259 @@
 #include <fluent-bit/flb_str.h>
 #include <xxhash.h>
 
+/* slot control bytes, any other value is a key fingerprint */
+#define HASH_SLOT_EMPTY    0
+#define HASH_SLOT_DELETED  1
+
+#define HASH_SLOT_USED(ht, id)  ((ht)->ctrl[id] > HASH_SLOT_DELETED)
+
+/* fingerprint: 7 bits of the hash not used to pick the home slot */
+static inline uint8_t hash_fingerprint(uint64_t hash)
+{
+    return (uint8_t) (hash >> 57) + 2;
+}
+
+static inline int hash_entry_id(struct flb_hash *ht,
+                                struct flb_hash_entry *entry)
+{
+    return entry - ht->table;
+}
+
+/* Link the entry at the end of the eviction order list */
+static inline void hash_order_add(struct flb_hash *ht, int id)
+{
+    struct flb_hash_entry *entry = &ht->table[id];
+
+    entry->prev = ht->last;
+    entry->next = -1;
+    if (ht->last >= 0) {
+        ht->table[ht->last].next = id;
+    }
+    else {
+        ht->first = id;
+    }
+    ht->last = id;
+}
+
+static inline void hash_order_del(struct flb_hash *ht, int id)
+{
+    struct flb_hash_entry *entry = &ht->table[id];
+
+    if (entry->prev >= 0) {
+        ht->table[entry->prev].next = entry->next;
+    }
+    else {
+        ht->first = entry->next;
+    }
+    if (entry->next >= 0) {
+        ht->table[entry->next].prev = entry->prev;
+    }
+    else {
+        ht->last = entry->prev;
+    }
+}
+
 static inline void flb_hash_entry_free(struct flb_hash *ht,
                                        struct flb_hash_entry *entry)
 {
-    mk_list_del(&entry->_head);
-    mk_list_del(&entry->_head_parent);
-    entry->table->count--;
-    ht->total_count--;
-    flb_free(entry->key);
+    int id;
+
+    id = hash_entry_id(ht, entry);
+    hash_order_del(ht, id);
+
+    if (entry->key != entry->key_buf) {
+        flb_free(entry->key);
+    }
     if (entry->val && entry->val_size > 0) {
         flb_free(entry->val);
     }
-    flb_free(entry);
+
+    /*
+     * A probe sequence stops at the first empty slot, so the slot can only
+     * be marked as empty if the next one is empty too.
+     */
+    if (ht->ctrl[(id + 1) & (ht->size - 1)] == HASH_SLOT_EMPTY) {
+        ht->ctrl[id] = HASH_SLOT_EMPTY;
+    }
+    else {
+        ht->ctrl[id] = HASH_SLOT_DELETED;
+        ht->deleted++;
+    }
+    ht->total_count--;
+}
+
+/* Compare an entry against a key, the full hash is checked first */
+static inline int hash_entry_cmp(struct flb_hash_entry *entry, uint64_t hash,
+                                 const char *key, int key_len)
+{
+    if (entry->hash != hash || entry->key_len != key_len) {
+        return -1;
+    }
+
+    return memcmp(entry->key, key, key_len);
+}
+
+/* Find the slot of a key, -1 if it's not in the table */
+static int hash_find(struct flb_hash *ht, uint64_t hash,
+                     const char *key, int key_len)
+{
+    size_t n;
+    size_t id;
+    size_t mask = ht->size - 1;
+    uint8_t fp = hash_fingerprint(hash);
+    uint8_t c;
+
+    id = hash & mask;
+    for (n = 0; n < ht->size; n++) {
+        c = ht->ctrl[id];
+        if (c == HASH_SLOT_EMPTY) {
+            break;
+        }
+        if (c == fp &&
+            hash_entry_cmp(&ht->table[id], hash, key, key_len) == 0) {
+            return id;
+        }
+        id = (id + 1) & mask;
+    }
+
+    return -1;
+}
+
+/* Find a free slot (empty or deleted) for a new key */
+static int hash_find_free(struct flb_hash *ht, uint64_t hash)
+{
+    size_t id;
+    size_t mask = ht->size - 1;
+
+    id = hash & mask;
+    while (HASH_SLOT_USED(ht, id)) {
+        id = (id + 1) & mask;
+    }
+
+    return id;
+}
+
+/*
+ * Move every entry to a new array of 'size' slots, the eviction order is
+ * kept and the deleted slots are dropped.
+ */
+static int hash_resize(struct flb_hash *ht, size_t size)
+{
+    int id;
+    int old_id;
+    uint8_t *old_ctrl;
+    uint8_t *ctrl;
+    struct flb_hash_entry *old_table;
+    struct flb_hash_entry *table;
+    struct flb_hash_entry *entry;
+
+    ctrl = flb_calloc(1, size);
+    if (!ctrl) {
+        flb_errno();
+        return -1;
+    }
+
+    table = flb_malloc(sizeof(struct flb_hash_entry) * size);
+    if (!table) {
+        flb_errno();
+        flb_free(ctrl);
+        return -1;
+    }
+
+    old_ctrl = ht->ctrl;
+    old_table = ht->table;
+    old_id = ht->first;
+
+    ht->ctrl = ctrl;
+    ht->table = table;
+    ht->size = size;
+    ht->deleted = 0;
+    ht->first = -1;
+    ht->last = -1;
+
+    while (old_id >= 0) {
+        entry = &old_table[old_id];
+
+        id = hash_find_free(ht, entry->hash);
+        memcpy(&table[id], entry, sizeof(struct flb_hash_entry));
+        if (entry->key == entry->key_buf) {
+            table[id].key = table[id].key_buf;
+        }
+        ctrl[id] = old_ctrl[old_id];
+        hash_order_add(ht, id);
+
+        old_id = entry->next;
+    }
+
+    flb_free(old_ctrl);
+    flb_free(old_table);
+
+    return 0;
+}
+
+/*
+ * Make room for one more entry: the table grows once three quarters of the
+ * slots are in use, otherwise it's rebuilt in place when the deleted slots
+ * make the probe sequences too long.
+ */
+static int hash_reserve(struct flb_hash *ht)
+{
+    size_t used;
+
+    used = ht->total_count + ht->deleted + 1;
+    if (used <= ht->size - (ht->size >> 3)) {
+        return 0;
+    }
+
+    if (ht->total_count + 1 > ht->size - (ht->size >> 2)) {
+        return hash_resize(ht, ht->size * 2);
+    }
+
+    return hash_resize(ht, ht->size);
 }
 
 struct flb_hash *flb_hash_create(int evict_mode, size_t size, int max_entries)
 {
-    int i;
-    struct flb_hash_table *tmp;
+    size_t slots = 8;
     struct flb_hash *ht;
 
     if (size <= 0) {
         return NULL;
     }
 
+    /* the number of slots is a power of two */
+    while (slots < size) {
+        slots <<= 1;
+    }
+
     ht = flb_malloc(sizeof(struct flb_hash));
     if (!ht) {
         flb_errno();
         return NULL;
     }
 
-    mk_list_init(&ht->entries);
     ht->evict_mode = evict_mode;
     ht->max_entries = max_entries;
-    ht->size = size;
+    ht->size = slots;
     ht->total_count = 0;
+    ht->deleted = 0;
     ht->cache_ttl = 0;
-    ht->table = flb_calloc(1, sizeof(struct flb_hash_table) * size);
-    if (!ht->table) {
+    ht->first = -1;
+    ht->last = -1;
+
+    ht->ctrl = flb_calloc(1, slots);
+    if (!ht->ctrl) {
         flb_errno();
         flb_free(ht);
         return NULL;
     }
 
-    /* Initialize chains list head */
-    for (i = 0; i < size; i++) {
-        tmp = &ht->table[i];
-        tmp->count = 0;
-        mk_list_init(&tmp->chains);
+    ht->table = flb_malloc(sizeof(struct flb_hash_entry) * slots);
+    if (!ht->table) {
+        flb_errno();
+        flb_free(ht->ctrl);
+        flb_free(ht);
+        return NULL;
     }
 
     return ht;
@@ -98,27 +303,19 @@ int flb_hash_del_ptr(struct flb_hash *ht, const char *key, int key_len,
                      void *ptr)
 {
     int id;
-    uint64_t hash;
-    struct mk_list *head;
-    struct flb_hash_entry *entry = NULL;
-    struct flb_hash_table *table;
-
-    /* Generate hash number */
-    hash = XXH3_64bits(key, key_len);
-    id = (hash % ht->size);
+    struct flb_hash_entry *entry;
 
-    /* Link the new entry in our table at the end of the list */
-    table = &ht->table[id];
+    if (!key || key_len <= 0) {
+        return -1;
+    }
 
-    mk_list_foreach(head, &table->chains) {
-        entry = mk_list_entry(head, struct flb_hash_entry, _head);
-        if (strncmp(entry->key, key, key_len) == 0 && entry->val == ptr) {
-            break;
-        }
-        entry = NULL;
+    id = hash_find(ht, XXH3_64bits(key, key_len), key, key_len);
+    if (id == -1) {
+        return -1;
     }
 
-    if (!entry) {
+    entry = &ht->table[id];
+    if (entry->val != ptr) {
         return -1;
     }
 
@@ -130,51 +327,43 @@ int flb_hash_del_ptr(struct flb_hash *ht, const char *key, int key_len,
 
 void flb_hash_destroy(struct flb_hash *ht)
 {
-    int i;
-    struct mk_list *tmp;
-    struct mk_list *head;
     struct flb_hash_entry *entry;
-    struct flb_hash_table *table;
+    struct flb_hash_entry *tmp;
 
-    for (i = 0; i < ht->size; i++) {
-        table = &ht->table[i];
-        mk_list_foreach_safe(head, tmp, &table->chains) {
-            entry = mk_list_entry(head, struct flb_hash_entry, _head);
-            flb_hash_entry_free(ht, entry);
-        }
+    flb_hash_foreach(entry, tmp, ht) {
+        flb_hash_entry_free(ht, entry);
     }
 
+    flb_free(ht->ctrl);
     flb_free(ht->table);
     flb_free(ht);
 }
 
+/* Evict the first used slot found from a random position */
 static void flb_hash_evict_random(struct flb_hash *ht)
 {
-    int id;
-    int count = 0;
-    struct mk_list *tmp;
-    struct mk_list *head;
-    struct flb_hash_entry *entry;
+    size_t id;
 
-    id = random() % ht->total_count;
-    mk_list_foreach_safe(head, tmp, &ht->entries) {
-        if (id == count) {
-            entry = mk_list_entry(head, struct flb_hash_entry, _head_parent);
-            flb_hash_entry_free(ht, entry);
-            break;
-        }
-        count++;
+    if (ht->total_count == 0) {
+        return;
+    }
+
+    id = random() & (ht->size - 1);
+    while (!HASH_SLOT_USED(ht, id)) {
+        id = (id + 1) & (ht->size - 1);
     }
+
+    flb_hash_entry_free(ht, &ht->table[id]);
 }
 
 static void flb_hash_evict_less_used(struct flb_hash *ht)
 {
-    struct mk_list *head;
+    int id;
     struct flb_hash_entry *entry;
     struct flb_hash_entry *entry_less_used = NULL;
 
-    mk_list_foreach(head, &ht->entries) {
-        entry = mk_list_entry(head, struct flb_hash_entry, _head_parent);
+    for (id = ht->first; id >= 0; id = entry->next) {
+        entry = &ht->table[id];
         if (!entry_less_used) {
             entry_less_used = entry;
         }
@@ -183,69 +372,37 @@ static void flb_hash_evict_less_used(struct flb_hash *ht)
         }
     }
 
-    flb_hash_entry_free(ht, entry_less_used);
+    if (entry_less_used) {
+        flb_hash_entry_free(ht, entry_less_used);
+    }
 }
 
+/*
+ * Evict the first entry of the list: on FLB_HASH_EVICT_OLDER the list is
+ * ordered by insertion, on FLB_HASH_EVICT_LRU every access moves the entry
+ * to the end of the list, so the first one is the least recently used.
+ */
 static void flb_hash_evict_older(struct flb_hash *ht)
 {
-    struct flb_hash_entry *entry;
-
-    entry = mk_list_entry_first(&ht->entries, struct flb_hash_entry, _head_parent);
-    flb_hash_entry_free(ht, entry);
+    if (ht->first >= 0) {
+        flb_hash_entry_free(ht, &ht->table[ht->first]);
+    }
 }
 
-static struct flb_hash_entry *hash_get_entry(struct flb_hash *ht,
-                                             const char *key, int key_len, int *out_id)
+/* On LRU mode, a hit moves the entry to the end of the eviction list */
+static inline void hash_entry_touch(struct flb_hash *ht,
+                                    struct flb_hash_entry *entry)
 {
     int id;
-    uint64_t hash;
-    struct mk_list *head;
-    struct flb_hash_table *table;
-    struct flb_hash_entry *entry;
-
-    if (!key || key_len <= 0) {
-        return NULL;
-    }
-
-    hash = XXH3_64bits(key, key_len);
-    id = (hash % ht->size);
 
-    table = &ht->table[id];
-    if (table->count == 0) {
-        return NULL;
-    }
-
-    if (table->count == 1) {
-        entry = mk_list_entry_first(&table->chains,
-                                    struct flb_hash_entry, _head);
-
-        if (entry->key_len != key_len
-            || strncmp(entry->key, key, key_len) != 0) {
-            entry = NULL;
-        }
-    }
-    else {
-        /* Iterate entries */
-        mk_list_foreach(head, &table->chains) {
-            entry = mk_list_entry(head, struct flb_hash_entry, _head);
-            if (entry->key_len != key_len) {
-                entry = NULL;
-                continue;
-            }
-
-            if (strncmp(entry->key, key, key_len) == 0) {
-                break;
-            }
-
-            entry = NULL;
+    entry->hits++;
+    if (ht->evict_mode == FLB_HASH_EVICT_LRU) {
+        id = hash_entry_id(ht, entry);
+        if (ht->last != id) {
+            hash_order_del(ht, id);
+            hash_order_add(ht, id);
         }
     }
-
-    if (entry) {
-        *out_id = id;
-    }
-
-    return entry;
 }
 
 static int entry_set_value(struct flb_hash_entry *entry, void *val, size_t val_size)
@@ -298,9 +455,9 @@ int flb_hash_add(struct flb_hash *ht,
 {
     int id;
     int ret;
+    uint8_t ctrl;
     uint64_t hash;
     struct flb_hash_entry *entry;
-    struct flb_hash_table *table;
 
     if (!key || key_len <= 0) {
         return -1;
@@ -311,7 +468,8 @@ int flb_hash_add(struct flb_hash *ht,
         if (ht->evict_mode == FLB_HASH_EVICT_NONE) {
             /* Do nothing */
         }
-        else if (ht->evict_mode == FLB_HASH_EVICT_OLDER) {
+        else if (ht->evict_mode == FLB_HASH_EVICT_OLDER ||
+                 ht->evict_mode == FLB_HASH_EVICT_LRU) {
             flb_hash_evict_older(ht);
         }
         else if (ht->evict_mode == FLB_HASH_EVICT_LESS_USED) {
@@ -322,14 +480,17 @@ int flb_hash_add(struct flb_hash *ht,
         }
     }
 
+    /* Generate hash number */
+    hash = XXH3_64bits(key, key_len);
+
     /* Check if this is a replacement */
-    entry = hash_get_entry(ht, key, key_len, &id);
-    if (entry) {
+    id = hash_find(ht, hash, key, key_len);
+    if (id >= 0) {
         /*
          * The key already exists, just perform a value replacement, check if the
          * value refers to our own previous allocation.
          */
-        ret = entry_set_value(entry, val, val_size);
+        ret = entry_set_value(&ht->table[id], val, val_size);
         if (ret == -1) {
             return -1;
         }
@@ -340,42 +501,49 @@ int flb_hash_add(struct flb_hash *ht,
     /*
      * Below is just code to handle the creation of a new entry in the table
      */
-
-    /* Generate hash number */
-    hash = XXH3_64bits(key, key_len);
-    id = (hash % ht->size);
-
-    /* Allocate the entry */
-    entry = flb_calloc(1, sizeof(struct flb_hash_entry));
-    if (!entry) {
-        flb_errno();
+    ret = hash_reserve(ht);
+    if (ret == -1) {
         return -1;
     }
+
+    id = hash_find_free(ht, hash);
+    entry = &ht->table[id];
     entry->created = time(NULL);
     entry->hits = 0;
+    entry->hash = hash;
 
-    /* Store the key and value as a new memory region */
-    entry->key = flb_strndup(key, key_len);
+    /* Store the key in the slot if it's short, otherwise in the heap */
+    if (key_len < FLB_HASH_KEY_INLINE) {
+        memcpy(entry->key_buf, key, key_len);
+        entry->key_buf[key_len] = '\0';
+        entry->key = entry->key_buf;
+    }
+    else {
+        entry->key = flb_strndup(key, key_len);
+        if (!entry->key) {
+            flb_errno();
+            return -1;
+        }
+    }
     entry->key_len = key_len;
     entry->val_size = 0;
 
     /* store or reference the value */
     ret = entry_set_value(entry, val, val_size);
     if (ret == -1) {
-        flb_free(entry);
+        if (entry->key != entry->key_buf) {
+            flb_free(entry->key);
+        }
         return -1;
     }
 
-    /* Link the new entry in our table at the end of the list */
-    table = &ht->table[id];
-    entry->table = table;
-
-    /* Add the new entry */
-    mk_list_add(&entry->_head, &table->chains);
-    mk_list_add(&entry->_head_parent, &ht->entries);
-
-    /* Update counters */
-    table->count++;
+    /* Claim the slot */
+    ctrl = ht->ctrl[id];
+    if (ctrl == HASH_SLOT_DELETED) {
+        ht->deleted--;
+    }
+    ht->ctrl[id] = hash_fingerprint(hash);
+    hash_order_add(ht, id);
     ht->total_count++;
 
     return id;
@@ -389,10 +557,15 @@ int flb_hash_get(struct flb_hash *ht,
     struct flb_hash_entry *entry;
     time_t expiration;
 
-    entry = hash_get_entry(ht, key, key_len, &id);
-    if (!entry) {
+    if (!key || key_len <= 0) {
+        return -1;
+    }
+
+    id = hash_find(ht, XXH3_64bits(key, key_len), key, key_len);
+    if (id == -1) {
         return -1;
     }
+    entry = &ht->table[id];
 
     if (ht->cache_ttl > 0) {
         expiration = entry->created + ht->cache_ttl;
@@ -402,7 +575,7 @@ int flb_hash_get(struct flb_hash *ht,
         }
     }
 
-    entry->hits++;
+    hash_entry_touch(ht, entry);
     *out_buf = entry->val;
     *out_size = entry->val_size;
 
@@ -410,41 +583,22 @@ int flb_hash_get(struct flb_hash *ht,
 }
 
 /*
- * Get an entry based in the table id. Note that a table id might have multiple
- * entries so the 'key' parameter is required to get an exact match.
+ * Get an entry based in the table id returned by flb_hash_add() or
+ * flb_hash_get(). The id is valid until the table is modified, the 'key'
+ * parameter is required to confirm it's still the same entry.
  */
 int flb_hash_get_by_id(struct flb_hash *ht, int id,
                        const char *key,
                        const char **out_buf, size_t * out_size)
 {
-    struct mk_list *head;
-    struct flb_hash_entry *entry = NULL;
-    struct flb_hash_table *table;
-
-    if (ht->size <= id) {
-        return -1;
-    }
+    struct flb_hash_entry *entry;
 
-    table = &ht->table[id];
-    if (table->count == 0) {
+    if (id < 0 || ht->size <= id || !HASH_SLOT_USED(ht, id)) {
         return -1;
     }
 
-    if (table->count == 1) {
-        entry = mk_list_entry_first(&table->chains,
-                                    struct flb_hash_entry, _head);
-    }
-    else {
-        mk_list_foreach(head, &table->chains) {
-            entry = mk_list_entry(head, struct flb_hash_entry, _head);
-            if (strcmp(entry->key, key) == 0) {
-                break;
-            }
-            entry = NULL;
-        }
-    }
-
-    if (!entry) {
+    entry = &ht->table[id];
+    if (strcmp(entry->key, key) != 0) {
         return -1;
     }
 
@@ -460,12 +614,17 @@ void *flb_hash_get_ptr(struct flb_hash *ht,
     int id;
     struct flb_hash_entry *entry;
 
-    entry = hash_get_entry(ht, key, key_len, &id);
-    if (!entry) {
+    if (!key || key_len <= 0) {
         return NULL;
     }
 
-    entry->hits++;
+    id = hash_find(ht, XXH3_64bits(key, key_len), key, key_len);
+    if (id == -1) {
+        return NULL;
+    }
+
+    entry = &ht->table[id];
+    hash_entry_touch(ht, entry);
     return entry->val;
 }
 
@@ -473,10 +632,6 @@ int flb_hash_del(struct flb_hash *ht, const char *key)
 {
     int id;
     int len;
-    uint64_t hash;
-    struct mk_list *head;
-    struct flb_hash_entry *entry = NULL;
-    struct flb_hash_table *table;
 
     if (!key) {
         return -1;
@@ -487,33 +642,35 @@ int flb_hash_del(struct flb_hash *ht, const char *key)
         return -1;
     }
 
-    hash = XXH3_64bits(key, len);
-    id = (hash % ht->size);
-
-    table = &ht->table[id];
-    if (table->count == 1) {
-        entry = mk_list_entry_first(&table->chains,
-                                    struct flb_hash_entry,
-                                    _head);
-        if (strcmp(entry->key, key) != 0) {
-            entry = NULL;
-        }
+    id = hash_find(ht, XXH3_64bits(key, len), key, len);
+    if (id == -1) {
+        return -1;
     }
-    else {
-        mk_list_foreach(head, &table->chains) {
-            entry = mk_list_entry(head, struct flb_hash_entry, _head);
-            if (strcmp(entry->key, key) == 0) {
-                break;
-            }
-            entry = NULL;
-        }
+
+    flb_hash_entry_free(ht, &ht->table[id]);
+
+    return 0;
+}
+
+struct flb_hash_entry *flb_hash_iter_first(struct flb_hash *ht)
+{
+    if (ht->first < 0) {
+        return NULL;
     }
+    return &ht->table[ht->first];
+}
 
-    if (!entry) {
-        return -1;
+struct flb_hash_entry *flb_hash_iter_next(struct flb_hash *ht,
+                                          struct flb_hash_entry *entry)
+{
+    if (entry->next < 0) {
+        return NULL;
     }
+    return &ht->table[entry->next];
+}
 
+/* Remove an entry found with flb_hash_foreach() */
+void flb_hash_del_entry(struct flb_hash *ht, struct flb_hash_entry *entry)
+{
     flb_hash_entry_free(ht, entry);
-
-    return 0;
 }
@@ -0,0 +1,850 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * HPACK (RFC 7541): header fields compression for HTTP/2. The encoder
+ * indexes the fields that are repeated on every request of a connection
+ * (authority, content-type, user-agent...) so they are sent as one or two
+ * bytes, the decoder implements the full specification.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_hpack.h>
+
+#include <string.h>
+
+/* Values larger than this are not worth to be indexed */
+#define HPACK_INDEX_VALUE_MAX    512
+
+struct hpack_static {
+    const char *name;
+    const char *value;
+};
+
+/* Static table (RFC 7541, Appendix A) */
+static const struct hpack_static static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+};
+
+#define STATIC_TABLE_SIZE  (sizeof(static_table) / sizeof(struct hpack_static))
+
+/* Huffman code (RFC 7541, Appendix B): code, number of bits */
+static const struct {
+    uint32_t code;
+    uint8_t bits;
+} huff_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30}
+};
+
+/* Canonical decoding: symbols sorted by code */
+static const uint16_t huff_syms[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37,
+    45, 46, 47, 51, 52, 53, 54, 55, 56, 57, 61, 65,
+    95, 98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+    58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+    77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89,
+    106, 107, 113, 118, 119, 120, 121, 122, 38, 42, 44, 59,
+    88, 90, 33, 34, 40, 41, 63, 39, 43, 124, 35, 62,
+    0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+    167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+    132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+    173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+    151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+    183, 188, 191, 197, 231, 239, 9, 142, 144, 145, 148, 159,
+    171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+    255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+    246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5,
+    6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+    21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220,
+    249, 10, 13, 22, 256
+};
+
+/* First code, number of codes and offset in huff_syms for each length */
+static const uint32_t huff_first[31] = {
+    0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x14, 0x5c,
+    0xf8, 0x0, 0x3f8, 0x7fa, 0xffa, 0x1ff8, 0x3ffc, 0x7ffc,
+    0x0, 0x0, 0x0, 0x7fff0, 0xfffe6, 0x1fffdc, 0x3fffd2, 0x7fffd8,
+    0xffffea, 0x1ffffec, 0x3ffffe0, 0x7ffffde, 0xfffffe2, 0x0, 0x3ffffffc
+};
+static const uint16_t huff_count[31] = {
+    0, 0, 0, 0, 0, 10, 26, 32,
+    6, 0, 5, 3, 2, 6, 2, 3,
+    0, 0, 0, 3, 8, 13, 26, 29,
+    12, 4, 15, 19, 29, 0, 4
+};
+static const uint16_t huff_offset[31] = {
+    0, 0, 0, 0, 0, 0, 10, 36,
+    68, 0, 74, 79, 82, 84, 90, 92,
+    0, 0, 0, 95, 98, 106, 119, 145,
+    174, 186, 190, 205, 224, 0, 253
+};
+
+/* Append raw bytes to the output buffer */
+static inline int put(flb_sds_t *buf, const void *data, size_t len)
+{
+    return flb_sds_cat_safe(buf, (const char *) data, len);
+}
+
+/* Integer representation (5.1) */
+static int encode_int(flb_sds_t *buf, uint8_t first, int prefix,
+                      uint64_t value)
+{
+    int n = 0;
+    uint64_t max;
+    unsigned char tmp[16];
+
+    max = (1 << prefix) - 1;
+    if (value < max) {
+        tmp[n++] = first | value;
+    }
+    else {
+        tmp[n++] = first | max;
+        value -= max;
+        while (value >= 128) {
+            tmp[n++] = (value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        tmp[n++] = value;
+    }
+
+    return put(buf, tmp, n);
+}
+
+static int decode_int(const unsigned char **p, const unsigned char *end,
+                      int prefix, uint64_t *out)
+{
+    int shift = 0;
+    uint64_t max;
+    uint64_t value;
+    const unsigned char *c = *p;
+
+    if (c >= end) {
+        return -1;
+    }
+
+    max = (1 << prefix) - 1;
+    value = *c & max;
+    c++;
+
+    if (value == max) {
+        while (1) {
+            /* sizes and indexes are limited to 32 bits */
+            if (c >= end || shift > 28) {
+                return -1;
+            }
+            value += (uint64_t) (*c & 0x7f) << shift;
+            shift += 7;
+            if ((*c++ & 0x80) == 0) {
+                break;
+            }
+        }
+    }
+
+    *p = c;
+    *out = value;
+    return 0;
+}
+
+size_t flb_hpack_huffman_len(const char *str, size_t len)
+{
+    size_t i;
+    uint64_t bits = 0;
+
+    for (i = 0; i < len; i++) {
+        bits += huff_codes[(unsigned char) str[i]].bits;
+    }
+
+    return (bits + 7) / 8;
+}
+
+int flb_hpack_huffman_encode(const char *str, size_t len, flb_sds_t *buf)
+{
+    int n = 0;
+    int o = 0;
+    size_t i;
+    uint64_t acc = 0;
+    unsigned char c;
+    unsigned char out[64];
+
+    for (i = 0; i < len; i++) {
+        c = (unsigned char) str[i];
+        acc = (acc << huff_codes[c].bits) | huff_codes[c].code;
+        n += huff_codes[c].bits;
+
+        while (n >= 8) {
+            n -= 8;
+            out[o++] = acc >> n;
+            if (o == sizeof(out)) {
+                if (put(buf, out, o) == -1) {
+                    return -1;
+                }
+                o = 0;
+            }
+        }
+        acc &= ((uint64_t) 1 << n) - 1;
+    }
+
+    /* pad with the most significant bits of EOS (all ones) */
+    if (n > 0) {
+        out[o++] = (acc << (8 - n)) | (0xff >> n);
+    }
+
+    if (o > 0 && put(buf, out, o) == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int flb_hpack_huffman_decode(const unsigned char *in, size_t len,
+                             flb_sds_t *buf)
+{
+    int b;
+    int o = 0;
+    int bits = 0;
+    int sym;
+    size_t i;
+    uint32_t code = 0;
+    unsigned char out[64];
+
+    for (i = 0; i < len; i++) {
+        for (b = 7; b >= 0; b--) {
+            code = (code << 1) | ((in[i] >> b) & 1);
+            bits++;
+
+            if (bits > 30) {
+                return -1;
+            }
+
+            if (code < huff_first[bits] ||
+                code - huff_first[bits] >= huff_count[bits]) {
+                continue;
+            }
+
+            sym = huff_syms[huff_offset[bits] + (code - huff_first[bits])];
+            if (sym == 256) {
+                /* EOS must not be part of the string */
+                return -1;
+            }
+
+            out[o++] = sym;
+            if (o == sizeof(out)) {
+                if (put(buf, out, o) == -1) {
+                    return -1;
+                }
+                o = 0;
+            }
+            code = 0;
+            bits = 0;
+        }
+    }
+
+    /* padding: up to 7 bits, the most significant bits of EOS */
+    if (bits > 7 || code != ((uint32_t) 1 << bits) - 1) {
+        return -1;
+    }
+
+    if (o > 0 && put(buf, out, o) == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* String literal representation (5.2) */
+static int encode_string(flb_sds_t *buf, const char *str, size_t len)
+{
+    int ret;
+    size_t hlen;
+
+    hlen = flb_hpack_huffman_len(str, len);
+    if (hlen < len) {
+        ret = encode_int(buf, 0x80, 7, hlen);
+        if (ret == -1) {
+            return -1;
+        }
+        return flb_hpack_huffman_encode(str, len, buf);
+    }
+
+    ret = encode_int(buf, 0x00, 7, len);
+    if (ret == -1) {
+        return -1;
+    }
+    return put(buf, str, len);
+}
+
+static int decode_string(const unsigned char **p, const unsigned char *end,
+                         flb_sds_t *tmp, const char **out, size_t *out_len)
+{
+    int huffman;
+    uint64_t len;
+
+    if (*p >= end) {
+        return -1;
+    }
+
+    huffman = **p & 0x80;
+    if (decode_int(p, end, 7, &len) == -1) {
+        return -1;
+    }
+
+    if (len > (uint64_t) (end - *p)) {
+        return -1;
+    }
+
+    if (huffman) {
+        flb_sds_len_set(*tmp, 0);
+        if (flb_hpack_huffman_decode(*p, len, tmp) == -1) {
+            return -1;
+        }
+        *out = *tmp;
+        *out_len = flb_sds_len(*tmp);
+    }
+    else {
+        *out = (const char *) *p;
+        *out_len = len;
+    }
+
+    *p += len;
+    return 0;
+}
+
+/* Dynamic table: 'index' starts at 1 for the newest entry */
+static struct flb_hpack_field *table_get(struct flb_hpack *hp, uint64_t index)
+{
+    int pos;
+
+    if (index < 1 || index > hp->count) {
+        return NULL;
+    }
+
+    pos = (hp->head - (int) index + 1 + hp->ring_size) % hp->ring_size;
+    return &hp->ring[pos];
+}
+
+static void table_evict(struct flb_hpack *hp)
+{
+    struct flb_hpack_field *f;
+
+    f = table_get(hp, hp->count);
+    hp->size -= f->name_len + f->value_len + FLB_HPACK_ENTRY_OVERHEAD;
+    flb_free(f->name);
+    f->name = NULL;
+    f->value = NULL;
+    hp->count--;
+}
+
+static void table_fit(struct flb_hpack *hp, size_t size)
+{
+    while (hp->count > 0 && hp->size > size) {
+        table_evict(hp);
+    }
+}
+
+static int table_add(struct flb_hpack *hp,
+                     const char *name, size_t name_len,
+                     const char *value, size_t value_len)
+{
+    char *buf;
+    size_t size;
+    struct flb_hpack_field *f;
+
+    size = name_len + value_len + FLB_HPACK_ENTRY_OVERHEAD;
+    if (size > hp->max_size) {
+        /* not an error: the table is emptied (4.4) */
+        table_fit(hp, 0);
+        return 0;
+    }
+
+    /* the name might reference an entry being evicted, copy it first */
+    buf = flb_malloc(name_len + value_len + 2);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+    memcpy(buf, name, name_len);
+    buf[name_len] = '\0';
+    memcpy(buf + name_len + 1, value, value_len);
+    buf[name_len + 1 + value_len] = '\0';
+
+    table_fit(hp, hp->max_size - size);
+    if (hp->count == hp->ring_size) {
+        table_evict(hp);
+    }
+
+    hp->head = (hp->head + 1) % hp->ring_size;
+    f = &hp->ring[hp->head];
+    f->name = buf;
+    f->name_len = name_len;
+    f->value = buf + name_len + 1;
+    f->value_len = value_len;
+
+    hp->count++;
+    hp->size += size;
+    return 0;
+}
+
+struct flb_hpack *flb_hpack_create(size_t max_size)
+{
+    struct flb_hpack *hp;
+
+    hp = flb_calloc(1, sizeof(struct flb_hpack));
+    if (!hp) {
+        flb_errno();
+        return NULL;
+    }
+
+    hp->ring_size = (max_size / FLB_HPACK_ENTRY_OVERHEAD) + 1;
+    hp->ring = flb_calloc(hp->ring_size, sizeof(struct flb_hpack_field));
+    if (!hp->ring) {
+        flb_errno();
+        flb_free(hp);
+        return NULL;
+    }
+    hp->max_size = max_size;
+    hp->max_size_limit = max_size;
+
+    return hp;
+}
+
+void flb_hpack_destroy(struct flb_hpack *hp)
+{
+    if (!hp) {
+        return;
+    }
+
+    table_fit(hp, 0);
+    flb_free(hp->ring);
+    flb_free(hp);
+}
+
+/*
+ * Encoder: the peer changed SETTINGS_HEADER_TABLE_SIZE. The table never
+ * grows beyond the size it was created with, a smaller size is signaled
+ * at the beginning of the next header block.
+ */
+int flb_hpack_set_max_size(struct flb_hpack *hp, size_t max_size)
+{
+    hp->max_size_limit = max_size;
+    if (max_size < hp->max_size) {
+        hp->max_size = max_size;
+        table_fit(hp, max_size);
+        hp->size_update = FLB_TRUE;
+    }
+
+    return 0;
+}
+
+/* Encoder: start a new header block */
+int flb_hpack_encode_begin(struct flb_hpack *hp, flb_sds_t *buf)
+{
+    if (hp->size_update == FLB_FALSE) {
+        return 0;
+    }
+
+    hp->size_update = FLB_FALSE;
+    return encode_int(buf, 0x20, 5, hp->max_size);
+}
+
+/*
+ * Lookup a header field in the static and dynamic tables, it returns the
+ * index of a full match or zero, 'name_index' is set with the first entry
+ * matching the name.
+ */
+static uint64_t table_lookup(struct flb_hpack *hp,
+                             const char *name, size_t name_len,
+                             const char *value, size_t value_len,
+                             uint64_t *name_index)
+{
+    int i;
+    struct flb_hpack_field *f;
+    const struct hpack_static *s;
+
+    *name_index = 0;
+
+    for (i = 0; i < STATIC_TABLE_SIZE; i++) {
+        s = &static_table[i];
+        if (strlen(s->name) != name_len ||
+            memcmp(s->name, name, name_len) != 0) {
+            continue;
+        }
+
+        if (*name_index == 0) {
+            *name_index = i + 1;
+        }
+        if (strlen(s->value) == value_len &&
+            memcmp(s->value, value, value_len) == 0) {
+            return i + 1;
+        }
+    }
+
+    for (i = 1; i <= hp->count; i++) {
+        f = table_get(hp, i);
+        if (f->name_len != name_len || memcmp(f->name, name, name_len) != 0) {
+            continue;
+        }
+
+        if (*name_index == 0) {
+            *name_index = STATIC_TABLE_SIZE + i;
+        }
+        if (f->value_len == value_len &&
+            memcmp(f->value, value, value_len) == 0) {
+            return STATIC_TABLE_SIZE + i;
+        }
+    }
+
+    return 0;
+}
+
+/* Encode a header field, 'name' must be lowercase */
+int flb_hpack_encode(struct flb_hpack *hp, flb_sds_t *buf,
+                     const char *name, size_t name_len,
+                     const char *value, size_t value_len, int flags)
+{
+    int ret;
+    int prefix;
+    uint8_t first;
+    uint64_t index;
+    uint64_t name_index;
+
+    index = table_lookup(hp, name, name_len, value, value_len, &name_index);
+    if (index > 0 && !(flags & FLB_HPACK_NEVER_INDEX)) {
+        /* Indexed header field (6.1) */
+        return encode_int(buf, 0x80, 7, index);
+    }
+
+    if (value_len > HPACK_INDEX_VALUE_MAX) {
+        flags |= FLB_HPACK_NO_INDEX;
+    }
+
+    if (flags & FLB_HPACK_NEVER_INDEX) {
+        first = 0x10;
+        prefix = 4;
+    }
+    else if (flags & FLB_HPACK_NO_INDEX) {
+        first = 0x00;
+        prefix = 4;
+    }
+    else {
+        /* Literal with incremental indexing (6.2.1) */
+        first = 0x40;
+        prefix = 6;
+    }
+
+    ret = encode_int(buf, first, prefix, name_index);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (name_index == 0) {
+        ret = encode_string(buf, name, name_len);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    ret = encode_string(buf, value, value_len);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (first == 0x40) {
+        return table_add(hp, name, name_len, value, value_len);
+    }
+
+    return 0;
+}
+
+static int index_get(struct flb_hpack *hp, uint64_t index,
+                     const char **name, size_t *name_len,
+                     const char **value, size_t *value_len)
+{
+    struct flb_hpack_field *f;
+
+    if (index == 0) {
+        return -1;
+    }
+
+    if (index <= STATIC_TABLE_SIZE) {
+        *name = static_table[index - 1].name;
+        *name_len = strlen(*name);
+        *value = static_table[index - 1].value;
+        *value_len = strlen(*value);
+        return 0;
+    }
+
+    f = table_get(hp, index - STATIC_TABLE_SIZE);
+    if (!f) {
+        return -1;
+    }
+
+    *name = f->name;
+    *name_len = f->name_len;
+    *value = f->value;
+    *value_len = f->value_len;
+    return 0;
+}
+
+/*
+ * Decode a complete header block, 'cb_header' is invoked for every header
+ * field. It returns -1 on a compression error: the dynamic table cannot be
+ * trusted anymore and the connection must be closed.
+ */
+int flb_hpack_decode(struct flb_hpack *hp, const char *buf, size_t len,
+                     int (*cb_header)(void *,
+                                      const char *, size_t,
+                                      const char *, size_t),
+                     void *data)
+{
+    int ret = -1;
+    int add;
+    int prefix;
+    int fields = 0;
+    size_t name_len;
+    size_t value_len;
+    uint64_t index;
+    const char *name;
+    const char *value;
+    const char *tmp;
+    const unsigned char *p;
+    const unsigned char *end;
+    flb_sds_t name_buf;
+    flb_sds_t value_buf;
+
+    name_buf = flb_sds_create_size(64);
+    if (!name_buf) {
+        return -1;
+    }
+    value_buf = flb_sds_create_size(256);
+    if (!value_buf) {
+        flb_sds_destroy(name_buf);
+        return -1;
+    }
+
+    p = (const unsigned char *) buf;
+    end = p + len;
+
+    while (p < end) {
+        if (*p & 0x80) {
+            /* Indexed header field */
+            if (decode_int(&p, end, 7, &index) == -1 ||
+                index_get(hp, index, &name, &name_len,
+                          &value, &value_len) == -1) {
+                goto exit;
+            }
+        }
+        else if ((*p & 0xe0) == 0x20) {
+            /* Dynamic table size update, only at the beginning */
+            if (fields > 0 || decode_int(&p, end, 5, &index) == -1 ||
+                index > hp->max_size_limit) {
+                goto exit;
+            }
+            hp->max_size = index;
+            table_fit(hp, index);
+            continue;
+        }
+        else {
+            /* Literal header field */
+            if ((*p & 0xc0) == 0x40) {
+                add = FLB_TRUE;
+                prefix = 6;
+            }
+            else {
+                add = FLB_FALSE;
+                prefix = 4;
+            }
+
+            if (decode_int(&p, end, prefix, &index) == -1) {
+                goto exit;
+            }
+
+            if (index > 0) {
+                if (index_get(hp, index, &name, &name_len,
+                              &tmp, &value_len) == -1) {
+                    goto exit;
+                }
+
+                /* the entry might be evicted when the new one is added */
+                if (add == FLB_TRUE) {
+                    flb_sds_len_set(name_buf, 0);
+                    if (flb_sds_cat_safe(&name_buf, name, name_len) == -1) {
+                        goto exit;
+                    }
+                    name = name_buf;
+                }
+            }
+            else if (decode_string(&p, end, &name_buf,
+                                   &name, &name_len) == -1) {
+                goto exit;
+            }
+
+            if (decode_string(&p, end, &value_buf, &value, &value_len) == -1) {
+                goto exit;
+            }
+
+            if (add == FLB_TRUE &&
+                table_add(hp, name, name_len, value, value_len) == -1) {
+                goto exit;
+            }
+        }
+
+        fields++;
+        if (cb_header(data, name, name_len, value, value_len) == -1) {
+            goto exit;
+        }
+    }
+
+    ret = 0;
+
+ exit:
+    flb_sds_destroy(name_buf);
+    flb_sds_destroy(value_buf);
+    return ret;
+}
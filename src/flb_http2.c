@@ -0,0 +1,1488 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * HTTP/2 client (RFC 7540) for the HTTP client interface: when an upstream
+ * enables 'net.http2', every request of flb_http_do() becomes a stream of
+ * a session that lives in the upstream connection, and the upstream shares
+ * that connection between the coroutines flushing data concurrently.
+ *
+ * The session owns the socket events: a callback running in the event loop
+ * reads and dispatches the frames of all the streams and flushes the
+ * output buffer. The coroutines only queue frames and wait to be notified
+ * (flb_upstream_conn_wait()) when their stream makes progress. Without a
+ * coroutine (sync mode) the caller drives the connection with poll(2).
+ *
+ * The response is exposed through 'c->resp' exactly as an HTTP/1.1 one so
+ * the plugins don't need any change.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_compat.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_kv.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_io.h>
+#include <fluent-bit/flb_network.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_upstream.h>
+#include <fluent-bit/flb_upstream_conn.h>
+#include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_hpack.h>
+#include <fluent-bit/flb_http2.h>
+#include <fluent-bit/tls/flb_tls.h>
+
+#include <sys/poll.h>
+#include <string.h>
+#include <ctype.h>
+
+static inline uint32_t get_u32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+           ((uint32_t) p[2] << 8) | p[3];
+}
+
+static int frame_header(flb_sds_t *buf, uint32_t len, uint8_t type,
+                        uint8_t flags, uint32_t stream_id)
+{
+    unsigned char h[FLB_HTTP2_FRAME_HEADER_SIZE];
+
+    h[0] = (len >> 16) & 0xff;
+    h[1] = (len >> 8) & 0xff;
+    h[2] = len & 0xff;
+    h[3] = type;
+    h[4] = flags;
+    h[5] = (stream_id >> 24) & 0x7f;
+    h[6] = (stream_id >> 16) & 0xff;
+    h[7] = (stream_id >> 8) & 0xff;
+    h[8] = stream_id & 0xff;
+
+    return flb_sds_cat_safe(buf, (char *) h, sizeof(h));
+}
+
+static int frame_append(struct flb_http2_session *s, uint8_t type,
+                        uint8_t flags, uint32_t stream_id,
+                        const void *payload, uint32_t len)
+{
+    int ret;
+
+    ret = frame_header(&s->out, len, type, flags, stream_id);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (len > 0) {
+        return flb_sds_cat_safe(&s->out, payload, len);
+    }
+
+    return 0;
+}
+
+/*
+ * Append a DATA frame with 'len' bytes of the request body starting at
+ * 'offset': the body is 'body_buf' followed by the client body segments.
+ */
+static int frame_data_append(struct flb_http2_session *s,
+                             struct flb_http_client *c, uint8_t flags,
+                             uint32_t stream_id, size_t offset, uint32_t len)
+{
+    int i;
+    int ret;
+    size_t n;
+    size_t seg_len;
+    const char *seg;
+
+    ret = frame_header(&s->out, len, FLB_HTTP2_DATA, flags, stream_id);
+    if (ret == -1) {
+        return -1;
+    }
+
+    seg = c->body_buf;
+    seg_len = c->body_buf ? c->body_len : 0;
+
+    i = -1;
+    while (len > 0) {
+        if (offset < seg_len) {
+            n = seg_len - offset;
+            if (n > len) {
+                n = len;
+            }
+            ret = flb_sds_cat_safe(&s->out, seg + offset, n);
+            if (ret == -1) {
+                return -1;
+            }
+            len -= n;
+            offset = 0;
+        }
+        else {
+            offset -= seg_len;
+        }
+
+        /* next segment */
+        if (++i >= c->body_iov_count) {
+            break;
+        }
+        seg = c->body_iov[i].iov_base;
+        seg_len = c->body_iov[i].iov_len;
+    }
+
+    return len == 0 ? 0 : -1;
+}
+
+static int frame_window_update(struct flb_http2_session *s,
+                               uint32_t stream_id, uint32_t increment)
+{
+    unsigned char p[4];
+
+    p[0] = (increment >> 24) & 0x7f;
+    p[1] = (increment >> 16) & 0xff;
+    p[2] = (increment >> 8) & 0xff;
+    p[3] = increment & 0xff;
+
+    return frame_append(s, FLB_HTTP2_WINDOW_UPDATE, 0, stream_id, p, 4);
+}
+
+static int frame_settings(struct flb_http2_session *s)
+{
+    int n = 0;
+    unsigned char p[18];
+
+    /* no server push */
+    p[n++] = 0;
+    p[n++] = FLB_HTTP2_SETTINGS_ENABLE_PUSH;
+    p[n++] = 0; p[n++] = 0; p[n++] = 0; p[n++] = 0;
+
+    /* receive window of every stream */
+    p[n++] = 0;
+    p[n++] = FLB_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    p[n++] = (FLB_HTTP2_WINDOW >> 24) & 0xff;
+    p[n++] = (FLB_HTTP2_WINDOW >> 16) & 0xff;
+    p[n++] = (FLB_HTTP2_WINDOW >> 8) & 0xff;
+    p[n++] = FLB_HTTP2_WINDOW & 0xff;
+
+    /* size of the response header blocks we accept */
+    p[n++] = 0;
+    p[n++] = FLB_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE;
+    p[n++] = (FLB_HTTP2_HEADER_LIST_MAX >> 24) & 0xff;
+    p[n++] = (FLB_HTTP2_HEADER_LIST_MAX >> 16) & 0xff;
+    p[n++] = (FLB_HTTP2_HEADER_LIST_MAX >> 8) & 0xff;
+    p[n++] = FLB_HTTP2_HEADER_LIST_MAX & 0xff;
+
+    return frame_append(s, FLB_HTTP2_SETTINGS, 0, 0, p, n);
+}
+
+static int frame_rst_stream(struct flb_http2_session *s,
+                            uint32_t stream_id, uint32_t error)
+{
+    unsigned char p[4];
+
+    p[0] = (error >> 24) & 0xff;
+    p[1] = (error >> 16) & 0xff;
+    p[2] = (error >> 8) & 0xff;
+    p[3] = error & 0xff;
+
+    return frame_append(s, FLB_HTTP2_RST_STREAM, 0, stream_id, p, 4);
+}
+
+static int frame_goaway(struct flb_http2_session *s, uint32_t error)
+{
+    unsigned char p[8];
+
+    /* we never accept streams from the server */
+    memset(p, 0, 4);
+    p[4] = (error >> 24) & 0xff;
+    p[5] = (error >> 16) & 0xff;
+    p[6] = (error >> 8) & 0xff;
+    p[7] = error & 0xff;
+
+    return frame_append(s, FLB_HTTP2_GOAWAY, 0, 0, p, 8);
+}
+
+static struct flb_http2_stream *stream_get(struct flb_http2_session *s,
+                                           uint32_t id)
+{
+    struct mk_list *head;
+    struct flb_http2_stream *st;
+
+    mk_list_foreach(head, &s->streams) {
+        st = mk_list_entry(head, struct flb_http2_stream, _head);
+        if (st->id == id) {
+            return st;
+        }
+    }
+
+    return NULL;
+}
+
+static int cb_http2_event(void *data);
+
+/* Wake up the coroutines waiting on the session */
+static void session_notify(struct flb_http2_session *s)
+{
+    if (s->async == FLB_TRUE) {
+        flb_upstream_conn_notify(s->u_conn);
+    }
+}
+
+/* Watch the socket, it asks for write notifications if output is pending */
+static int session_events(struct flb_http2_session *s)
+{
+    int ret;
+    int mask = MK_EVENT_READ;
+    struct flb_upstream_conn *u_conn = s->u_conn;
+
+    if (s->async == FLB_FALSE || s->status == FLB_HTTP2_SESSION_ERROR) {
+        return 0;
+    }
+
+    if (s->out_pos < flb_sds_len(s->out)) {
+        mask |= MK_EVENT_WRITE;
+    }
+
+    /* note: once fired, 'event.mask' holds the events, not the interest */
+    if ((u_conn->event.status & MK_EVENT_REGISTERED) &&
+        u_conn->event.type == FLB_ENGINE_EV_CUSTOM &&
+        u_conn->event.handler == cb_http2_event &&
+        s->ev_mask == mask) {
+        return 0;
+    }
+
+    ret = mk_event_add(u_conn->evl, u_conn->fd,
+                       FLB_ENGINE_EV_CUSTOM, mask, &u_conn->event);
+    if (ret == -1) {
+        return -1;
+    }
+    s->ev_mask = mask;
+
+    return 0;
+}
+
+/* The connection is broken: fail every stream */
+static void session_fail(struct flb_http2_session *s)
+{
+    struct mk_list *head;
+    struct flb_http2_stream *st;
+    struct flb_upstream_conn *u_conn = s->u_conn;
+
+    if (s->status == FLB_HTTP2_SESSION_ERROR) {
+        return;
+    }
+    s->status = FLB_HTTP2_SESSION_ERROR;
+
+    mk_list_foreach(head, &s->streams) {
+        st = mk_list_entry(head, struct flb_http2_stream, _head);
+        st->error = FLB_TRUE;
+    }
+
+    if (s->async == FLB_TRUE && (u_conn->event.status & MK_EVENT_REGISTERED)) {
+        mk_event_del(u_conn->evl, &u_conn->event);
+    }
+
+    /* the last user of the connection destroys it */
+    flb_upstream_conn_recycle(u_conn, FLB_FALSE);
+    session_notify(s);
+}
+
+/* Write as much pending output as possible without blocking */
+static int session_flush(struct flb_http2_session *s)
+{
+    size_t len;
+    ssize_t bytes;
+
+    while (s->out_pos < flb_sds_len(s->out)) {
+        len = flb_sds_len(s->out) - s->out_pos;
+
+        /* a TLS write that would block must be retried with the same length */
+        if (s->out_retry > 0) {
+            len = s->out_retry;
+        }
+        else if (len > FLB_HTTP2_FRAME_SIZE) {
+            len = FLB_HTTP2_FRAME_SIZE;
+        }
+
+        bytes = flb_io_net_try_write(s->u_conn, s->out + s->out_pos, len);
+        if (bytes == -1) {
+            flb_debug("[http2] connection #%i to %s:%i broken on write",
+                      s->u_conn->fd, s->u_conn->u->tcp_host,
+                      s->u_conn->u->tcp_port);
+            session_fail(s);
+            return -1;
+        }
+        else if (bytes == 0) {
+            s->out_retry = len;
+            break;
+        }
+
+        s->out_retry = 0;
+        s->out_pos += bytes;
+    }
+
+    if (s->out_pos == flb_sds_len(s->out)) {
+        s->out_pos = 0;
+        flb_sds_len_set(s->out, 0);
+    }
+
+    return session_events(s);
+}
+
+/* Connection error (5.4.1): tell the server and close */
+static int session_error(struct flb_http2_session *s, uint32_t error,
+                         const char *reason)
+{
+    flb_error("[http2] connection #%i to %s:%i: %s",
+              s->u_conn->fd, s->u_conn->u->tcp_host, s->u_conn->u->tcp_port,
+              reason);
+
+    if (s->status != FLB_HTTP2_SESSION_ERROR) {
+        frame_goaway(s, error);
+        session_flush(s);
+        session_fail(s);
+    }
+
+    return -1;
+}
+
+/* Header block being decoded */
+struct header_block {
+    struct flb_http2_stream *st;
+    size_t list_size;             /* RFC 7541 4.1 size of the fields */
+};
+
+/* HPACK callback for the response header fields */
+static int cb_header(void *data,
+                     const char *name, size_t name_len,
+                     const char *value, size_t value_len)
+{
+    char tmp[32];
+    struct header_block *hb = data;
+    struct flb_http2_stream *st = hb->st;
+
+    /* every field counts, even the ones we discard */
+    hb->list_size += name_len + value_len + 32;
+    if (hb->list_size > FLB_HTTP2_HEADER_LIST_MAX) {
+        return -1;
+    }
+
+    /* unknown stream or trailers: the block is decoded but discarded */
+    if (!st || st->headers_done == FLB_TRUE) {
+        return 0;
+    }
+
+    if (name_len == 7 && memcmp(name, ":status", 7) == 0) {
+        if (value_len != 3) {
+            return -1;
+        }
+        memcpy(tmp, value, 3);
+        tmp[3] = '\0';
+        st->status = atoi(tmp);
+        return 0;
+    }
+    else if (name_len > 0 && name[0] == ':') {
+        return 0;
+    }
+
+    if (name_len == 14 && memcmp(name, "content-length", 14) == 0 &&
+        value_len < sizeof(tmp)) {
+        memcpy(tmp, value, value_len);
+        tmp[value_len] = '\0';
+        st->content_length = strtoll(tmp, NULL, 10);
+    }
+
+    if (flb_sds_cat_safe(&st->headers, name, name_len) == -1 ||
+        flb_sds_cat_safe(&st->headers, ": ", 2) == -1 ||
+        flb_sds_cat_safe(&st->headers, value, value_len) == -1 ||
+        flb_sds_cat_safe(&st->headers, "\r\n", 2) == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void stream_end(struct flb_http2_session *s, struct flb_http2_stream *st)
+{
+    st->end_stream = FLB_TRUE;
+    session_notify(s);
+}
+
+/* Stream error (5.4.2): reset the stream, its request fails */
+static void stream_error(struct flb_http2_session *s,
+                         struct flb_http2_stream *st, uint32_t error,
+                         const char *reason)
+{
+    flb_error("[http2] stream %u to %s:%i: %s", st->id,
+              s->u_conn->u->tcp_host, s->u_conn->u->tcp_port, reason);
+
+    frame_rst_stream(s, st->id, error);
+    session_flush(s);
+
+    st->error = FLB_TRUE;
+    st->closed = FLB_TRUE;
+    stream_end(s, st);
+}
+
+/* A complete header block has been received */
+static int process_header_block(struct flb_http2_session *s)
+{
+    int ret;
+    struct header_block hb;
+    struct flb_http2_stream *st;
+
+    st = stream_get(s, s->hb_stream);
+    hb.st = st;
+    hb.list_size = 0;
+
+    ret = flb_hpack_decode(s->decoder, s->hb_buf, flb_sds_len(s->hb_buf),
+                           cb_header, &hb);
+    flb_sds_len_set(s->hb_buf, 0);
+    if (hb.list_size > FLB_HTTP2_HEADER_LIST_MAX) {
+        return session_error(s, FLB_HTTP2_ENHANCE_YOUR_CALM,
+                             "header list too large");
+    }
+    else if (ret == -1) {
+        return session_error(s, FLB_HTTP2_COMPRESSION_ERROR,
+                             "invalid header block");
+    }
+
+    if (!st) {
+        return 0;
+    }
+
+    if (st->headers_done == FLB_FALSE) {
+        if (st->status >= 100 && st->status < 200) {
+            /* informational response, the final one comes later */
+            st->status = 0;
+            flb_sds_len_set(st->headers, 0);
+        }
+        else if (st->status > 0) {
+            st->headers_done = FLB_TRUE;
+        }
+        else {
+            st->error = FLB_TRUE;
+            stream_end(s, st);
+            return 0;
+        }
+    }
+
+    if (s->hb_flags & FLB_HTTP2_FLAG_END_STREAM) {
+        stream_end(s, st);
+    }
+
+    return 0;
+}
+
+static int process_data(struct flb_http2_session *s, struct flb_http2_stream *st,
+                        int flags, const unsigned char *p, uint32_t len)
+{
+    int ret;
+    uint32_t pad = 0;
+    uint32_t frame_len = len;
+    size_t avail;
+
+    if (flags & FLB_HTTP2_FLAG_PADDED) {
+        if (len < 1 || p[0] >= len) {
+            return session_error(s, FLB_HTTP2_PROTOCOL_ERROR, "invalid padding");
+        }
+        pad = p[0];
+        p++;
+        len -= 1 + pad;
+    }
+
+    if (st && st->end_stream == FLB_FALSE) {
+        avail = len;
+        if (st->body_max > 0) {
+            avail = 0;
+            if (flb_sds_len(st->body) < st->body_max) {
+                avail = st->body_max - flb_sds_len(st->body);
+            }
+            if (avail > len) {
+                avail = len;
+            }
+        }
+
+        if (avail > 0) {
+            ret = flb_sds_cat_safe(&st->body, (const char *) p, avail);
+            if (ret == -1) {
+                return session_error(s, FLB_HTTP2_INTERNAL_ERROR,
+                                     "cannot allocate response");
+            }
+        }
+        st->body_dropped += len - avail;
+    }
+
+    /* flow control: give back the window once half of it is used */
+    s->recv_consumed += frame_len;
+    if (s->recv_consumed >= FLB_HTTP2_WINDOW / 2) {
+        frame_window_update(s, 0, s->recv_consumed);
+        s->recv_consumed = 0;
+    }
+
+    if (st && !(flags & FLB_HTTP2_FLAG_END_STREAM)) {
+        st->recv_consumed += frame_len;
+        if (st->recv_consumed >= FLB_HTTP2_WINDOW / 2) {
+            frame_window_update(s, st->id, st->recv_consumed);
+            st->recv_consumed = 0;
+        }
+    }
+
+    if (st && (flags & FLB_HTTP2_FLAG_END_STREAM)) {
+        stream_end(s, st);
+    }
+
+    return 0;
+}
+
+static int process_settings(struct flb_http2_session *s, int flags,
+                            const unsigned char *p, uint32_t len)
+{
+    int id;
+    uint32_t i;
+    uint32_t value;
+    int32_t delta;
+    struct mk_list *head;
+    struct flb_http2_stream *st;
+
+    if (flags & FLB_HTTP2_FLAG_ACK) {
+        return 0;
+    }
+
+    if (len % 6 != 0) {
+        return session_error(s, FLB_HTTP2_FRAME_SIZE_ERROR,
+                             "invalid SETTINGS frame");
+    }
+
+    for (i = 0; i < len; i += 6) {
+        id = (p[i] << 8) | p[i + 1];
+        value = get_u32(p + i + 2);
+
+        switch (id) {
+        case FLB_HTTP2_SETTINGS_HEADER_TABLE_SIZE:
+            flb_hpack_set_max_size(s->encoder, value);
+            break;
+        case FLB_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS:
+            s->max_concurrent = value;
+            break;
+        case FLB_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+            if (value > FLB_HTTP2_WINDOW_MAX) {
+                return session_error(s, FLB_HTTP2_FLOW_CONTROL_ERROR,
+                                     "invalid initial window size");
+            }
+            delta = (int32_t) value - s->initial_window;
+            s->initial_window = value;
+            mk_list_foreach(head, &s->streams) {
+                st = mk_list_entry(head, struct flb_http2_stream, _head);
+                if ((int64_t) st->send_window + delta > FLB_HTTP2_WINDOW_MAX) {
+                    return session_error(s, FLB_HTTP2_FLOW_CONTROL_ERROR,
+                                         "stream window overflow");
+                }
+                st->send_window += delta;
+            }
+            break;
+        case FLB_HTTP2_SETTINGS_MAX_FRAME_SIZE:
+            if (value < FLB_HTTP2_FRAME_SIZE || value > FLB_HTTP2_FRAME_SIZE_MAX) {
+                return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                     "invalid max frame size");
+            }
+            s->max_frame_size = value;
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* acknowledge */
+    return frame_append(s, FLB_HTTP2_SETTINGS, FLB_HTTP2_FLAG_ACK, 0, NULL, 0);
+}
+
+static int process_goaway(struct flb_http2_session *s,
+                          const unsigned char *p, uint32_t len)
+{
+    uint32_t error;
+    struct mk_list *head;
+    struct flb_http2_stream *st;
+
+    if (len < 8) {
+        return session_error(s, FLB_HTTP2_FRAME_SIZE_ERROR,
+                             "invalid GOAWAY frame");
+    }
+
+    s->last_stream_id = get_u32(p) & FLB_HTTP2_STREAM_ID_MAX;
+    error = get_u32(p + 4);
+
+    flb_debug("[http2] connection #%i to %s:%i: GOAWAY last_stream=%u "
+              "error=%u", s->u_conn->fd, s->u_conn->u->tcp_host,
+              s->u_conn->u->tcp_port, s->last_stream_id, error);
+
+    if (s->status == FLB_HTTP2_SESSION_OK) {
+        s->status = FLB_HTTP2_SESSION_GOAWAY;
+    }
+    flb_upstream_conn_recycle(s->u_conn, FLB_FALSE);
+
+    /* streams not processed by the server */
+    mk_list_foreach(head, &s->streams) {
+        st = mk_list_entry(head, struct flb_http2_stream, _head);
+        if (st->id > s->last_stream_id) {
+            st->error = FLB_TRUE;
+            st->closed = FLB_TRUE;
+            st->end_stream = FLB_TRUE;
+        }
+    }
+
+    session_notify(s);
+    return 0;
+}
+
+static int process_frame(struct flb_http2_session *s, const unsigned char *h,
+                         const unsigned char *p)
+{
+    int type;
+    int flags;
+    uint32_t len;
+    uint32_t id;
+    uint32_t pad = 0;
+    uint32_t increment;
+    struct flb_http2_stream *st;
+
+    len = (h[0] << 16) | (h[1] << 8) | h[2];
+    type = h[3];
+    flags = h[4];
+    id = get_u32(h + 5) & FLB_HTTP2_STREAM_ID_MAX;
+
+    /* a header block can only be followed by its CONTINUATION frames */
+    if (s->hb_stream > 0 &&
+        (type != FLB_HTTP2_CONTINUATION || id != s->hb_stream)) {
+        return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                             "header block interrupted");
+    }
+
+    st = NULL;
+    if (id > 0) {
+        st = stream_get(s, id);
+    }
+
+    switch (type) {
+    case FLB_HTTP2_DATA:
+        if (id == 0) {
+            return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                 "DATA frame on stream 0");
+        }
+        return process_data(s, st, flags, p, len);
+    case FLB_HTTP2_HEADERS:
+        if (id == 0) {
+            return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                 "HEADERS frame on stream 0");
+        }
+        if (flags & FLB_HTTP2_FLAG_PADDED) {
+            if (len < 1 || p[0] >= len) {
+                return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                     "invalid padding");
+            }
+            pad = p[0];
+            p++;
+            len -= 1 + pad;
+        }
+        if (flags & FLB_HTTP2_FLAG_PRIORITY) {
+            if (len < 5) {
+                return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                     "invalid HEADERS frame");
+            }
+            p += 5;
+            len -= 5;
+        }
+
+        s->hb_flags = flags;
+        if (flb_sds_len(s->hb_buf) + len > FLB_HTTP2_HEADER_LIST_MAX) {
+            return session_error(s, FLB_HTTP2_ENHANCE_YOUR_CALM,
+                                 "header block too large");
+        }
+        if (flb_sds_cat_safe(&s->hb_buf, (const char *) p, len) == -1) {
+            return session_error(s, FLB_HTTP2_INTERNAL_ERROR,
+                                 "cannot allocate header block");
+        }
+
+        if (flags & FLB_HTTP2_FLAG_END_HEADERS) {
+            s->hb_stream = id;
+            process_header_block(s);
+            s->hb_stream = 0;
+        }
+        else {
+            s->hb_stream = id;
+        }
+        return 0;
+    case FLB_HTTP2_CONTINUATION:
+        if (s->hb_stream == 0) {
+            return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                 "unexpected CONTINUATION frame");
+        }
+        if (flb_sds_len(s->hb_buf) + len > FLB_HTTP2_HEADER_LIST_MAX) {
+            return session_error(s, FLB_HTTP2_ENHANCE_YOUR_CALM,
+                                 "header block too large");
+        }
+        if (flb_sds_cat_safe(&s->hb_buf, (const char *) p, len) == -1) {
+            return session_error(s, FLB_HTTP2_INTERNAL_ERROR,
+                                 "cannot allocate header block");
+        }
+        if (flags & FLB_HTTP2_FLAG_END_HEADERS) {
+            process_header_block(s);
+            s->hb_stream = 0;
+        }
+        return 0;
+    case FLB_HTTP2_RST_STREAM:
+        if (len != 4) {
+            return session_error(s, FLB_HTTP2_FRAME_SIZE_ERROR,
+                                 "invalid RST_STREAM frame");
+        }
+        if (st) {
+            flb_debug("[http2] stream %u reset by the server, error=%u",
+                      id, get_u32(p));
+            st->error = FLB_TRUE;
+            st->closed = FLB_TRUE;
+            stream_end(s, st);
+        }
+        return 0;
+    case FLB_HTTP2_SETTINGS:
+        if (id != 0) {
+            return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                 "SETTINGS frame on a stream");
+        }
+        process_settings(s, flags, p, len);
+        session_notify(s);
+        return 0;
+    case FLB_HTTP2_PUSH_PROMISE:
+        return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                             "server push is disabled");
+    case FLB_HTTP2_PING:
+        if (len != 8) {
+            return session_error(s, FLB_HTTP2_FRAME_SIZE_ERROR,
+                                 "invalid PING frame");
+        }
+        if (!(flags & FLB_HTTP2_FLAG_ACK)) {
+            return frame_append(s, FLB_HTTP2_PING, FLB_HTTP2_FLAG_ACK, 0, p, 8);
+        }
+        return 0;
+    case FLB_HTTP2_GOAWAY:
+        return process_goaway(s, p, len);
+    case FLB_HTTP2_WINDOW_UPDATE:
+        if (len != 4) {
+            return session_error(s, FLB_HTTP2_FRAME_SIZE_ERROR,
+                                 "invalid WINDOW_UPDATE frame");
+        }
+        increment = get_u32(p) & FLB_HTTP2_WINDOW_MAX;
+        if (id == 0) {
+            if (increment == 0) {
+                return session_error(s, FLB_HTTP2_PROTOCOL_ERROR,
+                                     "window update of 0");
+            }
+            if ((int64_t) s->send_window + increment > FLB_HTTP2_WINDOW_MAX) {
+                return session_error(s, FLB_HTTP2_FLOW_CONTROL_ERROR,
+                                     "window overflow");
+            }
+            s->send_window += increment;
+        }
+        else if (st && st->closed == FLB_FALSE) {
+            if (increment == 0) {
+                stream_error(s, st, FLB_HTTP2_PROTOCOL_ERROR,
+                             "window update of 0");
+                return 0;
+            }
+            if ((int64_t) st->send_window + increment > FLB_HTTP2_WINDOW_MAX) {
+                stream_error(s, st, FLB_HTTP2_FLOW_CONTROL_ERROR,
+                             "window overflow");
+                return 0;
+            }
+            st->send_window += increment;
+        }
+        session_notify(s);
+        return 0;
+    default:
+        /* PRIORITY and unknown frame types are ignored */
+        return 0;
+    }
+}
+
+/* Read and process every frame available without blocking */
+static int session_read(struct flb_http2_session *s)
+{
+    int ret;
+    ssize_t bytes;
+    size_t off;
+    uint32_t len;
+    unsigned char *h;
+
+    while (s->status != FLB_HTTP2_SESSION_ERROR) {
+        bytes = flb_io_net_try_read(s->u_conn, s->in + s->in_len,
+                                    s->in_size - s->in_len);
+        if (bytes == -1) {
+            flb_debug("[http2] connection #%i to %s:%i closed",
+                      s->u_conn->fd, s->u_conn->u->tcp_host,
+                      s->u_conn->u->tcp_port);
+            session_fail(s);
+            return -1;
+        }
+        else if (bytes == 0) {
+            break;
+        }
+        s->in_len += bytes;
+
+        /* process complete frames */
+        off = 0;
+        while (s->in_len - off >= FLB_HTTP2_FRAME_HEADER_SIZE) {
+            h = (unsigned char *) s->in + off;
+            len = (h[0] << 16) | (h[1] << 8) | h[2];
+            if (len > FLB_HTTP2_FRAME_SIZE) {
+                return session_error(s, FLB_HTTP2_FRAME_SIZE_ERROR,
+                                     "frame too large");
+            }
+
+            if (s->in_len - off < FLB_HTTP2_FRAME_HEADER_SIZE + len) {
+                break;
+            }
+
+            ret = process_frame(s, h, h + FLB_HTTP2_FRAME_HEADER_SIZE);
+            if (ret == -1 || s->status == FLB_HTTP2_SESSION_ERROR) {
+                return -1;
+            }
+            off += FLB_HTTP2_FRAME_HEADER_SIZE + len;
+        }
+
+        if (off > 0) {
+            memmove(s->in, s->in + off, s->in_len - off);
+            s->in_len -= off;
+        }
+    }
+
+    /* frames generated by the processing: ACKs, window updates... */
+    return session_flush(s);
+}
+
+/* Event loop callback for the connection socket */
+static int cb_http2_event(void *data)
+{
+    int mask;
+    struct flb_upstream_conn *u_conn = data;
+    struct flb_http2_session *s = u_conn->http2;
+
+    if (!s) {
+        return 0;
+    }
+
+    mask = u_conn->event.mask;
+    if (mask & MK_EVENT_WRITE) {
+        if (session_flush(s) == -1) {
+            return 0;
+        }
+        session_notify(s);
+    }
+
+    if (mask & ~MK_EVENT_WRITE) {
+        session_read(s);
+    }
+
+    return 0;
+}
+
+/* Sync mode: wait for the socket and process its events */
+static int session_poll(struct flb_http2_session *s)
+{
+    int ret;
+    struct pollfd pfd;
+
+    pfd.fd = s->u_conn->fd;
+    pfd.events = POLLIN;
+    if (s->out_pos < flb_sds_len(s->out)) {
+        pfd.events |= POLLOUT;
+    }
+    pfd.revents = 0;
+
+    ret = poll(&pfd, 1, -1);
+    if (ret == -1) {
+        flb_errno();
+        session_fail(s);
+        return -1;
+    }
+
+    if (pfd.revents & POLLOUT) {
+        if (session_flush(s) == -1) {
+            return -1;
+        }
+    }
+
+    if (pfd.revents & ~POLLOUT) {
+        return session_read(s);
+    }
+
+    return 0;
+}
+
+/* Wait until the session makes some progress */
+static int session_wait(struct flb_http2_session *s, struct flb_coro *coro)
+{
+    if (s->async == FLB_TRUE) {
+        return flb_upstream_conn_wait(s->u_conn, coro);
+    }
+
+    return session_poll(s);
+}
+
+/* Take over the socket events: a recycled connection gets them back */
+static int session_attach(struct flb_http2_session *s)
+{
+    struct flb_upstream_conn *u_conn = s->u_conn;
+
+    if (s->async == FLB_FALSE) {
+        return 0;
+    }
+
+    if (u_conn->event.handler != cb_http2_event ||
+        u_conn->event.type != FLB_ENGINE_EV_CUSTOM) {
+        if (u_conn->event.status & MK_EVENT_REGISTERED) {
+            mk_event_del(u_conn->evl, &u_conn->event);
+        }
+        MK_EVENT_NEW(&u_conn->event);
+        u_conn->event.handler = cb_http2_event;
+    }
+
+    return session_events(s);
+}
+
+struct flb_http2_session *flb_http2_session_create(struct flb_upstream_conn *u_conn)
+{
+    int ret;
+    struct flb_http2_session *s;
+
+    s = flb_calloc(1, sizeof(struct flb_http2_session));
+    if (!s) {
+        flb_errno();
+        return NULL;
+    }
+    s->u_conn = u_conn;
+    s->status = FLB_HTTP2_SESSION_OK;
+    s->async = flb_upstream_is_async(u_conn->u);
+    s->next_stream_id = 1;
+    s->max_concurrent = FLB_HTTP2_MAX_CONCURRENT;
+    s->max_frame_size = FLB_HTTP2_FRAME_SIZE;
+    s->initial_window = FLB_HTTP2_WINDOW_DEFAULT;
+    s->send_window = FLB_HTTP2_WINDOW_DEFAULT;
+    mk_list_init(&s->streams);
+
+    s->encoder = flb_hpack_create(FLB_HPACK_TABLE_SIZE);
+    s->decoder = flb_hpack_create(FLB_HPACK_TABLE_SIZE);
+    s->out = flb_sds_create_size(4096);
+    s->hb_buf = flb_sds_create_size(1024);
+    s->in_size = FLB_HTTP2_FRAME_HEADER_SIZE + FLB_HTTP2_FRAME_SIZE;
+    s->in = flb_malloc(s->in_size);
+    if (!s->encoder || !s->decoder || !s->out || !s->hb_buf || !s->in) {
+        flb_errno();
+        flb_http2_session_destroy(s);
+        return NULL;
+    }
+
+    /* sync mode: the session polls the socket, it must not block */
+    if (s->async == FLB_FALSE) {
+        flb_net_socket_nonblocking(u_conn->fd);
+    }
+
+    /* connection preface, settings and connection window */
+    ret = flb_sds_cat_safe(&s->out, FLB_HTTP2_PREFACE, FLB_HTTP2_PREFACE_LEN);
+    if (ret == 0) {
+        ret = frame_settings(s);
+    }
+    if (ret == 0) {
+        ret = frame_window_update(s, 0,
+                                  FLB_HTTP2_WINDOW - FLB_HTTP2_WINDOW_DEFAULT);
+    }
+    if (ret == -1) {
+        flb_http2_session_destroy(s);
+        return NULL;
+    }
+
+    flb_debug("[http2] session started on connection #%i to %s:%i",
+              u_conn->fd, u_conn->u->tcp_host, u_conn->u->tcp_port);
+    return s;
+}
+
+void flb_http2_session_destroy(struct flb_http2_session *s)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_http2_stream *st;
+
+    if (!s) {
+        return;
+    }
+
+    mk_list_foreach_safe(head, tmp, &s->streams) {
+        st = mk_list_entry(head, struct flb_http2_stream, _head);
+        mk_list_del(&st->_head);
+        flb_sds_destroy(st->headers);
+        flb_sds_destroy(st->body);
+        flb_free(st);
+    }
+
+    flb_hpack_destroy(s->encoder);
+    flb_hpack_destroy(s->decoder);
+    flb_sds_destroy(s->out);
+    flb_sds_destroy(s->hb_buf);
+    flb_free(s->in);
+    flb_free(s);
+}
+
+/* Check if the session can take one more request (shared connections) */
+int flb_http2_session_available(struct flb_http2_session *s, int users)
+{
+    if (s->status != FLB_HTTP2_SESSION_OK) {
+        return FLB_FALSE;
+    }
+
+    if (users >= s->max_concurrent) {
+        return FLB_FALSE;
+    }
+
+    if (s->next_stream_id + (users * 2) > FLB_HTTP2_STREAM_ID_MAX) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
+static struct flb_http2_stream *stream_create(struct flb_http2_session *s,
+                                              struct flb_http_client *c)
+{
+    struct flb_http2_stream *st;
+
+    st = flb_calloc(1, sizeof(struct flb_http2_stream));
+    if (!st) {
+        flb_errno();
+        return NULL;
+    }
+
+    st->headers = flb_sds_create_size(256);
+    st->body = flb_sds_create_size(256);
+    if (!st->headers || !st->body) {
+        flb_sds_destroy(st->headers);
+        flb_sds_destroy(st->body);
+        flb_free(st);
+        return NULL;
+    }
+
+    st->id = s->next_stream_id;
+    s->next_stream_id += 2;
+    st->send_window = s->initial_window;
+    st->content_length = -1;
+    st->body_max = c->resp.data_size_max;
+
+    mk_list_add(&st->_head, &s->streams);
+    s->active++;
+    return st;
+}
+
+static void stream_destroy(struct flb_http2_session *s,
+                           struct flb_http2_stream *st)
+{
+    uint32_t error;
+
+    /*
+     * A stream abandoned before it's closed in both directions is reset,
+     * otherwise the server keeps its state (and the request body it's
+     * still waiting for) around. A complete response only means we don't
+     * need the rest of the request (8.1).
+     */
+    if (s->status != FLB_HTTP2_SESSION_ERROR && st->closed == FLB_FALSE &&
+        (st->local_end == FLB_FALSE || st->end_stream == FLB_FALSE)) {
+        error = FLB_HTTP2_CANCEL;
+        if (st->end_stream == FLB_TRUE) {
+            error = FLB_HTTP2_NO_ERROR;
+        }
+        frame_rst_stream(s, st->id, error);
+        session_flush(s);
+    }
+
+    mk_list_del(&st->_head);
+    s->active--;
+    flb_sds_destroy(st->headers);
+    flb_sds_destroy(st->body);
+    flb_free(st);
+
+    /* a stream slot is available */
+    session_notify(s);
+}
+
+/* HTTP/1.1 headers that don't exist in HTTP/2 (8.1.2.2) */
+static int header_skip(const char *key, size_t len)
+{
+    if ((len == 4 && strncasecmp(key, "host", 4) == 0) ||
+        (len == 10 && strncasecmp(key, "connection", 10) == 0) ||
+        (len == 10 && strncasecmp(key, "keep-alive", 10) == 0) ||
+        (len == 16 && strncasecmp(key, "proxy-connection", 16) == 0) ||
+        (len == 17 && strncasecmp(key, "transfer-encoding", 17) == 0) ||
+        (len == 7 && strncasecmp(key, "upgrade", 7) == 0) ||
+        (len == 2 && strncasecmp(key, "te", 2) == 0)) {
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+static int encode_headers(struct flb_http2_session *s,
+                          struct flb_http_client *c, flb_sds_t *buf)
+{
+    int ret;
+    int flags;
+    size_t i;
+    size_t len;
+    const char *method;
+    const char *path;
+    char name[256];
+    struct mk_list *head;
+    struct flb_kv *kv;
+    struct flb_kv *host = NULL;
+
+    switch (c->method) {
+    case FLB_HTTP_GET:
+        method = "GET";
+        break;
+    case FLB_HTTP_POST:
+        method = "POST";
+        break;
+    case FLB_HTTP_PUT:
+        method = "PUT";
+        break;
+    case FLB_HTTP_HEAD:
+        method = "HEAD";
+        break;
+    case FLB_HTTP_PATCH:
+        method = "PATCH";
+        break;
+    default:
+        return -1;
+    }
+
+    path = c->uri;
+    if (!path || *path == '\0') {
+        path = "/";
+    }
+
+    mk_list_foreach(head, &c->headers) {
+        kv = mk_list_entry(head, struct flb_kv, _head);
+        if (strcasecmp(kv->key, "host") == 0) {
+            host = kv;
+        }
+    }
+
+    ret = flb_hpack_encode_begin(s->encoder, buf);
+    ret |= flb_hpack_encode(s->encoder, buf, ":method", 7,
+                            method, strlen(method), 0);
+    if (c->u_conn->u->flags & FLB_IO_TLS) {
+        ret |= flb_hpack_encode(s->encoder, buf, ":scheme", 7, "https", 5, 0);
+    }
+    else {
+        ret |= flb_hpack_encode(s->encoder, buf, ":scheme", 7, "http", 4, 0);
+    }
+    if (host) {
+        ret |= flb_hpack_encode(s->encoder, buf, ":authority", 10,
+                                host->val, flb_sds_len(host->val), 0);
+    }
+    ret |= flb_hpack_encode(s->encoder, buf, ":path", 5, path, strlen(path),
+                            FLB_HPACK_NO_INDEX);
+    if (ret != 0) {
+        return -1;
+    }
+
+    mk_list_foreach(head, &c->headers) {
+        kv = mk_list_entry(head, struct flb_kv, _head);
+        len = flb_sds_len(kv->key);
+        if (len == 0 || len >= sizeof(name) || header_skip(kv->key, len)) {
+            continue;
+        }
+
+        /* field names are lowercase in HTTP/2 */
+        for (i = 0; i < len; i++) {
+            name[i] = tolower((unsigned char) kv->key[i]);
+        }
+
+        flags = 0;
+        if ((len == 13 && memcmp(name, "authorization", 13) == 0) ||
+            (len == 19 && memcmp(name, "proxy-authorization", 19) == 0)) {
+            flags = FLB_HPACK_NEVER_INDEX;
+        }
+        else if (len == 14 && memcmp(name, "content-length", 14) == 0) {
+            flags = FLB_HPACK_NO_INDEX;
+        }
+
+        ret = flb_hpack_encode(s->encoder, buf, name, len,
+                               kv->val, flb_sds_len(kv->val), flags);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Queue HEADERS (+ CONTINUATION) frames for the request */
+static int send_headers(struct flb_http2_session *s,
+                        struct flb_http2_stream *st,
+                        struct flb_http_client *c, size_t *out_bytes)
+{
+    int ret;
+    int type;
+    int flags;
+    size_t off = 0;
+    size_t len;
+    size_t body_len;
+    flb_sds_t block;
+
+    block = flb_sds_create_size(512);
+    if (!block) {
+        return -1;
+    }
+
+    ret = encode_headers(s, c, &block);
+    if (ret == -1) {
+        flb_sds_destroy(block);
+        /* the encoder state is unknown, the connection can't be used */
+        session_fail(s);
+        return -1;
+    }
+
+    body_len = c->body_len + c->body_iov_len;
+    type = FLB_HTTP2_HEADERS;
+    do {
+        len = flb_sds_len(block) - off;
+        if (len > s->max_frame_size) {
+            len = s->max_frame_size;
+        }
+
+        flags = 0;
+        if (type == FLB_HTTP2_HEADERS && body_len == 0) {
+            flags |= FLB_HTTP2_FLAG_END_STREAM;
+            st->local_end = FLB_TRUE;
+        }
+        if (off + len == flb_sds_len(block)) {
+            flags |= FLB_HTTP2_FLAG_END_HEADERS;
+        }
+
+        ret = frame_append(s, type, flags, st->id, block + off, len);
+        if (ret == -1) {
+            flb_sds_destroy(block);
+            session_fail(s);
+            return -1;
+        }
+
+        off += len;
+        type = FLB_HTTP2_CONTINUATION;
+    } while (off < flb_sds_len(block));
+
+    *out_bytes = flb_sds_len(block);
+    flb_sds_destroy(block);
+    return 0;
+}
+
+/* Compose 'c->resp' as an HTTP/1.1 response so the callers can use it */
+static int response_set(struct flb_http_client *c, struct flb_http2_stream *st)
+{
+    int len;
+    char *tmp;
+    size_t size;
+    struct flb_http_response *r = &c->resp;
+
+    size = 32 + flb_sds_len(st->headers) + 2 + flb_sds_len(st->body) + 1;
+    if (r->data_size < size) {
+        tmp = flb_realloc(r->data, size);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        r->data = tmp;
+        r->data_size = size;
+    }
+
+    len = snprintf(r->data, 32, "HTTP/2.0 %i\r\n", st->status);
+    memcpy(r->data + len, st->headers, flb_sds_len(st->headers));
+    len += flb_sds_len(st->headers);
+    memcpy(r->data + len, "\r\n", 2);
+    len += 2;
+    r->headers_end = r->data + len;
+
+    memcpy(r->data + len, st->body, flb_sds_len(st->body));
+    len += flb_sds_len(st->body);
+    r->data[len] = '\0';
+    r->data_len = len;
+
+    r->status = st->status;
+    r->content_length = st->content_length;
+    r->connection_close = FLB_FALSE;
+    r->payload_size = flb_sds_len(st->body);
+    if (r->payload_size > 0) {
+        r->payload = r->headers_end;
+    }
+
+    if (st->body_dropped > 0) {
+        flb_warn("[http2] response body truncated to %zu bytes, %zu bytes "
+                 "dropped", flb_sds_len(st->body), st->body_dropped);
+    }
+
+    return 0;
+}
+
+/*
+ * Decide if the request goes through HTTP/2: the upstream must enable it,
+ * on TLS connections the server must have selected 'h2' through ALPN,
+ * otherwise the request falls back to HTTP/1.1.
+ */
+int flb_http2_check(struct flb_http_client *c)
+{
+    struct flb_upstream_conn *u_conn = c->u_conn;
+    struct flb_upstream *u = u_conn->u;
+
+    if (u_conn->http2) {
+        return FLB_TRUE;
+    }
+
+    if (u->net.http2 == FLB_FALSE || c->method == FLB_HTTP_CONNECT ||
+        c->proxy.host != NULL) {
+        return FLB_FALSE;
+    }
+
+#ifdef FLB_HAVE_TLS
+    if (u_conn->tls_session &&
+        flb_tls_session_alpn_selected(u_conn, "h2") == FLB_FALSE) {
+        return FLB_FALSE;
+    }
+#endif
+
+    return FLB_TRUE;
+}
+
+int flb_http2_do(struct flb_http_client *c, size_t *bytes)
+{
+    int ret = -1;
+    int flags;
+    size_t len;
+    size_t body_len;
+    size_t sent = 0;
+    size_t header_bytes = 0;
+    struct flb_coro *coro = NULL;
+    struct flb_http2_session *s;
+    struct flb_http2_stream *st;
+    struct flb_upstream_conn *u_conn = c->u_conn;
+
+    s = u_conn->http2;
+    if (!s) {
+        s = flb_http2_session_create(u_conn);
+        if (!s) {
+            return -1;
+        }
+        u_conn->http2 = s;
+    }
+
+    if (s->async == FLB_TRUE) {
+        coro = flb_coro_get();
+        if (!coro) {
+            flb_error("[http2] asynchronous request outside of a coroutine");
+            return -1;
+        }
+    }
+
+    session_attach(s);
+
+    /* wait for a stream slot */
+    while (s->status == FLB_HTTP2_SESSION_OK && s->active >= s->max_concurrent) {
+        session_wait(s, coro);
+    }
+
+    if (s->status != FLB_HTTP2_SESSION_OK ||
+        s->next_stream_id > FLB_HTTP2_STREAM_ID_MAX) {
+        flb_upstream_conn_recycle(u_conn, FLB_FALSE);
+        return -1;
+    }
+
+    st = stream_create(s, c);
+    if (!st) {
+        return -1;
+    }
+
+    ret = send_headers(s, st, c, &header_bytes);
+    if (ret == -1) {
+        goto exit;
+    }
+    session_flush(s);
+
+    /* request body, limited by the flow control windows */
+    body_len = c->body_len + c->body_iov_len;
+    while (sent < body_len && s->status != FLB_HTTP2_SESSION_ERROR &&
+           st->end_stream == FLB_FALSE) {
+        len = body_len - sent;
+        if (len > s->max_frame_size) {
+            len = s->max_frame_size;
+        }
+        if (s->send_window < len) {
+            len = s->send_window > 0 ? s->send_window : 0;
+        }
+        if (st->send_window < len) {
+            len = st->send_window > 0 ? st->send_window : 0;
+        }
+
+        if (len == 0 || flb_sds_len(s->out) - s->out_pos > FLB_HTTP2_OUT_MAX) {
+            session_wait(s, coro);
+            continue;
+        }
+
+        flags = 0;
+        if (sent + len == body_len) {
+            flags = FLB_HTTP2_FLAG_END_STREAM;
+        }
+
+        ret = frame_data_append(s, c, flags, st->id, sent, len);
+        if (ret == -1) {
+            session_fail(s);
+            break;
+        }
+        if (flags & FLB_HTTP2_FLAG_END_STREAM) {
+            st->local_end = FLB_TRUE;
+        }
+
+        sent += len;
+        s->send_window -= len;
+        st->send_window -= len;
+        session_flush(s);
+    }
+
+    /* wait for the response */
+    while (st->end_stream == FLB_FALSE && st->error == FLB_FALSE &&
+           s->status != FLB_HTTP2_SESSION_ERROR) {
+        session_wait(s, coro);
+    }
+
+    if (st->error == FLB_TRUE || st->end_stream == FLB_FALSE) {
+        flb_error("[http2] request on stream %u to %s:%i failed",
+                  st->id, u_conn->u->tcp_host, u_conn->u->tcp_port);
+        ret = -1;
+        goto exit;
+    }
+
+    ret = response_set(c, st);
+    *bytes = header_bytes + sent;
+
+ exit:
+    stream_destroy(s, st);
+    return ret;
+}
@@ -40,6 +40,7 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_http_client.h>
 #include <fluent-bit/flb_http_client_debug.h>
+#include <fluent-bit/flb_http2.h>
 #include <fluent-bit/flb_utils.h>
 
 
@@ -621,6 +622,57 @@ static int add_host_and_content_length(struct flb_http_client *c)
     return 0;
 }
 
+/*
+ * Append a segment to the request body. The data is not copied, it must be
+ * valid until the request is done. Segments let the caller send a payload
+ * made of different buffers (e.g: a prefix plus the chunk data) without
+ * concatenating them: flb_http_do() writes everything with a single vectored
+ * write.
+ */
+int flb_http_add_body_segment(struct flb_http_client *c,
+                              const void *data, size_t len)
+{
+    int size;
+    int ret;
+    char tmp[32];
+    struct flb_kv *kv;
+    struct mk_list *head;
+    struct mk_iovec *iov;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    if (c->body_iov_count == c->body_iov_size) {
+        size = c->body_iov_size == 0 ? 8 : c->body_iov_size * 2;
+        iov = flb_realloc(c->body_iov, sizeof(struct mk_iovec) * size);
+        if (!iov) {
+            flb_errno();
+            return -1;
+        }
+        c->body_iov = iov;
+        c->body_iov_size = size;
+    }
+
+    iov = &c->body_iov[c->body_iov_count++];
+    iov->iov_base = (void *) data;
+    iov->iov_len = len;
+    c->body_iov_len += len;
+
+    /* update the Content-Length header */
+    ret = snprintf(tmp, sizeof(tmp) - 1, "%zu",
+                   (size_t) c->body_len + c->body_iov_len);
+    mk_list_foreach(head, &c->headers) {
+        kv = mk_list_entry(head, struct flb_kv, _head);
+        if (flb_sds_casecmp(kv->key, "Content-Length", 14) == 0) {
+            flb_sds_len_set(kv->val, 0);
+            return flb_sds_cat_safe(&kv->val, tmp, ret);
+        }
+    }
+
+    return flb_http_add_header(c, "Content-Length", 14, tmp, ret);
+}
+
 struct flb_http_client *flb_http_client(struct flb_upstream_conn *u_conn,
                                         int method, const char *uri,
                                         const char *body, size_t body_len,
@@ -1108,6 +1160,49 @@ int flb_http_proxy_auth(struct flb_http_client *c,
 }
 
 
+/* Write the request header and body with one vectored write */
+static int http_request_write(struct flb_http_client *c, size_t *out_len)
+{
+    int i;
+    int n = 0;
+    int ret;
+    struct mk_iovec *iov;
+    struct mk_iovec iov_stack[2];
+
+    if (c->body_iov_count > 0) {
+        iov = flb_malloc(sizeof(struct mk_iovec) * (c->body_iov_count + 2));
+        if (!iov) {
+            flb_errno();
+            return -1;
+        }
+    }
+    else {
+        iov = iov_stack;
+    }
+
+    iov[n].iov_base = c->header_buf;
+    iov[n].iov_len = c->header_len;
+    n++;
+
+    if (c->body_buf && c->body_len > 0) {
+        iov[n].iov_base = (void *) c->body_buf;
+        iov[n].iov_len = c->body_len;
+        n++;
+    }
+
+    for (i = 0; i < c->body_iov_count; i++) {
+        iov[n++] = c->body_iov[i];
+    }
+
+    ret = flb_io_net_writev(c->u_conn, iov, n, out_len);
+
+    if (iov != iov_stack) {
+        flb_free(iov);
+    }
+
+    return ret;
+}
+
 int flb_http_do(struct flb_http_client *c, size_t *bytes)
 {
     int ret;
@@ -1116,10 +1211,14 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
     int new_size;
     ssize_t available;
     size_t out_size;
-    size_t bytes_header = 0;
-    size_t bytes_body = 0;
+    size_t bytes_out = 0;
     char *tmp;
 
+    /* HTTP/2 enabled upstream: the request becomes a stream */
+    if (flb_http2_check(c) == FLB_TRUE) {
+        return flb_http2_do(c, bytes);
+    }
+
     /* Append pending headers */
     ret = http_headers_compose(c);
     if (ret == -1) {
@@ -1147,15 +1246,13 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
     flb_http_client_debug_cb(c, "_debug.http.request_headers");
 
     /* debug: request_payload callback */
-    if (c->body_len > 0) {
+    if (c->body_len > 0 || c->body_iov_len > 0) {
         flb_http_client_debug_cb(c, "_debug.http.request_payload");
     }
 #endif
 
-    /* Write the header */
-    ret = flb_io_net_write(c->u_conn,
-                           c->header_buf, c->header_len,
-                           &bytes_header);
+    /* Write the header and the body segments at once */
+    ret = http_request_write(c, &bytes_out);
     if (ret == -1) {
         /* errno might be changed from the original call */
         if (errno != 0) {
@@ -1164,18 +1261,8 @@ int flb_http_do(struct flb_http_client *c, size_t *bytes)
         return -1;
     }
 
-    if (c->body_len > 0) {
-        ret = flb_io_net_write(c->u_conn,
-                               c->body_buf, c->body_len,
-                               &bytes_body);
-        if (ret == -1) {
-            flb_errno();
-            return -1;
-        }
-    }
-
     /* number of sent bytes */
-    *bytes = (bytes_header + bytes_body);
+    *bytes = bytes_out;
 
     /* Read the server response, we need at least 19 bytes */
     c->resp.data_len = 0;
@@ -1322,6 +1409,7 @@ int flb_http_client_proxy_connect(struct flb_upstream_conn *u_conn)
 void flb_http_client_destroy(struct flb_http_client *c)
 {
     http_headers_destroy(c);
+    flb_free(c->body_iov);
     flb_free(c->resp.data);
     flb_free(c->header_buf);
     flb_free((void *)c->proxy.host);
@@ -41,6 +41,12 @@ static void debug_cb_request_payload(char *name, void *p1, void *p2)
     unsigned char *ptr;
     struct flb_http_client *c = p1;
 
+    if (c->body_iov_count > 0) {
+        flb_idebug("[http] request payload (%lu bytes, %i segments)",
+                   c->body_len + c->body_iov_len, c->body_iov_count);
+        return;
+    }
+
     if (c->body_len > 3) {
         ptr = (unsigned char *) c->body_buf;
         if (ptr[0] == 0x1F && ptr[1] == 0x8B && ptr[2] == 0x08) {
@@ -28,11 +28,13 @@
 #include <fluent-bit/flb_pipe.h>
 #include <fluent-bit/flb_macros.h>
 #include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_engine_dispatch.h>
 #include <fluent-bit/flb_error.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_metrics.h>
 #include <fluent-bit/flb_storage.h>
+#include <fluent-bit/flb_compress.h>
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_hash.h>
 
@@ -208,6 +210,8 @@ struct flb_input_instance *flb_input_new(struct flb_config *config,
         instance->threaded = FLB_FALSE;
         instance->storage  = NULL;
         instance->storage_type = -1;
+        instance->storage_async = FLB_FALSE;
+        instance->storage_compress = FLB_COMPRESS_NONE;
         instance->log_level = -1;
 
         /* net */
@@ -244,8 +248,12 @@ struct flb_input_instance *flb_input_new(struct flb_config *config,
         instance->mp_total_buf_size = 0;
         instance->mem_buf_status = FLB_INPUT_RUNNING;
         instance->mem_buf_limit = 0;
+        instance->mem_buf_weight = 1;
         instance->mem_chunks_size = 0;
         instance->storage_buf_status = FLB_INPUT_RUNNING;
+        instance->task_limit_status = FLB_INPUT_RUNNING;
+        instance->dispatch_priority = FLB_TASK_PRIO_NORMAL;
+        instance->dispatch_weight = 1;
         mk_list_add(&instance->_head, &config->inputs);
     }
 
@@ -333,6 +341,14 @@ int flb_input_set_property(struct flb_input_instance *ins,
         }
         ins->mem_buf_limit = (size_t) limit;
     }
+    else if (prop_key_check("mem_buf.weight", k, len) == 0 && tmp) {
+        ret = atoi(tmp);
+        flb_sds_destroy(tmp);
+        if (ret <= 0) {
+            return -1;
+        }
+        ins->mem_buf_weight = ret;
+    }
     else if (prop_key_check("listen", k, len) == 0) {
         ins->host.listen = tmp;
     }
@@ -358,6 +374,11 @@ int flb_input_set_property(struct flb_input_instance *ins,
             /* Set the storage type */
             if (strcasecmp(tmp, "filesystem") == 0) {
                 ins->storage_type = CIO_STORE_FS;
+                ins->storage_async = FLB_FALSE;
+            }
+            else if (strcasecmp(tmp, "filesystem_async") == 0) {
+                ins->storage_type = CIO_STORE_FS;
+                ins->storage_async = FLB_TRUE;
             }
             else if (strcasecmp(tmp, "memory") == 0) {
                 ins->storage_type = CIO_STORE_MEM;
@@ -369,6 +390,30 @@ int flb_input_set_property(struct flb_input_instance *ins,
         }
         flb_sds_destroy(tmp);
     }
+    else if (prop_key_check("storage.compress", k, len) == 0 && tmp) {
+        ret = flb_compress_type(tmp);
+        flb_sds_destroy(tmp);
+        if (ret == -1) {
+            return -1;
+        }
+        ins->storage_compress = ret;
+    }
+    else if (prop_key_check("dispatch.priority", k, len) == 0 && tmp) {
+        ret = flb_engine_dispatch_priority(tmp);
+        flb_sds_destroy(tmp);
+        if (ret == -1) {
+            return -1;
+        }
+        ins->dispatch_priority = ret;
+    }
+    else if (prop_key_check("dispatch.weight", k, len) == 0 && tmp) {
+        ret = atoi(tmp);
+        flb_sds_destroy(tmp);
+        if (ret <= 0) {
+            return -1;
+        }
+        ins->dispatch_weight = ret;
+    }
     else if (prop_key_check("storage.pause_on_chunks_overlimit", k, len) == 0 && tmp) {
         if (ins->storage_type == CIO_STORE_FS) {
             ret = flb_utils_bool(tmp);
@@ -917,6 +962,58 @@ int flb_input_pause_all(struct flb_config *config)
     return paused;
 }
 
+/* Pause the inputs when the engine reach the soft limit of tasks */
+int flb_input_task_limit_pause(struct flb_config *config)
+{
+    int paused = 0;
+    struct mk_list *head;
+    struct flb_input_instance *in;
+
+    mk_list_foreach(head, &config->inputs) {
+        in = mk_list_entry(head, struct flb_input_instance, _head);
+        if (flb_input_buf_paused(in) == FLB_FALSE) {
+            if (in->p->cb_pause && in->context) {
+                flb_info("[input] %s paused (task limit)",
+                         flb_input_name(in));
+                in->p->cb_pause(in->context, in->config);
+            }
+            paused++;
+        }
+        in->task_limit_status = FLB_INPUT_PAUSED;
+    }
+
+    return paused;
+}
+
+/* Resume the inputs paused by the task limit if nothing else holds them */
+int flb_input_task_limit_resume(struct flb_config *config)
+{
+    int resumed = 0;
+    struct mk_list *head;
+    struct flb_input_instance *in;
+
+    mk_list_foreach(head, &config->inputs) {
+        in = mk_list_entry(head, struct flb_input_instance, _head);
+        if (in->task_limit_status != FLB_INPUT_PAUSED) {
+            continue;
+        }
+        in->task_limit_status = FLB_INPUT_RUNNING;
+
+        if (flb_input_buf_paused(in) == FLB_TRUE ||
+            config->is_running == FLB_FALSE ||
+            config->is_ingestion_active == FLB_FALSE) {
+            continue;
+        }
+        if (in->p->cb_resume && in->context) {
+            flb_info("[input] %s resume (task limit)", flb_input_name(in));
+            in->p->cb_resume(in->context, in->config);
+        }
+        resumed++;
+    }
+
+    return resumed;
+}
+
 int flb_input_collector_pause(int coll_id, struct flb_input_instance *in)
 {
     int ret;
@@ -65,7 +65,9 @@ static ssize_t flb_input_chunk_get_releasable_space(
     mk_list_foreach(input_chunk_iterator, &input_plugin->chunks) {
         old_input_chunk = mk_list_entry(input_chunk_iterator, struct flb_input_chunk, _head);
 
-        if (!flb_routes_mask_get_bit(old_input_chunk->routes_mask, output_plugin->id)) {
+        if (!flb_routes_mask_get_bit(old_input_chunk->routes_mask,
+                                     output_plugin->id,
+                                     input_plugin->config)) {
             continue;
         }
 
@@ -108,7 +110,8 @@ static int flb_input_chunk_release_space(
                                              struct flb_input_chunk, _head);
 
         if (!flb_routes_mask_get_bit(old_input_chunk->routes_mask,
-                                     output_plugin->id)) {
+                                     output_plugin->id,
+                                     input_plugin->config)) {
             continue;
         }
 
@@ -125,12 +128,14 @@ static int flb_input_chunk_release_space(
 
         if (release_scope == FLB_INPUT_CHUNK_RELEASE_SCOPE_LOCAL) {
             flb_routes_mask_clear_bit(old_input_chunk->routes_mask,
-                                      output_plugin->id);
+                                      output_plugin->id,
+                                      input_plugin->config);
 
             output_plugin->fs_chunks_size -= chunk_size;
 
             chunk_destroy_flag = flb_routes_mask_is_empty(
-                                                old_input_chunk->routes_mask);
+                                                old_input_chunk->routes_mask,
+                                                input_plugin->config);
 
             chunk_released = FLB_TRUE;
         }
@@ -293,7 +298,7 @@ static int flb_input_chunk_safe_delete(struct flb_input_chunk *ic,
      * the routes_mask could be modified when new chunks is ingested. Therefore,
      * we still need to do the validation on the routes_mask with o_id.
      */
-    if (flb_routes_mask_get_bit(old_ic->routes_mask, o_id) == 0) {
+    if (flb_routes_mask_get_bit(old_ic->routes_mask, o_id, old_ic->in->config) == 0) {
         return FLB_FALSE;
     }
 
@@ -467,7 +472,7 @@ int flb_intput_chunk_count_dropped_chunks(struct flb_input_chunk *ic,
  * will drop the the oldest chunks when the limitation on local disk is reached.
  */
 int flb_input_chunk_find_space_new_data(struct flb_input_chunk *ic,
-                                        size_t chunk_size, int overlimit)
+                                        size_t chunk_size, uint64_t *overlimit)
 {
     int count;
     int result;
@@ -490,8 +495,9 @@ int flb_input_chunk_find_space_new_data(struct flb_input_chunk *ic,
         count = 0;
         o_ins = mk_list_entry(head, struct flb_output_instance, _head);
 
-        if ((o_ins->total_limit_size == -1) || ((1 << o_ins->id) & overlimit) == 0 ||
-           (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id) == 0)) {
+        if ((o_ins->total_limit_size == -1) ||
+            (flb_routes_mask_get_bit(overlimit, o_ins->id, ic->in->config) == 0) ||
+            (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id, ic->in->config) == 0)) {
             continue;
         }
 
@@ -525,8 +531,8 @@ int flb_input_chunk_find_space_new_data(struct flb_input_chunk *ic,
             flb_error("[input chunk] no enough space in filesystem to buffer "
                       "chunk %s in plugin %s", flb_input_chunk_get_name(ic), o_ins->name);
 
-            flb_routes_mask_clear_bit(ic->routes_mask, o_ins->id);
-            if (flb_routes_mask_is_empty(ic->routes_mask)) {
+            flb_routes_mask_clear_bit(ic->routes_mask, o_ins->id, ic->in->config);
+            if (flb_routes_mask_is_empty(ic->routes_mask, ic->in->config)) {
                 bytes = flb_input_chunk_get_size(ic);
                 if (bytes != 0) {
                     /*
@@ -561,14 +567,14 @@ int flb_input_chunk_find_space_new_data(struct flb_input_chunk *ic,
             old_ic_bytes = flb_input_chunk_get_real_size(old_ic);
 
             /* drop chunk by adjusting the routes_mask */
-            flb_routes_mask_clear_bit(old_ic->routes_mask, o_ins->id);
+            flb_routes_mask_clear_bit(old_ic->routes_mask, o_ins->id, old_ic->in->config);
             o_ins->fs_chunks_size -= old_ic_bytes;
 
             flb_debug("[input chunk] remove route of chunk %s with size %ld bytes to output plugin %s "
                       "to place the incoming data with size %ld bytes", flb_input_chunk_get_name(old_ic),
                       old_ic_bytes, o_ins->name, chunk_size);
 
-            if (flb_routes_mask_is_empty(old_ic->routes_mask)) {
+            if (flb_routes_mask_is_empty(old_ic->routes_mask, old_ic->in->config)) {
                 if (old_ic->task != NULL) {
                     /*
                      * If the chunk is referenced by a task and task has no active route,
@@ -604,12 +610,13 @@ int flb_input_chunk_find_space_new_data(struct flb_input_chunk *ic,
 
 /*
  * Returns a non-zero result if any output instances will reach the limit
- * after buffering the new data
+ * after buffering the new data, the 'overlimit' routes mask is set with
+ * those outputs.
  */
 int flb_input_chunk_has_overlimit_routes(struct flb_input_chunk *ic,
-                                         size_t chunk_size)
+                                         size_t chunk_size, uint64_t *overlimit)
 {
-    int overlimit = 0;
+    int count = 0;
     struct mk_list *head;
     struct flb_output_instance *o_ins;
 
@@ -617,7 +624,7 @@ int flb_input_chunk_has_overlimit_routes(struct flb_input_chunk *ic,
         o_ins = mk_list_entry(head, struct flb_output_instance, _head);
 
         if ((o_ins->total_limit_size == -1) ||
-            (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id) == 0)) {
+            (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id, ic->in->config) == 0)) {
             continue;
         }
 
@@ -631,11 +638,12 @@ int flb_input_chunk_has_overlimit_routes(struct flb_input_chunk *ic,
         if ((o_ins->fs_chunks_size +
              o_ins->fs_backlog_chunks_size +
              chunk_size) > o_ins->total_limit_size) {
-            overlimit |= (1 << o_ins->id);
+            flb_routes_mask_set_bit(overlimit, o_ins->id, ic->in->config);
+            count++;
         }
     }
 
-    return overlimit;
+    return count;
 }
 
 /* Find a slot for the incoming data to buffer it in local file system
@@ -643,16 +651,54 @@ int flb_input_chunk_has_overlimit_routes(struct flb_input_chunk *ic,
  */
 int flb_input_chunk_place_new_chunk(struct flb_input_chunk *ic, size_t chunk_size)
 {
-	int overlimit;
-    overlimit = flb_input_chunk_has_overlimit_routes(ic, chunk_size);
-    if (overlimit != 0) {
+    int count;
+    uint64_t *overlimit;
+    uint64_t overlimit_stack[4];
+    struct flb_config *config = ic->in->config;
+
+    /* routes mask of the outputs over the limit */
+    if (config->route_mask_size <= 4) {
+        overlimit = overlimit_stack;
+        memset(overlimit, 0, flb_routes_mask_bytes(config));
+    }
+    else {
+        overlimit = flb_calloc(1, flb_routes_mask_bytes(config));
+        if (!overlimit) {
+            flb_errno();
+            return !flb_routes_mask_is_empty(ic->routes_mask, config);
+        }
+    }
+
+    count = flb_input_chunk_has_overlimit_routes(ic, chunk_size, overlimit);
+    if (count > 0) {
         flb_input_chunk_find_space_new_data(ic, chunk_size, overlimit);
     }
 
-    return !flb_routes_mask_is_empty(ic->routes_mask);
+    if (overlimit != overlimit_stack) {
+        flb_free(overlimit);
+    }
+
+    return !flb_routes_mask_is_empty(ic->routes_mask, config);
+}
+
+/*
+ * Allocate a chunk context, the routes mask is sized by the number of
+ * outputs and it's stored right after the structure in the same block.
+ */
+static struct flb_input_chunk *input_chunk_alloc(struct flb_config *config)
+{
+    struct flb_input_chunk *ic;
+
+    ic = flb_calloc(1, sizeof(struct flb_input_chunk) +
+                    flb_routes_mask_bytes(config));
+    if (!ic) {
+        return NULL;
+    }
+    ic->routes_mask = (uint64_t *) (ic + 1);
+
+    return ic;
 }
 
-/* Create an input chunk using a Chunk I/O */
 struct flb_input_chunk *flb_input_chunk_map(struct flb_input_instance *in,
                                             void *chunk)
 {
@@ -669,7 +715,7 @@ struct flb_input_chunk *flb_input_chunk_map(struct flb_input_instance *in,
     struct flb_input_chunk *ic;
 
     /* Create context for the input instance */
-    ic = flb_calloc(1, sizeof(struct flb_input_chunk));
+    ic = input_chunk_alloc(in->config);
     if (!ic) {
         flb_errno();
         return NULL;
@@ -844,7 +890,7 @@ struct flb_input_chunk *flb_input_chunk_create(struct flb_input_instance *in,
     }
 
     /* Create context for the input instance */
-    ic = flb_calloc(1, sizeof(struct flb_input_chunk));
+    ic = input_chunk_alloc(in->config);
     if (!ic) {
         flb_errno();
         cio_chunk_close(chunk, CIO_TRUE);
@@ -863,6 +909,7 @@ struct flb_input_chunk *flb_input_chunk_create(struct flb_input_instance *in,
     ic->in = in;
     ic->stream_off = 0;
     ic->task = NULL;
+    ic->create_ts = cmt_time_now();
 #ifdef FLB_HAVE_METRICS
     ic->total_records = 0;
 #endif
@@ -917,7 +964,7 @@ int flb_input_chunk_destroy(struct flb_input_chunk *ic, int del)
             continue;
         }
 
-        if (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id) != 0) {
+        if (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id, ic->in->config) != 0) {
             o_ins->fs_chunks_size -= bytes;
             flb_debug("[input chunk] remove chunk %s with %ld bytes from plugin %s, "
                       "the updated fs_chunks_size is %ld bytes", flb_input_chunk_get_name(ic),
@@ -1017,7 +1064,7 @@ static struct flb_input_chunk *input_chunk_get(struct flb_input_instance *in,
      * that the chunk will flush to, we need to modify the routes_mask of the oldest chunks
      * (based in creation time) to get enough space for the incoming chunk.
      */
-    if (!flb_routes_mask_is_empty(ic->routes_mask)
+    if (!flb_routes_mask_is_empty(ic->routes_mask, ic->in->config)
         && flb_input_chunk_place_new_chunk(ic, chunk_size) == 0) {
         /*
          * If the chunk is not newly created, the chunk might already have logs inside.
@@ -1025,7 +1072,8 @@ static struct flb_input_chunk *input_chunk_get(struct flb_input_instance *in,
          * If the routes_mask is cleared after trying to append new data, we destroy
          * the chunk.
          */
-        if (new_chunk || flb_routes_mask_is_empty(ic->routes_mask) == FLB_TRUE) {
+        if (new_chunk ||
+            flb_routes_mask_is_empty(ic->routes_mask, in->config) == FLB_TRUE) {
             flb_input_chunk_destroy(ic, FLB_TRUE);
         }
 
@@ -1035,7 +1083,85 @@ static struct flb_input_chunk *input_chunk_get(struct flb_input_instance *in,
     return ic;
 }
 
-static inline int flb_input_chunk_is_mem_overlimit(struct flb_input_instance *i)
+/*
+ * Global memory budget: summarize the bytes in use by the chunks 'up' of
+ * every input instance and the weights of the instances.
+ */
+static void mem_budget_get(struct flb_config *config,
+                           size_t *usage, size_t *weights)
+{
+    struct mk_list *head;
+    struct flb_input_instance *in;
+
+    *usage = 0;
+    *weights = 0;
+
+    mk_list_foreach(head, &config->inputs) {
+        in = mk_list_entry(head, struct flb_input_instance, _head);
+        *usage += in->mem_chunks_size;
+        *weights += in->mem_buf_weight;
+    }
+}
+
+/* Number of bytes of the global memory budget in use */
+size_t flb_input_chunk_mem_usage(struct flb_config *config)
+{
+    size_t usage;
+    size_t weights;
+
+    mem_budget_get(config, &usage, &weights);
+    return usage;
+}
+
+/* Share of the global memory budget for the input instance */
+size_t flb_input_chunk_mem_allotment(struct flb_input_instance *in)
+{
+    size_t usage;
+    size_t weights;
+    size_t budget;
+
+    budget = in->config->storage_mem_budget_size;
+    if (budget == 0) {
+        return 0;
+    }
+
+    mem_budget_get(in->config, &usage, &weights);
+    if (weights == 0) {
+        return budget;
+    }
+
+    return (budget / weights) * in->mem_buf_weight;
+}
+
+/*
+ * The budget is shared: an instance can use the space not needed by the
+ * others, it's only considered overlimit when the budget is exhausted and
+ * the instance is using more than its own share.
+ */
+static inline int flb_input_chunk_is_budget_overlimit(struct flb_input_instance *i)
+{
+    size_t usage;
+    size_t weights;
+    size_t budget;
+
+    budget = i->config->storage_mem_budget_size;
+    if (budget == 0) {
+        return FLB_FALSE;
+    }
+
+    mem_budget_get(i->config, &usage, &weights);
+    if (usage < budget) {
+        return FLB_FALSE;
+    }
+
+    if (i->mem_chunks_size < (budget / weights) * i->mem_buf_weight) {
+        return FLB_FALSE;
+    }
+
+    return FLB_TRUE;
+}
+
+static inline int flb_input_chunk_is_limit_overlimit(struct flb_input_instance *i)
 {
     if (i->mem_buf_limit <= 0) {
         return FLB_FALSE;
@@ -1048,6 +1174,15 @@ static inline int flb_input_chunk_is_mem_overlimit(struct flb_input_instance *i)
     return FLB_FALSE;
 }
 
+static inline int flb_input_chunk_is_mem_overlimit(struct flb_input_instance *i)
+{
+    if (flb_input_chunk_is_limit_overlimit(i) == FLB_TRUE) {
+        return FLB_TRUE;
+    }
+
+    return flb_input_chunk_is_budget_overlimit(i);
+}
+
 static inline int flb_input_chunk_is_storage_overlimit(struct flb_input_instance *i)
 {
     struct flb_storage_input *storage = (struct flb_storage_input *)i->storage;
@@ -1085,9 +1220,26 @@ size_t flb_input_chunk_total_size(struct flb_input_instance *in)
  *
  * It always returns the number of bytes in use.
  */
+static void input_chunk_mem_resume(struct flb_input_instance *in)
+{
+    if (flb_input_chunk_is_mem_overlimit(in) == FLB_FALSE &&
+        in->config->is_running == FLB_TRUE &&
+        in->config->is_ingestion_active == FLB_TRUE &&
+        in->mem_buf_status == FLB_INPUT_PAUSED) {
+        in->mem_buf_status = FLB_INPUT_RUNNING;
+        if (in->p->cb_resume && flb_input_buf_paused(in) == FLB_FALSE) {
+            in->p->cb_resume(in->context, in->config);
+            flb_info("[input] %s resume (mem buf overlimit)",
+                      in->name);
+        }
+    }
+}
+
 size_t flb_input_chunk_set_limits(struct flb_input_instance *in)
 {
     size_t total;
+    struct mk_list *head;
+    struct flb_input_instance *i;
 
     /* Gather total number of enqueued bytes */
     total = flb_input_chunk_total_size(in);
@@ -1098,15 +1250,21 @@ size_t flb_input_chunk_set_limits(struct flb_input_instance *in)
      * After the adjustments, validate if the plugin is overlimit or paused
      * and perform further adjustments.
      */
-    if (flb_input_chunk_is_mem_overlimit(in) == FLB_FALSE &&
-        in->config->is_running == FLB_TRUE &&
-        in->config->is_ingestion_active == FLB_TRUE &&
-        in->mem_buf_status == FLB_INPUT_PAUSED) {
-        in->mem_buf_status = FLB_INPUT_RUNNING;
-        if (in->p->cb_resume) {
-            in->p->cb_resume(in->context, in->config);
-            flb_info("[input] %s resume (mem buf overlimit)",
-                      in->name);
+    input_chunk_mem_resume(in);
+
+    /*
+     * With a global memory budget the space released by this instance
+     * might let other paused instances resume.
+     */
+    if (in->config->storage_mem_budget_size > 0) {
+        mk_list_foreach(head, &in->config->inputs) {
+            i = mk_list_entry(head, struct flb_input_instance, _head);
+            if (i == in || !i->storage ||
+                i->mem_buf_status != FLB_INPUT_PAUSED) {
+                continue;
+            }
+            i->mem_chunks_size = flb_input_chunk_total_size(i);
+            input_chunk_mem_resume(i);
         }
     }
     if (flb_input_chunk_is_storage_overlimit(in) == FLB_FALSE &&
@@ -1114,7 +1272,7 @@ size_t flb_input_chunk_set_limits(struct flb_input_instance *in)
         in->config->is_ingestion_active == FLB_TRUE &&
         in->storage_buf_status == FLB_INPUT_PAUSED) {
         in->storage_buf_status = FLB_INPUT_RUNNING;
-        if (in->p->cb_resume) {
+        if (in->p->cb_resume && flb_input_buf_paused(in) == FLB_FALSE) {
             in->p->cb_resume(in->context, in->config);
             flb_info("[input] %s resume (storage buf overlimit %d/%d)",
                       in->name,
@@ -1126,6 +1284,57 @@ size_t flb_input_chunk_set_limits(struct flb_input_instance *in)
     return total;
 }
 
+/*
+ * Over the global memory budget, an instance using the filesystem storage
+ * can put its sealed chunks down instead of being paused
+ * (storage.mem_budget.spill). Chunks being flushed or still taking appends
+ * are not touched. It returns FLB_TRUE if the instance is no longer
+ * overlimit.
+ */
+static int input_chunk_mem_spill(struct flb_input_instance *in)
+{
+    int spilled = 0;
+    struct mk_list *head;
+    struct flb_input_chunk *ic;
+    struct flb_storage_input *si;
+
+    si = (struct flb_storage_input *) in->storage;
+    if (in->config->storage_mem_budget_spill == FLB_FALSE ||
+        si->type != CIO_STORE_FS) {
+        return FLB_FALSE;
+    }
+
+    /* the limit of the instance itself always pauses it */
+    if (flb_input_chunk_is_limit_overlimit(in) == FLB_TRUE) {
+        return FLB_FALSE;
+    }
+
+    mk_list_foreach(head, &in->chunks) {
+        ic = mk_list_entry(head, struct flb_input_chunk, _head);
+        if (ic->busy == FLB_TRUE || cio_chunk_is_up(ic->chunk) == CIO_FALSE) {
+            continue;
+        }
+
+        /* the active chunk would be brought up again on the next append */
+        if (cio_chunk_is_locked(ic->chunk) == CIO_FALSE) {
+            continue;
+        }
+
+        if (cio_chunk_down(ic->chunk) == CIO_OK) {
+            spilled++;
+        }
+    }
+
+    if (spilled > 0) {
+        in->config->storage_mem_budget_spilled += spilled;
+        in->mem_chunks_size = flb_input_chunk_total_size(in);
+        flb_debug("[input] %s spilled %i chunks to disk (mem budget overlimit)",
+                  in->name, spilled);
+    }
+
+    return !flb_input_chunk_is_mem_overlimit(in);
+}
+
 /*
  * If the number of bytes in use by the chunks are over the imposed limit
  * by configuration, pause the instance.
@@ -1133,8 +1342,17 @@ size_t flb_input_chunk_set_limits(struct flb_input_instance *in)
 static inline int flb_input_chunk_protect(struct flb_input_instance *i)
 {
     if (flb_input_chunk_is_mem_overlimit(i) == FLB_TRUE) {
-        flb_warn("[input] %s paused (mem buf overlimit)",
-                 i->name);
+        if (input_chunk_mem_spill(i) == FLB_TRUE) {
+            return FLB_FALSE;
+        }
+        if (flb_input_chunk_is_limit_overlimit(i) == FLB_TRUE) {
+            flb_warn("[input] %s paused (mem buf overlimit)",
+                     i->name);
+        }
+        else {
+            flb_warn("[input] %s paused (mem budget overlimit)",
+                     i->name);
+        }
         if (!flb_input_buf_paused(i)) {
             if (i->p->cb_pause) {
                 i->p->cb_pause(i->context, i->config);
@@ -1235,6 +1453,7 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
     size_t pre_size;
     struct flb_input_chunk *ic;
     struct flb_storage_input *si;
+    struct flb_storage_sync *sync;
 
     /* Check if the input plugin has been paused */
     if (flb_input_buf_paused(in) == FLB_TRUE) {
@@ -1372,6 +1591,13 @@ int flb_input_chunk_append_raw(struct flb_input_instance *in,
         cio_chunk_lock(ic->chunk);
     }
 
+    /* Group sync: don't wait for the timer if too much data is pending */
+    sync = in->config->storage_sync_ctx;
+    if (sync &&
+        ((struct cio_ctx *) in->config->cio)->dirty_bytes >= sync->max_bytes) {
+        flb_storage_sync(in->config);
+    }
+
     /* Make sure the data was not filtered out and the buffer size is zero */
     if (size == 0) {
         flb_input_chunk_destroy(ic, FLB_TRUE);
@@ -1495,6 +1721,76 @@ int flb_input_chunk_release_lock(struct flb_input_chunk *ic)
     return 0;
 }
 
+/*
+ * Move the records of 'src' to the end of 'dst' and destroy 'src'. Both
+ * chunks must be idle and share the same Tag and routes, the caller is
+ * responsible to check it.
+ */
+int flb_input_chunk_merge(struct flb_input_chunk *dst,
+                          struct flb_input_chunk *src)
+{
+    int ret;
+    int tag_len;
+    char *buf;
+    size_t size;
+    size_t pre_size;
+    const char *tag_buf;
+
+    if (dst->busy == FLB_TRUE || src->busy == FLB_TRUE ||
+        cio_chunk_is_locked(dst->chunk)) {
+        return -1;
+    }
+
+    if (flb_input_chunk_is_up(dst) == FLB_FALSE) {
+        ret = cio_chunk_up_force(dst->chunk);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+    if (flb_input_chunk_is_up(src) == FLB_FALSE) {
+        ret = cio_chunk_up_force(src->chunk);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    ret = cio_chunk_get_content(src->chunk, &buf, &size);
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (size > 0) {
+        pre_size = cio_chunk_get_content_size(dst->chunk);
+        ret = flb_input_chunk_write(dst, buf, size);
+        if (ret == -1) {
+            cio_chunk_tx_rollback(dst->chunk);
+            return -1;
+        }
+
+        /* the stream processor already saw these records */
+        if (dst->stream_off == pre_size) {
+            dst->stream_off += size;
+        }
+
+        /* 'src' bytes are discounted when it's destroyed */
+        flb_input_chunk_update_output_instances(dst, size);
+    }
+
+    /* keep appending new records to the merged chunk */
+    ret = flb_input_chunk_get_tag(dst, &tag_buf, &tag_len);
+    flb_input_chunk_destroy(src, FLB_TRUE);
+    if (ret == 0 && dst->fs_backlog == FLB_FALSE) {
+        if (dst->event_type == FLB_INPUT_LOGS) {
+            flb_hash_add(dst->in->ht_log_chunks, tag_buf, tag_len, dst, 0);
+        }
+        else if (dst->event_type == FLB_INPUT_METRICS) {
+            flb_hash_add(dst->in->ht_metric_chunks, tag_buf, tag_len, dst, 0);
+        }
+    }
+
+    return 0;
+}
+
 flb_sds_t flb_input_chunk_get_name(struct flb_input_chunk *ic)
 {
     struct cio_chunk *ch;
@@ -1540,7 +1836,7 @@ void flb_input_chunk_update_output_instances(struct flb_input_chunk *ic,
             continue;
         }
 
-        if (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id) != 0) {
+        if (flb_routes_mask_get_bit(ic->routes_mask, o_ins->id, ic->in->config) != 0) {
             /*
              * if there is match on any index of 1's in the binary, it indicates
              * that the input chunk will flush to this output instance
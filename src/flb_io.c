@@ -45,11 +45,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 #include <assert.h>
 
 #include <monkey/mk_core.h>
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_io.h>
 #include <fluent-bit/tls/flb_tls.h>
@@ -305,6 +307,153 @@ static FLB_INLINE int net_io_write_async(struct flb_coro *co,
     return bytes;
 }
 
+/*
+ * Skip 'bytes' already written from the head of the vector, it updates the
+ * first pending segment in place and returns its index.
+ */
+static int iov_advance(struct mk_iovec *iov, int iovcnt, int idx, size_t bytes)
+{
+    while (idx < iovcnt && bytes > 0) {
+        if (bytes < iov[idx].iov_len) {
+            iov[idx].iov_base = (char *) iov[idx].iov_base + bytes;
+            iov[idx].iov_len -= bytes;
+            break;
+        }
+        bytes -= iov[idx].iov_len;
+        idx++;
+    }
+
+    /* skip empty segments */
+    while (idx < iovcnt && iov[idx].iov_len == 0) {
+        idx++;
+    }
+
+    return idx;
+}
+
+static inline int iov_count(int iovcnt, int idx)
+{
+    if (iovcnt - idx > FLB_IO_IOV_MAX) {
+        return FLB_IO_IOV_MAX;
+    }
+    return iovcnt - idx;
+}
+
+static int net_io_writev(struct flb_upstream_conn *u_conn,
+                         struct mk_iovec *iov, int iovcnt, size_t *out_len)
+{
+    int ret;
+    int idx;
+    int tries = 0;
+    ssize_t bytes;
+    size_t total = 0;
+    struct flb_coro *coro;
+
+    if (u_conn->fd <= 0) {
+        coro = flb_coro_get();
+        ret = flb_io_net_connect(u_conn, coro);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    idx = iov_advance(iov, iovcnt, 0, 0);
+    while (idx < iovcnt) {
+        bytes = writev(u_conn->fd, iov + idx, iov_count(iovcnt, idx));
+        if (bytes == -1) {
+            if (FLB_WOULDBLOCK()) {
+                /* same lazy approach than net_io_write() */
+                sleep(1);
+                tries++;
+
+                if (tries == 30) {
+                    return -1;
+                }
+                continue;
+            }
+            return -1;
+        }
+        tries = 0;
+        total += bytes;
+        idx = iov_advance(iov, iovcnt, idx, bytes);
+    }
+
+    *out_len = total;
+    return total;
+}
+
+/* Async version of net_io_writev(), it yields while the socket is busy */
+static FLB_INLINE int net_io_writev_async(struct flb_coro *co,
+                                          struct flb_upstream_conn *u_conn,
+                                          struct mk_iovec *iov, int iovcnt,
+                                          size_t *out_len)
+{
+    int ret;
+    int idx;
+    int error;
+    uint32_t mask;
+    ssize_t bytes;
+    size_t total = 0;
+    char so_error_buf[256];
+    struct flb_upstream *u = u_conn->u;
+
+    idx = iov_advance(iov, iovcnt, 0, 0);
+    while (idx < iovcnt) {
+        bytes = writev(u_conn->fd, iov + idx, iov_count(iovcnt, idx));
+
+        flb_trace("[io coro=%p] [fd %i] writev_async(2)=%zd (%zu)",
+                  co, u_conn->fd, bytes, total + (bytes > 0 ? bytes : 0));
+
+        if (bytes == -1) {
+            if (!FLB_WOULDBLOCK()) {
+                return -1;
+            }
+
+            ret = mk_event_add(u_conn->evl,
+                               u_conn->fd,
+                               FLB_ENGINE_EV_THREAD,
+                               MK_EVENT_WRITE, &u_conn->event);
+            if (ret == -1) {
+                return -1;
+            }
+
+            u_conn->coro = co;
+            flb_coro_yield(co, FLB_FALSE);
+            u_conn->coro = NULL;
+
+            /* Save events mask since mk_event_del() will reset it */
+            mask = u_conn->event.mask;
+
+            ret = mk_event_del(u_conn->evl, &u_conn->event);
+            if (ret == -1) {
+                return -1;
+            }
+
+            if (!(mask & MK_EVENT_WRITE)) {
+                return -1;
+            }
+
+            error = flb_socket_error(u_conn->fd);
+            if (error != 0) {
+                strerror_r(error, so_error_buf, sizeof(so_error_buf) - 1);
+                flb_error("[io fd=%i] error sending data to: %s:%i (%s)",
+                          u_conn->fd,
+                          u->tcp_host, u->tcp_port, so_error_buf);
+                return -1;
+            }
+
+            MK_EVENT_NEW(&u_conn->event);
+            continue;
+        }
+
+        total += bytes;
+        idx = iov_advance(iov, iovcnt, idx, bytes);
+    }
+
+    *out_len = total;
+    return total;
+}
+
 static ssize_t net_io_read(struct flb_upstream_conn *u_conn,
                            void *buf, size_t len)
 {
@@ -400,6 +549,75 @@ int flb_io_net_write(struct flb_upstream_conn *u_conn, const void *data,
     return ret;
 }
 
+/*
+ * Write a vector of buffers to an upstream connection. On plain sockets the
+ * segments go out with writev(2), over TLS they are coalesced in records so
+ * small segments don't produce small records. The caller vector is not
+ * modified.
+ */
+int flb_io_net_writev(struct flb_upstream_conn *u_conn,
+                      const struct mk_iovec *iov, int iovcnt, size_t *out_len)
+{
+    int ret = -1;
+    struct mk_iovec *vec;
+    struct mk_iovec vec_stack[FLB_IO_IOV_STACK];
+    struct flb_upstream *u = u_conn->u;
+    struct flb_coro *coro = flb_coro_get();
+
+    *out_len = 0;
+    if (iovcnt <= 0) {
+        return 0;
+    }
+
+    flb_trace("[io coro=%p] [net_writev] trying %i segments", coro, iovcnt);
+
+    if (!u_conn->tls_session) {
+        /* writev(2) moves through a copy of the vector */
+        if (iovcnt <= FLB_IO_IOV_STACK) {
+            vec = vec_stack;
+        }
+        else {
+            vec = flb_malloc(sizeof(struct mk_iovec) * iovcnt);
+            if (!vec) {
+                flb_errno();
+                return -1;
+            }
+        }
+        memcpy(vec, iov, sizeof(struct mk_iovec) * iovcnt);
+
+        if (u->flags & FLB_IO_ASYNC) {
+            ret = net_io_writev_async(coro, u_conn, vec, iovcnt, out_len);
+        }
+        else {
+            ret = net_io_writev(u_conn, vec, iovcnt, out_len);
+        }
+
+        if (vec != vec_stack) {
+            flb_free(vec);
+        }
+    }
+#ifdef FLB_HAVE_TLS
+    else if (u->flags & FLB_IO_TLS) {
+        if (u->flags & FLB_IO_ASYNC) {
+            ret = flb_tls_net_writev_async(coro, u_conn, iov, iovcnt, out_len);
+        }
+        else {
+            ret = flb_tls_net_writev(u_conn, iov, iovcnt, out_len);
+        }
+    }
+#endif
+
+    if (ret == -1 && u_conn->fd > 0) {
+        flb_socket_close(u_conn->fd);
+        u_conn->fd = -1;
+        u_conn->event.fd = -1;
+    }
+
+    flb_trace("[io coro=%p] [net_writev] ret=%i total=%lu",
+              coro, ret, *out_len);
+    return ret;
+}
+
 ssize_t flb_io_net_read(struct flb_upstream_conn *u_conn, void *buf, size_t len)
 {
     int ret = -1;
@@ -430,3 +648,75 @@ ssize_t flb_io_net_read(struct flb_upstream_conn *u_conn, void *buf, size_t len)
     flb_trace("[io coro=%p] [net_read] ret=%i", coro, ret);
     return ret;
 }
+
+/*
+ * Non-blocking read: it never yields nor waits, it's meant for callers
+ * driving a non-blocking socket from their own event handler. Returns the
+ * number of bytes read, zero if the operation would block or -1 on error
+ * or when the connection was closed by the peer.
+ */
+ssize_t flb_io_net_try_read(struct flb_upstream_conn *u_conn,
+                            void *buf, size_t len)
+{
+    ssize_t ret;
+
+#ifdef FLB_HAVE_TLS
+    if (u_conn->tls_session) {
+        ret = u_conn->tls->api->net_read(u_conn, buf, len);
+        if (ret == FLB_TLS_WANT_READ || ret == FLB_TLS_WANT_WRITE) {
+            return 0;
+        }
+        else if (ret <= 0) {
+            return -1;
+        }
+        return ret;
+    }
+#endif
+
+    ret = recv(u_conn->fd, buf, len, 0);
+    if (ret == -1) {
+        if (FLB_WOULDBLOCK()) {
+            return 0;
+        }
+        return -1;
+    }
+    else if (ret == 0) {
+        return -1;
+    }
+
+    return ret;
+}
+
+/*
+ * Non-blocking write, same semantics of flb_io_net_try_read(). Note that
+ * when a TLS write would block, it must be retried with the same buffer
+ * length.
+ */
+ssize_t flb_io_net_try_write(struct flb_upstream_conn *u_conn,
+                             const void *data, size_t len)
+{
+    ssize_t ret;
+
+#ifdef FLB_HAVE_TLS
+    if (u_conn->tls_session) {
+        ret = u_conn->tls->api->net_write(u_conn, data, len);
+        if (ret == FLB_TLS_WANT_READ || ret == FLB_TLS_WANT_WRITE) {
+            return 0;
+        }
+        else if (ret <= 0) {
+            return -1;
+        }
+        return ret;
+    }
+#endif
+
+    ret = send(u_conn->fd, data, len, 0);
+    if (ret == -1) {
+        if (FLB_WOULDBLOCK()) {
+            return 0;
+        }
+        return -1;
+    }
+
+    return ret;
+}
@@ -106,6 +106,9 @@ void flb_net_setup_init(struct flb_net_setup *net)
     net->keepalive = FLB_TRUE;
     net->keepalive_idle_timeout = 30;
     net->keepalive_max_recycle = 0;
+    net->max_connections = 0;
+    net->warmup_connections = 0;
+    net->http2 = FLB_FALSE;
     net->connect_timeout = 10;
     net->source_address = NULL;
 }
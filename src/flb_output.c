@@ -28,6 +28,8 @@
 #include <fluent-bit/flb_env.h>
 #include <fluent-bit/flb_coro.h>
 #include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_engine_dispatch.h>
+#include <fluent-bit/flb_routes_mask.h>
 #include <fluent-bit/flb_kv.h>
 #include <fluent-bit/flb_io.h>
 #include <fluent-bit/flb_uri.h>
@@ -39,6 +41,8 @@
 #include <fluent-bit/flb_output_thread.h>
 #include <fluent-bit/flb_mp.h>
 #include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_compress.h>
+#include <fluent-bit/flb_http2.h>
 
 FLB_TLS_DEFINE(struct flb_out_coro_params, out_coro_params);
 
@@ -284,6 +288,9 @@ int flb_output_instance_destroy(struct flb_output_instance *ins)
     /* release properties */
     flb_output_free_properties(ins);
 
+    /* dispatch queues */
+    flb_engine_dispatch_flows_destroy(ins);
+
     mk_list_del(&ins->_head);
     flb_free(ins);
 
@@ -404,6 +411,7 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
                                            const char *output, void *data,
                                            int public_only)
 {
+    int i;
     int ret = -1;
     int flags = 0;
     struct mk_list *head;
@@ -453,6 +461,7 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
 
     /* Retrieve an instance id for the output instance */
     instance->id = instance_id(config);
+    flb_routes_mask_set_size(config, instance->id);
 
     /* format name (with instance id) */
     snprintf(instance->name, sizeof(instance->name) - 1,
@@ -497,6 +506,9 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     /* Storage */
     instance->total_limit_size = -1;
 
+    /* Chunks coalescing */
+    instance->dispatch_coalesce_wait = FLB_OUTPUT_COALESCE_WAIT * 1000000000ULL;
+
     /* Parent plugin flags */
     flags = instance->flags;
     if (flags & FLB_IO_TCP) {
@@ -521,6 +533,9 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     instance->tls_crt_file          = NULL;
     instance->tls_key_file          = NULL;
     instance->tls_key_passwd        = NULL;
+    instance->tls_session_cache     = FLB_TRUE;
+    instance->tls_session_lifetime  = FLB_TLS_SESSION_LIFETIME;
+    instance->tls_ktls              = FLB_FALSE;
 #endif
 
     if (plugin->flags & FLB_OUTPUT_NET) {
@@ -537,6 +552,12 @@ struct flb_output_instance *flb_output_new(struct flb_config *config,
     mk_list_init(&instance->coros);
     mk_list_init(&instance->coros_destroy);
 
+    /* Dispatch queues */
+    mk_list_init(&instance->dispatch_flows);
+    for (i = 0; i < FLB_TASK_PRIO_LEVELS; i++) {
+        mk_list_init(&instance->dispatch_active[i]);
+    }
+
     mk_list_add(&instance->_head, &config->outputs);
 
     /* Tests */
@@ -564,6 +585,7 @@ int flb_output_set_property(struct flb_output_instance *ins,
     int len;
     int ret;
     ssize_t limit;
+    double wait;
     flb_sds_t tmp;
     struct flb_kv *kv;
     struct flb_config *config = ins->config;
@@ -716,6 +738,33 @@ int flb_output_set_property(struct flb_output_instance *ins,
     else if (prop_key_check("tls.key_passwd", k, len) == 0) {
         ins->tls_key_passwd = tmp;
     }
+    else if (prop_key_check("tls.session_cache", k, len) == 0 && tmp) {
+        if (strcasecmp(tmp, "true") == 0 || strcasecmp(tmp, "on") == 0) {
+            ins->tls_session_cache = FLB_TRUE;
+        }
+        else {
+            ins->tls_session_cache = FLB_FALSE;
+        }
+        flb_sds_destroy(tmp);
+    }
+    else if (prop_key_check("tls.ktls", k, len) == 0 && tmp) {
+        if (strcasecmp(tmp, "true") == 0 || strcasecmp(tmp, "on") == 0) {
+            ins->tls_ktls = FLB_TRUE;
+        }
+        else {
+            ins->tls_ktls = FLB_FALSE;
+        }
+        flb_sds_destroy(tmp);
+    }
+    else if (prop_key_check("tls.session_cache_lifetime", k, len) == 0 && tmp) {
+        ins->tls_session_lifetime = flb_utils_time_to_seconds(tmp);
+        flb_sds_destroy(tmp);
+        if (ins->tls_session_lifetime < 0) {
+            flb_error("[config] invalid tls.session_cache_lifetime on "
+                      "instance '%s'", flb_output_name(ins));
+            return -1;
+        }
+    }
 #endif
     else if (prop_key_check("storage.total_limit_size", k, len) == 0 && tmp) {
         if (strcasecmp(tmp, "off") == 0 ||
@@ -745,6 +794,40 @@ int flb_output_set_property(struct flb_output_instance *ins,
         ins->tp_workers = atoi(tmp);
         flb_sds_destroy(tmp);
     }
+    else if (prop_key_check("dispatch.max_inflight", k, len) == 0 && tmp) {
+        /* Limit the number of flushes running at the same time */
+        ins->dispatch_max_inflight = atoi(tmp);
+        flb_sds_destroy(tmp);
+        if (ins->dispatch_max_inflight < 0) {
+            return -1;
+        }
+    }
+    else if (prop_key_check("dispatch.coalesce_size", k, len) == 0 && tmp) {
+        /* Hold small chunks until they reach this size */
+        limit = flb_utils_size_to_bytes(tmp);
+        flb_sds_destroy(tmp);
+        if (limit < 0) {
+            return -1;
+        }
+        ins->dispatch_coalesce_size = limit;
+    }
+    else if (prop_key_check("dispatch.coalesce_records", k, len) == 0 && tmp) {
+        /* Hold small chunks until they reach this number of records */
+        ins->dispatch_coalesce_records = atoi(tmp);
+        flb_sds_destroy(tmp);
+        if (ins->dispatch_coalesce_records < 0) {
+            return -1;
+        }
+    }
+    else if (prop_key_check("dispatch.coalesce_wait", k, len) == 0 && tmp) {
+        /* Latency budget: max time a chunk is held (seconds) */
+        wait = atof(tmp);
+        flb_sds_destroy(tmp);
+        if (wait < 0) {
+            return -1;
+        }
+        ins->dispatch_coalesce_wait = wait * 1000000000.0;
+    }
     else {
         /*
          * Create the property, we don't pass the value since we will
@@ -899,6 +982,85 @@ int flb_output_init_all(struct flb_config *config)
                                              "Number of retried records.",
                                              1, (char *[]) {"name"});
 
+        ins->cmt_compress_in = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "compress_input_bytes_total",
+                                             "Number of bytes given to the "
+                                             "compressor.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_compress_out = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "compress_output_bytes_total",
+                                             "Number of bytes produced by the "
+                                             "compressor.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_compress_time = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "compress_seconds_total",
+                                             "Time spent compressing payloads.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_dispatch_queue = cmt_gauge_create(ins->cmt, "fluentbit",
+                                             "output", "dispatch_queue_length",
+                                             "Number of chunks waiting to be "
+                                             "flushed.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_dispatch_total = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "dispatch_total",
+                                             "Number of chunks taken from the "
+                                             "dispatch queue.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_dispatch_time = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "dispatch_queue_seconds_total",
+                                             "Time spent by chunks waiting in "
+                                             "the dispatch queue.",
+                                             1, (char *[]) {"name"});
+
+        /* upstream connections pool */
+        ins->cmt_upstream_busy = cmt_gauge_create(ins->cmt, "fluentbit",
+                                             "output", "upstream_busy_connections",
+                                             "Number of upstream connections "
+                                             "in use.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_upstream_idle = cmt_gauge_create(ins->cmt, "fluentbit",
+                                             "output", "upstream_idle_connections",
+                                             "Number of keepalive connections "
+                                             "available.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_upstream_waiters = cmt_gauge_create(ins->cmt, "fluentbit",
+                                             "output", "upstream_waiters",
+                                             "Number of flushes waiting for a "
+                                             "connection.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_upstream_waits = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "upstream_waits_total",
+                                             "Number of times a flush waited "
+                                             "for a connection.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_upstream_wait_time = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "upstream_wait_seconds_total",
+                                             "Time spent by flushes waiting "
+                                             "for a connection.",
+                                             1, (char *[]) {"name"});
+
+        /* TLS session resumption */
+        ins->cmt_tls_handshakes = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "tls_handshakes_total",
+                                             "Number of TLS handshakes "
+                                             "completed.",
+                                             1, (char *[]) {"name"});
+
+        ins->cmt_tls_resumed = cmt_counter_create(ins->cmt, "fluentbit",
+                                             "output", "tls_resumed_total",
+                                             "Number of TLS handshakes that "
+                                             "resumed a cached session.",
+                                             1, (char *[]) {"name"});
+
         /* old API */
         ins->metrics = flb_metrics_create(name);
         if (ins->metrics) {
@@ -956,6 +1118,11 @@ int flb_output_init_all(struct flb_config *config)
                 flb_output_instance_destroy(ins);
                 return -1;
             }
+            flb_tls_set_session_cache(ins->tls, ins->tls_session_cache,
+                                      ins->tls_session_lifetime);
+            if (ins->tls_ktls == FLB_TRUE) {
+                flb_tls_set_ktls(ins->tls, FLB_TRUE);
+            }
         }
 #endif
         /*
@@ -1113,6 +1280,26 @@ int flb_output_upstream_set(struct flb_upstream *u, struct flb_output_instance *
 
     /* Set networking options 'net.*' received through instance properties */
     memcpy(&u->net, &ins->net_setup, sizeof(struct flb_net_setup));
+
+#ifdef FLB_HAVE_TLS
+    /* HTTP/2 over TLS is negotiated through ALPN */
+    if (u->net.http2 == FLB_TRUE && u->tls) {
+        flb_tls_set_alpn(u->tls, FLB_HTTP2_ALPN);
+    }
+#endif
+
+#ifdef FLB_HAVE_METRICS
+    /* Connections pool metrics */
+    u->cmt_name = (char *) flb_output_name(ins);
+    u->cmt_busy = ins->cmt_upstream_busy;
+    u->cmt_idle = ins->cmt_upstream_idle;
+    u->cmt_waiters = ins->cmt_upstream_waiters;
+    u->cmt_waits = ins->cmt_upstream_waits;
+    u->cmt_wait_time = ins->cmt_upstream_wait_time;
+    u->cmt_tls_handshakes = ins->cmt_tls_handshakes;
+    u->cmt_tls_resumed = ins->cmt_tls_resumed;
+#endif
+
     return 0;
 }
 
@@ -1142,3 +1329,39 @@ int flb_output_set_http_debug_callbacks(struct flb_output_instance *ins)
     return 0;
 #endif
 }
+
+/*
+ * Compress an output payload. When the compression pool is enabled
+ * (service 'compress.workers') the calling coroutine waits for a pool
+ * worker instead of blocking its event loop. Sizes and time spent are
+ * tracked in the instance metrics.
+ */
+int flb_output_compress(struct flb_output_instance *ins, int type,
+                        void *in_data, size_t in_len,
+                        void **out_data, size_t *out_len)
+{
+    int ret;
+    char *name;
+    uint64_t ts;
+    struct flb_time t0;
+    struct flb_time t1;
+    struct flb_time diff;
+
+    flb_time_get(&t0);
+    ret = flb_compress_async(ins->config, type, in_data, in_len,
+                             out_data, out_len);
+    if (ret != 0) {
+        return ret;
+    }
+    flb_time_get(&t1);
+    flb_time_diff(&t1, &t0, &diff);
+
+    name = (char *) flb_output_name(ins);
+    ts = cmt_time_now();
+    cmt_counter_add(ins->cmt_compress_in, ts, in_len, 1, (char *[]) {name});
+    cmt_counter_add(ins->cmt_compress_out, ts, *out_len, 1, (char *[]) {name});
+    cmt_counter_add(ins->cmt_compress_time, ts, flb_time_to_double(&diff),
+                    1, (char *[]) {name});
+
+    return 0;
+}
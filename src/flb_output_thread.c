@@ -65,7 +65,6 @@ static inline int handle_output_event(struct flb_config *config,
     int bytes;
     int out_id;
     uint32_t type;
-    uint32_t key;
     uint64_t val;
 
     bytes = flb_pipe_r(fd, &val, sizeof(val));
@@ -74,9 +73,8 @@ static inline int handle_output_event(struct flb_config *config,
         return -1;
     }
 
-    /* Get type and key */
-    type = FLB_BITS_U64_HIGH(val);
-    key  = FLB_BITS_U64_LOW(val);
+    /* Get type */
+    type = FLB_TASK_EVENT_TYPE(val);
 
     if (type != FLB_ENGINE_TASK) {
         flb_error("[engine] invalid event type %i for output handler",
@@ -84,8 +82,8 @@ static inline int handle_output_event(struct flb_config *config,
         return -1;
     }
 
-    ret     = FLB_TASK_RET(key);
-    out_id  = FLB_TASK_OUT(key);
+    ret     = FLB_TASK_RET(val);
+    out_id  = FLB_TASK_OUT(val);
 
     /* Destroy the output co-routine context */
     flb_output_flush_finished(config, out_id);
@@ -206,6 +204,9 @@ static void output_thread(void *data)
     /* Set the upstream queue */
     flb_upstream_list_set(&th_ins->upstreams);
 
+    /* Warm up the connections of this worker */
+    flb_upstream_conn_warmup_list(&ins->upstreams);
+
     /* Create a scheduler context */
     sched = flb_sched_create(ins->config, th_ins->evl);
     if (!sched) {
@@ -327,6 +328,9 @@ static void output_thread(void *data)
 
         flb_net_dns_lookup_context_cleanup(&dns_ctx);
 
+        /* Resume coroutines waiting for a connection */
+        flb_upstream_conn_waiters_resume_list(&th_ins->upstreams);
+
         /* Destroy upstream connections from the 'pending destroy list' */
         flb_upstream_conn_pending_destroy_list(&th_ins->upstreams);
         flb_sched_timer_cleanup(sched);
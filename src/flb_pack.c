@@ -30,12 +30,11 @@
 #include <fluent-bit/flb_time.h>
 #include <fluent-bit/flb_pack.h>
 #include <fluent-bit/flb_unescape.h>
+#include <fluent-bit/flb_utf8.h>
 
 #include <msgpack.h>
 #include <jsmn/jsmn.h>
 
-#define try_to_write_str  flb_utils_write_str
-
 int flb_json_tokenise(const char *js, size_t len,
                       struct flb_pack_state *state)
 {
@@ -132,88 +131,519 @@ static inline int pack_string_token(struct flb_pack_state *state,
     return out_len;
 }
 
-/* Receive a tokenized JSON message and convert it to MsgPack */
-static char *tokens_to_msgpack(struct flb_pack_state *state,
-                               const char *js,
-                               int *out_size, int *last_byte,
-                               int *out_records)
+/*
+ * JSON to MessagePack decoder
+ * ---------------------------
+ * The decoder walks the JSON text once and writes MessagePack directly into
+ * the output buffer, there is no intermediate tokens array. Since the number
+ * of entries of a map or array is only known when the container is closed,
+ * the longest header (5 bytes) is reserved when it's opened; on close, the
+ * final header is written and the content is moved back if a shorter header
+ * was used, so the output is the same as packing with msgpack_pack_map()
+ * and msgpack_pack_array().
+ *
+ * The grammar accepted is the one of the JSMN strict mode used before: keys
+ * must be strings, primitives are delimited by a space, comma or a closing
+ * bracket and top-level messages can be concatenated.
+ */
+
+#define JSON_STACK_SIZE   64       /* nested levels before using the heap */
+#define JSON_HEADER_SIZE  5        /* map32 / array32 header */
+
+#define JSON_EXPECT_VALUE           0
+#define JSON_EXPECT_VALUE_OR_CLOSE  1  /* after '[' */
+#define JSON_EXPECT_KEY             2  /* after ',' in a map */
+#define JSON_EXPECT_KEY_OR_CLOSE    3  /* after '{' */
+#define JSON_EXPECT_COLON           4
+#define JSON_EXPECT_COMMA_OR_CLOSE  5
+
+struct json_frame {
+    int type;                      /* FLB_PACK_JSON_OBJECT or ARRAY */
+    uint32_t entries;              /* map pairs or array items      */
+    size_t header;                 /* offset of the reserved header */
+};
+
+/* JSON whitespace */
+static const char json_ws[256] = {
+    [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1
+};
+
+/* characters that end a primitive (JSMN strict) */
+static const char json_delim[256] = {
+    [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1,
+    [','] = 1, [']'] = 1, ['}'] = 1
+};
+
+static inline const char *json_skip_ws(const char *p, const char *end)
 {
-    int i;
-    int flen;
-    int arr_size;
-    int records = 0;
-    const char *p;
-    char *buf;
-    const jsmntok_t *t;
-    msgpack_packer pck;
-    msgpack_sbuffer sbuf;
-    jsmntok_t *tokens;
+    while (p < end && json_ws[(unsigned char) *p]) {
+        p++;
+    }
+    return p;
+}
+
+static inline int is_hex(char c)
+{
+    return ((c >= '0' && c <= '9') ||
+            (c >= 'a' && c <= 'f') ||
+            (c >= 'A' && c <= 'F'));
+}
+
+/* Reserve the space for a container header */
+static int json_frame_open(msgpack_sbuffer *sbuf, struct json_frame *f,
+                           int type)
+{
+    static const char empty[JSON_HEADER_SIZE] = {0};
 
-    tokens = state->tokens;
-    arr_size = state->tokens_count;
+    f->type = type;
+    f->entries = 0;
+    f->header = sbuf->size;
 
-    if (arr_size == 0) {
-        return NULL;
+    return msgpack_sbuffer_write(sbuf, empty, JSON_HEADER_SIZE);
+}
+
+/* Write the final container header, move the content if it's shorter */
+static void json_frame_close(msgpack_sbuffer *sbuf, struct json_frame *f)
+{
+    int len;
+    uint32_t n = f->entries;
+    unsigned char h[JSON_HEADER_SIZE];
+    char *base;
+
+    if (n < 16) {
+        h[0] = (f->type == FLB_PACK_JSON_OBJECT ? 0x80 : 0x90) | n;
+        len = 1;
+    }
+    else if (n < 65536) {
+        h[0] = (f->type == FLB_PACK_JSON_OBJECT ? 0xde : 0xdc);
+        h[1] = n >> 8;
+        h[2] = n;
+        len = 3;
+    }
+    else {
+        h[0] = (f->type == FLB_PACK_JSON_OBJECT ? 0xdf : 0xdd);
+        h[1] = n >> 24;
+        h[2] = n >> 16;
+        h[3] = n >> 8;
+        h[4] = n;
+        len = 5;
     }
 
-    /* initialize buffers */
-    msgpack_sbuffer_init(&sbuf);
-    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+    base = sbuf->data + f->header;
+    if (len < JSON_HEADER_SIZE) {
+        memmove(base + len, base + JSON_HEADER_SIZE,
+                sbuf->size - f->header - JSON_HEADER_SIZE);
+        sbuf->size -= (JSON_HEADER_SIZE - len);
+    }
+    memcpy(base, h, len);
+}
 
-    for (i = 0; i < arr_size ; i++) {
-        t = &tokens[i];
+/*
+ * Pack the string starting at 'p' (opening quote). Strings without escape
+ * sequences are packed straight from the JSON buffer, the others are
+ * decoded through the state temporary buffer.
+ */
+static int json_pack_string(struct flb_pack_state *state,
+                            const char **p, const char *end,
+                            msgpack_packer *pck)
+{
+    int ret;
+    const char *s = *p + 1;
+    const char *q;
+    const char *quote;
 
-        if (t->start == -1 || t->end == -1 || (t->start == 0 && t->end == 0)) {
-            break;
+    quote = memchr(s, '"', end - s);
+    if (!quote) {
+        return FLB_ERR_JSON_PART;
+    }
+
+    q = memchr(s, '\\', quote - s);
+    if (!q) {
+        if (memchr(s, '\0', quote - s) == NULL) {
+            msgpack_pack_str(pck, quote - s);
+            msgpack_pack_str_body(pck, s, quote - s);
         }
+        else {
+            ret = pack_string_token(state, s, quote - s, pck);
+            if (ret == -1) {
+                return -1;
+            }
+        }
+        *p = quote + 1;
+        return 0;
+    }
 
-        if (t->parent == -1) {
-            *last_byte = t->end;
-            records++;
+    /* validate escape sequences and find the closing quote */
+    while (q < end && *q != '"') {
+        if (*q != '\\') {
+            q++;
+            continue;
+        }
+
+        q++;
+        if (q >= end) {
+            return FLB_ERR_JSON_PART;
         }
 
-        flen = (t->end - t->start);
-        switch (t->type) {
-        case JSMN_OBJECT:
-            msgpack_pack_map(&pck, t->size);
+        switch (*q) {
+        case '"': case '/': case '\\': case 'b':
+        case 'f': case 'r': case 'n': case 't':
+            q++;
             break;
-        case JSMN_ARRAY:
-            msgpack_pack_array(&pck, t->size);
+        case 'u':
+            if (end - q < 5) {
+                return FLB_ERR_JSON_PART;
+            }
+            if (!is_hex(q[1]) || !is_hex(q[2]) ||
+                !is_hex(q[3]) || !is_hex(q[4])) {
+                return FLB_ERR_JSON_INVAL;
+            }
+            q += 5;
+            break;
+        default:
+            return FLB_ERR_JSON_INVAL;
+        }
+    }
+
+    if (q >= end) {
+        return FLB_ERR_JSON_PART;
+    }
+
+    ret = pack_string_token(state, s, q - s, pck);
+    if (ret == -1) {
+        return -1;
+    }
+    *p = q + 1;
+
+    return 0;
+}
+
+/* Pack a true, false, null or number primitive */
+static int json_pack_primitive(const char **p, const char *end,
+                               msgpack_packer *pck)
+{
+    int len;
+    const char *s = *p;
+    const char *q = s;
+    unsigned char c;
+
+    while (q < end) {
+        c = *q;
+        if (json_delim[c]) {
             break;
-        case JSMN_STRING:
-            pack_string_token(state, js + t->start, flen, &pck);
+        }
+        if (c < 32 || c >= 127) {
+            return FLB_ERR_JSON_INVAL;
+        }
+        q++;
+    }
+
+    /* a primitive must be followed by a delimiter */
+    if (q >= end) {
+        return FLB_ERR_JSON_PART;
+    }
+
+    len = q - s;
+    if (*s == 'f') {
+        msgpack_pack_false(pck);
+    }
+    else if (*s == 't') {
+        msgpack_pack_true(pck);
+    }
+    else if (*s == 'n') {
+        msgpack_pack_nil(pck);
+    }
+    else if (is_float(s, len)) {
+        msgpack_pack_double(pck, atof(s));
+    }
+    else {
+        msgpack_pack_int64(pck, atoll(s));
+    }
+    *p = q;
+
+    return 0;
+}
+
+/*
+ * Pack the JSON message that starts at 'js + *pos'. On success '*pos' is
+ * set to the end of the message and '*type' to the root type. It returns
+ * FLB_ERR_JSON_PART if the message is incomplete, FLB_ERR_JSON_INVAL if it's
+ * not valid or -1 on memory errors.
+ */
+static int json_pack_message(struct flb_pack_state *state,
+                             const char *js, size_t len, size_t *pos,
+                             msgpack_sbuffer *sbuf, msgpack_packer *pck,
+                             int *type, int resume, int save)
+{
+    int ret = 0;
+    int depth = 0;
+    int stack_size = JSON_STACK_SIZE;
+    int expect = JSON_EXPECT_VALUE;
+    const char *p = js + *pos;
+    const char *end = js + len;
+    struct json_frame *f = NULL;
+    struct json_frame *tmp;
+    struct json_frame *stack;
+    struct json_frame frames[JSON_STACK_SIZE];
+
+    stack = frames;
+    *type = FLB_PACK_JSON_UNDEFINED;
+
+    /* continue the message saved by the previous call */
+    if (resume) {
+        depth = state->scan_depth;
+        expect = state->scan_expect;
+        *type = state->scan_type;
+        p = js + state->scan_pos;
+
+        while (stack_size < depth) {
+            stack_size *= 2;
+        }
+        if (stack_size > JSON_STACK_SIZE) {
+            stack = flb_malloc(sizeof(struct json_frame) * stack_size);
+            if (!stack) {
+                flb_errno();
+                return -1;
+            }
+        }
+        if (depth > 0) {
+            memcpy(stack, state->scan_stack,
+                   sizeof(struct json_frame) * depth);
+            f = &stack[depth - 1];
+        }
+        flb_free(state->scan_stack);
+        state->scan_stack = NULL;
+        state->scan_resume = FLB_FALSE;
+    }
+
+    while (1) {
+        p = json_skip_ws(p, end);
+        if (p >= end) {
+            ret = FLB_ERR_JSON_PART;
             break;
-        case JSMN_PRIMITIVE:
-            p = js + t->start;
-            if (*p == 'f') {
-                msgpack_pack_false(&pck);
+        }
+
+        if (expect == JSON_EXPECT_COLON) {
+            if (*p != ':') {
+                ret = FLB_ERR_JSON_INVAL;
+                break;
             }
-            else if (*p == 't') {
-                msgpack_pack_true(&pck);
+            p++;
+            expect = JSON_EXPECT_VALUE;
+            continue;
+        }
+
+        if (expect == JSON_EXPECT_COMMA_OR_CLOSE) {
+            if (*p == ',') {
+                p++;
+                expect = (f->type == FLB_PACK_JSON_OBJECT) ?
+                    JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+                continue;
             }
-            else if (*p == 'n') {
-                msgpack_pack_nil(&pck);
+            goto close;
+        }
+
+        if (expect == JSON_EXPECT_KEY_OR_CLOSE ||
+            expect == JSON_EXPECT_VALUE_OR_CLOSE) {
+            if (*p == '}' || *p == ']') {
+                goto close;
             }
-            else {
-                if (is_float(p, flen)) {
-                    msgpack_pack_double(&pck, atof(p));
+        }
+
+        /* map key */
+        if (expect == JSON_EXPECT_KEY || expect == JSON_EXPECT_KEY_OR_CLOSE) {
+            if (*p != '"') {
+                ret = FLB_ERR_JSON_INVAL;
+                break;
+            }
+            ret = json_pack_string(state, &p, end, pck);
+            if (ret != 0) {
+                break;
+            }
+            f->entries++;
+            expect = JSON_EXPECT_COLON;
+            continue;
+        }
+
+        /* value */
+        if (*p == '{' || *p == '[') {
+            if (f && f->type == FLB_PACK_JSON_ARRAY) {
+                f->entries++;
+            }
+
+            if (depth == stack_size) {
+                tmp = flb_malloc(sizeof(struct json_frame) * stack_size * 2);
+                if (!tmp) {
+                    flb_errno();
+                    ret = -1;
+                    break;
                 }
-                else {
-                    msgpack_pack_int64(&pck, atoll(p));
+                memcpy(tmp, stack, sizeof(struct json_frame) * depth);
+                if (stack != frames) {
+                    flb_free(stack);
                 }
+                stack = tmp;
+                stack_size *= 2;
+            }
+            f = &stack[depth++];
+
+            if (*p == '{') {
+                ret = json_frame_open(sbuf, f, FLB_PACK_JSON_OBJECT);
+                expect = JSON_EXPECT_KEY_OR_CLOSE;
+            }
+            else {
+                ret = json_frame_open(sbuf, f, FLB_PACK_JSON_ARRAY);
+                expect = JSON_EXPECT_VALUE_OR_CLOSE;
+            }
+            if (ret != 0) {
+                ret = -1;
+                break;
+            }
+            if (depth == 1) {
+                *type = f->type;
+            }
+            p++;
+            continue;
+        }
+
+        if (*p == '"') {
+            ret = json_pack_string(state, &p, end, pck);
+            if (depth == 0) {
+                *type = FLB_PACK_JSON_STRING;
+            }
+        }
+        else if (*p == '-' || (*p >= '0' && *p <= '9') ||
+                 *p == 't' || *p == 'f' || *p == 'n') {
+            ret = json_pack_primitive(&p, end, pck);
+            if (depth == 0) {
+                *type = FLB_PACK_JSON_PRIMITIVE;
             }
+        }
+        else {
+            ret = FLB_ERR_JSON_INVAL;
+        }
+
+        if (ret != 0 || depth == 0) {
+            break;
+        }
+        if (f->type == FLB_PACK_JSON_ARRAY) {
+            f->entries++;
+        }
+        expect = JSON_EXPECT_COMMA_OR_CLOSE;
+        continue;
+
+    close:
+        if ((*p == '}' && f->type != FLB_PACK_JSON_OBJECT) ||
+            (*p == ']' && f->type != FLB_PACK_JSON_ARRAY) ||
+            (*p != '}' && *p != ']')) {
+            ret = FLB_ERR_JSON_INVAL;
             break;
-        case JSMN_UNDEFINED:
-            msgpack_sbuffer_destroy(&sbuf);
-            return NULL;
         }
+        p++;
+
+        json_frame_close(sbuf, f);
+        depth--;
+        if (depth == 0) {
+            ret = 0;
+            break;
+        }
+        f = &stack[depth - 1];
+        expect = JSON_EXPECT_COMMA_OR_CLOSE;
     }
 
-    *out_size = sbuf.size;
-    *out_records = records;
-    buf = sbuf.data;
+    /*
+     * Keep the scan state of an incomplete message: the scan stops on a
+     * token boundary, so the next call starts from that token.
+     */
+    if (ret == FLB_ERR_JSON_PART && save) {
+        state->scan_stack = NULL;
+        if (depth > 0) {
+            state->scan_stack = flb_malloc(sizeof(struct json_frame) * depth);
+            if (!state->scan_stack) {
+                flb_errno();
+                ret = -1;
+            }
+            else {
+                memcpy(state->scan_stack, stack,
+                       sizeof(struct json_frame) * depth);
+            }
+        }
+        if (ret == FLB_ERR_JSON_PART) {
+            state->scan_resume = FLB_TRUE;
+            state->scan_depth = depth;
+            state->scan_expect = expect;
+            state->scan_type = *type;
+            state->scan_pos = p - js;
+        }
+    }
 
-    return buf;
+    if (stack != frames) {
+        flb_free(stack);
+    }
+
+    if (ret == 0) {
+        *pos = p - js;
+    }
+    return ret;
+}
+
+/*
+ * Pack the concatenated JSON messages found in 'js'. It returns the number
+ * of packed messages (or a negative error) and sets 'last_byte' to the end
+ * of the last complete one. If 'partial' is set, an incomplete message at
+ * the end of the buffer stops the process without failing; when no message
+ * was complete, the scan state is saved so the next call resumes it.
+ */
+static int json_to_msgpack(struct flb_pack_state *state,
+                           const char *js, size_t len, int partial,
+                           msgpack_sbuffer *sbuf, int *last_byte,
+                           int *root_type)
+{
+    int ret;
+    int type;
+    int resume;
+    int records = 0;
+    size_t pos = 0;
+    size_t mark;
+    msgpack_packer pck;
+
+    msgpack_packer_init(&pck, sbuf, msgpack_sbuffer_write);
+
+    resume = (partial && state->scan_resume);
+    while (1) {
+        /* messages can be separated by spaces or commas */
+        while (!resume && pos < len && (json_ws[(unsigned char) js[pos]] ||
+                                        js[pos] == ',')) {
+            pos++;
+        }
+        if (!resume && pos >= len) {
+            break;
+        }
+
+        mark = resume ? 0 : sbuf->size;
+        ret = json_pack_message(state, js, len, &pos, sbuf, &pck, &type,
+                                resume, partial && records == 0);
+        resume = FLB_FALSE;
+        if (ret != 0) {
+            if (ret == FLB_ERR_JSON_PART && state->scan_resume) {
+                /* keep the message packed so far */
+                return ret;
+            }
+            sbuf->size = mark;
+            if (ret == FLB_ERR_JSON_PART && partial && records > 0) {
+                break;
+            }
+            return ret;
+        }
+
+        if (records == 0) {
+            *root_type = type;
+        }
+        records++;
+        *last_byte = pos;
+    }
+
+    return records;
 }
 
 /*
@@ -228,42 +658,28 @@ static int pack_json_to_msgpack(const char *js, size_t len, char **buffer,
                                 size_t *size, int *root_type, int *records)
 {
     int ret = -1;
-    int n_records;
-    int out;
     int last;
-    char *buf = NULL;
+    msgpack_sbuffer sbuf;
     struct flb_pack_state state;
 
-    ret = flb_pack_state_init(&state);
-    if (ret != 0) {
-        return -1;
-    }
-    ret = flb_json_tokenise(js, len, &state);
-    if (ret != 0) {
-        ret = -1;
-        goto flb_pack_json_end;
-    }
+    /* no tokens are needed, the buffer is only allocated to unescape */
+    memset(&state, 0, sizeof(state));
 
-    if (state.tokens_count == 0) {
-        ret = -1;
-        goto flb_pack_json_end;
-    }
+    msgpack_sbuffer_init(&sbuf);
+    ret = json_to_msgpack(&state, js, len, FLB_FALSE, &sbuf, &last,
+                          root_type);
+    flb_pack_state_reset(&state);
 
-    buf = tokens_to_msgpack(&state, js, &out, &last, &n_records);
-    if (!buf) {
-        ret = -1;
-        goto flb_pack_json_end;
+    if (ret <= 0) {
+        msgpack_sbuffer_destroy(&sbuf);
+        return -1;
     }
 
-    *root_type = state.tokens[0].type;
-    *size = out;
-    *buffer = buf;
-    *records = n_records;
-    ret = 0;
+    *size = sbuf.size;
+    *buffer = sbuf.data;
+    *records = ret;
 
- flb_pack_json_end:
-    flb_pack_state_reset(&state);
-    return ret;
+    return 0;
 }
 
 /* Pack unlimited serialized JSON messages into msgpack */
@@ -313,6 +729,14 @@ int flb_pack_state_init(struct flb_pack_state *s)
     s->buf_size = size;
     s->buf_len = 0;
 
+    s->scan_resume = FLB_FALSE;
+    s->scan_depth  = 0;
+    s->scan_expect = 0;
+    s->scan_type   = FLB_PACK_JSON_UNDEFINED;
+    s->scan_pos    = 0;
+    s->scan_stack  = NULL;
+    msgpack_sbuffer_init(&s->scan_buf);
+
     return 0;
 }
 
@@ -324,79 +748,69 @@ void flb_pack_state_reset(struct flb_pack_state *s)
     s->last_byte    = 0;
     s->buf_size     = 0;
     flb_free(s->buf_data);
+
+    flb_free(s->scan_stack);
+    s->scan_stack  = NULL;
+    s->scan_resume = FLB_FALSE;
+    msgpack_sbuffer_destroy(&s->scan_buf);
+    msgpack_sbuffer_init(&s->scan_buf);
 }
 
 
 /*
  * It parse a JSON string and convert it to MessagePack format. The main
  * difference of this function and the previous flb_pack_json() is that it
- * keeps a parser and tokens state, allowing to process big messages and
- * resume the parsing process instead of start from zero.
+ * accepts an incomplete message at the end of the buffer: the complete
+ * messages are packed and 'state->last_byte' is set to the end of the last
+ * one, so the caller can drop them and try again once more data arrives.
+ *
+ * If no message is complete, FLB_ERR_JSON_PART is returned and the state
+ * keeps the decoded part: the caller must call it again with the same
+ * buffer plus the new data (or reset the state), the scan is resumed from
+ * where it stopped instead of the start of the buffer.
  */
 int flb_pack_json_state(const char *js, size_t len,
                         char **buffer, int *size,
                         struct flb_pack_state *state)
 {
     int ret;
-    int out;
-    int delim = 0;
-    int last =  0;
-    int records;
-    char *buf;
-    jsmntok_t *t;
+    int last = 0;
+    int root_type;
+    msgpack_sbuffer sbuf;
 
-    ret = flb_json_tokenise(js, len, state);
+    /*
+     * The incoming buffer may have multiple JSON messages concatenated and
+     * likely the last one is only incomplete: pack the complete ones and
+     * let the caller know through 'last_byte' where the next one starts.
+     */
     state->multiple = FLB_TRUE;
-    if (ret == FLB_ERR_JSON_PART && state->multiple == FLB_TRUE) {
-        /*
-         * If the caller enabled 'multiple' flag, it means that the incoming
-         * JSON message may have multiple messages concatenated and likely
-         * the last one is only incomplete.
-         *
-         * The following routine aims to determinate how many JSON messages
-         * are OK in the array of tokens, if any, process them and adjust
-         * the JSMN context/buffers.
-         */
-        int i;
-        int found = 0;
-
-        for (i = 1; i < state->tokens_size; i++) {
-            t = &state->tokens[i];
-
-            if (t->start < (state->tokens[i - 1]).start) {
-                break;
-            }
-
-            if (t->parent == -1 && (t->end != 0)) {
-                found++;
-                delim = i;
-            }
-
-        }
 
-        if (found > 0) {
-            state->tokens_count += delim;
-        }
-        else {
-            return ret;
-        }
+    /* the message packed so far by a previous call, if any */
+    if (state->scan_resume) {
+        sbuf = state->scan_buf;
+        msgpack_sbuffer_init(&state->scan_buf);
     }
-    else if (ret != 0) {
-        return ret;
+    else {
+        msgpack_sbuffer_init(&sbuf);
     }
 
-    if (state->tokens_count == 0) {
-        state->last_byte = last;
-        return FLB_ERR_JSON_INVAL;
+    ret = json_to_msgpack(state, js, len, state->multiple, &sbuf, &last,
+                          &root_type);
+    if (ret == FLB_ERR_JSON_PART && state->scan_resume) {
+        state->scan_buf = sbuf;
+        return ret;
     }
-
-    buf = tokens_to_msgpack(state, js, &out, &last, &records);
-    if (!buf) {
-        return -1;
+    if (ret <= 0) {
+        msgpack_sbuffer_destroy(&sbuf);
+        if (ret == 0) {
+            state->last_byte = last;
+            return FLB_ERR_JSON_INVAL;
+        }
+        return ret;
     }
 
-    *size = out;
-    *buffer = buf;
+    *size = sbuf.size;
+    *buffer = sbuf.data;
     state->last_byte = last;
 
     return 0;
@@ -455,20 +869,238 @@ void flb_pack_print(const char *data, size_t bytes)
 }
 
 
-static inline int try_to_write(char *buf, int *off, size_t left,
-                               const char *str, size_t str_len)
+/*
+ * msgpack to JSON encoder
+ * -----------------------
+ * The encoder writes into a 'json_buf', it can be a caller fixed size
+ * buffer or a buffer that grows on demand (heap or sds). Space is reserved
+ * once per value instead of checking every written byte, so when an
+ * estimated size is too small the buffer is expanded and the encoding
+ * continues where it was.
+ */
+#define JSON_BUF_FIXED  0
+#define JSON_BUF_HEAP   1
+#define JSON_BUF_SDS    2
+
+struct json_buf {
+    int mode;
+    char *data;
+    size_t len;
+    size_t size;          /* usable bytes, excluding the NULL byte */
+};
+
+/*
+ * String escaping table: 0 means the byte is copied as it is, 'u' means
+ * \u00XX, 1 is the lead byte of a UTF-8 sequence and any other value is
+ * the character used after the backslash.
+ */
+static const char json_escape[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+     0,   0,  '"',  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, '\\',  0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 'u',
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1
+};
+
+static const char json_hex[] = "0123456789abcdef";
+
+static const char json_digits[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static int json_buf_grow(struct json_buf *jb, size_t bytes)
 {
-    if (str_len <= 0){
-        str_len = strlen(str);
+    size_t inc;
+    char *tmp;
+    flb_sds_t sds;
+
+    if (jb->mode == JSON_BUF_FIXED) {
+        return -1;
     }
-    if (left <= *off+str_len) {
-        return FLB_FALSE;
+
+    /* at least double the buffer to keep the number of reallocs low */
+    inc = (jb->size > bytes) ? jb->size : bytes;
+    if (inc < 64) {
+        inc = 64;
+    }
+
+    if (jb->mode == JSON_BUF_SDS) {
+        sds = flb_sds_increase(jb->data, inc);
+        if (!sds) {
+            return -1;
+        }
+        jb->data = sds;
+        jb->size = flb_sds_alloc(sds);
+    }
+    else {
+        tmp = flb_realloc(jb->data, jb->size + inc + 1);
+        if (!tmp) {
+            flb_errno();
+            return -1;
+        }
+        jb->data = tmp;
+        jb->size += inc;
+    }
+
+    return 0;
+}
+
+static inline int json_buf_reserve(struct json_buf *jb, size_t bytes)
+{
+    if (jb->size - jb->len >= bytes) {
+        return 0;
     }
-    memcpy(buf+*off, str, str_len);
-    *off += str_len;
-    return FLB_TRUE;
+    return json_buf_grow(jb, bytes);
 }
 
+static inline int json_buf_cat(struct json_buf *jb, const char *str,
+                               size_t len)
+{
+    if (json_buf_reserve(jb, len) != 0) {
+        return -1;
+    }
+    memcpy(jb->data + jb->len, str, len);
+    jb->len += len;
+    return 0;
+}
+
+static inline int json_format_u64(char *out, uint64_t v)
+{
+    int idx;
+    int len;
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        idx = (v % 100) * 2;
+        v /= 100;
+        *--p = json_digits[idx + 1];
+        *--p = json_digits[idx];
+    }
+    if (v < 10) {
+        *--p = '0' + v;
+    }
+    else {
+        idx = v * 2;
+        *--p = json_digits[idx + 1];
+        *--p = json_digits[idx];
+    }
+
+    len = (tmp + sizeof(tmp)) - p;
+    memcpy(out, p, len);
+    return len;
+}
+
+static inline int json_format_double(char *out, size_t size, double d)
+{
+    int len;
+
+    if (d != (double) (long long int) d) {
+        return snprintf(out, size - 1, "%.16g", d);
+    }
+
+    /* integral values keep one decimal, same as '%.1f' */
+    if (d > -1e15 && d < 1e15 && d != 0) {
+        len = 0;
+        if (d < 0) {
+            out[len++] = '-';
+            d = -d;
+        }
+        len += json_format_u64(out + len, (uint64_t) d);
+        out[len++] = '.';
+        out[len++] = '0';
+        return len;
+    }
+
+    return snprintf(out, size - 1, "%.1f", d);
+}
+
+/*
+ * Append a quoted and escaped string. Control characters are escaped,
+ * UTF-8 sequences are copied as they are and a truncated sequence at the
+ * end of the string is dropped.
+ */
+static int json_buf_str(struct json_buf *jb, const char *str, size_t len)
+{
+    int n;
+    char e;
+    char *p;
+    size_t i = 0;
+    size_t run;
+    unsigned char c;
+
+    /* the output is never shorter than the input */
+    if (json_buf_reserve(jb, len + 2) != 0) {
+        return -1;
+    }
+    jb->data[jb->len++] = '"';
+
+    while (i < len) {
+        /* copy the longest run of bytes that don't need escaping */
+        run = i;
+        while (run < len && json_escape[(unsigned char) str[run]] == 0) {
+            run++;
+        }
+        if (run > i) {
+            memcpy(jb->data + jb->len, str + i, run - i);
+            jb->len += run - i;
+            i = run;
+            if (i == len) {
+                break;
+            }
+        }
+
+        c = str[i];
+        e = json_escape[c];
+        if (e == 1) {
+            n = flb_utf8_len(str + i);
+            if (i + n > len) {
+                break; /* skip truncated UTF-8 */
+            }
+            memcpy(jb->data + jb->len, str + i, n);
+            jb->len += n;
+            i += n;
+            continue;
+        }
+
+        /* keep room for the escape, the rest of the input and the quote */
+        n = (e == 'u') ? 6 : 2;
+        if (json_buf_reserve(jb, (len - i - 1) + n + 1) != 0) {
+            return -1;
+        }
+        p = jb->data + jb->len;
+        *p++ = '\\';
+        if (e == 'u') {
+            *p++ = 'u';
+            *p++ = '0';
+            *p++ = '0';
+            *p++ = json_hex[c >> 4];
+            *p++ = json_hex[c & 0xf];
+        }
+        else {
+            *p++ = e;
+        }
+        jb->len = p - jb->data;
+        i++;
+    }
+
+    jb->data[jb->len++] = '"';
+    return 0;
+}
 
 /*
  * Check if a key exists in the map using the 'offset' as an index to define
@@ -501,163 +1133,179 @@ static inline int key_exists_in_map(msgpack_object key, msgpack_object map, int
     return FLB_FALSE;
 }
 
-static int msgpack2json(char *buf, int *off, size_t left,
-                        const msgpack_object *o)
+static int json_buf_object(struct json_buf *jb, const msgpack_object *o);
+
+/*
+ * Append the key/value pairs of a map, 'packed' is the number of entries
+ * already written in the current JSON object. When a key is duplicated only
+ * the last entry is kept.
+ */
+static int json_buf_map_entries(struct json_buf *jb, const msgpack_object *o,
+                                int packed)
 {
     int i;
-    int dup;
-    int ret = FLB_FALSE;
-    int loop;
-    int packed;
+    msgpack_object_kv *p;
+
+    for (i = 0; i < o->via.map.size; i++) {
+        p = o->via.map.ptr + i;
+        if (key_exists_in_map(p->key, *o, i + 1) == FLB_TRUE) {
+            continue;
+        }
+
+        if (packed > 0 && json_buf_cat(jb, ",", 1) != 0) {
+            return -1;
+        }
+        if (json_buf_object(jb, &p->key) != 0 ||
+            json_buf_cat(jb, ":", 1) != 0 ||
+            json_buf_object(jb, &p->val) != 0) {
+            return -1;
+        }
+        packed++;
+    }
+
+    return 0;
+}
+
+static int json_buf_object(struct json_buf *jb, const msgpack_object *o)
+{
+    int i;
+    int len;
+    char tmp[64];
 
-    switch(o->type) {
+    switch (o->type) {
     case MSGPACK_OBJECT_NIL:
-        ret = try_to_write(buf, off, left, "null", 4);
-        break;
+        return json_buf_cat(jb, "null", 4);
 
     case MSGPACK_OBJECT_BOOLEAN:
-        ret = try_to_write(buf, off, left,
-                           (o->via.boolean ? "true":"false"),0);
-
-        break;
+        if (o->via.boolean) {
+            return json_buf_cat(jb, "true", 4);
+        }
+        return json_buf_cat(jb, "false", 5);
 
     case MSGPACK_OBJECT_POSITIVE_INTEGER:
-        {
-            char temp[32] = {0};
-            i = snprintf(temp, sizeof(temp)-1, "%"PRIu64, o->via.u64);
-            ret = try_to_write(buf, off, left, temp, i);
-        }
-        break;
+        len = json_format_u64(tmp, o->via.u64);
+        return json_buf_cat(jb, tmp, len);
 
     case MSGPACK_OBJECT_NEGATIVE_INTEGER:
-        {
-            char temp[32] = {0};
-            i = snprintf(temp, sizeof(temp)-1, "%"PRId64, o->via.i64);
-            ret = try_to_write(buf, off, left, temp, i);
+        if (o->via.i64 < 0) {
+            tmp[0] = '-';
+            len = json_format_u64(tmp + 1,
+                                  (uint64_t) 0 - (uint64_t) o->via.i64) + 1;
+        }
+        else {
+            len = json_format_u64(tmp, o->via.i64);
         }
-        break;
+        return json_buf_cat(jb, tmp, len);
+
     case MSGPACK_OBJECT_FLOAT32:
     case MSGPACK_OBJECT_FLOAT64:
-        {
-            char temp[512] = {0};
-            if (o->via.f64 == (double)(long long int)o->via.f64) {
-                i = snprintf(temp, sizeof(temp)-1, "%.1f", o->via.f64);
-            }
-            else {
-                i = snprintf(temp, sizeof(temp)-1, "%.16g", o->via.f64);
-            }
-            ret = try_to_write(buf, off, left, temp, i);
-        }
-        break;
+        len = json_format_double(tmp, sizeof(tmp), o->via.f64);
+        return json_buf_cat(jb, tmp, len);
 
     case MSGPACK_OBJECT_STR:
-        if (try_to_write(buf, off, left, "\"", 1) &&
-            (o->via.str.size > 0 ?
-             try_to_write_str(buf, off, left, o->via.str.ptr, o->via.str.size)
-             : 1/* nothing to do */) &&
-            try_to_write(buf, off, left, "\"", 1)) {
-            ret = FLB_TRUE;
-        }
-        break;
+        return json_buf_str(jb, o->via.str.ptr, o->via.str.size);
 
     case MSGPACK_OBJECT_BIN:
-        if (try_to_write(buf, off, left, "\"", 1) &&
-            (o->via.bin.size > 0 ?
-             try_to_write_str(buf, off, left, o->via.bin.ptr, o->via.bin.size)
-              : 1 /* nothing to do */) &&
-            try_to_write(buf, off, left, "\"", 1)) {
-            ret = FLB_TRUE;
-        }
-        break;
+        return json_buf_str(jb, o->via.bin.ptr, o->via.bin.size);
 
     case MSGPACK_OBJECT_EXT:
-        if (!try_to_write(buf, off, left, "\"", 1)) {
-            goto msg2json_end;
-        }
         /* ext body. fortmat is similar to printf(1) */
-        {
-            char temp[32] = {0};
-            int  len;
-            loop = o->via.ext.size;
-            for(i=0; i<loop; i++) {
-                len = snprintf(temp, sizeof(temp)-1, "\\x%02x", (char)o->via.ext.ptr[i]);
-                if (!try_to_write(buf, off, left, temp, len)) {
-                    goto msg2json_end;
-                }
-            }
+        if (json_buf_cat(jb, "\"", 1) != 0) {
+            return -1;
         }
-        if (!try_to_write(buf, off, left, "\"", 1)) {
-            goto msg2json_end;
+        for (i = 0; i < o->via.ext.size; i++) {
+            len = snprintf(tmp, sizeof(tmp) - 1, "\\x%02x",
+                           (char) o->via.ext.ptr[i]);
+            if (json_buf_cat(jb, tmp, len) != 0) {
+                return -1;
+            }
         }
-        ret = FLB_TRUE;
-        break;
+        return json_buf_cat(jb, "\"", 1);
 
     case MSGPACK_OBJECT_ARRAY:
-        loop = o->via.array.size;
-
-        if (!try_to_write(buf, off, left, "[", 1)) {
-            goto msg2json_end;
+        if (json_buf_cat(jb, "[", 1) != 0) {
+            return -1;
         }
-        if (loop != 0) {
-            msgpack_object* p = o->via.array.ptr;
-            if (!msgpack2json(buf, off, left, p)) {
-                goto msg2json_end;
+        for (i = 0; i < o->via.array.size; i++) {
+            if (i > 0 && json_buf_cat(jb, ",", 1) != 0) {
+                return -1;
             }
-            for (i=1; i<loop; i++) {
-                if (!try_to_write(buf, off, left, ",", 1) ||
-                    !msgpack2json(buf, off, left, p+i)) {
-                    goto msg2json_end;
-                }
+            if (json_buf_object(jb, o->via.array.ptr + i) != 0) {
+                return -1;
             }
         }
-
-        ret = try_to_write(buf, off, left, "]", 1);
-        break;
+        return json_buf_cat(jb, "]", 1);
 
     case MSGPACK_OBJECT_MAP:
-        loop = o->via.map.size;
-        if (!try_to_write(buf, off, left, "{", 1)) {
-            goto msg2json_end;
-        }
-        if (loop != 0) {
-            msgpack_object k;
-            msgpack_object_kv *p = o->via.map.ptr;
-
-            packed = 0;
-            dup = FLB_FALSE;
-
-            k = o->via.map.ptr[0].key;
-            for (i = 0; i < loop; i++) {
-                k = o->via.map.ptr[i].key;
-                dup = key_exists_in_map(k, *o, i + 1);
-                if (dup == FLB_TRUE) {
-                    continue;
-                }
-
-                if (packed > 0) {
-                    if (!try_to_write(buf, off, left, ",", 1)) {
-                        goto msg2json_end;
-                    }
-                }
-
-                if (
-                    !msgpack2json(buf, off, left, &(p+i)->key) ||
-                    !try_to_write(buf, off, left, ":", 1)  ||
-                    !msgpack2json(buf, off, left, &(p+i)->val) ) {
-                    goto msg2json_end;
-                }
-                packed++;
-            }
+        if (json_buf_cat(jb, "{", 1) != 0 ||
+            json_buf_map_entries(jb, o, 0) != 0) {
+            return -1;
         }
-
-        ret = try_to_write(buf, off, left, "}", 1);
-        break;
+        return json_buf_cat(jb, "}", 1);
 
     default:
         flb_warn("[%s] unknown msgpack type %i", __FUNCTION__, o->type);
     }
 
- msg2json_end:
+    return -1;
+}
+
+static inline void json_buf_sds_init(struct json_buf *jb, flb_sds_t s)
+{
+    jb->mode = JSON_BUF_SDS;
+    jb->data = s;
+    jb->len = flb_sds_len(s);
+    jb->size = flb_sds_alloc(s);
+}
+
+/* Set the final length of an sds buffer, returns its (new) address */
+static inline flb_sds_t json_buf_sds_done(struct json_buf *jb)
+{
+    jb->data[jb->len] = '\0';
+    flb_sds_len_set(jb->data, jb->len);
+    return jb->data;
+}
+
+/*
+ * Append the JSON representation of 'obj' to the sds string pointed by 's',
+ * the buffer is expanded as needed so '*s' can change. On error the string
+ * keeps its original content. This is the interface that output plugins
+ * can use to compose request bodies in place.
+ */
+int flb_pack_json_append(flb_sds_t *s, const msgpack_object *obj)
+{
+    int ret;
+    size_t len;
+    struct json_buf jb;
+
+    len = flb_sds_len(*s);
+    json_buf_sds_init(&jb, *s);
+
+    ret = json_buf_object(&jb, obj);
+    if (ret != 0) {
+        jb.len = len;
+    }
+    *s = json_buf_sds_done(&jb);
+
+    return ret;
+}
+
+/* Append 'str' as a quoted and escaped JSON string */
+int flb_pack_json_append_str(flb_sds_t *s, const char *str, size_t len)
+{
+    int ret;
+    size_t prev;
+    struct json_buf jb;
+
+    prev = flb_sds_len(*s);
+    json_buf_sds_init(&jb, *s);
+
+    ret = json_buf_str(&jb, str, len);
+    if (ret != 0) {
+        jb.len = prev;
+    }
+    *s = json_buf_sds_done(&jb);
+
     return ret;
 }
 
@@ -668,35 +1316,42 @@ static int msgpack2json(char *buf, int *off, size_t left,
  *  @param  json_str  The buffer to fill JSON string.
  *  @param  json_size The size of json_str.
  *  @param  data      The msgpack_unpacked data.
- *  @return success   ? a number characters filled : negative value
+ *  @return success   ? a number characters filled : 0 if the buffer is
+ *                    too small, negative value on invalid arguments
  */
 int flb_msgpack_to_json(char *json_str, size_t json_size,
                         const msgpack_object *obj)
 {
-    int ret = -1;
-    int off = 0;
+    int ret;
+    struct json_buf jb;
 
-    if (json_str == NULL || obj == NULL) {
+    if (json_str == NULL || obj == NULL || json_size == 0) {
         return -1;
     }
 
-    ret = msgpack2json(json_str, &off, json_size - 1, obj);
-    json_str[off] = '\0';
-    return ret ? off: ret;
+    jb.mode = JSON_BUF_FIXED;
+    jb.data = json_str;
+    jb.len = 0;
+    jb.size = json_size - 1;
+
+    ret = json_buf_object(&jb, obj);
+    if (ret != 0) {
+        json_str[0] = '\0';
+        return 0;
+    }
+    json_str[jb.len] = '\0';
+
+    return jb.len;
 }
 
 flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size)
 {
     int ret;
     size_t off = 0;
-    size_t out_size;
     msgpack_unpacked result;
-    msgpack_object *root;
     flb_sds_t out_buf;
-    flb_sds_t tmp_buf;
 
-    out_size = in_size * 3 / 2;
-    out_buf = flb_sds_create_size(out_size);
+    out_buf = flb_sds_create_size(in_size * 3 / 2);
     if (!out_buf) {
         flb_errno();
         return NULL;
@@ -710,29 +1365,12 @@ flb_sds_t flb_msgpack_raw_to_json_sds(const void *in_buf, size_t in_size)
         return NULL;
     }
 
-    root = &result.data;
-    while (1) {
-        ret = flb_msgpack_to_json(out_buf, out_size, root);
-        if (ret <= 0) {
-            tmp_buf = flb_sds_increase(out_buf, 256);
-            if (tmp_buf) {
-                out_buf = tmp_buf;
-                out_size += 256;
-            }
-            else {
-                flb_errno();
-                flb_sds_destroy(out_buf);
-                msgpack_unpacked_destroy(&result);
-                return NULL;
-            }
-        }
-        else {
-            break;
-        }
-    }
-
+    ret = flb_pack_json_append(&out_buf, &result.data);
     msgpack_unpacked_destroy(&result);
-    flb_sds_len_set(out_buf, ret);
+    if (ret != 0 || flb_sds_len(out_buf) == 0) {
+        flb_sds_destroy(out_buf);
+        return NULL;
+    }
 
     return out_buf;
 }
@@ -781,64 +1419,58 @@ flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
                                           int json_format, int date_format,
                                           flb_sds_t date_key)
 {
-    int i;
     int len;
-    int ok = MSGPACK_UNPACK_SUCCESS;
+    int ret = 0;
+    int packed;
     int records = 0;
-    int map_size;
     size_t off = 0;
-    char time_formatted[32];
+    char time_formatted[64];
     size_t s;
-    flb_sds_t out_tmp;
-    flb_sds_t out_js;
-    flb_sds_t out_buf = NULL;
+    flb_sds_t out_buf;
     msgpack_unpacked result;
     msgpack_object root;
     msgpack_object map;
-    msgpack_sbuffer tmp_sbuf;
-    msgpack_packer tmp_pck;
     msgpack_object *obj;
-    msgpack_object *k;
-    msgpack_object *v;
+    msgpack_object date_obj;
+    struct json_buf jb;
     struct tm tm;
     struct flb_time tms;
 
-    /* Iterate the original buffer and perform adjustments */
-    records = flb_mp_count(data, bytes);
-    if (records <= 0) {
+    out_buf = flb_sds_create_size(bytes + bytes / 2);
+    if (!out_buf) {
+        flb_errno();
         return NULL;
     }
+    json_buf_sds_init(&jb, out_buf);
 
-    /* For json lines and streams mode we need a pre-allocated buffer */
-    if (json_format == FLB_PACK_JSON_FORMAT_LINES ||
-        json_format == FLB_PACK_JSON_FORMAT_STREAM) {
-        out_buf = flb_sds_create_size(bytes + bytes / 4);
-        if (!out_buf) {
-            flb_errno();
-            return NULL;
-        }
+    if (date_key != NULL) {
+        date_obj.type = MSGPACK_OBJECT_STR;
+        date_obj.via.str.ptr = date_key;
+        date_obj.via.str.size = flb_sds_len(date_key);
     }
 
-    /* Create temporary msgpack buffer */
-    msgpack_sbuffer_init(&tmp_sbuf);
-    msgpack_packer_init(&tmp_pck, &tmp_sbuf, msgpack_sbuffer_write);
-
     /*
-     * If the format is the original msgpack style of one big array,
-     * registrate the array, otherwise is not necessary. FYI, original format:
+     * Records are encoded straight into the output buffer:
+     *
+     * FLB_PACK_JSON_FORMAT_JSON : one big array, [{R1},{R2},{RN}]
+     * FLB_PACK_JSON_FORMAT_LINES: add  breakline (\n) after each record
+     *
+     *     {'ts':abc,'k1':1}
+     *     {'ts':abc,'k1':2}
+     *     {N}
      *
-     * [
-     *   [timestamp, map],
-     *   [timestamp, map],
-     *   [T, M]...
-     * ]
+     * FLB_PACK_JSON_FORMAT_STREAM: no separators, e.g:
+     *
+     *     {'ts':abc,'k1':1}{'ts':abc,'k1':2}{N}
      */
     if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-        msgpack_pack_array(&tmp_pck, records);
+        ret = json_buf_cat(&jb, "[", 1);
     }
 
     msgpack_unpacked_init(&result);
-    while (msgpack_unpack_next(&result, data, bytes, &off) == ok) {
+    while (ret == 0 &&
+           msgpack_unpack_next(&result, data, bytes, &off) ==
+           MSGPACK_UNPACK_SUCCESS) {
         /* Each array must have two entries: time and record */
         root = result.data;
         if (root.type != MSGPACK_OBJECT_ARRAY) {
@@ -856,24 +1488,35 @@ flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
         if (map.type != MSGPACK_OBJECT_MAP) {
             continue;
         }
-        map_size = map.via.map.size;
 
-        if (date_key != NULL) {
-            msgpack_pack_map(&tmp_pck, map_size + 1);
+        if (records > 0 && json_format == FLB_PACK_JSON_FORMAT_JSON) {
+            ret = json_buf_cat(&jb, ",", 1);
         }
-        else {
-            msgpack_pack_map(&tmp_pck, map_size);
+        if (ret == 0) {
+            ret = json_buf_cat(&jb, "{", 1);
+        }
+        if (ret != 0) {
+            break;
         }
 
-        if (date_key != NULL) {
-            /* Append date key */
-            msgpack_pack_str(&tmp_pck, flb_sds_len(date_key));
-            msgpack_pack_str_body(&tmp_pck, date_key, flb_sds_len(date_key));
+        /* Prepend the date key, unless the record overrides it */
+        packed = 0;
+        if (date_key != NULL &&
+            key_exists_in_map(date_obj, map, 0) == FLB_FALSE) {
+            ret = json_buf_object(&jb, &date_obj);
+            if (ret == 0) {
+                ret = json_buf_cat(&jb, ":", 1);
+            }
+            if (ret != 0) {
+                break;
+            }
 
-            /* Append date value */
             switch (date_format) {
             case FLB_PACK_JSON_DATE_DOUBLE:
-                msgpack_pack_double(&tmp_pck, flb_time_to_double(&tms));
+                len = json_format_double(time_formatted,
+                                         sizeof(time_formatted),
+                                         flb_time_to_double(&tms));
+                ret = json_buf_cat(&jb, time_formatted, len);
                 break;
             case FLB_PACK_JSON_DATE_ISO8601:
             /* Format the time, use microsecond precision not nanoseconds */
@@ -886,112 +1529,39 @@ flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
                                ".%06" PRIu64 "Z",
                                (uint64_t) tms.tm.tv_nsec / 1000);
                 s += len;
-                msgpack_pack_str(&tmp_pck, s);
-                msgpack_pack_str_body(&tmp_pck, time_formatted, s);
+                ret = json_buf_str(&jb, time_formatted, s);
                 break;
             case FLB_PACK_JSON_DATE_EPOCH:
-                msgpack_pack_uint64(&tmp_pck, (long long unsigned)(tms.tm.tv_sec));
+                len = json_format_u64(time_formatted,
+                                      (uint64_t) tms.tm.tv_sec);
+                ret = json_buf_cat(&jb, time_formatted, len);
                 break;
             }
+            packed++;
         }
 
         /* Append remaining keys/values */
-        for (i = 0; i < map_size; i++) {
-            k = &map.via.map.ptr[i].key;
-            v = &map.via.map.ptr[i].val;
-            msgpack_pack_object(&tmp_pck, *k);
-            msgpack_pack_object(&tmp_pck, *v);
-        }
-
-        /*
-         * If the format is the original msgpack style, just continue since
-         * we don't care about separator or JSON convertion at this point.
-         */
-        if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-            continue;
+        if (ret == 0) {
+            ret = json_buf_map_entries(&jb, &map, packed);
         }
-
-        /*
-         * Here we handle two types of records concatenation:
-         *
-         * FLB_PACK_JSON_FORMAT_LINES: add  breakline (\n) after each record
-         *
-         *
-         *     {'ts':abc,'k1':1}
-         *     {'ts':abc,'k1':2}
-         *     {N}
-         *
-         * FLB_PACK_JSON_FORMAT_STREAM: no separators, e.g:
-         *
-         *     {'ts':abc,'k1':1}{'ts':abc,'k1':2}{N}
-         */
-        if (json_format == FLB_PACK_JSON_FORMAT_LINES ||
-            json_format == FLB_PACK_JSON_FORMAT_STREAM) {
-
-            /* Encode current record into JSON in a temporary variable */
-            out_js = flb_msgpack_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
-            if (!out_js) {
-                flb_sds_destroy(out_buf);
-                msgpack_sbuffer_destroy(&tmp_sbuf);
-                msgpack_unpacked_destroy(&result);
-                return NULL;
-            }
-
-            /*
-             * One map record has been converted, now append it to the
-             * outgoing out_buf sds variable.
-             */
-            out_tmp = flb_sds_cat(out_buf, out_js, flb_sds_len(out_js));
-            if (!out_tmp) {
-                flb_sds_destroy(out_js);
-                flb_sds_destroy(out_buf);
-                msgpack_sbuffer_destroy(&tmp_sbuf);
-                msgpack_unpacked_destroy(&result);
-                return NULL;
-            }
-
-            /* Release temporary json sds buffer */
-            flb_sds_destroy(out_js);
-
-            /* If a realloc happened, check the returned address */
-            if (out_tmp != out_buf) {
-                out_buf = out_tmp;
-            }
-
-            /* Append the breakline only for json lines mode */
-            if (json_format == FLB_PACK_JSON_FORMAT_LINES) {
-                out_tmp = flb_sds_cat(out_buf, "\n", 1);
-                if (!out_tmp) {
-                    flb_sds_destroy(out_buf);
-                    msgpack_sbuffer_destroy(&tmp_sbuf);
-                    msgpack_unpacked_destroy(&result);
-                    return NULL;
-                }
-                if (out_tmp != out_buf) {
-                    out_buf = out_tmp;
-                }
-            }
-            msgpack_sbuffer_clear(&tmp_sbuf);
+        if (ret == 0) {
+            ret = json_buf_cat(&jb, "}", 1);
         }
+        if (ret == 0 && json_format == FLB_PACK_JSON_FORMAT_LINES) {
+            ret = json_buf_cat(&jb, "\n", 1);
+        }
+        records++;
     }
 
     /* Release the unpacker */
     msgpack_unpacked_destroy(&result);
 
-    /* Format to JSON */
-    if (json_format == FLB_PACK_JSON_FORMAT_JSON) {
-        out_buf = flb_msgpack_raw_to_json_sds(tmp_sbuf.data, tmp_sbuf.size);
-        msgpack_sbuffer_destroy(&tmp_sbuf);
-
-        if (!out_buf) {
-            return NULL;
-        }
-    }
-    else {
-        msgpack_sbuffer_destroy(&tmp_sbuf);
+    if (ret == 0 && json_format == FLB_PACK_JSON_FORMAT_JSON) {
+        ret = json_buf_cat(&jb, "]", 1);
     }
 
-    if (out_buf && flb_sds_len(out_buf) == 0) {
+    out_buf = json_buf_sds_done(&jb);
+    if (ret != 0 || records == 0) {
         flb_sds_destroy(out_buf);
         return NULL;
     }
@@ -1009,8 +1579,7 @@ flb_sds_t flb_pack_msgpack_to_json_format(const char *data, uint64_t bytes,
 char *flb_msgpack_to_json_str(size_t size, const msgpack_object *obj)
 {
     int ret;
-    char *buf = NULL;
-    char *tmp;
+    struct json_buf jb;
 
     if (obj == NULL) {
         return NULL;
@@ -1020,33 +1589,23 @@ char *flb_msgpack_to_json_str(size_t size, const msgpack_object *obj)
         size = 128;
     }
 
-    buf = flb_malloc(size);
-    if (!buf) {
+    jb.mode = JSON_BUF_HEAP;
+    jb.len = 0;
+    jb.size = size - 1;
+    jb.data = flb_malloc(size);
+    if (!jb.data) {
         flb_errno();
         return NULL;
     }
 
-    while (1) {
-        ret = flb_msgpack_to_json(buf, size, obj);
-        if (ret <= 0) {
-            /* buffer is small. retry.*/
-            size += 128;
-            tmp = flb_realloc(buf, size);
-            if (tmp) {
-                buf = tmp;
-            }
-            else {
-                flb_free(buf);
-                flb_errno();
-                return NULL;
-            }
-        }
-        else {
-            break;
-        }
+    ret = json_buf_object(&jb, obj);
+    if (ret != 0) {
+        flb_free(jb.data);
+        return NULL;
     }
+    jb.data[jb.len] = '\0';
 
-    return buf;
+    return jb.data;
 }
 
 int flb_pack_time_now(msgpack_packer *pck)
@@ -27,6 +27,9 @@
 #include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_config.h>
 #include <fluent-bit/flb_router.h>
+#include <fluent-bit/flb_routes_mask.h>
+#include <fluent-bit/flb_filter.h>
+#include <fluent-bit/flb_hash.h>
 
 #ifdef FLB_HAVE_REGEX
 #include <onigmo.h>
@@ -34,14 +37,25 @@
 
 #include <string.h>
 
-/* wildcard support */
-/* tag and match should be null terminated. */
+/* Size of a cache value: filters mask followed by the routes mask */
+#define router_cache_value_size(config)                                 \
+    (sizeof(uint64_t) * FLB_ROUTER_FILTERS_MASK_ELEMENTS +              \
+     flb_routes_mask_bytes(config))
+
+/*
+ * Wildcard support: 'tag' does not need to be NULL terminated, only the
+ * first 'tag_len' bytes are considered. The 'match' pattern must be NULL
+ * terminated. The algorithm is iterative: when a mismatch is found after
+ * a '*', it backtracks to the last star position consuming one more byte
+ * of the tag, so no recursion or memory allocation is required.
+ */
 static inline int router_match(const char *tag, int tag_len,
                                const char *match,
                                void *match_r)
 {
-    int ret = FLB_FALSE;
-    char *pos = NULL;
+    const char *end = tag + tag_len;
+    const char *star_match = NULL;
+    const char *star_tag = NULL;
 
 #ifdef FLB_HAVE_REGEX
     struct flb_regex *match_regex = match_r;
@@ -60,69 +74,205 @@ static inline int router_match(const char *tag, int tag_len,
     (void) match_r;
 #endif
 
-    while (match) {
+    if (!match) {
+        return FLB_FALSE;
+    }
+
+    while (tag < end) {
         if (*match == '*') {
             while (*++match == '*'){
                 /* skip successive '*' */
             }
             if (*match == '\0') {
                 /*  '*' is last of string */
-                ret = 1;
-                break;
-            }
-
-            while ((pos = strchr(tag, (int) *match))) {
-#ifndef FLB_HAVE_REGEX
-                if (router_match(pos, tag_len, match, NULL)) {
-#else
-                /* We don't need to pass the regex recursively,
-                 * we matched in order above
-                 */
-                if (router_match(pos, tag_len, match, NULL)) {
-#endif
-                    ret = 1;
-                    break;
-                }
-                tag = pos+1;
+                return FLB_TRUE;
             }
-            break;
+            star_match = match;
+            star_tag = tag;
         }
-        else if (*tag != *match) {
-            /* mismatch! */
-            break;
+        else if (*match != '\0' && *match == *tag) {
+            tag++;
+            match++;
         }
-        else if (*tag == '\0') {
-            /* end of tag. so matched! */
-            ret = 1;
-            break;
+        else if (star_match) {
+            /* mismatch after a star: let the star consume one more byte */
+            match = star_match;
+            tag = ++star_tag;
         }
-        tag++;
+        else {
+            /* mismatch! */
+            return FLB_FALSE;
+        }
+    }
+
+    /* end of tag, only trailing stars can remain in the pattern */
+    while (*match == '*') {
         match++;
     }
 
-    return ret;
+    return (*match == '\0');
 }
 
 int flb_router_match(const char *tag, int tag_len, const char *match,
                      void *match_regex)
 {
-    int ret;
-    flb_sds_t t;
+    return router_match(tag, tag_len, match, match_regex);
+}
 
-    if (tag[tag_len] != '\0') {
-        t = flb_sds_create_len(tag, tag_len);
-        if (!t) {
-            return FLB_FALSE;
+/*
+ * Calculate the routing information for a Tag by matching every output and
+ * filter. The result is written in the cache value layout: the filters mask
+ * followed by the routes mask.
+ */
+static void router_cache_value_set(struct flb_config *config,
+                                   const char *tag, int tag_len,
+                                   uint64_t *value)
+{
+    uint64_t *filters_mask;
+    uint64_t *routes_mask;
+    struct mk_list *head;
+    struct flb_output_instance *o_ins;
+    struct flb_filter_instance *f_ins;
+
+    filters_mask = value;
+    routes_mask = value + FLB_ROUTER_FILTERS_MASK_ELEMENTS;
+    memset(value, 0, router_cache_value_size(config));
+
+    mk_list_foreach(head, &config->outputs) {
+        o_ins = mk_list_entry(head, struct flb_output_instance, _head);
+        if (router_match(tag, tag_len, o_ins->match
+#ifdef FLB_HAVE_REGEX
+                         , o_ins->match_regex
+#else
+                         , NULL
+#endif
+                         )) {
+            flb_routes_mask_set_bit(routes_mask, o_ins->id, config);
         }
+    }
 
-        ret = router_match(t, tag_len, match, match_regex);
-        flb_sds_destroy(t);
+    mk_list_foreach(head, &config->filters) {
+        f_ins = mk_list_entry(head, struct flb_filter_instance, _head);
+        if (f_ins->id < 0 || f_ins->id >= FLB_ROUTER_FILTERS_MASK_MAX_VALUE) {
+            continue;
+        }
+        if (router_match(tag, tag_len, f_ins->match
+#ifdef FLB_HAVE_REGEX
+                         , f_ins->match_regex
+#else
+                         , NULL
+#endif
+                         )) {
+            filters_mask[f_ins->id / FLB_ROUTES_MASK_ELEMENT_BITS] |=
+                1ULL << (f_ins->id % FLB_ROUTES_MASK_ELEMENT_BITS);
+        }
+    }
+}
+
+/*
+ * Create the routing cache. It must be invoked once every input, filter and
+ * output instance has been initialized since the cached results depends on
+ * the final set of instances and their match rules.
+ */
+int flb_router_cache_create(struct flb_config *config)
+{
+    struct flb_hash *ht;
+
+    if (config->router_cache) {
+        flb_hash_destroy(config->router_cache);
+    }
+
+    ht = flb_hash_create(FLB_HASH_EVICT_LRU,
+                         FLB_ROUTER_CACHE_SIZE,
+                         FLB_ROUTER_CACHE_ENTRIES);
+    if (!ht) {
+        config->router_cache = NULL;
+        return -1;
+    }
+    config->router_cache = ht;
+
+    return 0;
+}
+
+void flb_router_cache_destroy(struct flb_config *config)
+{
+    if (config->router_cache) {
+        flb_hash_destroy(config->router_cache);
+        config->router_cache = NULL;
+    }
+}
+
+/*
+ * Lookup the routing information for a Tag, on a cache miss it's calculated
+ * and stored. The result is copied into 'entry' since further cache
+ * insertions (e.g: a filter ingesting records with a new Tag) might evict the
+ * cached entry. Returns -1 if the cache is not available, on that case the
+ * caller must perform the matching by itself.
+ */
+int flb_router_cache_get(struct flb_config *config,
+                         const char *tag, int tag_len,
+                         struct flb_router_cache_entry *entry)
+{
+    int ret;
+    int heap = FLB_FALSE;
+    size_t size;
+    size_t value_size;
+    void *val;
+    uint64_t *value;
+    uint64_t tmp[FLB_ROUTER_FILTERS_MASK_ELEMENTS + 8];
+
+    if (!config->router_cache) {
+        return -1;
+    }
+
+    value_size = router_cache_value_size(config);
+    ret = flb_hash_get(config->router_cache, tag, tag_len, &val, &size);
+    if (ret >= 0 && size == value_size) {
+        value = val;
     }
     else {
-        ret = router_match(tag, tag_len, match, match_regex);
+        /* small configurations use the stack, larger ones the heap */
+        if (value_size <= sizeof(tmp)) {
+            value = tmp;
+        }
+        else {
+            value = flb_malloc(value_size);
+            if (!value) {
+                flb_errno();
+                return -1;
+            }
+            heap = FLB_TRUE;
+        }
+
+        router_cache_value_set(config, tag, tag_len, value);
+        if (tag_len > 0) {
+            flb_hash_add(config->router_cache, tag, tag_len,
+                         value, value_size);
+        }
     }
 
-    return ret;
+    memcpy(entry->filters_mask, value, sizeof(entry->filters_mask));
+    if (entry->routes_mask) {
+        memcpy(entry->routes_mask, value + FLB_ROUTER_FILTERS_MASK_ELEMENTS,
+               flb_routes_mask_bytes(config));
+    }
+
+    if (heap == FLB_TRUE) {
+        flb_free(value);
+    }
+
+    return 0;
+}
+
+static void router_cache_init(struct flb_config *config)
+{
+    int ret;
+
+    ret = flb_router_cache_create(config);
+    if (ret == -1) {
+        flb_warn("[router] could not create routing cache, tags will be "
+                 "matched on every record append");
+    }
 }
 
 /* Associate and input and output instances due to a previous match */
@@ -182,6 +332,7 @@ int flb_router_io_set(struct flb_config *config)
                       i_ins->name, o_ins->name);
             o_ins->match = flb_sds_create_len("*", 1);
             flb_router_connect(i_ins, o_ins);
+            router_cache_init(config);
             return 0;
         }
     }
@@ -248,6 +399,8 @@ int flb_router_io_set(struct flb_config *config)
         }
     }
 
+    /* Match rules are final now, start caching the routes per Tag */
+    router_cache_init(config);
     return 0;
 }
 
@@ -260,6 +413,8 @@ void flb_router_exit(struct flb_config *config)
     struct flb_input_instance *in;
     struct flb_router_path *r;
 
+    flb_router_cache_destroy(config);
+
     /* Iterate input plugins */
     mk_list_foreach_safe(head, tmp, &config->inputs) {
         in = mk_list_entry(head, struct flb_input_instance, _head);
@@ -25,6 +25,20 @@
 #include <fluent-bit/flb_routes_mask.h>
 
 
+/*
+ * Adjust the size of the routes mask so it can represent the output id
+ * 'max_id', the size never shrinks.
+ */
+void flb_routes_mask_set_size(struct flb_config *config, int max_id)
+{
+    int size;
+
+    size = FLB_ROUTES_MASK_ELEMENTS(max_id + 1);
+    if (size > config->route_mask_size) {
+        config->route_mask_size = size;
+    }
+}
+
 /*
  * Set the routes_mask for input chunk with a router_match on tag, return a
  * non-zero value if any routes matched
@@ -34,15 +48,25 @@ int flb_routes_mask_set_by_tag(uint64_t *routes_mask,
                                int tag_len,
                                struct flb_input_instance *in)
 {
+    int ret;
     int has_routes = 0;
     struct mk_list *o_head;
     struct flb_output_instance *o_ins;
+    struct flb_router_cache_entry entry;
+
     if (!in) {
         return 0;
     }
 
+    /* Use the precomputed routes for the Tag if available */
+    entry.routes_mask = routes_mask;
+    ret = flb_router_cache_get(in->config, tag, tag_len, &entry);
+    if (ret == 0) {
+        return !flb_routes_mask_is_empty(routes_mask, in->config);
+    }
+
     /* Clear the bit field */
-    memset(routes_mask, 0, sizeof(uint64_t) * FLB_ROUTES_MASK_ELEMENTS);
+    memset(routes_mask, 0, flb_routes_mask_bytes(in->config));
 
     /* Find all matching routes for the given tag */
     mk_list_foreach(o_head, &in->config->outputs) {
@@ -56,7 +80,7 @@ int flb_routes_mask_set_by_tag(uint64_t *routes_mask,
                              , NULL
 #endif
                              )) {
-            flb_routes_mask_set_bit(routes_mask, o_ins->id);
+            flb_routes_mask_set_bit(routes_mask, o_ins->id, in->config);
             has_routes = 1;
         }
     }
@@ -71,18 +95,19 @@ int flb_routes_mask_set_by_tag(uint64_t *routes_mask,
  * 4th bit in the 2nd value of the bitfield array.
  *
  */
-void flb_routes_mask_set_bit(uint64_t *routes_mask, int value)
+void flb_routes_mask_set_bit(uint64_t *routes_mask, int value,
+                             struct flb_config *config)
 {
     int index;
     uint64_t bit;
 
-    if (value < 0 || value > FLB_ROUTES_MASK_MAX_VALUE) {
+    index = value / FLB_ROUTES_MASK_ELEMENT_BITS;
+    if (value < 0 || index >= config->route_mask_size) {
         flb_warn("[routes_mask] Can't set bit (%d) past limits of bitfield",
                  value);
         return;
     }
 
-    index = value / FLB_ROUTES_MASK_ELEMENT_BITS;
     bit = 1ULL << (value % FLB_ROUTES_MASK_ELEMENT_BITS);
     routes_mask[index] |= bit;
 }
@@ -94,18 +119,19 @@ void flb_routes_mask_set_bit(uint64_t *routes_mask, int value)
  * 4th bit in the 2nd value of the bitfield array.
  *
  */
-void flb_routes_mask_clear_bit(uint64_t *routes_mask, int value)
+void flb_routes_mask_clear_bit(uint64_t *routes_mask, int value,
+                               struct flb_config *config)
 {
     int index;
     uint64_t bit;
 
-    if (value < 0 || value > FLB_ROUTES_MASK_MAX_VALUE) {
+    index = value / FLB_ROUTES_MASK_ELEMENT_BITS;
+    if (value < 0 || index >= config->route_mask_size) {
         flb_warn("[routes_mask] Can't set bit (%d) past limits of bitfield",
                  value);
         return;
     }
 
-    index = value / FLB_ROUTES_MASK_ELEMENT_BITS;
     bit = 1ULL << (value % FLB_ROUTES_MASK_ELEMENT_BITS);
     routes_mask[index] &= ~(bit);
 }
@@ -118,27 +144,35 @@ void flb_routes_mask_clear_bit(uint64_t *routes_mask, int value)
  * if the 4th bit in the 2nd value of the bitfield array is set.
  *
  */
-int flb_routes_mask_get_bit(uint64_t *routes_mask, int value)
+int flb_routes_mask_get_bit(uint64_t *routes_mask, int value,
+                            struct flb_config *config)
 {
     int index;
     uint64_t bit;
 
-    if (value < 0 || value > FLB_ROUTES_MASK_MAX_VALUE) {
+    index = value / FLB_ROUTES_MASK_ELEMENT_BITS;
+    if (value < 0 || index >= config->route_mask_size) {
         flb_warn("[routes_mask] Can't get bit (%d) past limits of bitfield",
                  value);
         return 0;
     }
 
-    index = value / FLB_ROUTES_MASK_ELEMENT_BITS;
     bit = 1ULL << (value % FLB_ROUTES_MASK_ELEMENT_BITS);
     return (routes_mask[index] & bit) != 0ULL;
 }
 
-int flb_routes_mask_is_empty(uint64_t *routes_mask)
+/*
+ * The checks below walks the mask one 64-bit element at a time with no
+ * branches in the loop body, so the compiler can vectorize them.
+ */
+int flb_routes_mask_is_empty(uint64_t *routes_mask, struct flb_config *config)
 {
-    uint64_t empty[FLB_ROUTES_MASK_ELEMENTS];
+    int i;
+    uint64_t bits = 0;
+
+    for (i = 0; i < config->route_mask_size; i++) {
+        bits |= routes_mask[i];
+    }
 
-    /* Clear the tmp bitfield */
-    memset(empty, 0, sizeof(empty));
-    return memcmp(routes_mask, empty, sizeof(empty)) == 0;
+    return bits == 0;
 }
@@ -445,6 +445,35 @@ static flb_sds_t url_params_format(char *params)
     return buf;
 }
 
+/* Format the urlencoded params of a POST payload: body buffer and segments */
+static flb_sds_t body_params_format(struct flb_http_client *c)
+{
+    int i;
+    flb_sds_t tmp;
+    flb_sds_t body;
+    flb_sds_t params;
+
+    body = flb_sds_create_len(c->body_buf, c->body_buf ? c->body_len : 0);
+    if (!body) {
+        return NULL;
+    }
+
+    for (i = 0; i < c->body_iov_count; i++) {
+        tmp = flb_sds_cat(body, c->body_iov[i].iov_base,
+                          c->body_iov[i].iov_len);
+        if (!tmp) {
+            flb_sds_destroy(body);
+            return NULL;
+        }
+        body = tmp;
+    }
+
+    params = url_params_format(body);
+    flb_sds_destroy(body);
+
+    return params;
+}
+
 /*
  * Given an original list of kv headers with 'in_list' as the list headed,
  * generate new entries on 'out_list' considering lower case headers key,
@@ -689,11 +718,11 @@ static flb_sds_t flb_signv4_canonical_request(struct flb_http_client *c,
      * If the original HTTP method is POST and we have some urlencoded parameters
      * as payload, we must handle them as we did for the query string.
      */
-    if (c->method == FLB_HTTP_POST && c->body_len > 0) {
+    if (c->method == FLB_HTTP_POST && (c->body_len > 0 || c->body_iov_len > 0)) {
         val = (char *) flb_kv_get_key_value("Content-Type", &c->headers);
         if (val) {
             if (strstr(val, "application/x-www-form-urlencoded")) {
-                params = url_params_format((char *) c->body_buf);
+                params = body_params_format(c);
                 if (!params) {
                     flb_error("[signv4] error processing POST payload params");
                     flb_sds_destroy(cr);
@@ -734,9 +763,18 @@ static flb_sds_t flb_signv4_canonical_request(struct flb_http_client *c,
     } else {
         mbedtls_sha256_init(&sha256_ctx);
         mbedtls_sha256_starts(&sha256_ctx, 0);
-        if (c->body_len > 0 && post_params == FLB_FALSE) {
-            mbedtls_sha256_update(&sha256_ctx, (const unsigned char *) c->body_buf,
-                                  c->body_len);
+        if (post_params == FLB_FALSE) {
+            if (c->body_len > 0) {
+                mbedtls_sha256_update(&sha256_ctx,
+                                      (const unsigned char *) c->body_buf,
+                                      c->body_len);
+            }
+            /* payload segments */
+            for (i = 0; i < c->body_iov_count; i++) {
+                mbedtls_sha256_update(&sha256_ctx,
+                                      (const unsigned char *) c->body_iov[i].iov_base,
+                                      c->body_iov[i].iov_len);
+            }
         }
         mbedtls_sha256_finish(&sha256_ctx, sha256_buf);
 
@@ -21,23 +21,191 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_input.h>
 #include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_engine.h>
 #include <fluent-bit/flb_storage.h>
 #include <fluent-bit/flb_scheduler.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_http_server.h>
 
+#include <fluent-bit/flb_compress.h>
+
+#include <cmetrics/cmt_time.h>
+
+extern int sb_get_progress(struct flb_config *config,
+                           struct flb_storage_backlog *progress);
+
+/* Upper bounds of the group sync latency histogram buckets (microseconds) */
+static uint64_t sync_buckets[FLB_STORAGE_SYNC_BUCKETS] = {
+    100, 500, 1000, 5000, 10000, 50000, 100000, 1000000
+};
+
+static void metrics_append_sync(msgpack_packer *mp_pck,
+                                struct flb_storage_sync *sync)
+{
+    int i;
+    int len;
+    char buf[32];
+    uint64_t count = 0;
+
+    msgpack_pack_str(mp_pck, 4);
+    msgpack_pack_str_body(mp_pck, "sync", 4);
+    msgpack_pack_map(mp_pck, 5);
+
+    /* sync['syncs'] */
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "syncs", 5);
+    msgpack_pack_uint64(mp_pck, sync->syncs);
+
+    /* sync['chunks'] */
+    msgpack_pack_str(mp_pck, 6);
+    msgpack_pack_str_body(mp_pck, "chunks", 6);
+    msgpack_pack_uint64(mp_pck, sync->chunks);
+
+    /* sync['bytes'] */
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "bytes", 5);
+    msgpack_pack_uint64(mp_pck, sync->bytes);
+
+    /* sync['errors'] */
+    msgpack_pack_str(mp_pck, 6);
+    msgpack_pack_str_body(mp_pck, "errors", 6);
+    msgpack_pack_uint64(mp_pck, sync->errors);
+
+    /* sync['latency_us']: cumulative histogram */
+    msgpack_pack_str(mp_pck, 10);
+    msgpack_pack_str_body(mp_pck, "latency_us", 10);
+    msgpack_pack_map(mp_pck, 3);
+
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "count", 5);
+    msgpack_pack_uint64(mp_pck, sync->syncs);
+
+    msgpack_pack_str(mp_pck, 3);
+    msgpack_pack_str_body(mp_pck, "sum", 3);
+    msgpack_pack_uint64(mp_pck, sync->latency_sum);
+
+    msgpack_pack_str(mp_pck, 7);
+    msgpack_pack_str_body(mp_pck, "buckets", 7);
+    msgpack_pack_map(mp_pck, FLB_STORAGE_SYNC_BUCKETS + 1);
+
+    for (i = 0; i <= FLB_STORAGE_SYNC_BUCKETS; i++) {
+        if (i < FLB_STORAGE_SYNC_BUCKETS) {
+            len = snprintf(buf, sizeof(buf) - 1, "%" PRIu64, sync_buckets[i]);
+        }
+        else {
+            len = snprintf(buf, sizeof(buf) - 1, "+Inf");
+        }
+        count += sync->latency[i];
+
+        msgpack_pack_str(mp_pck, len);
+        msgpack_pack_str_body(mp_pck, buf, len);
+        msgpack_pack_uint64(mp_pck, count);
+    }
+}
+
+static void metrics_append_backlog(msgpack_packer *mp_pck,
+                                   struct flb_storage_backlog *bl)
+{
+    msgpack_pack_str(mp_pck, 7);
+    msgpack_pack_str_body(mp_pck, "backlog", 7);
+    msgpack_pack_map(mp_pck, 5);
+
+    /* backlog['chunks_total'] */
+    msgpack_pack_str(mp_pck, 12);
+    msgpack_pack_str_body(mp_pck, "chunks_total", 12);
+    msgpack_pack_uint64(mp_pck, bl->chunks_total);
+
+    /* backlog['chunks_remaining'] */
+    msgpack_pack_str(mp_pck, 16);
+    msgpack_pack_str_body(mp_pck, "chunks_remaining", 16);
+    msgpack_pack_uint64(mp_pck, bl->chunks_remaining);
+
+    /* backlog['bytes_total'] */
+    msgpack_pack_str(mp_pck, 11);
+    msgpack_pack_str_body(mp_pck, "bytes_total", 11);
+    msgpack_pack_uint64(mp_pck, bl->bytes_total);
+
+    /* backlog['bytes_remaining'] */
+    msgpack_pack_str(mp_pck, 15);
+    msgpack_pack_str_body(mp_pck, "bytes_remaining", 15);
+    msgpack_pack_uint64(mp_pck, bl->bytes_remaining);
+
+    /* backlog['eta_seconds'] */
+    msgpack_pack_str(mp_pck, 11);
+    msgpack_pack_str_body(mp_pck, "eta_seconds", 11);
+    msgpack_pack_int64(mp_pck, bl->eta);
+}
+
+static void metrics_append_mem_budget(msgpack_packer *mp_pck,
+                                      struct flb_config *ctx)
+{
+    msgpack_pack_str(mp_pck, 10);
+    msgpack_pack_str_body(mp_pck, "mem_budget", 10);
+    msgpack_pack_map(mp_pck, 4);
+
+    /* mem_budget['limit'] */
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "limit", 5);
+    msgpack_pack_uint64(mp_pck, ctx->storage_mem_budget_size);
+
+    /* mem_budget['usage'] */
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "usage", 5);
+    msgpack_pack_uint64(mp_pck, flb_input_chunk_mem_usage(ctx));
+
+    /* mem_budget['spill'] */
+    msgpack_pack_str(mp_pck, 5);
+    msgpack_pack_str_body(mp_pck, "spill", 5);
+    if (ctx->storage_mem_budget_spill == FLB_TRUE) {
+        msgpack_pack_true(mp_pck);
+    }
+    else {
+        msgpack_pack_false(mp_pck);
+    }
+
+    /* mem_budget['spilled_chunks'] */
+    msgpack_pack_str(mp_pck, 14);
+    msgpack_pack_str_body(mp_pck, "spilled_chunks", 14);
+    msgpack_pack_uint64(mp_pck, ctx->storage_mem_budget_spilled);
+}
+
 static void metrics_append_general(msgpack_packer *mp_pck,
                                    struct flb_config *ctx,
                                    struct flb_storage_metrics *sm)
 {
+    int ret;
+    int entries = 1;
     struct cio_stats storage_st;
+    struct flb_storage_backlog backlog;
 
     /* Retrieve general stats from the storage layer */
     cio_stats_get(ctx->cio, &storage_st);
 
+    /* Backlog replay progress */
+    ret = sb_get_progress(ctx, &backlog);
+    if (ret == 0) {
+        entries++;
+    }
+    if (ctx->storage_sync_ctx) {
+        entries++;
+    }
+    if (ctx->storage_mem_budget_size > 0) {
+        entries++;
+    }
+
     msgpack_pack_str(mp_pck, 13);
     msgpack_pack_str_body(mp_pck, "storage_layer", 13);
-    msgpack_pack_map(mp_pck, 1);
+    msgpack_pack_map(mp_pck, entries);
+
+    if (ctx->storage_sync_ctx) {
+        metrics_append_sync(mp_pck, ctx->storage_sync_ctx);
+    }
+    if (ret == 0) {
+        metrics_append_backlog(mp_pck, &backlog);
+    }
+    if (ctx->storage_mem_budget_size > 0) {
+        metrics_append_mem_budget(mp_pck, ctx);
+    }
 
     /* Chunks */
     msgpack_pack_str(mp_pck, 6);
@@ -115,8 +283,16 @@ static void metrics_append_input(msgpack_packer *mp_pck,
         msgpack_pack_str(mp_pck, 6);
         msgpack_pack_str_body(mp_pck, "status", 6);
 
-        /* 'status' map has 2 keys: overlimit and chunks */
-        msgpack_pack_map(mp_pck, 3);
+        /*
+         * 'status' map has 3 keys: overlimit, mem_size and mem_limit, plus
+         * mem_weight and mem_allotment if a memory budget is set.
+         */
+        if (ctx->storage_mem_budget_size > 0) {
+            msgpack_pack_map(mp_pck, 5);
+        }
+        else {
+            msgpack_pack_map(mp_pck, 3);
+        }
 
         /* status['overlimit'] */
         msgpack_pack_str(mp_pck, 9);
@@ -128,6 +304,9 @@ static void metrics_append_input(msgpack_packer *mp_pck,
                 ret = FLB_TRUE;
             }
         }
+        if (i->mem_buf_status == FLB_INPUT_PAUSED) {
+            ret = FLB_TRUE;
+        }
         if (ret == FLB_TRUE) {
             msgpack_pack_true(mp_pck);
         }
@@ -156,6 +335,23 @@ static void metrics_append_input(msgpack_packer *mp_pck,
         msgpack_pack_str(mp_pck, len);
         msgpack_pack_str_body(mp_pck, buf, len);
 
+        if (ctx->storage_mem_budget_size > 0) {
+            /* status['mem_weight'] */
+            msgpack_pack_str(mp_pck, 10);
+            msgpack_pack_str_body(mp_pck, "mem_weight", 10);
+            msgpack_pack_uint64(mp_pck, i->mem_buf_weight);
+
+            /* status['mem_allotment']: share of the memory budget */
+            msgpack_pack_str(mp_pck, 13);
+            msgpack_pack_str_body(mp_pck, "mem_allotment", 13);
+
+            flb_utils_bytes_to_human_readable_size(flb_input_chunk_mem_allotment(i),
+                                                   buf, sizeof(buf) - 1);
+            len = strlen(buf);
+            msgpack_pack_str(mp_pck, len);
+            msgpack_pack_str_body(mp_pck, buf, len);
+        }
+
         /*
          * Chunks
          * ======
@@ -277,7 +473,79 @@ struct flb_storage_metrics *flb_storage_metrics_create(struct flb_config *ctx)
     return sm;
 }
 
-static int sort_chunk_cmp(const void *a_arg, const void *b_arg)
+/*
+ * Group sync: flush the chunks written since the last sync to disk and
+ * account the latency. Returns the number of chunks synced or -1.
+ */
+int flb_storage_sync(struct flb_config *ctx)
+{
+    int i;
+    int ret;
+    size_t bytes;
+    uint64_t ts;
+    uint64_t latency;
+    struct cio_ctx *cio = ctx->cio;
+    struct flb_storage_sync *sync = ctx->storage_sync_ctx;
+
+    if (!sync || mk_list_is_empty(&cio->dirty) == 0) {
+        return 0;
+    }
+
+    bytes = cio->dirty_bytes;
+    ts = cmt_time_now();
+    ret = cio_sync_dirty(cio);
+    latency = (cmt_time_now() - ts) / 1000;
+
+    if (ret == -1) {
+        sync->errors++;
+        flb_error("[storage] group sync failed");
+    }
+    else {
+        sync->chunks += ret;
+    }
+    sync->syncs++;
+    sync->bytes += bytes;
+    sync->latency_sum += latency;
+
+    for (i = 0; i < FLB_STORAGE_SYNC_BUCKETS; i++) {
+        if (latency <= sync_buckets[i]) {
+            break;
+        }
+    }
+    sync->latency[i]++;
+
+    flb_trace("[storage] group sync chunks=%i bytes=%zu latency=%" PRIu64
+              "us", ret, bytes, latency);
+    return ret;
+}
+
+static void cb_storage_sync(struct flb_config *ctx, void *data)
+{
+    flb_storage_sync(ctx);
+}
+
+/* Start the group sync timer, it requires the scheduler */
+int flb_storage_sync_create(struct flb_config *ctx)
+{
+    int ret;
+
+    if (!ctx->storage_sync_ctx) {
+        return 0;
+    }
+
+    ret = flb_sched_timer_cb_create(ctx->sched, FLB_SCHED_TIMER_CB_PERM,
+                                    ctx->storage_sync_interval,
+                                    cb_storage_sync, NULL, NULL);
+    if (ret == -1) {
+        flb_error("[storage] cannot create timer for group sync");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Sort chunks by age, it compares the creation time found in their names */
+int flb_storage_chunk_cmp(const void *a_arg, const void *b_arg)
 {
     char *p;
     struct cio_chunk *chunk_a = *(struct cio_chunk **) a_arg;
@@ -341,6 +609,9 @@ static void print_storage_info(struct flb_config *ctx, struct cio_ctx *cio)
     if (cio->flags & CIO_FULL_SYNC) {
         sync = "full";
     }
+    else if (cio->flags & CIO_GROUP_SYNC) {
+        sync = "group";
+    }
     else {
         sync = "normal";
     }
@@ -355,6 +626,21 @@ static void print_storage_info(struct flb_config *ctx, struct cio_ctx *cio)
     flb_info("[storage] %s synchronization mode, checksum %s, max_chunks_up=%i",
              sync, checksum, ctx->storage_max_chunks_up);
 
+    if (cio->flags & CIO_INDEX) {
+        flb_info("[storage] chunk index enabled");
+    }
+
+    if (ctx->storage_mem_budget_size > 0) {
+        flb_info("[storage] memory budget %s shared by the inputs, spill %s",
+                 ctx->storage_mem_budget,
+                 ctx->storage_mem_budget_spill ? "enabled" : "disabled");
+    }
+
+    if (ctx->storage_sync_ctx) {
+        flb_info("[storage] group sync every %i ms or %s pending",
+                 ctx->storage_sync_interval, ctx->storage_sync_bytes);
+    }
+
     /* Storage input plugin */
     if (ctx->storage_input_plugin) {
         in = (struct flb_input_instance *) ctx->storage_input_plugin;
@@ -384,6 +670,7 @@ static int log_cb(struct cio_ctx *ctx, int level, const char *file, int line,
 int flb_storage_input_create(struct cio_ctx *cio,
                              struct flb_input_instance *in)
 {
+    int ret;
     struct flb_storage_input *si;
     struct cio_stream *stream;
 
@@ -418,6 +705,25 @@ int flb_storage_input_create(struct cio_ctx *cio,
         return -1;
     }
 
+    /* Compression of chunks that are down */
+    if (in->storage_compress != FLB_COMPRESS_NONE) {
+        ret = cio_stream_set_compression(stream, in->storage_compress);
+        if (ret == -1) {
+            flb_warn("[storage] chunk compression is not available for "
+                     "instance '%s'", flb_input_name(in));
+        }
+    }
+
+    /* Asynchronous file operations, or plain filesystem storage */
+    if (in->storage_async == FLB_TRUE && stream->async == CIO_FALSE) {
+        ret = cio_stream_set_async(stream, CIO_TRUE);
+        if (ret == -1) {
+            flb_warn("[storage] asynchronous file I/O is not available for "
+                     "instance '%s', using synchronous filesystem storage",
+                     flb_input_name(in));
+        }
+    }
+
     si->stream = stream;
     si->cio = cio;
     si->type = in->storage_type;
@@ -442,6 +748,90 @@ void flb_storage_input_destroy(struct flb_input_instance *in)
     in->storage = NULL;
 }
 
+/* Event loop callback: asynchronous file operations completed */
+static int storage_async_handler(void *data)
+{
+    struct mk_event *event = data;
+    struct flb_config *config = event->data;
+
+    cio_async_process(config->cio);
+    return 0;
+}
+
+/*
+ * If an input instance asks for it, set up the asynchronous file operations
+ * of chunkio and get notified of their completions in the event loop. If it
+ * fails the instances use the synchronous filesystem storage.
+ */
+static int storage_async_create(struct flb_config *config)
+{
+    int ret;
+    int fd;
+    struct mk_list *head;
+    struct mk_event *event;
+    struct flb_input_instance *in;
+
+    mk_list_foreach(head, &config->inputs) {
+        in = mk_list_entry(head, struct flb_input_instance, _head);
+        if (in->storage_type == CIO_STORE_FS && in->storage_async == FLB_TRUE) {
+            break;
+        }
+    }
+    if (head == &config->inputs || !config->evl) {
+        return 0;
+    }
+
+    ret = cio_async_create(config->cio, CIO_ASYNC_ENTRIES);
+    if (ret == -1) {
+        return -1;
+    }
+
+    fd = cio_async_fd(config->cio);
+    event = &config->storage_async_event;
+    MK_EVENT_INIT(event, fd, config, storage_async_handler);
+    ret = mk_event_add(config->evl, fd, FLB_ENGINE_EV_CUSTOM,
+                       MK_EVENT_READ, event);
+    if (ret == -1) {
+        flb_error("[storage] could not register async I/O event");
+        cio_async_destroy(config->cio);
+        return -1;
+    }
+    event->type = FLB_ENGINE_EV_CUSTOM;
+
+    flb_info("[storage] asynchronous file I/O enabled (io_uring)");
+    return 0;
+}
+
+static int storage_sync_init(struct flb_config *config)
+{
+    int64_t bytes;
+    struct flb_storage_sync *sync;
+
+    if (config->storage_sync_interval <= 0) {
+        config->storage_sync_interval = FLB_STORAGE_SYNC_INTERVAL;
+    }
+    if (!config->storage_sync_bytes) {
+        config->storage_sync_bytes = flb_strdup(FLB_STORAGE_SYNC_BYTES);
+    }
+
+    bytes = flb_utils_size_to_bytes(config->storage_sync_bytes);
+    if (bytes <= 0) {
+        flb_error("[storage] invalid group sync size '%s'",
+                  config->storage_sync_bytes);
+        return -1;
+    }
+
+    sync = flb_calloc(1, sizeof(struct flb_storage_sync));
+    if (!sync) {
+        flb_errno();
+        return -1;
+    }
+    sync->max_bytes = bytes;
+    config->storage_sync_ctx = sync;
+
+    return 0;
+}
+
 static int storage_contexts_create(struct flb_config *config)
 {
     int c = 0;
@@ -480,6 +870,7 @@ int flb_storage_create(struct flb_config *ctx)
 {
     int ret;
     int flags;
+    int64_t size;
     struct flb_input_instance *in = NULL;
     struct cio_ctx *cio;
 
@@ -494,17 +885,33 @@ int flb_storage_create(struct flb_config *ctx)
         else if (strcasecmp(ctx->storage_sync, "full") == 0) {
             flags |= CIO_FULL_SYNC;
         }
+        else if (strcasecmp(ctx->storage_sync, "group") == 0) {
+            flags |= CIO_GROUP_SYNC;
+        }
         else {
             flb_error("[storage] invalid synchronization mode");
             return -1;
         }
     }
 
+    /* group sync */
+    if (flags & CIO_GROUP_SYNC) {
+        ret = storage_sync_init(ctx);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
     /* checksum */
     if (ctx->storage_checksum == FLB_TRUE) {
         flags |= CIO_CHECKSUM;
     }
 
+    /* index of chunks at rest, restarts do not open every chunk */
+    if (ctx->storage_index == FLB_TRUE) {
+        flags |= CIO_INDEX;
+    }
+
     /* Create chunkio context */
     cio = cio_create(ctx->storage_path, log_cb, CIO_LOG_DEBUG, flags);
     if (!cio) {
@@ -513,12 +920,28 @@ int flb_storage_create(struct flb_config *ctx)
     }
     ctx->cio = cio;
 
+    /* Compressed chunks can be found in the file system at any time */
+    cio_set_compression_callback(cio, flb_compress, flb_uncompress);
+
     /* Set Chunk I/O maximum number of chunks up */
     if (ctx->storage_max_chunks_up == 0) {
         ctx->storage_max_chunks_up = FLB_STORAGE_MAX_CHUNKS_UP;
     }
     cio_set_max_chunks_up(ctx->cio, ctx->storage_max_chunks_up);
 
+    /* Memory budget shared by the input instances */
+    if (ctx->storage_mem_budget) {
+        size = flb_utils_size_to_bytes(ctx->storage_mem_budget);
+        if (size <= 0) {
+            flb_error("[storage] invalid memory budget '%s'",
+                      ctx->storage_mem_budget);
+            cio_destroy(ctx->cio);
+            ctx->cio = NULL;
+            return -1;
+        }
+        ctx->storage_mem_budget_size = size;
+    }
+
     /* Load content from the file system if any */
     ret = cio_load(ctx->cio, NULL);
     if (ret == -1) {
@@ -529,7 +952,7 @@ int flb_storage_create(struct flb_config *ctx)
     }
 
     /* Sort chunks */
-    cio_qsort(ctx->cio, sort_chunk_cmp);
+    cio_qsort(ctx->cio, flb_storage_chunk_cmp);
 
     /*
      * If we have a filesystem storage path, create an instance of the
@@ -550,8 +973,19 @@ int flb_storage_create(struct flb_config *ctx)
         if (!ctx->storage_bl_mem_limit) {
             ctx->storage_bl_mem_limit = flb_strdup(FLB_STORAGE_BL_MEM_LIMIT);
         }
+
+        /* Scan threads and share of the backlog in the data in flight */
+        if (ctx->storage_bl_workers <= 0) {
+            ctx->storage_bl_workers = FLB_STORAGE_BL_WORKERS;
+        }
+        if (ctx->storage_bl_ratio <= 0 || ctx->storage_bl_ratio > 100) {
+            ctx->storage_bl_ratio = FLB_STORAGE_BL_RATIO;
+        }
     }
 
+    /* Asynchronous file operations */
+    storage_async_create(ctx);
+
     /* Create streams for input instances */
     ret = storage_contexts_create(ctx);
     if (ret == -1) {
@@ -580,8 +1014,19 @@ void flb_storage_destroy(struct flb_config *ctx)
         flb_free(ctx->storage_metrics_ctx);
     }
 
+    /* Pending file operations are completed by cio_destroy() */
+    if (cio_async_fd(cio) != -1 && ctx->evl) {
+        mk_event_del(ctx->evl, &ctx->storage_async_event);
+    }
+
+    /* Chunks pending a group sync are synced when closed */
     cio_destroy(cio);
 
+    if (ctx->storage_sync_ctx) {
+        flb_free(ctx->storage_sync_ctx);
+        ctx->storage_sync_ctx = NULL;
+    }
+
     /* Delete references from input instances */
     storage_contexts_destroy(ctx);
     ctx->cio = NULL;
@@ -31,39 +31,35 @@
 #include <fluent-bit/flb_mem.h>
 #include <fluent-bit/flb_str.h>
 #include <fluent-bit/flb_scheduler.h>
+#include <fluent-bit/flb_engine_dispatch.h>
 
 /*
- * Every task created must have an unique ID, this function lookup the
- * lowest number available in the tasks_map.
- *
- * This 'id' is used by the task interface to communicate with the engine event
- * loop about some action.
+ * Soft limit of tasks: once reached, inputs are paused so the pressure of
+ * the pending tasks flows back to the sources. Inputs are resumed when the
+ * number of tasks drops under 3/4 of the limit, so they don't flip on every
+ * task created or destroyed.
  */
-
-static inline int map_get_task_id(struct flb_config *config)
+static inline void task_limit_check(struct flb_config *config)
 {
-    int i;
-    int map_size = (sizeof(config->tasks_map) / sizeof(struct flb_task_map));
+    int limit = config->task_soft_limit;
 
-    for (i = 0; i < map_size; i++) {
-        if (config->tasks_map[i].task == NULL) {
-            return i;
-        }
+    if (limit <= 0) {
+        return;
     }
 
-    return -1;
-}
-
-static inline void map_set_task_id(int id, struct flb_task *task,
-                                   struct flb_config *config)
-{
-    config->tasks_map[id].task = task;
-
-}
-
-static inline void map_free_task_id(int id, struct flb_config *config)
-{
-    config->tasks_map[id].task = NULL;
+    if (config->tasks_paused == FLB_FALSE && config->tasks_count >= limit) {
+        flb_warn("[task] soft limit reached (%i tasks), pausing inputs",
+                 config->tasks_count);
+        flb_input_task_limit_pause(config);
+        config->tasks_paused = FLB_TRUE;
+    }
+    else if (config->tasks_paused == FLB_TRUE &&
+             config->tasks_count < limit - (limit / 4)) {
+        flb_info("[task] under soft limit (%i tasks), resuming inputs",
+                 config->tasks_count);
+        flb_input_task_limit_resume(config);
+        config->tasks_paused = FLB_FALSE;
+    }
 }
 
 void flb_task_retry_destroy(struct flb_task_retry *retry)
@@ -77,6 +73,7 @@ void flb_task_retry_destroy(struct flb_task_retry *retry)
                   retry);
     }
 
+    retry->o_ins->dispatch_retries--;
     mk_list_del(&retry->_head);
     flb_free(retry);
 }
@@ -146,6 +143,7 @@ struct flb_task_retry *flb_task_retry_create(struct flb_task *task,
         retry->o_ins   = ins;
         retry->parent  = task;
         mk_list_add(&retry->_head, &task->retries);
+        ins->dispatch_retries++;
 
         flb_debug("[retry] new retry created for task_id=%i attempts=%i",
                   task->id, retry->attempts);
@@ -242,12 +240,15 @@ static struct flb_task *task_alloc(struct flb_config *config)
     }
 
     /* Get ID and set back 'task' reference */
-    task_id = map_get_task_id(config);
+    task_id = flb_task_map_get_id(config);
     if (task_id == -1) {
+        flb_debug("[task] no task IDs available (%i tasks)",
+                  config->tasks_count);
         flb_free(task);
         return NULL;
     }
-    map_set_task_id(task_id, task, config);
+    flb_task_map_set(config, task_id, task);
+    task_limit_check(config);
 
     flb_trace("[task %p] created (id=%i)", task, task_id);
 
@@ -363,6 +364,7 @@ struct flb_task *flb_task_create(uint64_t ref_id,
     task->tag = flb_malloc(tag_len + 1);
     if (!task->tag) {
         flb_errno();
+        flb_task_map_release_id(config, task->id);
         flb_free(task);
         *err = FLB_TRUE;
         return NULL;
@@ -396,13 +398,16 @@ struct flb_task *flb_task_create(uint64_t ref_id,
             continue;
         }
 
-        if (flb_routes_mask_get_bit(task_ic->routes_mask, o_ins->id) != 0) {
+        if (flb_routes_mask_get_bit(task_ic->routes_mask, o_ins->id, task_ic->in->config) != 0) {
             route = flb_malloc(sizeof(struct flb_task_route));
             if (!route) {
                 flb_errno();
                 continue;
             }
 
+            route->queued = FLB_FALSE;
+            route->queued_ts = 0;
+            route->task = task;
             route->out = o_ins;
             mk_list_add(&route->_head, &task->routes);
             count++;
@@ -432,11 +437,15 @@ void flb_task_destroy(struct flb_task *task, int del)
     flb_debug("[task] destroy task=%p (task_id=%i)", task, task->id);
 
     /* Release task_id */
-    map_free_task_id(task->id, task->config);
+    flb_task_map_release_id(task->config, task->id);
+    task_limit_check(task->config);
 
     /* Remove routes */
     mk_list_foreach_safe(head, tmp, &task->routes) {
         route = mk_list_entry(head, struct flb_task_route, _head);
+        if (route->queued == FLB_TRUE) {
+            flb_engine_dispatch_route_remove(route);
+        }
         mk_list_del(&route->_head);
         flb_free(route);
     }
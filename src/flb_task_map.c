@@ -0,0 +1,136 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_task_map.h>
+
+/*
+ * Every task created must have an unique ID. The ID is the slot where the
+ * task is referenced in the tasks map and it's used by the task interface
+ * to communicate with the engine event loop about some action.
+ *
+ * Unused slots are chained in a free list: taking or releasing an ID does
+ * not depend on the number of tasks. When the free list is empty the map
+ * doubles its size until it reach the configured hard limit (or the
+ * maximum ID that fits in a task event).
+ */
+
+static int map_max_size(struct flb_config *config)
+{
+    if (config->task_hard_limit > 0 &&
+        config->task_hard_limit <= FLB_TASK_ID_MAX) {
+        return config->task_hard_limit;
+    }
+
+    return FLB_TASK_ID_MAX + 1;
+}
+
+static int map_grow(struct flb_config *config)
+{
+    int i;
+    int size;
+    int max;
+    struct flb_task_map *tmp;
+
+    max = map_max_size(config);
+    if (config->tasks_map_size >= max) {
+        return -1;
+    }
+
+    if (config->tasks_map_size == 0) {
+        size = FLB_TASK_MAP_SIZE;
+    }
+    else {
+        size = config->tasks_map_size * 2;
+    }
+    if (size > max) {
+        size = max;
+    }
+
+    tmp = flb_realloc(config->tasks_map, sizeof(struct flb_task_map) * size);
+    if (!tmp) {
+        flb_errno();
+        return -1;
+    }
+
+    /* chain the new slots keeping the lowest IDs first */
+    for (i = config->tasks_map_size; i < size; i++) {
+        tmp[i].task = NULL;
+        tmp[i].next_free = (i + 1 < size) ? i + 1 : -1;
+    }
+    config->tasks_map_free = config->tasks_map_size;
+    config->tasks_map = tmp;
+    config->tasks_map_size = size;
+
+    flb_debug("[task] tasks map size=%i", size);
+    return 0;
+}
+
+int flb_task_map_get_id(struct flb_config *config)
+{
+    int id;
+
+    if (config->tasks_map_free == -1 && map_grow(config) == -1) {
+        return -1;
+    }
+
+    id = config->tasks_map_free;
+    config->tasks_map_free = config->tasks_map[id].next_free;
+    config->tasks_map[id].next_free = -1;
+    config->tasks_count++;
+
+    return id;
+}
+
+void flb_task_map_set(struct flb_config *config, int id, void *task)
+{
+    config->tasks_map[id].task = task;
+}
+
+void *flb_task_map_get(struct flb_config *config, int id)
+{
+    if (id < 0 || id >= config->tasks_map_size) {
+        return NULL;
+    }
+
+    return config->tasks_map[id].task;
+}
+
+void flb_task_map_release_id(struct flb_config *config, int id)
+{
+    config->tasks_map[id].task = NULL;
+    config->tasks_map[id].next_free = config->tasks_map_free;
+    config->tasks_map_free = id;
+    config->tasks_count--;
+}
+
+void flb_task_map_destroy(struct flb_config *config)
+{
+    flb_free(config->tasks_map);
+    config->tasks_map = NULL;
+    config->tasks_map_size = 0;
+    config->tasks_map_free = -1;
+    config->tasks_count = 0;
+}
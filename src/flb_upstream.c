@@ -29,6 +29,10 @@
 #include <fluent-bit/tls/flb_tls.h>
 #include <fluent-bit/flb_utils.h>
 #include <fluent-bit/flb_thread_storage.h>
+#include <fluent-bit/flb_http2.h>
+#include <cmetrics/cmt_time.h>
+#include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_counter.h>
 
 FLB_TLS_DEFINE(struct mk_list, flb_upstream_list_key);
 
@@ -72,6 +76,28 @@ struct flb_config_map upstream_net[] = {
      "before it is retired."
     },
 
+    {
+     FLB_CONFIG_MAP_INT, "net.max_connections", "0",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, max_connections),
+     "Set maximum number of connections to the upstream, when all of them "
+     "are busy the caller waits for a free one up to 'net.connect_timeout'. "
+     "Zero means no limit."
+    },
+
+    {
+     FLB_CONFIG_MAP_INT, "net.warmup_connections", "0",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, warmup_connections),
+     "Set number of keepalive connections to open at startup"
+    },
+
+    {
+     FLB_CONFIG_MAP_BOOL, "net.http2", "false",
+     0, FLB_TRUE, offsetof(struct flb_net_setup, http2),
+     "Use HTTP/2 for the HTTP requests: concurrent requests are multiplexed "
+     "over the same connection. On TLS connections it's negotiated through "
+     "ALPN, falling back to HTTP/1.1."
+    },
+
     /* EOF */
     {0}
 };
@@ -126,6 +152,8 @@ void flb_upstream_queue_init(struct flb_upstream_queue *uq)
     mk_list_init(&uq->av_queue);
     mk_list_init(&uq->busy_queue);
     mk_list_init(&uq->destroy_queue);
+    mk_list_init(&uq->wait_queue);
+    uq->reserved = 0;
 }
 
 struct flb_upstream_queue *flb_upstream_queue_get(struct flb_upstream *u)
@@ -387,6 +415,163 @@ struct flb_upstream *flb_upstream_create_url(struct flb_config *config,
     return u;
 }
 
+/* Set the state of the connection in the pool and update the metrics */
+static void conn_pool_state(struct flb_upstream_conn *conn, int state)
+{
+#ifdef FLB_HAVE_METRICS
+    uint64_t ts;
+    char *labels[1];
+    struct flb_upstream *u = conn->u;
+#endif
+
+    if (conn->pool_state == state) {
+        return;
+    }
+
+#ifdef FLB_HAVE_METRICS
+    if (u->cmt_busy) {
+        ts = cmt_time_now();
+        labels[0] = u->cmt_name;
+
+        if (conn->pool_state == FLB_UPSTREAM_CONN_BUSY) {
+            cmt_gauge_dec(u->cmt_busy, ts, 1, labels);
+        }
+        else if (conn->pool_state == FLB_UPSTREAM_CONN_IDLE) {
+            cmt_gauge_dec(u->cmt_idle, ts, 1, labels);
+        }
+
+        if (state == FLB_UPSTREAM_CONN_BUSY) {
+            cmt_gauge_inc(u->cmt_busy, ts, 1, labels);
+        }
+        else if (state == FLB_UPSTREAM_CONN_IDLE) {
+            cmt_gauge_inc(u->cmt_idle, ts, 1, labels);
+        }
+    }
+#endif
+
+    conn->pool_state = state;
+}
+
+/* Check if the connections pool reached the 'net.max_connections' limit */
+static int pool_is_full(struct flb_upstream *u, struct flb_upstream_queue *uq)
+{
+    int total;
+
+    if (u->net.max_connections <= 0) {
+        return FLB_FALSE;
+    }
+
+    total = mk_list_size(&uq->busy_queue) + mk_list_size(&uq->av_queue) +
+            uq->reserved;
+    if (total >= u->net.max_connections) {
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
+/*
+ * Mark the first coroutine waiting for a connection as ready to be resumed.
+ * If 'conn' is set it's handed over to the waiter, otherwise a slot in the
+ * pool is reserved so it can create a new connection. It returns 0 if a
+ * waiter was found. The caller must hold the lists mutex if required.
+ */
+static int pool_wakeup(struct flb_upstream_queue *uq,
+                       struct flb_upstream_conn *conn)
+{
+    struct mk_list *head;
+    struct flb_upstream_waiter *waiter;
+
+    mk_list_foreach(head, &uq->wait_queue) {
+        waiter = mk_list_entry(head, struct flb_upstream_waiter, _head);
+        if (waiter->type != FLB_UPSTREAM_WAIT_POOL ||
+            waiter->ready == FLB_TRUE) {
+            continue;
+        }
+
+        waiter->ready = FLB_TRUE;
+        waiter->conn = conn;
+        if (!conn) {
+            uq->reserved++;
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * The pool is full: suspend the coroutine until a connection is released or
+ * the wait times out (-1). On success, 'out' is set with the connection
+ * handed over or NULL if a new connection can be created.
+ */
+static int pool_wait(struct flb_upstream *u, struct flb_upstream_queue *uq,
+                     struct flb_coro *coro, struct flb_upstream_conn **out)
+{
+    uint64_t ts;
+    struct flb_upstream_waiter waiter;
+#ifdef FLB_HAVE_METRICS
+    char *labels[1];
+#endif
+
+    waiter.type = FLB_UPSTREAM_WAIT_POOL;
+    waiter.coro = coro;
+    waiter.conn = NULL;
+    waiter.ready = FLB_FALSE;
+    waiter.timeout = FLB_FALSE;
+    waiter.ts_start = cmt_time_now();
+
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_lock(&u->mutex_lists);
+    }
+    mk_list_add(&waiter._head, &uq->wait_queue);
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_unlock(&u->mutex_lists);
+    }
+
+#ifdef FLB_HAVE_METRICS
+    labels[0] = u->cmt_name;
+    if (u->cmt_waiters) {
+        cmt_gauge_inc(u->cmt_waiters, waiter.ts_start, 1, labels);
+    }
+#endif
+
+    flb_debug("[upstream] connection pool to %s:%i is full (%i connections), "
+              "waiting", u->tcp_host, u->tcp_port, u->net.max_connections);
+
+    /* flb_upstream_conn_waiters_resume() unlinks the waiter */
+    flb_coro_yield(coro, FLB_FALSE);
+
+    ts = cmt_time_now();
+#ifdef FLB_HAVE_METRICS
+    if (u->cmt_waiters) {
+        cmt_gauge_dec(u->cmt_waiters, ts, 1, labels);
+        cmt_counter_inc(u->cmt_waits, ts, 1, labels);
+        cmt_counter_add(u->cmt_wait_time, ts,
+                        (double) (ts - waiter.ts_start) / 1000000000.0,
+                        1, labels);
+    }
+#endif
+
+    if (waiter.timeout == FLB_TRUE) {
+        return -1;
+    }
+
+    /* release the reserved slot, the caller creates the connection now */
+    if (!waiter.conn) {
+        if (u->thread_safe == FLB_TRUE) {
+            pthread_mutex_lock(&u->mutex_lists);
+        }
+        uq->reserved--;
+        if (u->thread_safe == FLB_TRUE) {
+            pthread_mutex_unlock(&u->mutex_lists);
+        }
+    }
+
+    *out = waiter.conn;
+    return 0;
+}
+
 /*
  * This function moves the 'upstream connection' into the queue to be
  * destroyed. Note that the caller is responsible to validate and check
@@ -418,6 +603,12 @@ static int prepare_destroy_conn(struct flb_upstream_conn *u_conn)
     /* Add node to destroy queue */
     mk_list_add(&u_conn->_head, &uq->destroy_queue);
 
+    /* The connection released a slot in the pool, let a waiter take it */
+    if (u_conn->pool_state != FLB_UPSTREAM_CONN_NONE) {
+        conn_pool_state(u_conn, FLB_UPSTREAM_CONN_NONE);
+        pool_wakeup(uq, NULL);
+    }
+
     /*
      * note: the connection context is destroyed by the engine once all events
      * have been processed.
@@ -451,6 +642,10 @@ static int destroy_conn(struct flb_upstream_conn *u_conn)
         return 0;
     }
 
+    if (u_conn->http2) {
+        flb_http2_session_destroy(u_conn->http2);
+    }
+
 #ifdef FLB_HAVE_TLS
     if (u_conn->tls_session) {
         flb_tls_session_destroy(u_conn->tls, u_conn);
@@ -462,12 +657,12 @@ static int destroy_conn(struct flb_upstream_conn *u_conn)
     return 0;
 }
 
-static struct flb_upstream_conn *create_conn(struct flb_upstream *u)
+static struct flb_upstream_conn *create_conn(struct flb_upstream *u,
+                                             struct flb_coro *coro)
 {
     int ret;
     time_t now;
     struct mk_event_loop *evl;
-    struct flb_coro *coro = flb_coro_get();
     struct flb_upstream_conn *conn;
     struct flb_upstream_queue *uq;
 
@@ -520,6 +715,7 @@ static struct flb_upstream_conn *create_conn(struct flb_upstream *u)
     /* Link new connection to the busy queue */
     uq = flb_upstream_queue_get(u);
     mk_list_add(&conn->_head, &uq->busy_queue);
+    conn_pool_state(conn, FLB_UPSTREAM_CONN_BUSY);
 
     if (u->thread_safe == FLB_TRUE) {
         pthread_mutex_unlock(&u->mutex_lists);
@@ -594,6 +790,82 @@ int flb_upstream_conn_recycle(struct flb_upstream_conn *conn, int val)
     return -1;
 }
 
+/*
+ * Create a new connection if the pool is not full, otherwise wait until a
+ * connection is released. Waiting is only possible from a coroutine.
+ */
+static struct flb_upstream_conn *pool_conn_get(struct flb_upstream *u,
+                                               struct flb_upstream_queue *uq)
+{
+    int ret;
+    struct flb_coro *coro = flb_coro_get();
+    struct flb_upstream_conn *conn = NULL;
+
+    if (coro && flb_upstream_is_async(u) == FLB_TRUE &&
+        pool_is_full(u, uq) == FLB_TRUE) {
+        ret = pool_wait(u, uq, coro, &conn);
+        if (ret == -1) {
+            flb_error("[upstream] no connection available to %s:%i after "
+                      "waiting %i seconds (net.max_connections=%i)",
+                      u->tcp_host, u->tcp_port, u->net.connect_timeout,
+                      u->net.max_connections);
+            return NULL;
+        }
+
+        if (conn) {
+            flb_debug("[upstream] KA connection #%i to %s:%i has been "
+                      "assigned (handed over)",
+                      conn->fd, u->tcp_host, u->tcp_port);
+            return conn;
+        }
+    }
+
+    return create_conn(u, coro);
+}
+
+/*
+ * HTTP/2: find a busy connection whose session can take one more stream,
+ * the caller shares it with the current users.
+ */
+static struct flb_upstream_conn *shared_conn_get(struct flb_upstream *u,
+                                                 struct flb_upstream_queue *uq)
+{
+    struct mk_list *head;
+    struct flb_upstream_conn *conn;
+
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_lock(&u->mutex_lists);
+    }
+
+    mk_list_foreach(head, &uq->busy_queue) {
+        conn = mk_list_entry(head, struct flb_upstream_conn, _head);
+        if (!conn->http2 || conn->busy_flag == FLB_TRUE || conn->fd == -1 ||
+            conn->recycle == FLB_FALSE) {
+            continue;
+        }
+
+        if (flb_http2_session_available(conn->http2,
+                                        conn->shared + 1) == FLB_TRUE) {
+            conn->shared++;
+
+            if (u->thread_safe == FLB_TRUE) {
+                pthread_mutex_unlock(&u->mutex_lists);
+            }
+
+            flb_debug("[upstream] HTTP/2 connection #%i to %s:%i has been "
+                      "assigned (shared by %i)",
+                      conn->fd, u->tcp_host, u->tcp_port, conn->shared + 1);
+            return conn;
+        }
+    }
+
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_unlock(&u->mutex_lists);
+    }
+
+    return NULL;
+}
+
 struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
 {
     int err;
@@ -617,7 +889,16 @@ struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
 
     /* On non Keepalive mode, always create a new TCP connection */
     if (u->net.keepalive == FLB_FALSE) {
-        return create_conn(u);
+        return pool_conn_get(u, uq);
+    }
+
+    /* HTTP/2 connections are multiplexed by the coroutines */
+    if (u->net.http2 == FLB_TRUE && flb_upstream_is_async(u) == FLB_TRUE &&
+        flb_coro_get() != NULL) {
+        conn = shared_conn_get(u, uq);
+        if (conn) {
+            return conn;
+        }
     }
 
     /*
@@ -635,6 +916,7 @@ struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
         /* This connection works, let's move it to the busy queue */
         mk_list_del(&conn->_head);
         mk_list_add(&conn->_head, &uq->busy_queue);
+        conn_pool_state(conn, FLB_UPSTREAM_CONN_BUSY);
 
         if (u->thread_safe == FLB_TRUE) {
             pthread_mutex_unlock(&u->mutex_lists);
@@ -671,7 +953,7 @@ struct flb_upstream_conn *flb_upstream_conn_get(struct flb_upstream *u)
 
     /* No keepalive connection available, create a new one */
     if (!conn) {
-        conn = create_conn(u);
+        conn = pool_conn_get(u, uq);
     }
 
     return conn;
@@ -701,18 +983,54 @@ int flb_upstream_conn_release(struct flb_upstream_conn *conn)
 
     uq = flb_upstream_queue_get(u);
 
+    /* A shared connection is still in use by other callers */
+    if (conn->shared > 0) {
+        if (u->thread_safe == FLB_TRUE) {
+            pthread_mutex_lock(&u->mutex_lists);
+        }
+        conn->shared--;
+        if (u->thread_safe == FLB_TRUE) {
+            pthread_mutex_unlock(&u->mutex_lists);
+        }
+        return 0;
+    }
+
     /* If this is a valid KA connection just recycle */
     if (conn->u->net.keepalive == FLB_TRUE && conn->recycle == FLB_TRUE && conn->fd > -1) {
-        /*
-         * This connection is still useful, move it to the 'available' queue and
-         * initialize variables.
-         */
         if (u->thread_safe == FLB_TRUE) {
             pthread_mutex_lock(&u->mutex_lists);
         }
 
+        /*
+         * If a coroutine is waiting for a connection, hand this one over
+         * while it can still be recycled: it stays in the busy queue.
+         */
+        if (mk_list_is_empty(&uq->wait_queue) != 0 &&
+            (conn->u->net.keepalive_max_recycle <= 0 ||
+             conn->ka_count < conn->u->net.keepalive_max_recycle)) {
+            ret = pool_wakeup(uq, conn);
+            if (ret == 0) {
+                if (conn->event.status & MK_EVENT_REGISTERED) {
+                    mk_event_del(conn->evl, &conn->event);
+                }
+                conn->ka_count++;
+                conn->net_error = -1;
+                conn->ts_assigned = time(NULL);
+
+                if (u->thread_safe == FLB_TRUE) {
+                    pthread_mutex_unlock(&u->mutex_lists);
+                }
+                return 0;
+            }
+        }
+
+        /*
+         * This connection is still useful, move it to the 'available' queue and
+         * initialize variables.
+         */
         mk_list_del(&conn->_head);
         mk_list_add(&conn->_head, &uq->av_queue);
+        conn_pool_state(conn, FLB_UPSTREAM_CONN_IDLE);
 
         if (u->thread_safe == FLB_TRUE) {
             pthread_mutex_unlock(&u->mutex_lists);
@@ -762,6 +1080,8 @@ int flb_upstream_conn_timeouts(struct mk_list *list)
 {
     time_t now;
     int drop;
+    uint64_t ts;
+    struct flb_upstream_waiter *waiter;
     struct mk_list *head;
     struct mk_list *u_head;
     struct mk_list *tmp;
@@ -841,6 +1161,21 @@ int flb_upstream_conn_timeouts(struct mk_list *list)
             }
         }
 
+        /* Coroutines waiting for a connection more than 'connect_timeout' */
+        if (u->net.connect_timeout > 0) {
+            ts = cmt_time_now();
+            mk_list_foreach(u_head, &uq->wait_queue) {
+                waiter = mk_list_entry(u_head, struct flb_upstream_waiter, _head);
+                if (waiter->type == FLB_UPSTREAM_WAIT_POOL &&
+                    waiter->ready == FLB_FALSE &&
+                    (ts - waiter->ts_start) / 1000000000 >=
+                    (uint64_t) u->net.connect_timeout) {
+                    waiter->ready = FLB_TRUE;
+                    waiter->timeout = FLB_TRUE;
+                }
+            }
+        }
+
         /* Check every available Keepalive connection */
         mk_list_foreach_safe(u_head, tmp, &uq->av_queue) {
             u_conn = mk_list_entry(u_head, struct flb_upstream_conn, _head);
@@ -890,6 +1225,180 @@ int flb_upstream_conn_pending_destroy(struct flb_upstream *u)
     return 0;
 }
 
+/* Resume the coroutines waiting for a connection that are ready to go */
+int flb_upstream_conn_waiters_resume(struct flb_upstream *u)
+{
+    int c = 0;
+    struct mk_list *head;
+    struct flb_upstream_waiter *waiter;
+    struct flb_upstream_queue *uq;
+
+    uq = flb_upstream_queue_get(u);
+
+    while (1) {
+        waiter = NULL;
+
+        if (u->thread_safe == FLB_TRUE) {
+            pthread_mutex_lock(&u->mutex_lists);
+        }
+
+        mk_list_foreach(head, &uq->wait_queue) {
+            waiter = mk_list_entry(head, struct flb_upstream_waiter, _head);
+            if (waiter->ready == FLB_TRUE) {
+                mk_list_del(&waiter->_head);
+                break;
+            }
+            waiter = NULL;
+        }
+
+        if (u->thread_safe == FLB_TRUE) {
+            pthread_mutex_unlock(&u->mutex_lists);
+        }
+
+        if (!waiter) {
+            break;
+        }
+
+        /* the waiter lives in the coroutine stack, don't touch it anymore */
+        flb_coro_resume(waiter->coro);
+        c++;
+    }
+
+    return c;
+}
+
+int flb_upstream_conn_waiters_resume_list(struct mk_list *list)
+{
+    struct mk_list *head;
+    struct flb_upstream *u;
+
+    mk_list_foreach(head, list) {
+        u = mk_list_entry(head, struct flb_upstream, _head);
+        flb_upstream_conn_waiters_resume(u);
+    }
+
+    return 0;
+}
+
+/*
+ * Suspend the coroutine until flb_upstream_conn_notify() reports some
+ * activity on the connection: used by the users of a shared connection
+ * while the event loop drives its socket.
+ */
+int flb_upstream_conn_wait(struct flb_upstream_conn *conn, struct flb_coro *coro)
+{
+    struct flb_upstream *u = conn->u;
+    struct flb_upstream_queue *uq;
+    struct flb_upstream_waiter waiter;
+
+    uq = flb_upstream_queue_get(u);
+
+    waiter.type = FLB_UPSTREAM_WAIT_CONN;
+    waiter.coro = coro;
+    waiter.conn = conn;
+    waiter.ready = FLB_FALSE;
+    waiter.timeout = FLB_FALSE;
+    waiter.ts_start = 0;
+
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_lock(&u->mutex_lists);
+    }
+    mk_list_add(&waiter._head, &uq->wait_queue);
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_unlock(&u->mutex_lists);
+    }
+
+    /* flb_upstream_conn_waiters_resume() unlinks the waiter */
+    flb_coro_yield(coro, FLB_FALSE);
+
+    return 0;
+}
+
+/* Mark the coroutines waiting on the connection as ready to be resumed */
+void flb_upstream_conn_notify(struct flb_upstream_conn *conn)
+{
+    struct mk_list *head;
+    struct flb_upstream *u = conn->u;
+    struct flb_upstream_queue *uq;
+    struct flb_upstream_waiter *waiter;
+
+    uq = flb_upstream_queue_get(u);
+
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_lock(&u->mutex_lists);
+    }
+
+    mk_list_foreach(head, &uq->wait_queue) {
+        waiter = mk_list_entry(head, struct flb_upstream_waiter, _head);
+        if (waiter->type == FLB_UPSTREAM_WAIT_CONN && waiter->conn == conn) {
+            waiter->ready = FLB_TRUE;
+        }
+    }
+
+    if (u->thread_safe == FLB_TRUE) {
+        pthread_mutex_unlock(&u->mutex_lists);
+    }
+}
+
+/*
+ * Open 'net.warmup_connections' keepalive connections so the first flushes
+ * don't pay the TCP and TLS handshakes. It runs before the event loop
+ * starts, the connections are created in blocking mode.
+ */
+int flb_upstream_conn_warmup(struct flb_upstream *u)
+{
+    int i;
+    int n;
+    struct flb_upstream_conn *conn;
+
+    n = u->net.warmup_connections;
+    if (n <= 0 || u->net.keepalive == FLB_FALSE) {
+        return 0;
+    }
+
+    /* in multi-worker mode every worker thread warms up its own queue */
+    if (u->thread_safe == FLB_TRUE && !flb_upstream_list_get()) {
+        return 0;
+    }
+
+    if (u->net.max_connections > 0 && n > u->net.max_connections) {
+        n = u->net.max_connections;
+    }
+
+    for (i = 0; i < n; i++) {
+        conn = create_conn(u, NULL);
+        if (!conn) {
+            flb_warn("[upstream] could not warm up connection #%i to %s:%i",
+                     i + 1, u->tcp_host, u->tcp_port);
+            break;
+        }
+
+        if (flb_upstream_is_async(u) == FLB_TRUE) {
+            flb_net_socket_nonblocking(conn->fd);
+        }
+
+        conn->recycle = FLB_TRUE;
+        flb_upstream_conn_release(conn);
+    }
+
+    flb_debug("[upstream] %i/%i connections to %s:%i warmed up",
+              i, n, u->tcp_host, u->tcp_port);
+    return i;
+}
+
+int flb_upstream_conn_warmup_list(struct mk_list *list)
+{
+    struct mk_list *head;
+    struct flb_upstream *u;
+
+    mk_list_foreach(head, list) {
+        u = mk_list_entry(head, struct flb_upstream, _head);
+        flb_upstream_conn_warmup(u);
+    }
+
+    return 0;
+}
+
 int flb_upstream_conn_active_destroy(struct flb_upstream *u)
 {
     struct mk_list *tmp;
@@ -21,6 +21,11 @@
 #include <fluent-bit/flb_info.h>
 #include <fluent-bit/flb_time.h>
 
+#ifdef FLB_HAVE_METRICS
+#include <cmetrics/cmt_time.h>
+#include <cmetrics/cmt_counter.h>
+#endif
+
 #ifdef FLB_HAVE_OPENSSL
 #include "openssl.c"
 #else
@@ -78,6 +83,27 @@ struct flb_config_map tls_configmap[] = {
      "Hostname to be used for TLS SNI extension"
     },
 
+    {
+     FLB_CONFIG_MAP_BOOL, "tls.session_cache", "on",
+     0, FLB_FALSE, 0,
+     "Resume the TLS sessions of previous connections to the same server "
+     "instead of doing a full handshake"
+    },
+
+    {
+     FLB_CONFIG_MAP_TIME, "tls.session_cache_lifetime", "300s",
+     0, FLB_FALSE, 0,
+     "Maximum time a TLS session is kept to be resumed"
+    },
+
+    {
+     FLB_CONFIG_MAP_BOOL, "tls.ktls", "off",
+     0, FLB_FALSE, 0,
+     "Offload the records encryption to the Linux kernel (kTLS) after the "
+     "handshake. If the kernel does not support it, the encryption keeps "
+     "running in user space"
+    },
+
     /* EOF */
     {0}
 };
@@ -138,6 +164,10 @@ struct flb_tls *flb_tls_create(int verify,
 
     tls->verify = verify;
     tls->debug = debug;
+    tls->session_cache = FLB_TRUE;
+    tls->session_lifetime = FLB_TLS_SESSION_LIFETIME;
+    mk_list_init(&tls->session_list);
+    pthread_mutex_init(&tls->session_mutex, NULL);
 
     if (vhost) {
         tls->vhost = flb_strdup(vhost);
@@ -158,18 +188,298 @@ int flb_tls_init()
     return tls_init();
 }
 
+static void session_cache_entry_destroy(struct flb_tls *tls,
+                                       struct flb_tls_cache_entry *entry)
+{
+    tls->api->session_saved_destroy(entry->session);
+    flb_sds_destroy(entry->key);
+    mk_list_del(&entry->_head);
+    flb_free(entry);
+    tls->session_count--;
+}
+
 int flb_tls_destroy(struct flb_tls *tls)
 {
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tls_cache_entry *entry;
+
+    mk_list_foreach_safe(head, tmp, &tls->session_list) {
+        entry = mk_list_entry(head, struct flb_tls_cache_entry, _head);
+        session_cache_entry_destroy(tls, entry);
+    }
+    pthread_mutex_destroy(&tls->session_mutex);
+
     if (tls->ctx) {
         tls->api->context_destroy(tls->ctx);
     }
     if (tls->vhost) {
         flb_free(tls->vhost);
     }
+    if (tls->alpn) {
+        flb_free(tls->alpn);
+    }
     flb_free(tls);
     return 0;
 }
 
+/*
+ * Set the comma separated list of protocols offered through ALPN by the
+ * new sessions, e.g: 'h2,http/1.1'.
+ */
+int flb_tls_set_alpn(struct flb_tls *tls, const char *alpn)
+{
+    if (tls->alpn) {
+        flb_free(tls->alpn);
+        tls->alpn = NULL;
+    }
+
+    if (alpn) {
+        tls->alpn = flb_strdup(alpn);
+        if (!tls->alpn) {
+            flb_errno();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Enable or disable the session resumption cache. When enabled, the session
+ * of every connection is saved when the handshake finishes and when the
+ * connection is closed, so the next connection to the same server can do an
+ * abbreviated handshake. Sessions older than 'lifetime' seconds are not used.
+ */
+int flb_tls_set_session_cache(struct flb_tls *tls, int enabled, int lifetime)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_tls_cache_entry *entry;
+
+    if (lifetime < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&tls->session_mutex);
+    tls->session_cache = enabled;
+    tls->session_lifetime = lifetime;
+
+    if (enabled == FLB_FALSE) {
+        mk_list_foreach_safe(head, tmp, &tls->session_list) {
+            entry = mk_list_entry(head, struct flb_tls_cache_entry, _head);
+            session_cache_entry_destroy(tls, entry);
+        }
+    }
+    pthread_mutex_unlock(&tls->session_mutex);
+
+    return 0;
+}
+
+/*
+ * Request kernel TLS for the new sessions: once the handshake is done the
+ * backend installs the keys in the socket and the kernel encrypts the
+ * records. If the kernel can't do it (e.g: the 'tls' module is not loaded)
+ * the session keeps working in user space.
+ */
+int flb_tls_set_ktls(struct flb_tls *tls, int enabled)
+{
+    if (enabled == FLB_TRUE && !tls->api->session_ktls) {
+        flb_warn("[tls] kernel TLS is not supported by the %s backend",
+                 tls->api->name);
+        tls->ktls = FLB_FALSE;
+        return -1;
+    }
+
+    tls->ktls = enabled;
+    return 0;
+}
+
+/* Cache key: the server the TLS session is established with */
+static int session_cache_key(struct flb_upstream *u, char *buf, size_t size)
+{
+    int ret;
+
+    if (u->proxied_host) {
+        ret = snprintf(buf, size, "%s:%i", u->proxied_host, u->proxied_port);
+    }
+    else {
+        ret = snprintf(buf, size, "%s:%i", u->tcp_host, u->tcp_port);
+    }
+
+    if (ret < 0 || ret >= size) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Lookup a cached session, it must be called with the cache locked */
+static struct flb_tls_cache_entry *session_cache_lookup(struct flb_tls *tls,
+                                                        const char *key)
+{
+    struct mk_list *head;
+    struct flb_tls_cache_entry *entry;
+
+    mk_list_foreach(head, &tls->session_list) {
+        entry = mk_list_entry(head, struct flb_tls_cache_entry, _head);
+        if (strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Set the cached session (if any) on a new session before the handshake,
+ * returns 0 if the cached session was set or -1 otherwise.
+ */
+int flb_tls_session_cache_resume(struct flb_tls *tls, void *session,
+                                 const char *key)
+{
+    int ret;
+    struct flb_tls_cache_entry *entry;
+
+    pthread_mutex_lock(&tls->session_mutex);
+
+    entry = session_cache_lookup(tls, key);
+    if (!entry) {
+        pthread_mutex_unlock(&tls->session_mutex);
+        return -1;
+    }
+
+    if (entry->ts + tls->session_lifetime <= time(NULL)) {
+        session_cache_entry_destroy(tls, entry);
+        pthread_mutex_unlock(&tls->session_mutex);
+        return -1;
+    }
+
+    ret = tls->api->session_resume(session, entry->session);
+    if (ret == -1) {
+        session_cache_entry_destroy(tls, entry);
+    }
+
+    pthread_mutex_unlock(&tls->session_mutex);
+
+    return ret;
+}
+
+/*
+ * Save the session of an established connection. The entry keeps the time
+ * the session was established: a resumed session is saved again on every
+ * connection but it must still expire 'lifetime' seconds after the full
+ * handshake.
+ */
+void flb_tls_session_cache_save(struct flb_tls *tls, void *session,
+                                const char *key)
+{
+    time_t ts = 0;
+    void *saved;
+    struct flb_tls_cache_entry *entry;
+
+    /* the backend returns NULL if the session can't be resumed */
+    saved = tls->api->session_save(session);
+    if (!saved) {
+        return;
+    }
+
+    if (tls->api->session_time) {
+        ts = tls->api->session_time(saved);
+    }
+    if (ts <= 0) {
+        ts = time(NULL);
+    }
+
+    pthread_mutex_lock(&tls->session_mutex);
+
+    entry = session_cache_lookup(tls, key);
+    if (entry) {
+        tls->api->session_saved_destroy(entry->session);
+        mk_list_del(&entry->_head);
+    }
+    else {
+        entry = flb_calloc(1, sizeof(struct flb_tls_cache_entry));
+        if (!entry) {
+            flb_errno();
+            tls->api->session_saved_destroy(saved);
+            pthread_mutex_unlock(&tls->session_mutex);
+            return;
+        }
+        entry->key = flb_sds_create(key);
+        if (!entry->key) {
+            tls->api->session_saved_destroy(saved);
+            flb_free(entry);
+            pthread_mutex_unlock(&tls->session_mutex);
+            return;
+        }
+        tls->session_count++;
+    }
+
+    entry->session = saved;
+    entry->ts = ts;
+    mk_list_add(&entry->_head, &tls->session_list);
+
+    /* drop the oldest entry */
+    if (tls->session_count > FLB_TLS_SESSION_CACHE_MAX) {
+        entry = mk_list_entry_first(&tls->session_list,
+                                    struct flb_tls_cache_entry, _head);
+        session_cache_entry_destroy(tls, entry);
+    }
+
+    pthread_mutex_unlock(&tls->session_mutex);
+}
+
+/* Forget the session of a server, e.g: the handshake failed */
+void flb_tls_session_cache_remove(struct flb_tls *tls, const char *key)
+{
+    struct flb_tls_cache_entry *entry;
+
+    pthread_mutex_lock(&tls->session_mutex);
+    entry = session_cache_lookup(tls, key);
+    if (entry) {
+        session_cache_entry_destroy(tls, entry);
+    }
+    pthread_mutex_unlock(&tls->session_mutex);
+}
+
+#ifdef FLB_HAVE_METRICS
+static void session_metrics_update(struct flb_upstream *u, int reused)
+{
+    uint64_t ts;
+    char *labels[1];
+
+    if (!u->cmt_tls_handshakes) {
+        return;
+    }
+
+    ts = cmt_time_now();
+    labels[0] = u->cmt_name;
+    cmt_counter_inc(u->cmt_tls_handshakes, ts, 1, labels);
+    if (reused == FLB_TRUE) {
+        cmt_counter_inc(u->cmt_tls_resumed, ts, 1, labels);
+    }
+}
+#endif
+
+/* Check the protocol selected by the server during the handshake */
+int flb_tls_session_alpn_selected(struct flb_upstream_conn *u_conn,
+                                  const char *protocol)
+{
+    const char *selected;
+
+    if (!u_conn->tls_session || !u_conn->tls->api->session_alpn_get) {
+        return FLB_FALSE;
+    }
+
+    selected = u_conn->tls->api->session_alpn_get(u_conn->tls_session);
+    if (selected && strcmp(selected, protocol) == 0) {
+        return FLB_TRUE;
+    }
+
+    return FLB_FALSE;
+}
+
 int flb_tls_net_read(struct flb_upstream_conn *u_conn, void *buf, size_t len)
 {
     int ret;
@@ -308,6 +618,107 @@ int flb_tls_net_write_async(struct flb_coro *co, struct flb_upstream_conn *u_con
     return 0;
 }
 
+static inline int tls_write(struct flb_coro *co, struct flb_upstream_conn *u_conn,
+                            const void *data, size_t len, size_t *out_len)
+{
+    if (co) {
+        return flb_tls_net_write_async(co, u_conn, data, len, out_len);
+    }
+
+    return flb_tls_net_write(u_conn, data, len, out_len);
+}
+
+/*
+ * Write a vector of buffers: small segments are coalesced in a buffer of
+ * the size of a TLS record, large ones are written in place. It avoids
+ * a record (and its overhead) per segment without copying the bulk data.
+ */
+static int tls_net_writev(struct flb_coro *co, struct flb_upstream_conn *u_conn,
+                          const struct mk_iovec *iov, int iovcnt,
+                          size_t *out_len)
+{
+    int i;
+    int ret;
+    char *buf;
+    char *base;
+    size_t off;
+    size_t len;
+    size_t sent;
+    size_t buf_len = 0;
+    size_t total = 0;
+
+    buf = flb_malloc(FLB_TLS_RECORD_SIZE);
+    if (!buf) {
+        flb_errno();
+        return -1;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        base = iov[i].iov_base;
+        off = 0;
+
+        while (off < iov[i].iov_len) {
+            len = iov[i].iov_len - off;
+
+            if (buf_len == 0 && len >= FLB_TLS_RECORD_SIZE) {
+                ret = tls_write(co, u_conn, base + off, len, &sent);
+                if (ret == -1) {
+                    goto error;
+                }
+                total += sent;
+                off += len;
+                continue;
+            }
+
+            if (len > FLB_TLS_RECORD_SIZE - buf_len) {
+                len = FLB_TLS_RECORD_SIZE - buf_len;
+            }
+            memcpy(buf + buf_len, base + off, len);
+            buf_len += len;
+            off += len;
+
+            if (buf_len == FLB_TLS_RECORD_SIZE) {
+                ret = tls_write(co, u_conn, buf, buf_len, &sent);
+                if (ret == -1) {
+                    goto error;
+                }
+                total += sent;
+                buf_len = 0;
+            }
+        }
+    }
+
+    if (buf_len > 0) {
+        ret = tls_write(co, u_conn, buf, buf_len, &sent);
+        if (ret == -1) {
+            goto error;
+        }
+        total += sent;
+    }
+
+    flb_free(buf);
+    *out_len = total;
+    return 0;
+
+ error:
+    flb_free(buf);
+    *out_len = total;
+    return -1;
+}
+
+int flb_tls_net_writev(struct flb_upstream_conn *u_conn,
+                       const struct mk_iovec *iov, int iovcnt, size_t *out_len)
+{
+    return tls_net_writev(NULL, u_conn, iov, iovcnt, out_len);
+}
+
+int flb_tls_net_writev_async(struct flb_coro *co, struct flb_upstream_conn *u_conn,
+                             const struct mk_iovec *iov, int iovcnt,
+                             size_t *out_len)
+{
+    return tls_net_writev(co, u_conn, iov, iovcnt, out_len);
+}
+
 
 /* Create a TLS session (+handshake) */
 int flb_tls_session_create(struct flb_tls *tls,
@@ -316,6 +727,9 @@ int flb_tls_session_create(struct flb_tls *tls,
 {
     int ret;
     int flag;
+    int reused;
+    int cache = FLB_FALSE;
+    char key[256];
     struct flb_tls_session *session;
     struct flb_upstream *u = u_conn->u;
 
@@ -339,6 +753,13 @@ int flb_tls_session_create(struct flb_tls *tls,
     u_conn->tls = tls;
     u_conn->tls_session = session;
 
+    /* Try to resume a previous session with the same server */
+    if (tls->session_cache == FLB_TRUE && tls->api->session_resume &&
+        session_cache_key(u, key, sizeof(key)) == 0) {
+        cache = FLB_TRUE;
+        flb_tls_session_cache_resume(tls, session, key);
+    }
+
  retry_handshake:
     ret = tls->api->net_handshake(tls, session);
     if (ret != 0) {
@@ -408,12 +829,41 @@ int flb_tls_session_create(struct flb_tls *tls,
     if (u_conn->event.status & MK_EVENT_REGISTERED) {
         mk_event_del(u_conn->evl, &u_conn->event);
     }
+
+    reused = FLB_FALSE;
+    if (cache == FLB_TRUE) {
+        reused = tls->api->session_reused(session);
+        if (reused == FLB_TRUE) {
+            flb_debug("[tls] connection #%i resumed session with %s",
+                      u_conn->fd, key);
+        }
+        flb_tls_session_cache_save(tls, session, key);
+    }
+#ifdef FLB_HAVE_METRICS
+    session_metrics_update(u, reused);
+#endif
+
+    if (tls->ktls == FLB_TRUE) {
+        if (tls->api->session_ktls(session) == FLB_TRUE) {
+            flb_debug("[tls] connection #%i using kernel TLS", u_conn->fd);
+        }
+        else if (tls->ktls_warned == FLB_FALSE) {
+            flb_warn("[tls] kernel TLS not available for connections to "
+                     "%s:%i, encrypting in user space (is the 'tls' kernel "
+                     "module loaded?)", u->tcp_host, u->tcp_port);
+            tls->ktls_warned = FLB_TRUE;
+        }
+    }
+
     return 0;
 
  error:
     if (u_conn->event.status & MK_EVENT_REGISTERED) {
         mk_event_del(u_conn->evl, &u_conn->event);
     }
+    if (cache == FLB_TRUE) {
+        flb_tls_session_cache_remove(tls, key);
+    }
     flb_tls_session_destroy(tls, u_conn);
     u_conn->tls_session = NULL;
 
@@ -423,6 +873,17 @@ int flb_tls_session_create(struct flb_tls *tls,
 int flb_tls_session_destroy(struct flb_tls *tls, struct flb_upstream_conn *u_conn)
 {
     int ret;
+    char key[256];
+
+    /*
+     * Save the session again: with TLS 1.3 the tickets are sent by the
+     * server after the handshake.
+     */
+    if (u_conn->tls_session && tls->session_cache == FLB_TRUE &&
+        tls->api->session_save &&
+        session_cache_key(u_conn->u, key, sizeof(key)) == 0) {
+        flb_tls_session_cache_save(tls, u_conn->tls_session, key);
+    }
 
     ret = tls->api->session_destroy(u_conn->tls_session);
     if (ret == -1) {
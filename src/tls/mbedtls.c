@@ -27,6 +27,7 @@
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/debug.h>
 #include <mbedtls/error.h>
+#include <mbedtls/platform_util.h>
 
 #define tls_error(ret) _io_tls_error(ret, __FILE__, __LINE__)
 
@@ -34,6 +35,14 @@ struct tls_session {
     struct mbedtls_ssl_context ssl;
     struct mbedtls_ssl_config conf;
     mbedtls_net_context net_context;
+
+    /* ALPN protocols offered, referenced by 'conf' */
+    char alpn_buf[64];
+    const char *alpn_list[8];
+
+    /* master secret of the session offered to be resumed */
+    int resume;
+    unsigned char resume_master[48];
 };
 
 /* mbedTLS library context */
@@ -227,6 +236,52 @@ static void *tls_context_create(int verify, int debug,
     return NULL;
 }
 
+/* Split 'h2,http/1.1' into the NULL terminated list used by mbedtls */
+static int tls_alpn_set(struct tls_session *session, const char *alpn)
+{
+    int n = 0;
+    int max;
+    char *p;
+    char *end;
+
+    if (strlen(alpn) >= sizeof(session->alpn_buf)) {
+        return -1;
+    }
+    strcpy(session->alpn_buf, alpn);
+
+    max = (sizeof(session->alpn_list) / sizeof(session->alpn_list[0])) - 1;
+    p = session->alpn_buf;
+    while (*p && n < max) {
+        end = strchr(p, ',');
+        if (end) {
+            *end = '\0';
+        }
+        if (*p) {
+            session->alpn_list[n++] = p;
+        }
+        if (!end) {
+            break;
+        }
+        p = end + 1;
+    }
+    session->alpn_list[n] = NULL;
+
+    if (n == 0 ||
+        mbedtls_ssl_conf_alpn_protocols(&session->conf,
+                                        session->alpn_list) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static const char *tls_session_alpn_get(void *ptr_session)
+{
+    struct tls_session *session = ptr_session;
+
+    return mbedtls_ssl_get_alpn_protocol(&session->ssl);
+}
+
 static void *tls_session_create(struct flb_tls *tls,
                                 struct flb_upstream_conn *u_conn)
 {
@@ -282,6 +337,10 @@ static void *tls_session_create(struct flb_tls *tls,
     }
 
 
+    if (tls->alpn && tls_alpn_set(session, tls->alpn) == -1) {
+        flb_error("[tls] could not set ALPN protocols '%s'", tls->alpn);
+    }
+
     ret = mbedtls_ssl_setup(&session->ssl, &session->conf);
     if (ret == -1) {
         flb_error("[tls] ssl_setup");
@@ -317,6 +376,89 @@ static int tls_session_destroy(void *session)
     return 0;
 }
 
+/* Copy the session if it can be resumed */
+static void *tls_session_save(void *ptr_session)
+{
+    int ret;
+    mbedtls_ssl_session *saved;
+    struct tls_session *session = ptr_session;
+
+    if (session->ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        return NULL;
+    }
+
+    saved = flb_malloc(sizeof(mbedtls_ssl_session));
+    if (!saved) {
+        flb_errno();
+        return NULL;
+    }
+    mbedtls_ssl_session_init(saved);
+
+    ret = mbedtls_ssl_get_session(&session->ssl, saved);
+    if (ret != 0 || (saved->id_len == 0 && saved->ticket_len == 0)) {
+        mbedtls_ssl_session_free(saved);
+        flb_free(saved);
+        return NULL;
+    }
+
+    return saved;
+}
+
+static int tls_session_resume(void *ptr_session, void *ptr_saved)
+{
+    int ret;
+    mbedtls_ssl_session *saved = ptr_saved;
+    struct tls_session *session = ptr_session;
+
+    ret = mbedtls_ssl_set_session(&session->ssl, saved);
+    if (ret != 0) {
+        tls_error(ret);
+        return -1;
+    }
+
+    /* a resumed session keeps the master secret */
+    memcpy(session->resume_master, saved->master, sizeof(saved->master));
+    session->resume = FLB_TRUE;
+
+    return 0;
+}
+
+static void tls_session_saved_destroy(void *saved)
+{
+    mbedtls_ssl_session_free(saved);
+    flb_free(saved);
+}
+
+static int tls_session_reused(void *ptr_session)
+{
+    int ret = FLB_FALSE;
+    struct tls_session *session = ptr_session;
+    mbedtls_ssl_session *s = session->ssl.session;
+
+    if (session->resume == FLB_TRUE && s &&
+        memcmp(s->master, session->resume_master, sizeof(s->master)) == 0) {
+        ret = FLB_TRUE;
+    }
+
+    mbedtls_platform_zeroize(session->resume_master,
+                             sizeof(session->resume_master));
+    session->resume = FLB_FALSE;
+
+    return ret;
+}
+
+/* Time the saved session was established, it's kept when resumed */
+static time_t tls_session_time(void *ptr_saved)
+{
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ssl_session *saved = ptr_saved;
+
+    return saved->start;
+#else
+    return 0;
+#endif
+}
+
 static int tls_net_read(struct flb_upstream_conn *u_conn,
                         void *buf, size_t len)
 {
@@ -402,5 +544,11 @@ static struct flb_tls_backend tls_mbedtls = {
     .session_destroy = tls_session_destroy,
     .net_read        = tls_net_read,
     .net_write       = tls_net_write,
-    .net_handshake   = tls_net_handshake
+    .net_handshake   = tls_net_handshake,
+    .session_alpn_get = tls_session_alpn_get,
+    .session_save    = tls_session_save,
+    .session_resume  = tls_session_resume,
+    .session_saved_destroy = tls_session_saved_destroy,
+    .session_reused  = tls_session_reused,
+    .session_time    = tls_session_time
 };
@@ -34,6 +34,11 @@
  */
 #define OPENSSL_1_1_0 0x010100000L
 
+/* Kernel TLS is available since OpenSSL 3.0 when built with it */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define FLB_TLS_OPENSSL_KTLS
+#endif
+
 /*
  * RHEL-family distrbutions do not provide system certificates in
  * a format that OpenSSL's CAPath can read, but do provide a single
@@ -53,6 +58,7 @@ struct tls_context {
 struct tls_session {
     SSL *ssl;
     int fd;
+    char alpn[32];                 /* protocol selected through ALPN */
     struct tls_context *parent;    /* parent struct tls_context ref */
 };
 
@@ -275,6 +281,57 @@ static void *tls_context_create(int verify, int debug,
     return NULL;
 }
 
+/* Convert 'h2,http/1.1' to the ALPN wire format and set it */
+static int tls_alpn_set(SSL *ssl, const char *alpn)
+{
+    size_t len;
+    size_t off = 0;
+    const char *p;
+    const char *end;
+    unsigned char buf[256];
+
+    p = alpn;
+    while (*p) {
+        end = strchr(p, ',');
+        if (!end) {
+            end = p + strlen(p);
+        }
+
+        len = end - p;
+        if (len == 0 || len > 255 || off + 1 + len > sizeof(buf)) {
+            return -1;
+        }
+        buf[off++] = len;
+        memcpy(buf + off, p, len);
+        off += len;
+
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    /* note: SSL_set_alpn_protos() returns zero on success */
+    if (off == 0 || SSL_set_alpn_protos(ssl, buf, off) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static const char *tls_session_alpn_get(void *ptr_session)
+{
+    unsigned int len = 0;
+    const unsigned char *data = NULL;
+    struct tls_session *session = ptr_session;
+
+    SSL_get0_alpn_selected(session->ssl, &data, &len);
+    if (!data || len == 0 || len >= sizeof(session->alpn)) {
+        return NULL;
+    }
+
+    memcpy(session->alpn, data, len);
+    session->alpn[len] = '\0';
+    return session->alpn;
+}
+
 static void *tls_session_create(struct flb_tls *tls,
                                 struct flb_upstream_conn *u_conn)
 {
@@ -302,6 +359,20 @@ static void *tls_session_create(struct flb_tls *tls,
     session->fd = u_conn->fd;
     SSL_set_fd(ssl, u_conn->fd);
 
+    /* non-blocking writes are retried from buffers that might move */
+    SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+#ifdef FLB_TLS_OPENSSL_KTLS
+    /* OpenSSL falls back to user space if the kernel refuses the keys */
+    if (tls->ktls == FLB_TRUE) {
+        SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+
+    if (tls->alpn && tls_alpn_set(ssl, tls->alpn) == -1) {
+        flb_error("[openssl] could not set ALPN protocols '%s'", tls->alpn);
+    }
+
     /*
      * TLS Debug Levels:
      *
@@ -335,6 +406,15 @@ static int tls_session_destroy(void *session)
         SSL_shutdown(ptr->ssl);
         SSL_shutdown(ptr->ssl);
     }
+    else {
+        /*
+         * The socket is gone: mark the connection as shut down without
+         * sending anything, otherwise SSL_free() invalidates the session
+         * and it can't be resumed.
+         */
+        SSL_set_quiet_shutdown(ptr->ssl, 1);
+        SSL_shutdown(ptr->ssl);
+    }
     SSL_free(ptr->ssl);
     flb_free(ptr);
 
@@ -343,6 +423,77 @@ static int tls_session_destroy(void *session)
     return 0;
 }
 
+/* Get a reference to the session if it can be resumed */
+static void *tls_session_save(void *ptr_session)
+{
+    SSL_SESSION *saved = NULL;
+    struct tls_session *session = ptr_session;
+    struct tls_context *ctx = session->parent;
+
+    pthread_mutex_lock(&ctx->mutex);
+    if (SSL_is_init_finished(session->ssl)) {
+        saved = SSL_get1_session(session->ssl);
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (saved && !SSL_SESSION_is_resumable(saved)) {
+        SSL_SESSION_free(saved);
+        return NULL;
+    }
+#endif
+
+    return saved;
+}
+
+static int tls_session_resume(void *ptr_session, void *saved)
+{
+    int ret;
+    struct tls_session *session = ptr_session;
+    struct tls_context *ctx = session->parent;
+
+    pthread_mutex_lock(&ctx->mutex);
+    ret = SSL_set_session(session->ssl, saved);
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return ret == 1 ? 0 : -1;
+}
+
+static void tls_session_saved_destroy(void *saved)
+{
+    SSL_SESSION_free(saved);
+}
+
+static int tls_session_reused(void *ptr_session)
+{
+    struct tls_session *session = ptr_session;
+
+    return SSL_session_reused(session->ssl) ? FLB_TRUE : FLB_FALSE;
+}
+
+/* Time the saved session was established, it's kept when resumed */
+static time_t tls_session_time(void *saved)
+{
+    return SSL_SESSION_get_time(saved);
+}
+
+static int tls_session_ktls(void *ptr_session)
+{
+    int ret = FLB_FALSE;
+#ifdef FLB_TLS_OPENSSL_KTLS
+    struct tls_session *session = ptr_session;
+    struct tls_context *ctx = session->parent;
+
+    pthread_mutex_lock(&ctx->mutex);
+    if (BIO_get_ktls_send(SSL_get_wbio(session->ssl))) {
+        ret = FLB_TRUE;
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+#endif
+
+    return ret;
+}
+
 static int tls_net_read(struct flb_upstream_conn *u_conn,
                         void *buf, size_t len)
 {
@@ -359,7 +510,11 @@ static int tls_net_read(struct flb_upstream_conn *u_conn,
         if (ret == SSL_ERROR_WANT_READ) {
             ret = FLB_TLS_WANT_READ;
         }
-        else if (ret < 0) {
+        else if (ret == SSL_ERROR_WANT_WRITE) {
+            ret = FLB_TLS_WANT_WRITE;
+        }
+        else {
+            /* SSL_ERROR_ZERO_RETURN, SSL_ERROR_SYSCALL, ... */
             ret = -1;
         }
     }
@@ -448,5 +603,12 @@ static struct flb_tls_backend tls_openssl = {
     .session_destroy = tls_session_destroy,
     .net_read        = tls_net_read,
     .net_write       = tls_net_write,
-    .net_handshake   = tls_net_handshake
+    .net_handshake   = tls_net_handshake,
+    .session_alpn_get = tls_session_alpn_get,
+    .session_save    = tls_session_save,
+    .session_resume  = tls_session_resume,
+    .session_saved_destroy = tls_session_saved_destroy,
+    .session_reused  = tls_session_reused,
+    .session_time    = tls_session_time,
+    .session_ktls    = tls_session_ktls
 };
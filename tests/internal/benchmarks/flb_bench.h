@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_BENCH_H
+#define FLB_BENCH_H
+
+#include <string.h>
+
+/* root of the source tree, set by CMake */
+#ifndef FLB_BENCH_SOURCE_PATH
+#define FLB_BENCH_SOURCE_PATH ""
+#endif
+
+#define FLB_BENCH_MBS(bytes, secs)  ((bytes) / (secs) / 1048576.0)
+
+static inline const char *flb_bench_basename(const char *path)
+{
+    const char *p;
+
+    p = strrchr(path, '/');
+    if (!p) {
+        return path;
+    }
+    return p + 1;
+}
+
+#endif
@@ -0,0 +1,137 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Hash table benchmark: insert, lookup and delete N keys (1M by default,
+ * or the number given in the command line) with keys stored in the slots
+ * and with keys longer than FLB_HASH_KEY_INLINE.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_hash.h>
+#include <fluent-bit/flb_time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "flb_bench.h"
+
+static char *key_formats[] = {
+    "kube.pod_%i.log",
+    "kube.var.log.containers.app-%i_default_app-0123456789abcdef.log",
+    NULL
+};
+
+static double elapsed(struct flb_time *t0)
+{
+    struct flb_time t1;
+
+    flb_time_get(&t1);
+    return flb_time_to_double(&t1) - flb_time_to_double(t0);
+}
+
+static int bench_keys(const char *format, int total)
+{
+    int i;
+    int ret;
+    int len;
+    int found = 0;
+    char key[128];
+    double t_add;
+    double t_get;
+    double t_del;
+    struct flb_time t0;
+    struct flb_hash *ht;
+
+    ht = flb_hash_create(FLB_HASH_EVICT_NONE, total / 4, -1);
+    if (!ht) {
+        return -1;
+    }
+
+    flb_time_get(&t0);
+    for (i = 0; i < total; i++) {
+        len = snprintf(key, sizeof(key) - 1, format, i);
+        ret = flb_hash_add(ht, key, len, (void *) ht, 0);
+        if (ret == -1) {
+            break;
+        }
+    }
+    t_add = elapsed(&t0);
+
+    flb_time_get(&t0);
+    for (i = 0; i < total; i++) {
+        len = snprintf(key, sizeof(key) - 1, format, i);
+        if (flb_hash_get_ptr(ht, key, len) == ht) {
+            found++;
+        }
+    }
+    t_get = elapsed(&t0);
+
+    if (ht->total_count != total || found != total) {
+        fprintf(stderr, "%s: %i keys stored, %i found\n",
+                format, ht->total_count, found);
+        flb_hash_destroy(ht);
+        return -1;
+    }
+
+    flb_time_get(&t0);
+    for (i = 0; i < total; i++) {
+        snprintf(key, sizeof(key) - 1, format, i);
+        flb_hash_del(ht, key);
+    }
+    t_del = elapsed(&t0);
+
+    ret = 0;
+    if (ht->total_count != 0) {
+        fprintf(stderr, "%s: %i keys left\n", format, ht->total_count);
+        ret = -1;
+    }
+
+    printf("%-40.40s %12.0f %12.0f %12.0f\n", format,
+           total / t_add, total / t_get, total / t_del);
+
+    flb_hash_destroy(ht);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int ret = 0;
+    int total = 1000000;
+
+    if (argc > 1) {
+        total = atoi(argv[1]);
+        if (total <= 0) {
+            fprintf(stderr, "usage: %s [keys]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%i keys\n", total);
+    printf("%-40s %12s %12s %12s\n", "key", "add ops/s", "get ops/s",
+           "del ops/s");
+
+    for (i = 0; key_formats[i]; i++) {
+        ret |= bench_keys(key_formats[i], total);
+    }
+
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
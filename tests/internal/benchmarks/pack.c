@@ -0,0 +1,291 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019-2021 The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * JSON to msgpack benchmark: flb_pack_json() against the jsmn tokens
+ * pipeline it replaced (flb_json_tokenise() + tokens_to_msgpack()), on the
+ * JSON files given in the command line or on a few real documents of the
+ * source tree.
+ */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_pack.h>
+#include <fluent-bit/flb_time.h>
+#include <fluent-bit/flb_unescape.h>
+#include <monkey/mk_core.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flb_bench.h"
+
+/* bytes packed per file and per pipeline */
+#define BENCH_BYTES    (64 * 1024 * 1024)
+
+static char *default_files[] = {
+    "tests/internal/data/pack/bug342.json",
+    "tests/internal/data/avro/live-sample.json",
+    "tests/internal/data/avro/multiline.json",
+    "docker_compose/node-exporter-dashboard/config/grafana/provisioning/"
+    "dashboards/dashboard.json",
+    NULL
+};
+
+static inline int is_float(const char *buf, int len)
+{
+    const char *end = buf + len;
+    const char *p = buf;
+
+    while (p <= end) {
+        if (*p == 'e' && p < end && *(p + 1) == '-') {
+            return 1;
+        }
+        else if (*p == '.') {
+            return 1;
+        }
+        p++;
+    }
+
+    return 0;
+}
+
+static inline int pack_string_token(struct flb_pack_state *state,
+                                    const char *str, int len,
+                                    msgpack_packer *pck)
+{
+    int s;
+    int out_len;
+    char *tmp;
+
+    if (state->buf_size < len + 1) {
+        s = len + 1;
+        tmp = flb_realloc(state->buf_data, s);
+        if (!tmp) {
+            return -1;
+        }
+        state->buf_data = tmp;
+        state->buf_size = s;
+    }
+
+    out_len = flb_unescape_string_utf8(str, len, state->buf_data);
+    msgpack_pack_str(pck, out_len);
+    msgpack_pack_str_body(pck, state->buf_data, out_len);
+
+    return out_len;
+}
+
+/* tokens to msgpack conversion used by flb_pack_json() before v1.9 */
+static char *tokens_to_msgpack(struct flb_pack_state *state,
+                               const char *js, int *out_size)
+{
+    int i;
+    int flen;
+    const char *p;
+    const jsmntok_t *t;
+    msgpack_packer pck;
+    msgpack_sbuffer sbuf;
+
+    if (state->tokens_count == 0) {
+        return NULL;
+    }
+
+    msgpack_sbuffer_init(&sbuf);
+    msgpack_packer_init(&pck, &sbuf, msgpack_sbuffer_write);
+
+    for (i = 0; i < state->tokens_count; i++) {
+        t = &state->tokens[i];
+
+        if (t->start == -1 || t->end == -1 || (t->start == 0 && t->end == 0)) {
+            break;
+        }
+
+        flen = (t->end - t->start);
+        switch (t->type) {
+        case JSMN_OBJECT:
+            msgpack_pack_map(&pck, t->size);
+            break;
+        case JSMN_ARRAY:
+            msgpack_pack_array(&pck, t->size);
+            break;
+        case JSMN_STRING:
+            pack_string_token(state, js + t->start, flen, &pck);
+            break;
+        case JSMN_PRIMITIVE:
+            p = js + t->start;
+            if (*p == 'f') {
+                msgpack_pack_false(&pck);
+            }
+            else if (*p == 't') {
+                msgpack_pack_true(&pck);
+            }
+            else if (*p == 'n') {
+                msgpack_pack_nil(&pck);
+            }
+            else if (is_float(p, flen)) {
+                msgpack_pack_double(&pck, atof(p));
+            }
+            else {
+                msgpack_pack_int64(&pck, atoll(p));
+            }
+            break;
+        case JSMN_UNDEFINED:
+            msgpack_sbuffer_destroy(&sbuf);
+            return NULL;
+        }
+    }
+
+    *out_size = sbuf.size;
+    return sbuf.data;
+}
+
+static int pack_tokens(const char *js, size_t len,
+                       char **out_buf, size_t *out_size)
+{
+    int ret;
+    int size;
+    struct flb_pack_state state;
+
+    ret = flb_pack_state_init(&state);
+    if (ret != 0) {
+        return -1;
+    }
+
+    ret = flb_json_tokenise(js, len, &state);
+    if (ret != 0) {
+        flb_pack_state_reset(&state);
+        return -1;
+    }
+
+    *out_buf = tokens_to_msgpack(&state, js, &size);
+    flb_pack_state_reset(&state);
+    if (!*out_buf) {
+        return -1;
+    }
+    *out_size = size;
+
+    return 0;
+}
+
+static int pack_single_pass(const char *js, size_t len,
+                            char **out_buf, size_t *out_size)
+{
+    int type;
+
+    return flb_pack_json(js, len, out_buf, out_size, &type);
+}
+
+static double bench_run(int (*pack)(const char *, size_t, char **, size_t *),
+                        const char *js, size_t len, int rounds)
+{
+    int i;
+    char *out_buf;
+    size_t out_size;
+    struct flb_time t0;
+    struct flb_time t1;
+
+    flb_time_get(&t0);
+    for (i = 0; i < rounds; i++) {
+        if (pack(js, len, &out_buf, &out_size) != 0) {
+            return -1;
+        }
+        flb_free(out_buf);
+    }
+    flb_time_get(&t1);
+
+    return flb_time_to_double(&t1) - flb_time_to_double(&t0);
+}
+
+static int bench_file(const char *path)
+{
+    int ret;
+    int rounds;
+    size_t len;
+    size_t size_a;
+    size_t size_b;
+    char *js;
+    char *buf_a;
+    char *buf_b;
+    double t_tokens;
+    double t_single;
+
+    js = mk_file_to_buffer(path);
+    if (!js) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return -1;
+    }
+    len = strlen(js);
+
+    /* both pipelines must produce the same msgpack */
+    ret = pack_tokens(js, len, &buf_a, &size_a);
+    if (ret != 0) {
+        fprintf(stderr, "%s: invalid JSON\n", path);
+        flb_free(js);
+        return -1;
+    }
+    ret = pack_single_pass(js, len, &buf_b, &size_b);
+    if (ret != 0 || size_a != size_b || memcmp(buf_a, buf_b, size_a) != 0) {
+        fprintf(stderr, "%s: output differs\n", path);
+    }
+    flb_free(buf_a);
+    if (ret == 0) {
+        flb_free(buf_b);
+    }
+
+    rounds = BENCH_BYTES / len + 1;
+    t_tokens = bench_run(pack_tokens, js, len, rounds);
+    t_single = bench_run(pack_single_pass, js, len, rounds);
+
+    printf("%-40s %10zu %10.1f %10.1f %8.2fx\n",
+           flb_bench_basename(path), len,
+           FLB_BENCH_MBS(len * rounds, t_tokens),
+           FLB_BENCH_MBS(len * rounds, t_single),
+           t_tokens / t_single);
+
+    flb_free(js);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int ret = 0;
+    char path[4096];
+
+    printf("%-40s %10s %10s %10s %9s\n",
+           "file", "bytes", "tokens", "1-pass", "speedup");
+    printf("%-40s %10s %10s %10s\n", "", "", "MB/s", "MB/s");
+
+    if (argc > 1) {
+        for (i = 1; i < argc; i++) {
+            ret |= bench_file(argv[i]);
+        }
+        return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    for (i = 0; default_files[i]; i++) {
+        snprintf(path, sizeof(path), "%s%s",
+                 FLB_BENCH_SOURCE_PATH, default_files[i]);
+        ret |= bench_file(path);
+    }
+
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
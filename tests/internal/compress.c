@@ -0,0 +1,208 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_log.h>
+#include <fluent-bit/flb_gzip.h>
+#include <fluent-bit/flb_snappy.h>
+#include <fluent-bit/flb_compress.h>
+
+#include "flb_tests_internal.h"
+
+#define PAYLOAD_SIZE  (512 * 1024)
+
+struct compress_test {
+    int done;
+    int ret;
+    char *in;
+    void *out;
+    size_t out_len;
+    struct flb_coro *coro;
+    struct flb_config *config;
+};
+
+static struct compress_test *current;
+
+static char *payload_create()
+{
+    int i;
+    char *buf;
+
+    buf = flb_malloc(PAYLOAD_SIZE);
+    if (!buf) {
+        return NULL;
+    }
+    for (i = 0; i < PAYLOAD_SIZE; i++) {
+        buf[i] = 'a' + (i % 7) + ((i / 1024) % 3);
+    }
+    return buf;
+}
+
+static void check_roundtrip(int type, void *out, size_t out_len, char *in)
+{
+    int ret;
+    void *tmp = NULL;
+    size_t tmp_len = 0;
+
+    if (type == FLB_COMPRESS_GZIP) {
+        ret = flb_gzip_uncompress(out, out_len, &tmp, &tmp_len);
+    }
+    else {
+        ret = flb_snappy_uncompress(out, out_len, &tmp, &tmp_len);
+    }
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(tmp_len == PAYLOAD_SIZE);
+    if (ret == 0 && tmp_len == PAYLOAD_SIZE) {
+        TEST_CHECK(memcmp(tmp, in, PAYLOAD_SIZE) == 0);
+    }
+    flb_free(tmp);
+}
+
+void test_types()
+{
+    TEST_CHECK(flb_compress_type("gzip") == FLB_COMPRESS_GZIP);
+    TEST_CHECK(flb_compress_type("Snappy") == FLB_COMPRESS_SNAPPY);
+    TEST_CHECK(flb_compress_type("none") == FLB_COMPRESS_NONE);
+    TEST_CHECK(flb_compress_type("brotli") == -1);
+    TEST_CHECK(strcmp(flb_compress_name(FLB_COMPRESS_GZIP), "gzip") == 0);
+}
+
+void test_sync()
+{
+    int ret;
+    int type;
+    char *in;
+    void *out;
+    size_t out_len;
+
+    in = payload_create();
+    TEST_CHECK(in != NULL);
+
+    for (type = FLB_COMPRESS_GZIP; type <= FLB_COMPRESS_SNAPPY; type++) {
+        ret = flb_compress(type, in, PAYLOAD_SIZE, &out, &out_len);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(out_len < PAYLOAD_SIZE);
+        check_roundtrip(type, out, out_len, in);
+        flb_free(out);
+    }
+
+    flb_free(in);
+}
+
+static void coro_entry()
+{
+    struct compress_test *t = current;
+
+    t->ret = flb_compress_async(t->config, FLB_COMPRESS_GZIP,
+                                t->in, PAYLOAD_SIZE, &t->out, &t->out_len);
+    t->done = FLB_TRUE;
+    flb_coro_yield(t->coro, FLB_TRUE);
+}
+
+/* Coroutines yield while the pool compresses and get resumed by the loop */
+void test_pool()
+{
+    int i;
+    int ret;
+    int done;
+    void *out;
+    size_t out_len;
+    int waits = 0;
+    size_t stack_size;
+    struct mk_event *event;
+    struct mk_event_loop *evl;
+    struct flb_config *config;
+    struct compress_test tests[4];
+
+    flb_coro_init();
+    flb_engine_evl_init();
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    /* workers register their log channel */
+    config->log = flb_log_create(config, FLB_LOG_STDERR, FLB_LOG_INFO, NULL);
+    TEST_CHECK(config->log != NULL);
+
+    evl = mk_event_loop_create(16);
+    TEST_CHECK(evl != NULL);
+    flb_engine_evl_set(evl);
+
+    config->compress_pool = flb_compress_pool_create(config, 2);
+    TEST_CHECK(config->compress_pool != NULL);
+    if (!config->compress_pool) {
+        return;
+    }
+
+    memset(tests, '\0', sizeof(tests));
+    for (i = 0; i < 4; i++) {
+        tests[i].config = config;
+        tests[i].in = payload_create();
+        tests[i].coro = flb_coro_create(&tests[i]);
+        tests[i].coro->caller = co_active();
+        tests[i].coro->callee = co_create(config->coro_stack_size,
+                                          coro_entry, &stack_size);
+
+        /* start: it stops as soon as the job is queued */
+        current = &tests[i];
+        flb_coro_resume(tests[i].coro);
+        TEST_CHECK(tests[i].done == FLB_FALSE);
+    }
+
+    /* run the event loop until every coroutine finished */
+    do {
+        mk_event_wait(evl);
+        mk_event_foreach(event, evl) {
+            if (event->type == FLB_ENGINE_EV_CUSTOM) {
+                event->handler(event);
+            }
+        }
+        waits++;
+
+        done = 0;
+        for (i = 0; i < 4; i++) {
+            done += tests[i].done;
+        }
+    } while (done < 4 && waits < 100);
+    TEST_CHECK(done == 4);
+
+    /*
+     * Outside of a coroutine (e.g: a timer callback) the data is compressed
+     * in place even if the pool is enabled.
+     */
+    TEST_CHECK(flb_coro_get() == NULL);
+    ret = flb_compress_async(config, FLB_COMPRESS_GZIP,
+                             tests[0].in, PAYLOAD_SIZE, &out, &out_len);
+    TEST_CHECK(ret == 0);
+    if (ret == 0) {
+        check_roundtrip(FLB_COMPRESS_GZIP, out, out_len, tests[0].in);
+        flb_free(out);
+    }
+
+    for (i = 0; i < 4; i++) {
+        TEST_CHECK(tests[i].ret == 0);
+        if (tests[i].ret == 0) {
+            check_roundtrip(FLB_COMPRESS_GZIP, tests[i].out, tests[i].out_len,
+                            tests[i].in);
+            flb_free(tests[i].out);
+        }
+        flb_coro_destroy(tests[i].coro);
+        flb_free(tests[i].in);
+    }
+
+    flb_compress_pool_destroy(config->compress_pool);
+    config->compress_pool = NULL;
+    flb_engine_evl_set(NULL);
+    mk_event_loop_destroy(evl);
+    flb_config_exit(config);
+}
+
+TEST_LIST = {
+    {"types", test_types},
+    {"sync" , test_sync},
+    {"pool" , test_pool},
+    { 0 }
+};
@@ -0,0 +1,156 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_input.h>
+#include <fluent-bit/flb_output.h>
+#include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_engine_dispatch.h>
+
+#include "flb_tests_internal.h"
+
+#define N_ROUTES  6
+
+struct dispatch_test {
+    struct flb_input_instance in[2];
+    struct flb_output_instance out;
+    struct flb_task task[2];
+    struct flb_task_route routes[2][N_ROUTES];
+};
+
+static struct dispatch_test *test_create()
+{
+    int i;
+    int r;
+    struct dispatch_test *t;
+
+    t = flb_calloc(1, sizeof(struct dispatch_test));
+    if (!t) {
+        return NULL;
+    }
+
+    mk_list_init(&t->out.dispatch_flows);
+    for (i = 0; i < FLB_TASK_PRIO_LEVELS; i++) {
+        mk_list_init(&t->out.dispatch_active[i]);
+    }
+    t->out.cmt = cmt_create();
+    t->out.cmt_dispatch_queue = cmt_gauge_create(t->out.cmt, "fluentbit",
+                                                 "output",
+                                                 "dispatch_queue_length",
+                                                 "test", 1,
+                                                 (char *[]) {"name"});
+
+    for (i = 0; i < 2; i++) {
+        t->in[i].dispatch_priority = FLB_TASK_PRIO_NORMAL;
+        t->in[i].dispatch_weight = 1;
+        t->task[i].i_ins = &t->in[i];
+        mk_list_init(&t->task[i].routes);
+
+        for (r = 0; r < N_ROUTES; r++) {
+            t->routes[i][r].task = &t->task[i];
+            t->routes[i][r].out = &t->out;
+        }
+    }
+
+    return t;
+}
+
+static void test_destroy(struct dispatch_test *t)
+{
+    flb_engine_dispatch_flows_destroy(&t->out);
+    cmt_destroy(t->out.cmt);
+    flb_free(t);
+}
+
+/* Check the input each dequeued route comes from */
+static void check_order(struct dispatch_test *t, const char *order)
+{
+    int i;
+    int len;
+    struct flb_task_route *route;
+
+    len = strlen(order);
+    for (i = 0; i < len; i++) {
+        route = flb_engine_dispatch_dequeue(&t->out);
+        TEST_CHECK(route != NULL);
+        if (!route) {
+            return;
+        }
+        TEST_CHECK(route->queued == FLB_FALSE);
+        TEST_CHECK(route->task == &t->task[order[i] - 'A']);
+        TEST_MSG("position %i: expected input %c", i, order[i]);
+    }
+    TEST_CHECK(flb_engine_dispatch_dequeue(&t->out) == NULL);
+    TEST_CHECK(t->out.dispatch_queued == 0);
+}
+
+/* Higher priority classes go first */
+void test_priority()
+{
+    int r;
+    struct dispatch_test *t;
+
+    t = test_create();
+    TEST_CHECK(t != NULL);
+
+    t->in[0].dispatch_priority = FLB_TASK_PRIO_LOW;
+    t->in[1].dispatch_priority = FLB_TASK_PRIO_HIGH;
+
+    for (r = 0; r < 3; r++) {
+        flb_engine_dispatch_enqueue(&t->routes[0][r], 0);
+    }
+    for (r = 0; r < 3; r++) {
+        flb_engine_dispatch_enqueue(&t->routes[1][r], 0);
+    }
+    TEST_CHECK(t->out.dispatch_queued == 6);
+    TEST_CHECK(t->task[0].users == 3);
+
+    check_order(t, "BBBAAA");
+    test_destroy(t);
+}
+
+/* Inputs of the same class share the output by weight */
+void test_weight()
+{
+    int r;
+    struct dispatch_test *t;
+
+    t = test_create();
+    TEST_CHECK(t != NULL);
+
+    t->in[0].dispatch_weight = 2;
+
+    for (r = 0; r < N_ROUTES; r++) {
+        flb_engine_dispatch_enqueue(&t->routes[0][r], 0);
+        flb_engine_dispatch_enqueue(&t->routes[1][r], 0);
+    }
+
+    check_order(t, "AABAABAABBBB");
+    test_destroy(t);
+}
+
+void test_remove()
+{
+    struct dispatch_test *t;
+
+    t = test_create();
+    TEST_CHECK(t != NULL);
+
+    flb_engine_dispatch_enqueue(&t->routes[0][0], 0);
+    flb_engine_dispatch_enqueue(&t->routes[0][1], 0);
+    flb_engine_dispatch_enqueue(&t->routes[1][0], 0);
+
+    flb_engine_dispatch_route_remove(&t->routes[0][0]);
+    flb_engine_dispatch_route_remove(&t->routes[0][1]);
+    TEST_CHECK(t->out.dispatch_queued == 1);
+
+    check_order(t, "B");
+    test_destroy(t);
+}
+
+TEST_LIST = {
+    {"priority", test_priority},
+    {"weight"  , test_weight},
+    {"remove"  , test_remove},
+    { 0 }
+};
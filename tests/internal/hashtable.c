@@ -140,41 +140,50 @@ void test_medium_table()
     flb_hash_destroy(ht);
 }
 
-void test_chaining()
+/* Keys sharing slots are found by probing, the table grows on demand */
+void test_probing()
 {
     int i;
-    int inserts = 0;
-    int count;
-    int chains = 0;
+    int used;
+    int total;
+    char *out_buf;
+    size_t out_size;
     struct map *m;
-    struct mk_list *head;
-    struct flb_hash_table *table;
     struct flb_hash *ht;
 
     ht = flb_hash_create(FLB_HASH_EVICT_NONE, 8, -1);
     TEST_CHECK(ht != NULL);
 
-    for (i = 0; i < 8; i++) {
+    total = sizeof(entries) / sizeof(struct map);
+    for (i = 0; i < total; i++) {
         m = &entries[i];
         ht_add(ht, m->key, m->val);
-        inserts++;
     }
 
+    /* 3 keys were overridden */
+    TEST_CHECK(ht->total_count == total - 3);
+    TEST_CHECK(ht->size > ht->total_count);
+    TEST_CHECK((ht->size & (ht->size - 1)) == 0);
+
+    used = 0;
     for (i = 0; i < ht->size; i++) {
-        table = &ht->table[i];
-        count = 0;
-        mk_list_foreach(head, &table->chains) {
-            count++;
+        if (ht->ctrl[i] > 1) {
+            used++;
         }
-        TEST_CHECK(count == table->count);
+    }
+    TEST_CHECK(used == ht->total_count);
 
-        if (count > 0) {
-            chains++;
+    /* the last value set for every key */
+    for (i = 0; i < total; i++) {
+        m = &entries[i];
+        if (i >= 67 && i <= 69) {
+            continue;
         }
+        TEST_CHECK(flb_hash_get(ht, m->key, strlen(m->key),
+                                (void *) &out_buf, &out_size) >= 0);
+        TEST_CHECK(strcmp(out_buf, m->val) == 0);
     }
 
-    /* Tests diff between total, new minus 3 overrides */
-    TEST_CHECK(chains == inserts - 3);
     flb_hash_destroy(ht);
 }
 
@@ -186,7 +195,8 @@ void test_delete_all()
     int not_found = 0;
     int total = 0;
     struct map *m;
-    struct flb_hash_table *table;
+    struct flb_hash_entry *tmp;
+    struct flb_hash_entry *entry;
     struct flb_hash *ht;
 
     ht = flb_hash_create(FLB_HASH_EVICT_NONE, 8, -1);
@@ -205,14 +215,133 @@ void test_delete_all()
             not_found++;
         }
     }
+    TEST_CHECK(not_found == 3);
 
     count = 0;
-    for (i = 0; i < ht->size; i++) {
-        table = &ht->table[i];
-        count += table->count;
+    flb_hash_foreach(entry, tmp, ht) {
+        count++;
     }
 
     TEST_CHECK(count == 0);
+    TEST_CHECK(ht->total_count == 0);
+    flb_hash_destroy(ht);
+}
+
+/* Deleted slots are reused, add/delete cycles don't grow the table */
+void test_delete_reuse()
+{
+    int i;
+    int len;
+    size_t size;
+    char key[32];
+    struct flb_hash *ht;
+
+    ht = flb_hash_create(FLB_HASH_EVICT_NONE, 64, -1);
+    TEST_CHECK(ht != NULL);
+    size = ht->size;
+
+    for (i = 0; i < 10000; i++) {
+        len = snprintf(key, sizeof(key) - 1, "key_%i", i);
+        TEST_CHECK(flb_hash_add(ht, key, len, "v", 1) >= 0);
+        if (i >= 16) {
+            snprintf(key, sizeof(key) - 1, "key_%i", i - 16);
+            TEST_CHECK(flb_hash_del(ht, key) == 0);
+        }
+    }
+
+    TEST_CHECK(ht->total_count == 16);
+    TEST_CHECK(ht->size == size);
+
+    for (i = 10000 - 16; i < 10000; i++) {
+        len = snprintf(key, sizeof(key) - 1, "key_%i", i);
+        TEST_CHECK(flb_hash_get_ptr(ht, key, len) != NULL);
+    }
+
+    flb_hash_destroy(ht);
+}
+
+/* Short keys live in the slot, long ones in the heap */
+void test_long_keys()
+{
+    int i;
+    int id;
+    int len;
+    char key[128];
+    const char *out_buf;
+    size_t out_size;
+    struct flb_hash *ht;
+
+    ht = flb_hash_create(FLB_HASH_EVICT_NONE, 8, -1);
+    TEST_CHECK(ht != NULL);
+
+    for (i = 1; i < sizeof(key); i++) {
+        memset(key, 'a' + (i % 26), i);
+        key[i] = '\0';
+        TEST_CHECK(flb_hash_add(ht, key, i, key, i) >= 0);
+    }
+
+    for (i = 1; i < sizeof(key); i++) {
+        memset(key, 'a' + (i % 26), i);
+        key[i] = '\0';
+        id = flb_hash_get(ht, key, i, (void *) &out_buf, &out_size);
+        TEST_CHECK(id >= 0);
+        TEST_CHECK(out_size == i && strcmp(out_buf, key) == 0);
+
+        /* the id leads to the same entry */
+        TEST_CHECK(flb_hash_get_by_id(ht, id, key, &out_buf, &out_size) == 0);
+        TEST_CHECK(out_size == i);
+
+        len = strlen(ht->table[id].key);
+        TEST_CHECK(len == i);
+        if (i < FLB_HASH_KEY_INLINE) {
+            TEST_CHECK(ht->table[id].key == ht->table[id].key_buf);
+        }
+        else {
+            TEST_CHECK(ht->table[id].key != ht->table[id].key_buf);
+        }
+    }
+
+    flb_hash_destroy(ht);
+}
+
+/* Entries are iterated in insertion order and can be removed meanwhile */
+void test_iterator()
+{
+    int i;
+    int count;
+    char key[32];
+    struct flb_hash_entry *tmp;
+    struct flb_hash_entry *entry;
+    struct flb_hash *ht;
+
+    ht = flb_hash_create(FLB_HASH_EVICT_NONE, 8, -1);
+    TEST_CHECK(ht != NULL);
+
+    for (i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key) - 1, "key_%i", i);
+        TEST_CHECK(flb_hash_add(ht, key, strlen(key), (void *) (uintptr_t) i,
+                                0) >= 0);
+    }
+
+    /* remove the odd values */
+    count = 0;
+    flb_hash_foreach(entry, tmp, ht) {
+        TEST_CHECK((uintptr_t) entry->val == count);
+        if (count % 2) {
+            flb_hash_del_entry(ht, entry);
+        }
+        count++;
+    }
+    TEST_CHECK(count == 100);
+    TEST_CHECK(ht->total_count == 50);
+
+    count = 0;
+    flb_hash_foreach(entry, tmp, ht) {
+        TEST_CHECK((uintptr_t) entry->val == count * 2);
+        count++;
+    }
+    TEST_CHECK(count == 50);
+
     flb_hash_destroy(ht);
 }
 
@@ -321,6 +450,42 @@ void test_older_eviction()
     flb_hash_destroy(ht);
 }
 
+void test_lru_eviction()
+{
+    int ret;
+    const char *out_buf;
+    size_t out_size;
+    struct flb_hash *ht;
+
+    ht = flb_hash_create(FLB_HASH_EVICT_LRU, 8, 2);
+    TEST_CHECK(ht != NULL);
+
+    ret = ht_add(ht, "key2", "value2");
+    TEST_CHECK(ret != -1);
+
+    ret = ht_add(ht, "key1", "value1");
+    TEST_CHECK(ret != -1);
+
+    /* key2 is the older entry but the most recently used */
+    ret = flb_hash_get(ht, "key2", 4, (void *) &out_buf, &out_size);
+    TEST_CHECK(ret >= 0);
+
+    ret = ht_add(ht, "key3", "value3");
+    TEST_CHECK(ret != -1);
+
+    ret = flb_hash_get(ht, "key3", 4, (void *) &out_buf, &out_size);
+    TEST_CHECK(ret >= 0);
+
+    ret = flb_hash_get(ht, "key2", 4, (void *) &out_buf, &out_size);
+    TEST_CHECK(ret >= 0);
+
+    ret = flb_hash_get(ht, "key1", 4, (void *) &out_buf, &out_size);
+    TEST_CHECK(ret == -1);
+
+    TEST_CHECK(ht->total_count == 2);
+    flb_hash_destroy(ht);
+}
+
 void test_pointer()
 {
     int ret;
@@ -359,11 +524,15 @@ TEST_LIST = {
     { "single",    test_single },
     { "small_table", test_small_table },
     { "medium_table", test_medium_table },
-    { "chaining_count", test_chaining },
+    { "probing", test_probing },
     { "delete_all", test_delete_all },
+    { "delete_reuse", test_delete_reuse },
+    { "long_keys", test_long_keys },
+    { "iterator", test_iterator },
     { "random_eviction", test_random_eviction },
     { "less_used_eviction", test_less_used_eviction },
     { "older_eviction", test_older_eviction },
+    { "lru_eviction", test_lru_eviction },
     { "pointer", test_pointer },
     { 0 }
 };
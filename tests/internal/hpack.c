@@ -0,0 +1,303 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/flb_hpack.h>
+
+#include "flb_tests_internal.h"
+
+/* RFC 7541, Appendix C.3: requests without Huffman coding */
+static const char c31[] = "\x82\x86\x84\x41\x0f\x77\x77\x77\x2e\x65\x78\x61"
+                          "\x6d\x70\x6c\x65\x2e\x63\x6f\x6d";
+static const char c32[] = "\x82\x86\x84\xbe\x58\x08\x6e\x6f\x2d\x63\x61\x63"
+                          "\x68\x65";
+static const char c33[] = "\x82\x87\x85\xbf\x40\x0a\x63\x75\x73\x74\x6f\x6d"
+                          "\x2d\x6b\x65\x79\x0c\x63\x75\x73\x74\x6f\x6d\x2d"
+                          "\x76\x61\x6c\x75\x65";
+
+/* RFC 7541, Appendix C.4.1: request with Huffman coding */
+static const char c41[] = "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b"
+                          "\xa0\xab\x90\xf4\xff";
+
+static int cb_collect(void *data,
+                      const char *name, size_t name_len,
+                      const char *value, size_t value_len)
+{
+    flb_sds_t *out = data;
+
+    flb_sds_cat_safe(out, name, name_len);
+    flb_sds_cat_safe(out, ": ", 2);
+    flb_sds_cat_safe(out, value, value_len);
+    flb_sds_cat_safe(out, "\n", 1);
+
+    return 0;
+}
+
+static int decode(struct flb_hpack *hp, const char *buf, size_t len,
+                  const char *expected)
+{
+    int ret;
+    flb_sds_t out;
+
+    out = flb_sds_create_size(256);
+    ret = flb_hpack_decode(hp, buf, len, cb_collect, &out);
+    if (ret == 0 && strcmp(out, expected) != 0) {
+        TEST_MSG("expected:\n%s\ngot:\n%s", expected, out);
+        ret = -1;
+    }
+    flb_sds_destroy(out);
+
+    return ret;
+}
+
+static void test_decode_requests()
+{
+    int ret;
+    struct flb_hpack *hp;
+
+    hp = flb_hpack_create(FLB_HPACK_TABLE_SIZE);
+    TEST_CHECK(hp != NULL);
+
+    ret = decode(hp, c31, sizeof(c31) - 1,
+                 ":method: GET\n"
+                 ":scheme: http\n"
+                 ":path: /\n"
+                 ":authority: www.example.com\n");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(hp->count == 1);
+    TEST_CHECK(hp->size == 57);
+
+    /* references the dynamic table entry added by the first request */
+    ret = decode(hp, c32, sizeof(c32) - 1,
+                 ":method: GET\n"
+                 ":scheme: http\n"
+                 ":path: /\n"
+                 ":authority: www.example.com\n"
+                 "cache-control: no-cache\n");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(hp->count == 2);
+    TEST_CHECK(hp->size == 110);
+
+    ret = decode(hp, c33, sizeof(c33) - 1,
+                 ":method: GET\n"
+                 ":scheme: https\n"
+                 ":path: /index.html\n"
+                 ":authority: www.example.com\n"
+                 "custom-key: custom-value\n");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(hp->count == 3);
+    TEST_CHECK(hp->size == 164);
+
+    flb_hpack_destroy(hp);
+}
+
+static void test_decode_huffman()
+{
+    int ret;
+    struct flb_hpack *hp;
+
+    hp = flb_hpack_create(FLB_HPACK_TABLE_SIZE);
+    TEST_CHECK(hp != NULL);
+
+    ret = decode(hp, c41, sizeof(c41) - 1,
+                 ":method: GET\n"
+                 ":scheme: http\n"
+                 ":path: /\n"
+                 ":authority: www.example.com\n");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(hp->size == 57);
+
+    flb_hpack_destroy(hp);
+}
+
+static void test_decode_invalid()
+{
+    int ret;
+    flb_sds_t out;
+    struct flb_hpack *hp;
+
+    hp = flb_hpack_create(FLB_HPACK_TABLE_SIZE);
+    out = flb_sds_create_size(64);
+
+    /* index zero */
+    ret = flb_hpack_decode(hp, "\x80", 1, cb_collect, &out);
+    TEST_CHECK(ret == -1);
+
+    /* index out of the tables */
+    ret = flb_hpack_decode(hp, "\xff\x10", 2, cb_collect, &out);
+    TEST_CHECK(ret == -1);
+
+    /* truncated literal */
+    ret = flb_hpack_decode(hp, "\x41\x0f\x77\x77", 4, cb_collect, &out);
+    TEST_CHECK(ret == -1);
+
+    /* size update above the limit */
+    ret = flb_hpack_decode(hp, "\x3f\xe1\x3f", 3, cb_collect, &out);
+    TEST_CHECK(ret == -1);
+
+    flb_sds_destroy(out);
+    flb_hpack_destroy(hp);
+}
+
+static void test_huffman()
+{
+    int ret;
+    flb_sds_t enc;
+    flb_sds_t dec;
+    const char *str = "www.example.com";
+
+    TEST_CHECK(flb_hpack_huffman_len(str, strlen(str)) == 12);
+
+    enc = flb_sds_create_size(32);
+    ret = flb_hpack_huffman_encode(str, strlen(str), &enc);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_sds_len(enc) == 12);
+    TEST_CHECK(memcmp(enc, "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff",
+                      12) == 0);
+
+    dec = flb_sds_create_size(32);
+    ret = flb_hpack_huffman_decode((unsigned char *) enc, flb_sds_len(enc),
+                                   &dec);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_sds_len(dec) == strlen(str));
+    TEST_CHECK(memcmp(dec, str, strlen(str)) == 0);
+
+    /* padding longer than 7 bits is an error */
+    flb_sds_len_set(dec, 0);
+    ret = flb_hpack_huffman_decode((unsigned char *) "\xff\xff", 2, &dec);
+    TEST_CHECK(ret == -1);
+
+    flb_sds_destroy(enc);
+    flb_sds_destroy(dec);
+}
+
+/* Encoder and decoder contexts must stay in sync across header blocks */
+static void test_encode_roundtrip()
+{
+    int i;
+    int ret;
+    size_t first;
+    flb_sds_t buf;
+    flb_sds_t expected;
+    struct flb_hpack *enc;
+    struct flb_hpack *dec;
+
+    enc = flb_hpack_create(FLB_HPACK_TABLE_SIZE);
+    dec = flb_hpack_create(FLB_HPACK_TABLE_SIZE);
+    buf = flb_sds_create_size(512);
+    expected = ":method: POST\n"
+               ":scheme: https\n"
+               ":path: /api/v1/logs?tag=app\n"
+               "content-type: application/json\n"
+               "authorization: Bearer abc123\n"
+               "x-custom: value\n";
+
+    first = 0;
+    for (i = 0; i < 3; i++) {
+        flb_sds_len_set(buf, 0);
+        ret = flb_hpack_encode_begin(enc, &buf);
+        ret |= flb_hpack_encode(enc, &buf, ":method", 7, "POST", 4, 0);
+        ret |= flb_hpack_encode(enc, &buf, ":scheme", 7, "https", 5, 0);
+        ret |= flb_hpack_encode(enc, &buf, ":path", 5,
+                                "/api/v1/logs?tag=app", 20,
+                                FLB_HPACK_NO_INDEX);
+        ret |= flb_hpack_encode(enc, &buf, "content-type", 12,
+                                "application/json", 16, 0);
+        ret |= flb_hpack_encode(enc, &buf, "authorization", 13,
+                                "Bearer abc123", 13, FLB_HPACK_NEVER_INDEX);
+        ret |= flb_hpack_encode(enc, &buf, "x-custom", 8, "value", 5, 0);
+        TEST_CHECK(ret == 0);
+
+        ret = decode(dec, buf, flb_sds_len(buf), expected);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(enc->count == dec->count);
+        TEST_CHECK(enc->size == dec->size);
+
+        /* indexed fields make the next blocks smaller */
+        if (i == 0) {
+            first = flb_sds_len(buf);
+        }
+        else {
+            TEST_CHECK(flb_sds_len(buf) < first);
+        }
+    }
+
+    /* sensitive and non indexed fields never enter the table */
+    TEST_CHECK(enc->count == 2);
+
+    /* a table size update is sent before the next block */
+    ret = flb_hpack_set_max_size(enc, 0);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(enc->count == 0);
+
+    flb_sds_len_set(buf, 0);
+    ret = flb_hpack_encode_begin(enc, &buf);
+    ret |= flb_hpack_encode(enc, &buf, "x-custom", 8, "value", 5, 0);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(buf[0] == '\x20');
+
+    ret = decode(dec, buf, flb_sds_len(buf), "x-custom: value\n");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(dec->count == 0);
+    TEST_CHECK(dec->size == 0);
+
+    flb_sds_destroy(buf);
+    flb_hpack_destroy(enc);
+    flb_hpack_destroy(dec);
+}
+
+/* Entries are evicted in order when the table is full */
+static void test_table_eviction()
+{
+    int i;
+    int ret;
+    char name[16];
+    char value[64];
+    flb_sds_t buf;
+    flb_sds_t expected;
+    struct flb_hpack *enc;
+    struct flb_hpack *dec;
+
+    enc = flb_hpack_create(256);
+    dec = flb_hpack_create(256);
+    buf = flb_sds_create_size(256);
+    expected = flb_sds_create_size(256);
+
+    memset(value, 'v', sizeof(value));
+    for (i = 0; i < 20; i++) {
+        snprintf(name, sizeof(name) - 1, "x-header-%02d", i);
+
+        flb_sds_len_set(buf, 0);
+        ret = flb_hpack_encode_begin(enc, &buf);
+        ret |= flb_hpack_encode(enc, &buf, name, strlen(name), value, 40, 0);
+        TEST_CHECK(ret == 0);
+
+        flb_sds_len_set(expected, 0);
+        flb_sds_printf(&expected, "%s: %.*s\n", name, 40, value);
+        ret = decode(dec, buf, flb_sds_len(buf), expected);
+        TEST_CHECK(ret == 0);
+
+        TEST_CHECK(enc->size <= 256);
+        TEST_CHECK(enc->size == dec->size);
+        TEST_CHECK(enc->count == dec->count);
+    }
+
+    /* every entry takes 11 + 40 + 32 bytes */
+    TEST_CHECK(enc->count == 3);
+
+    flb_sds_destroy(buf);
+    flb_sds_destroy(expected);
+    flb_hpack_destroy(enc);
+    flb_hpack_destroy(dec);
+}
+
+TEST_LIST = {
+    { "decode_requests", test_decode_requests },
+    { "decode_huffman", test_decode_huffman },
+    { "decode_invalid", test_decode_invalid },
+    { "huffman", test_huffman },
+    { "encode_roundtrip", test_encode_roundtrip },
+    { "table_eviction", test_table_eviction },
+    { 0 }
+};
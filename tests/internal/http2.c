@@ -0,0 +1,678 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_error.h>
+#include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_http2.h>
+#include <fluent-bit/flb_upstream.h>
+
+#include <pthread.h>
+#include <fcntl.h>
+
+#include "flb_tests_internal.h"
+
+/*
+ * The tests drive flb_http_do() over a socketpair: the client runs in sync
+ * mode and the other end plays the server with scripted frames.
+ */
+
+#define BODY_SIZE   100000
+
+/* ':status: 200' and ':status: 404' from the HPACK static table */
+#define STATUS_200  "\x88"
+#define STATUS_404  "\x8d"
+
+struct h2_frame {
+    int type;
+    int flags;
+    uint32_t id;
+    unsigned char *p;
+    uint32_t len;
+};
+
+struct h2_test {
+    int sv[2];
+    struct flb_config *config;
+    struct flb_upstream *u;
+    struct flb_upstream_conn *u_conn;
+    struct flb_http_client *c;
+};
+
+static inline uint32_t get_u32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+           ((uint32_t) p[2] << 8) | p[3];
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    ssize_t n;
+    size_t total = 0;
+
+    while (total < len) {
+        n = write(fd, (const char *) buf + total, len - total);
+        if (n <= 0) {
+            return -1;
+        }
+        total += n;
+    }
+
+    return 0;
+}
+
+/* Server side: write a frame */
+static int frame_write(int fd, int type, int flags, uint32_t id,
+                       const void *payload, uint32_t len)
+{
+    unsigned char h[FLB_HTTP2_FRAME_HEADER_SIZE];
+
+    h[0] = (len >> 16) & 0xff;
+    h[1] = (len >> 8) & 0xff;
+    h[2] = len & 0xff;
+    h[3] = type;
+    h[4] = flags;
+    h[5] = (id >> 24) & 0x7f;
+    h[6] = (id >> 16) & 0xff;
+    h[7] = (id >> 8) & 0xff;
+    h[8] = id & 0xff;
+
+    if (write_all(fd, h, sizeof(h)) == -1) {
+        return -1;
+    }
+    if (len > 0) {
+        return write_all(fd, payload, len);
+    }
+
+    return 0;
+}
+
+static int window_update_write(int fd, uint32_t id, uint32_t increment)
+{
+    unsigned char p[4];
+
+    p[0] = (increment >> 24) & 0x7f;
+    p[1] = (increment >> 16) & 0xff;
+    p[2] = (increment >> 8) & 0xff;
+    p[3] = increment & 0xff;
+
+    return frame_write(fd, FLB_HTTP2_WINDOW_UPDATE, 0, id, p, 4);
+}
+
+/* Split the client output in frames, it returns the number of frames */
+static int frames_parse(unsigned char *buf, size_t size,
+                        struct h2_frame *frames, int max)
+{
+    int n = 0;
+    size_t off = FLB_HTTP2_PREFACE_LEN;
+    uint32_t len;
+
+    if (size < off || memcmp(buf, FLB_HTTP2_PREFACE, off) != 0) {
+        return -1;
+    }
+
+    while (n < max && off + FLB_HTTP2_FRAME_HEADER_SIZE <= size) {
+        len = (buf[off] << 16) | (buf[off + 1] << 8) | buf[off + 2];
+        if (off + FLB_HTTP2_FRAME_HEADER_SIZE + len > size) {
+            break;
+        }
+        frames[n].type = buf[off + 3];
+        frames[n].flags = buf[off + 4];
+        frames[n].id = get_u32(buf + off + 5) & FLB_HTTP2_STREAM_ID_MAX;
+        frames[n].p = buf + off + FLB_HTTP2_FRAME_HEADER_SIZE;
+        frames[n].len = len;
+        off += FLB_HTTP2_FRAME_HEADER_SIZE + len;
+        n++;
+    }
+
+    return n;
+}
+
+static struct h2_frame *frame_find(struct h2_frame *frames, int count,
+                                   int type, int flags)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (frames[i].type == type &&
+            (frames[i].flags & flags) == flags) {
+            return &frames[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Read everything the client wrote */
+static size_t client_output(struct h2_test *t, unsigned char *buf, size_t size)
+{
+    ssize_t n;
+    size_t len = 0;
+
+    fcntl(t->sv[1], F_SETFL, fcntl(t->sv[1], F_GETFL) | O_NONBLOCK);
+    while (len < size) {
+        n = read(t->sv[1], buf + len, size - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+
+    return len;
+}
+
+static int h2_setup(struct h2_test *t, int method, const char *body,
+                    size_t body_len)
+{
+    int ret;
+
+    memset(t, 0, sizeof(struct h2_test));
+
+    t->config = flb_config_init();
+    TEST_CHECK(t->config != NULL);
+
+    t->u = flb_upstream_create(t->config, "127.0.0.1", 80, 0, NULL);
+    TEST_CHECK(t->u != NULL);
+    if (!t->u) {
+        return -1;
+    }
+    t->u->flags &= ~FLB_IO_ASYNC;
+    t->u->net.http2 = FLB_TRUE;
+
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, t->sv);
+    TEST_CHECK(ret == 0);
+
+    t->u_conn = flb_calloc(1, sizeof(struct flb_upstream_conn));
+    TEST_CHECK(t->u_conn != NULL);
+    if (!t->u_conn) {
+        return -1;
+    }
+    t->u_conn->u = t->u;
+    t->u_conn->fd = t->sv[0];
+
+    t->c = flb_http_client(t->u_conn, method, "/", body, body_len,
+                           "127.0.0.1", 80, NULL, 0);
+    TEST_CHECK(t->c != NULL);
+    if (!t->c) {
+        return -1;
+    }
+
+    /* server connection preface */
+    return frame_write(t->sv[1], FLB_HTTP2_SETTINGS, 0, 0, NULL, 0);
+}
+
+static void h2_teardown(struct h2_test *t)
+{
+    flb_http_client_destroy(t->c);
+    flb_http2_session_destroy(t->u_conn->http2);
+    close(t->sv[0]);
+    close(t->sv[1]);
+    flb_free(t->u_conn);
+    flb_upstream_destroy(t->u);
+    flb_config_exit(t->config);
+}
+
+/* SETTINGS/ACK, a header block split in CONTINUATION and padded DATA */
+void test_http2_response()
+{
+    int ret;
+    int count;
+    size_t len;
+    size_t b_sent;
+    unsigned char buf[4096];
+    unsigned char pad[10];
+    struct h2_frame frames[16];
+    struct h2_frame *f;
+    struct h2_test t;
+
+    ret = h2_setup(&t, FLB_HTTP_GET, NULL, 0);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        return;
+    }
+
+    /* the client settings are acknowledged */
+    frame_write(t.sv[1], FLB_HTTP2_SETTINGS, FLB_HTTP2_FLAG_ACK, 0, NULL, 0);
+
+    /* ':status: 200' and 'x-test: ok' (literal, new name) */
+    frame_write(t.sv[1], FLB_HTTP2_HEADERS, 0, 1,
+                STATUS_200 "\x00\x06x-te", 7);
+    frame_write(t.sv[1], FLB_HTTP2_CONTINUATION, FLB_HTTP2_FLAG_END_HEADERS, 1,
+                "st\x02ok", 5);
+
+    /* 'hello' with 4 bytes of padding, then the end of the stream */
+    pad[0] = 4;
+    memcpy(pad + 1, "hello", 5);
+    memset(pad + 6, 0, 4);
+    frame_write(t.sv[1], FLB_HTTP2_DATA, FLB_HTTP2_FLAG_PADDED, 1, pad, 10);
+    frame_write(t.sv[1], FLB_HTTP2_DATA, FLB_HTTP2_FLAG_END_STREAM, 1, "!", 1);
+
+    ret = flb_http_do(t.c, &b_sent);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(t.c->resp.status == 200);
+    TEST_CHECK(t.c->resp.payload_size == 6);
+    TEST_CHECK(t.c->resp.payload &&
+               memcmp(t.c->resp.payload, "hello!", 6) == 0);
+    TEST_CHECK(strstr(t.c->resp.data, "x-test: ok\r\n") != NULL);
+
+    len = client_output(&t, buf, sizeof(buf));
+    count = frames_parse(buf, len, frames, 16);
+    TEST_CHECK(count > 0);
+
+    /* client settings, the server settings ACK and the request */
+    f = frame_find(frames, count, FLB_HTTP2_SETTINGS, 0);
+    TEST_CHECK(f != NULL && f->flags == 0 && f->id == 0);
+    f = frame_find(frames, count, FLB_HTTP2_SETTINGS, FLB_HTTP2_FLAG_ACK);
+    TEST_CHECK(f != NULL && f->len == 0);
+    f = frame_find(frames, count, FLB_HTTP2_HEADERS,
+                   FLB_HTTP2_FLAG_END_STREAM | FLB_HTTP2_FLAG_END_HEADERS);
+    TEST_CHECK(f != NULL && f->id == 1);
+
+    /* the stream is closed in both directions */
+    TEST_CHECK(frame_find(frames, count, FLB_HTTP2_RST_STREAM, 0) == NULL);
+
+    h2_teardown(&t);
+}
+
+struct window_server {
+    int fd;
+    size_t received;
+    size_t before_update;
+    int updates;
+    char *body;
+};
+
+/*
+ * Server that reads the request body and only opens the flow control
+ * windows once the client used all of them.
+ */
+static void *window_server(void *data)
+{
+    int end = FLB_FALSE;
+    ssize_t n;
+    size_t off;
+    size_t len = 0;
+    size_t skip = FLB_HTTP2_PREFACE_LEN;
+    uint32_t flen;
+    unsigned char *buf;
+    unsigned char *h;
+    struct window_server *ws = data;
+
+    buf = flb_malloc(FLB_HTTP2_FRAME_HEADER_SIZE + FLB_HTTP2_FRAME_SIZE);
+    if (!buf) {
+        return NULL;
+    }
+
+    while (end == FLB_FALSE) {
+        n = read(ws->fd, buf + len,
+                 FLB_HTTP2_FRAME_HEADER_SIZE + FLB_HTTP2_FRAME_SIZE - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+
+        /* connection preface */
+        if (skip > 0) {
+            if (len < skip) {
+                continue;
+            }
+            memmove(buf, buf + skip, len - skip);
+            len -= skip;
+            skip = 0;
+        }
+
+        off = 0;
+        while (len - off >= FLB_HTTP2_FRAME_HEADER_SIZE) {
+            h = buf + off;
+            flen = (h[0] << 16) | (h[1] << 8) | h[2];
+            if (len - off < FLB_HTTP2_FRAME_HEADER_SIZE + flen) {
+                break;
+            }
+
+            if (h[3] == FLB_HTTP2_DATA) {
+                memcpy(ws->body + ws->received,
+                       h + FLB_HTTP2_FRAME_HEADER_SIZE, flen);
+                ws->received += flen;
+
+                if (ws->received == FLB_HTTP2_WINDOW_DEFAULT &&
+                    ws->updates == 0) {
+                    ws->before_update = ws->received;
+                    ws->updates++;
+                    window_update_write(ws->fd, 1, BODY_SIZE);
+                    window_update_write(ws->fd, 0, BODY_SIZE);
+                }
+
+                if (h[4] & FLB_HTTP2_FLAG_END_STREAM) {
+                    frame_write(ws->fd, FLB_HTTP2_HEADERS,
+                                FLB_HTTP2_FLAG_END_HEADERS |
+                                FLB_HTTP2_FLAG_END_STREAM, 1, STATUS_200, 1);
+                    end = FLB_TRUE;
+                }
+            }
+            off += FLB_HTTP2_FRAME_HEADER_SIZE + flen;
+        }
+
+        memmove(buf, buf + off, len - off);
+        len -= off;
+    }
+
+    flb_free(buf);
+    return NULL;
+}
+
+/* The request body stalls until the server sends WINDOW_UPDATE */
+void test_http2_window_update()
+{
+    int ret;
+    size_t b_sent;
+    char *body;
+    pthread_t tid;
+    struct window_server ws;
+    struct h2_test t;
+
+    body = flb_malloc(BODY_SIZE);
+    memset(&ws, 0, sizeof(ws));
+    ws.body = flb_calloc(1, BODY_SIZE);
+    TEST_CHECK(body != NULL && ws.body != NULL);
+    if (!body || !ws.body) {
+        return;
+    }
+    for (ret = 0; ret < BODY_SIZE; ret++) {
+        body[ret] = 'a' + (ret % 26);
+    }
+
+    /* the body spans the body buffer and two segments */
+    ret = h2_setup(&t, FLB_HTTP_POST, body, 1000);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        return;
+    }
+    flb_http_add_body_segment(t.c, body + 1000, 50000);
+    flb_http_add_body_segment(t.c, body + 51000, BODY_SIZE - 51000);
+
+    ws.fd = t.sv[1];
+    ret = pthread_create(&tid, NULL, window_server, &ws);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_http_do(t.c, &b_sent);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(t.c->resp.status == 200);
+    pthread_join(tid, NULL);
+
+    /* the client never went over the default window */
+    TEST_CHECK(ws.updates == 1);
+    TEST_CHECK(ws.before_update == FLB_HTTP2_WINDOW_DEFAULT);
+    TEST_CHECK(ws.received == BODY_SIZE);
+    TEST_CHECK(memcmp(ws.body, body, BODY_SIZE) == 0);
+
+    h2_teardown(&t);
+    flb_free(ws.body);
+    flb_free(body);
+}
+
+/* A response before the end of the request body resets the stream */
+void test_http2_early_response()
+{
+    int i;
+    int ret;
+    int count;
+    size_t len;
+    size_t b_sent;
+    char *body;
+    unsigned char *buf;
+    struct h2_frame frames[64];
+    struct h2_frame *f = NULL;
+    struct h2_test t;
+
+    body = flb_calloc(1, BODY_SIZE);
+    buf = flb_malloc(BODY_SIZE * 2);
+    TEST_CHECK(body != NULL && buf != NULL);
+    if (!body || !buf) {
+        return;
+    }
+
+    ret = h2_setup(&t, FLB_HTTP_POST, body, BODY_SIZE);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        return;
+    }
+
+    /* the windows are never opened: the body can't be completed */
+    frame_write(t.sv[1], FLB_HTTP2_HEADERS,
+                FLB_HTTP2_FLAG_END_HEADERS | FLB_HTTP2_FLAG_END_STREAM, 1,
+                STATUS_404, 1);
+
+    ret = flb_http_do(t.c, &b_sent);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(t.c->resp.status == 404);
+
+    len = client_output(&t, buf, BODY_SIZE * 2);
+    count = frames_parse(buf, len, frames, 64);
+    TEST_CHECK(count > 0);
+
+    for (i = 0; i < count; i++) {
+        TEST_CHECK(frames[i].type != FLB_HTTP2_DATA ||
+                   !(frames[i].flags & FLB_HTTP2_FLAG_END_STREAM));
+        if (frames[i].type == FLB_HTTP2_RST_STREAM) {
+            f = &frames[i];
+        }
+    }
+
+    TEST_CHECK(f != NULL);
+    TEST_CHECK(f && f->id == 1 && f->len == 4 &&
+               get_u32(f->p) == FLB_HTTP2_NO_ERROR);
+
+    h2_teardown(&t);
+    flb_free(buf);
+    flb_free(body);
+}
+
+/* Streams above the GOAWAY last stream id fail and are not reset */
+void test_http2_goaway()
+{
+    int ret;
+    int count;
+    size_t len;
+    size_t b_sent;
+    unsigned char buf[4096];
+    unsigned char p[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    struct h2_frame frames[16];
+    struct h2_test t;
+
+    ret = h2_setup(&t, FLB_HTTP_GET, NULL, 0);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        return;
+    }
+
+    /* last stream id 0, no error */
+    frame_write(t.sv[1], FLB_HTTP2_GOAWAY, 0, 0, p, 8);
+
+    ret = flb_http_do(t.c, &b_sent);
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(t.u_conn->http2 != NULL &&
+               t.u_conn->http2->status == FLB_HTTP2_SESSION_GOAWAY);
+    TEST_CHECK(flb_http2_session_available(t.u_conn->http2, 0) == FLB_FALSE);
+    TEST_CHECK(t.u_conn->recycle == FLB_FALSE);
+
+    len = client_output(&t, buf, sizeof(buf));
+    count = frames_parse(buf, len, frames, 16);
+    TEST_CHECK(count > 0);
+    TEST_CHECK(frame_find(frames, count, FLB_HTTP2_RST_STREAM, 0) == NULL);
+
+    h2_teardown(&t);
+}
+
+/*
+ * Read the client output: it returns the GOAWAY error code, or -1 if there
+ * was none, and the MAX_HEADER_LIST_SIZE of the client SETTINGS.
+ */
+static int64_t client_goaway(struct h2_test *t, uint32_t *header_list_max)
+{
+    int count;
+    size_t len;
+    int64_t error = -1;
+    unsigned char *p;
+    unsigned char buf[4096];
+    struct h2_frame frames[16];
+    struct h2_frame *f;
+
+    *header_list_max = 0;
+
+    len = client_output(t, buf, sizeof(buf));
+    count = frames_parse(buf, len, frames, 16);
+    if (count <= 0) {
+        return -1;
+    }
+
+    f = frame_find(frames, count, FLB_HTTP2_SETTINGS, 0);
+    for (p = f ? f->p : NULL; p && p + 6 <= f->p + f->len; p += 6) {
+        if (((p[0] << 8) | p[1]) == FLB_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE) {
+            *header_list_max = get_u32(p + 2);
+        }
+    }
+
+    f = frame_find(frames, count, FLB_HTTP2_GOAWAY, 0);
+    if (f && f->len == 8) {
+        error = get_u32(f->p + 4);
+    }
+
+    return error;
+}
+
+/* Header blocks over the announced MAX_HEADER_LIST_SIZE fail the session */
+void test_http2_header_list_max()
+{
+    int i;
+    int ret;
+    size_t len;
+    size_t b_sent;
+    uint32_t list_max;
+    unsigned char *block;
+    struct h2_test t;
+
+    block = flb_malloc(FLB_HTTP2_FRAME_SIZE);
+    TEST_CHECK(block != NULL);
+    if (!block) {
+        return;
+    }
+    memset(block, 0, FLB_HTTP2_FRAME_SIZE);
+
+    /* a header block that never ends */
+    ret = h2_setup(&t, FLB_HTTP_GET, NULL, 0);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        flb_free(block);
+        return;
+    }
+    frame_write(t.sv[1], FLB_HTTP2_HEADERS, 0, 1,
+                block, FLB_HTTP2_FRAME_SIZE);
+    for (i = 0; i < FLB_HTTP2_HEADER_LIST_MAX / FLB_HTTP2_FRAME_SIZE; i++) {
+        frame_write(t.sv[1], FLB_HTTP2_CONTINUATION, 0, 1,
+                    block, FLB_HTTP2_FRAME_SIZE);
+    }
+
+    ret = flb_http_do(t.c, &b_sent);
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(t.u_conn->http2->status == FLB_HTTP2_SESSION_ERROR);
+    TEST_CHECK(client_goaway(&t, &list_max) == FLB_HTTP2_ENHANCE_YOUR_CALM);
+
+    /* the client announced the limit */
+    TEST_CHECK(list_max == FLB_HTTP2_HEADER_LIST_MAX);
+    h2_teardown(&t);
+
+    /*
+     * A small block that expands: a 1000 bytes field added to the dynamic
+     * table (literal with incremental indexing) and referenced a hundred
+     * times.
+     */
+    ret = h2_setup(&t, FLB_HTTP_GET, NULL, 0);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        flb_free(block);
+        return;
+    }
+
+    len = 0;
+    block[len++] = STATUS_200[0];
+    block[len++] = 0x40;
+    block[len++] = 1;
+    block[len++] = 'x';
+    block[len++] = 0x7f;                /* 1000 = 127 + 873 */
+    block[len++] = 0x80 | (873 & 0x7f);
+    block[len++] = 873 >> 7;
+    memset(block + len, 'a', 1000);
+    len += 1000;
+    for (i = 0; i < 100; i++) {
+        block[len++] = 0x80 | 62;       /* first dynamic table entry */
+    }
+    frame_write(t.sv[1], FLB_HTTP2_HEADERS,
+                FLB_HTTP2_FLAG_END_HEADERS | FLB_HTTP2_FLAG_END_STREAM, 1,
+                block, len);
+
+    ret = flb_http_do(t.c, &b_sent);
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(t.u_conn->http2->status == FLB_HTTP2_SESSION_ERROR);
+    TEST_CHECK(client_goaway(&t, &list_max) == FLB_HTTP2_ENHANCE_YOUR_CALM);
+
+    h2_teardown(&t);
+    flb_free(block);
+}
+
+/* Invalid stream WINDOW_UPDATE frames reset the stream, not the session */
+void test_http2_stream_window_update()
+{
+    int i;
+    int ret;
+    int count;
+    size_t len;
+    size_t b_sent;
+    unsigned char buf[4096];
+    struct h2_frame frames[16];
+    struct h2_frame *f;
+    struct h2_test t;
+    uint32_t increments[2] = { 0, FLB_HTTP2_WINDOW_MAX };
+    uint32_t errors[2] = { FLB_HTTP2_PROTOCOL_ERROR,
+                           FLB_HTTP2_FLOW_CONTROL_ERROR };
+
+    for (i = 0; i < 2; i++) {
+        ret = h2_setup(&t, FLB_HTTP_GET, NULL, 0);
+        TEST_CHECK(ret == 0);
+        if (ret != 0) {
+            return;
+        }
+
+        window_update_write(t.sv[1], 1, increments[i]);
+
+        ret = flb_http_do(t.c, &b_sent);
+        TEST_CHECK(ret == -1);
+        TEST_CHECK(t.u_conn->http2->status == FLB_HTTP2_SESSION_OK);
+
+        len = client_output(&t, buf, sizeof(buf));
+        count = frames_parse(buf, len, frames, 16);
+        TEST_CHECK(count > 0);
+
+        f = frame_find(frames, count, FLB_HTTP2_RST_STREAM, 0);
+        TEST_CHECK(f != NULL && f->id == 1 && f->len == 4);
+        TEST_CHECK(f && get_u32(f->p) == errors[i]);
+        TEST_MSG("increment=%u", increments[i]);
+
+        /* only one reset */
+        TEST_CHECK(f && frame_find(f + 1, count - (f - frames) - 1,
+                                   FLB_HTTP2_RST_STREAM, 0) == NULL);
+        TEST_CHECK(frame_find(frames, count, FLB_HTTP2_GOAWAY, 0) == NULL);
+
+        h2_teardown(&t);
+    }
+}
+
+TEST_LIST = {
+    { "http2_response", test_http2_response},
+    { "http2_window_update", test_http2_window_update},
+    { "http2_early_response", test_http2_early_response},
+    { "http2_goaway", test_http2_goaway},
+    { "http2_header_list_max", test_http2_header_list_max},
+    { "http2_stream_window_update", test_http2_stream_window_update},
+    { 0 }
+};
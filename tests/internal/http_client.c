@@ -5,6 +5,7 @@
 #include <fluent-bit/flb_error.h>
 #include <fluent-bit/flb_socket.h>
 #include <fluent-bit/flb_http_client.h>
+#include <fluent-bit/flb_upstream.h>
 
 #include "flb_tests_internal.h"
 
@@ -79,7 +80,87 @@ void test_http_buffer_increase()
     flb_config_exit(config);
 }
 
+/* Body segments are sent after the body buffer with a single write */
+void test_http_body_segments()
+{
+    int ret;
+    int sv[2];
+    char buf[1024];
+    char *p;
+    ssize_t n;
+    size_t len = 0;
+    size_t b_sent;
+    const char *resp = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    struct flb_http_client *c;
+    struct flb_upstream *u;
+    struct flb_upstream_conn *u_conn;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    u = flb_upstream_create(config, "127.0.0.1", 80, 0, NULL);
+    TEST_CHECK(u != NULL);
+    u->flags &= ~FLB_IO_ASYNC;
+
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    TEST_CHECK(ret == 0);
+
+    u_conn = flb_calloc(1, sizeof(struct flb_upstream_conn));
+    TEST_CHECK(u_conn != NULL);
+    u_conn->u = u;
+    u_conn->fd = sv[0];
+
+    c = flb_http_client(u_conn, FLB_HTTP_POST, "/", "[1,", 3,
+                        "127.0.0.1", 80, NULL, 0);
+    TEST_CHECK(c != NULL);
+
+    ret = flb_http_add_body_segment(c, "2,", 2);
+    TEST_CHECK(ret == 0);
+    ret = flb_http_add_body_segment(c, "", 0);
+    TEST_CHECK(ret == 0);
+    ret = flb_http_add_body_segment(c, "3]", 2);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(c->body_len == 3);
+    TEST_CHECK(c->body_iov_len == 4);
+    TEST_CHECK(c->body_iov_count == 2);
+
+    /* the response is ready before the request is sent */
+    n = write(sv[1], resp, strlen(resp));
+    TEST_CHECK(n == strlen(resp));
+
+    ret = flb_http_do(c, &b_sent);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(c->resp.status == 200);
+
+    while (len < b_sent) {
+        n = read(sv[1], buf + len, sizeof(buf) - len - 1);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    buf[len] = '\0';
+    TEST_CHECK(len == b_sent);
+
+    /* a single Content-Length with the size of all the segments */
+    p = strstr(buf, "Content-Length: 7\r\n");
+    TEST_CHECK(p != NULL);
+    TEST_CHECK(p && strstr(p + 1, "Content-Length") == NULL);
+
+    p = strstr(buf, "\r\n\r\n");
+    TEST_CHECK(p != NULL && strcmp(p + 4, "[1,2,3]") == 0);
+
+    flb_http_client_destroy(c);
+    close(sv[0]);
+    close(sv[1]);
+    flb_free(u_conn);
+    flb_upstream_destroy(u);
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     { "http_buffer_increase", test_http_buffer_increase},
+    { "http_body_segments", test_http_body_segments},
     { 0 }
 };
@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fluent-bit/flb_input_chunk.h>
+#include <fluent-bit/flb_storage.h>
 #include "flb_tests_internal.h"
 
 #include "data/input_chunk/log/test_buffer_drop_chunks.h"
@@ -316,10 +317,159 @@ void flb_test_input_chunk_dropping_chunks()
     flb_destroy(ctx);
 }
 
+static int cb_count_records(void *record, size_t size, void *data)
+{
+    int *count = data;
+
+    __sync_fetch_and_add(count, 1);
+    flb_free(record);
+    return 0;
+}
+
+/* Same Tag chunks are merged into the oldest one */
+void flb_test_input_chunk_merge()
+{
+    int i;
+    int ret;
+    size_t size = 0;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    struct flb_config *config;
+    struct flb_input_instance *in;
+    struct flb_output_instance *out;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_input_chunk *c;
+    struct flb_input_chunk *ic[2];
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    in = flb_input_new(config, "lib", NULL, FLB_TRUE);
+    out = flb_output_new(config, "null", NULL, FLB_TRUE);
+    TEST_CHECK(in != NULL && out != NULL);
+    flb_output_set_property(out, "match", "*");
+
+    ret = flb_storage_create(config);
+    TEST_CHECK(ret == 0);
+
+    for (i = 0; i < 2; i++) {
+        ic[i] = flb_input_chunk_create(in, "test", 4);
+        TEST_CHECK(ic[i] != NULL);
+        if (!ic[i]) {
+            return;
+        }
+        msgpack_sbuffer_init(&mp_sbuf);
+        msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+        msgpack_pack_array(&mp_pck, 2);
+        msgpack_pack_int(&mp_pck, i + 1);
+        msgpack_pack_map(&mp_pck, 1);
+        msgpack_pack_str(&mp_pck, 3);
+        msgpack_pack_str_body(&mp_pck, "key", 3);
+        msgpack_pack_str(&mp_pck, 3);
+        msgpack_pack_str_body(&mp_pck, "val", 3);
+
+        ret = flb_input_chunk_write(ic[i], mp_sbuf.data, mp_sbuf.size);
+        TEST_CHECK(ret == 0);
+        size += mp_sbuf.size;
+        msgpack_sbuffer_destroy(&mp_sbuf);
+    }
+    TEST_CHECK(mk_list_size(&in->chunks) == 2);
+
+    ret = flb_input_chunk_merge(ic[0], ic[1]);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(mk_list_size(&in->chunks) == 1);
+    TEST_CHECK(flb_input_chunk_get_size(ic[0]) == size);
+#ifdef FLB_HAVE_METRICS
+    TEST_CHECK(ic[0]->total_records == 2);
+#endif
+
+    /* a chunk being flushed is not modified */
+    ic[1] = flb_input_chunk_create(in, "test", 4);
+    TEST_CHECK(ic[1] != NULL);
+    flb_input_chunk_flush(ic[0], &size);
+    TEST_CHECK(flb_input_chunk_merge(ic[0], ic[1]) == -1);
+    TEST_CHECK(mk_list_size(&in->chunks) == 2);
+
+    mk_list_foreach_safe(head, tmp, &in->chunks) {
+        c = mk_list_entry(head, struct flb_input_chunk, _head);
+        flb_input_chunk_destroy(c, FLB_TRUE);
+    }
+    flb_storage_destroy(config);
+    flb_config_exit(config);
+}
+
+void flb_test_input_chunk_coalesce()
+{
+    int i;
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    int records = 0;
+    char buf[64];
+    flb_ctx_t *ctx;
+    struct flb_input_instance *i_ins;
+    struct flb_lib_out_cb cb;
+
+    cb.cb = cb_count_records;
+    cb.data = &records;
+
+    ctx = flb_create();
+    ret = flb_service_set(ctx,
+                          "flush", "0.5", "grace", "1",
+                          "Log_Level", "error",
+                          NULL);
+    TEST_CHECK_(ret == 0, "setting service options");
+
+    in_ffd = flb_input(ctx, (char *) "lib", NULL);
+    TEST_CHECK(flb_input_set(ctx, in_ffd, "tag", "test", NULL) == 0);
+
+    /* hold chunks up to 10 records or 3 seconds */
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "match", "test",
+                              "dispatch.coalesce_records", "10",
+                              "dispatch.coalesce_wait", "3",
+                              NULL) == 0);
+
+    ret = flb_start(ctx);
+    TEST_CHECK(ret == 0);
+
+    i_ins = mk_list_entry_first(&ctx->config->inputs,
+                                struct flb_input_instance,
+                                _head);
+
+    /* a few records over several flushes stay in the same chunk */
+    for (i = 0; i < 4; i++) {
+        ret = snprintf(buf, sizeof(buf), "[%i, {\"key\": \"val\"}]", i + 1);
+        flb_lib_push(ctx, in_ffd, buf, ret);
+        usleep(400000);
+    }
+    TEST_CHECK(__sync_fetch_and_add(&records, 0) == 0);
+    TEST_CHECK(mk_list_size(&i_ins->chunks) == 1);
+
+    /* the latency budget expires */
+    sleep(3);
+    TEST_CHECK(__sync_fetch_and_add(&records, 0) == 4);
+
+    /* reaching the records target dispatch the chunk right away */
+    for (i = 0; i < 10; i++) {
+        ret = snprintf(buf, sizeof(buf), "[%i, {\"key\": \"val\"}]", i + 1);
+        flb_lib_push(ctx, in_ffd, buf, ret);
+    }
+    sleep(1);
+    TEST_CHECK(__sync_fetch_and_add(&records, 0) == 14);
+
+    flb_stop(ctx);
+    flb_destroy(ctx);
+}
+
 /* Test list */
 TEST_LIST = {
     {"input_chunk_exceed_limit",       flb_test_input_chunk_exceed_limit},
     {"input_chunk_buffer_valid",       flb_test_input_chunk_buffer_valid},
     {"input_chunk_dropping_chunks",    flb_test_input_chunk_dropping_chunks},
+    {"input_chunk_merge",              flb_test_input_chunk_merge},
+    {"input_chunk_coalesce",           flb_test_input_chunk_coalesce},
     {NULL, NULL}
 };
@@ -626,6 +626,203 @@ void test_json_pack_bug1278()
     }
 }
 
+/*
+ * A buffer holding complete messages followed by an incomplete one must
+ * pack the complete messages and report where the partial tail starts.
+ */
+void test_json_pack_partial_tail()
+{
+    int ret;
+    int out_size;
+    size_t off = 0;
+    char *out_buf = NULL;
+    char buf[] = "{\"a\": 1} [\"b\", 2.5] {\"c\": \"d";
+    msgpack_unpacked result;
+    struct flb_pack_state state;
+
+    ret = flb_pack_state_init(&state);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_pack_json_state(buf, sizeof(buf) - 1, &out_buf, &out_size,
+                              &state);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(state.last_byte == 19);
+
+    ret = 0;
+    msgpack_unpacked_init(&result);
+    while (msgpack_unpack_next(&result, out_buf, out_size, &off) ==
+           MSGPACK_UNPACK_SUCCESS) {
+        ret++;
+    }
+    msgpack_unpacked_destroy(&result);
+    TEST_CHECK(ret == 2);
+
+    flb_pack_state_reset(&state);
+    flb_free(out_buf);
+}
+
+/*
+ * A big message received in small pieces: every call must resume the scan
+ * where the previous one stopped and the result must be the same as
+ * packing the whole message at once.
+ */
+void test_json_pack_resume()
+{
+    int i;
+    int ret;
+    int type;
+    int out_size;
+    int items = 2000;
+    size_t len = 0;
+    size_t size;
+    size_t pos = 0;
+    size_t exp_size;
+    char *data;
+    char *exp_buf;
+    char *out_buf = NULL;
+    struct flb_pack_state state;
+
+    size = items * 64 + 64;
+    data = flb_malloc(size);
+    TEST_CHECK(data != NULL);
+    if (!data) {
+        return;
+    }
+
+    len += snprintf(data, size, "{\"items\": [");
+    for (i = 0; i < items; i++) {
+        len += snprintf(data + len, size - len,
+                        "%s{\"id\": %i, \"msg\": \"line\\n%i\", "
+                        "\"v\": [true, null, %i.5]}",
+                        i > 0 ? ", " : "", i, i, i);
+    }
+    len += snprintf(data + len, size - len, "]} ");
+
+    ret = flb_pack_json(data, len, &exp_buf, &exp_size, &type);
+    TEST_CHECK(ret == 0);
+
+    ret = flb_pack_state_init(&state);
+    TEST_CHECK(ret == 0);
+
+    /* feed 7 bytes at a time */
+    for (i = 7; i < len; i += 7) {
+        ret = flb_pack_json_state(data, i, &out_buf, &out_size, &state);
+        if (ret != FLB_ERR_JSON_PART) {
+            break;
+        }
+        TEST_CHECK(state.scan_resume == FLB_TRUE);
+
+        /* the scan never goes back */
+        TEST_CHECK(state.scan_pos >= pos && state.scan_pos <= i);
+        pos = state.scan_pos;
+    }
+    TEST_CHECK(ret == FLB_ERR_JSON_PART);
+    TEST_CHECK(pos > len - 64);
+
+    ret = flb_pack_json_state(data, len, &out_buf, &out_size, &state);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(state.last_byte == len - 1);
+    TEST_CHECK(state.scan_resume == FLB_FALSE);
+    TEST_CHECK(out_size == exp_size);
+    if (ret == 0 && out_size == exp_size) {
+        TEST_CHECK(memcmp(out_buf, exp_buf, exp_size) == 0);
+    }
+
+    /* an invalid byte found after resuming fails the message */
+    data[len - 3] = ')';
+    flb_pack_state_reset(&state);
+    flb_pack_state_init(&state);
+    ret = flb_pack_json_state(data, len - 4, &out_buf, &out_size, &state);
+    TEST_CHECK(ret == FLB_ERR_JSON_PART);
+    ret = flb_pack_json_state(data, len, &out_buf, &out_size, &state);
+    TEST_CHECK(ret == FLB_ERR_JSON_INVAL);
+
+    flb_pack_state_reset(&state);
+    flb_free(out_buf);
+    flb_free(exp_buf);
+    flb_free(data);
+}
+
+/* Compose a JSON body incrementally with the append interface */
+void test_json_append()
+{
+    int i;
+    int ret;
+    char *big;
+    size_t size = 100000;
+    flb_sds_t buf;
+    flb_sds_t expected;
+    msgpack_sbuffer mp_sbuf;
+    msgpack_packer mp_pck;
+    msgpack_unpacked result;
+    size_t off = 0;
+
+    msgpack_sbuffer_init(&mp_sbuf);
+    msgpack_packer_init(&mp_pck, &mp_sbuf, msgpack_sbuffer_write);
+    msgpack_pack_map(&mp_pck, 3);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "key", 3);
+    msgpack_pack_str(&mp_pck, 7);
+    msgpack_pack_str_body(&mp_pck, "a\"b\n\001c\\", 7);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "num", 3);
+    msgpack_pack_int64(&mp_pck, -1234567890123LL);
+    msgpack_pack_str(&mp_pck, 3);
+    msgpack_pack_str_body(&mp_pck, "dbl", 3);
+    msgpack_pack_double(&mp_pck, 2.0);
+
+    msgpack_unpacked_init(&result);
+    ret = msgpack_unpack_next(&result, mp_sbuf.data, mp_sbuf.size, &off);
+    TEST_CHECK(ret == MSGPACK_UNPACK_SUCCESS);
+
+    /* start small so the buffer has to grow */
+    buf = flb_sds_create_size(4);
+    TEST_CHECK(buf != NULL);
+
+    for (i = 0; i < 2; i++) {
+        ret = flb_sds_cat_safe(&buf, i == 0 ? "[" : ",", 1);
+        TEST_CHECK(ret == 0);
+        ret = flb_pack_json_append(&buf, &result.data);
+        TEST_CHECK(ret == 0);
+    }
+    ret = flb_sds_cat_safe(&buf, ",", 1);
+    TEST_CHECK(ret == 0);
+    ret = flb_pack_json_append_str(&buf, "tail\t", 5);
+    TEST_CHECK(ret == 0);
+    ret = flb_sds_cat_safe(&buf, "]", 1);
+    TEST_CHECK(ret == 0);
+
+    expected = flb_sds_create("[{\"key\":\"a\\\"b\\n\\u0001c\\\\\","
+                              "\"num\":-1234567890123,\"dbl\":2.0},"
+                              "{\"key\":\"a\\\"b\\n\\u0001c\\\\\","
+                              "\"num\":-1234567890123,\"dbl\":2.0},"
+                              "\"tail\\t\"]");
+    TEST_CHECK(flb_sds_len(buf) == flb_sds_len(expected));
+    TEST_CHECK(strcmp(buf, expected) == 0);
+    if (strcmp(buf, expected) != 0) {
+        printf("expected: %s\noutput  : %s\n", expected, buf);
+    }
+    flb_sds_destroy(expected);
+    flb_sds_destroy(buf);
+    msgpack_unpacked_destroy(&result);
+
+    /* a string much bigger than the initial estimate */
+    big = flb_malloc(size);
+    TEST_CHECK(big != NULL);
+    memset(big, '\n', size);
+
+    buf = flb_sds_create_size(16);
+    ret = flb_pack_json_append_str(&buf, big, size);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_sds_len(buf) == size * 2 + 2);
+    TEST_CHECK(buf[0] == '"' && buf[1] == '\\' && buf[2] == 'n');
+    TEST_CHECK(buf[size * 2 + 1] == '"' && buf[size * 2 + 2] == '\0');
+
+    flb_sds_destroy(buf);
+    flb_free(big);
+    msgpack_sbuffer_destroy(&mp_sbuf);
+}
+
 TEST_LIST = {
     /* JSON maps iteration */
     { "json_pack"          , test_json_pack },
@@ -635,8 +832,11 @@ TEST_LIST = {
     { "json_dup_keys"      , test_json_dup_keys},
     { "json_pack_bug342"   , test_json_pack_bug342},
     { "json_pack_bug1278"  , test_json_pack_bug1278},
+    { "json_pack_resume"      , test_json_pack_resume},
+    { "json_pack_partial_tail", test_json_pack_partial_tail},
 
     /* Mixed bytes, check JSON encoding */
     { "utf8_to_json", test_utf8_to_json},
+    { "json_append" , test_json_append},
     { 0 }
 };
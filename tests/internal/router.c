@@ -1,6 +1,9 @@
 /* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_filter.h>
+#include <fluent-bit/flb_output.h>
 #include <fluent-bit/flb_router.h>
 
 #include "flb_tests_internal.h"
@@ -22,7 +25,14 @@ struct check route_checks[] = {
     {"cpu.rpi"        , "mem.*"      , FLB_FALSE},
     {"cpu.rpi"        , "*u.r*"      , FLB_TRUE},
     {"hoge"           , "hogeeeeeee" , FLB_FALSE},
-    {"test"           , "test"       , FLB_TRUE}
+    {"test"           , "test"       , FLB_TRUE},
+    {"test"           , "test*"      , FLB_TRUE},
+    {"test"           , "tes"        , FLB_FALSE},
+    {"a.b.c.log"      , "a.*.log"    , FLB_TRUE},
+    {"a.log.b.log"    , "*.log"      , FLB_TRUE},
+    {"a.log.b"        , "*.log"      , FLB_FALSE},
+    {"aaab"           , "*a*ab"      , FLB_TRUE},
+    {"kube.var.log"   , "kube.**.log", FLB_TRUE}
 };
 
 void test_router_wildcard()
@@ -47,9 +57,132 @@ void test_router_wildcard()
 
     ret = flb_router_match("aaaX", 3, "aaa", NULL);
     TEST_CHECK(ret == FLB_TRUE);
+
+    ret = flb_router_match("aaaX", 3, "aaa*X", NULL);
+    TEST_CHECK(ret == FLB_FALSE);
+}
+
+void test_router_cache()
+{
+    int ret;
+    struct flb_config *config;
+    struct flb_output_instance *o_kube;
+    struct flb_output_instance *o_syslog;
+    struct flb_filter_instance *f_kube;
+    uint64_t routes_mask[1];
+    struct flb_router_cache_entry entry;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    o_kube = flb_output_new(config, "null", NULL, FLB_TRUE);
+    TEST_CHECK(o_kube != NULL);
+    flb_output_set_property(o_kube, "match", "kube.*");
+
+    o_syslog = flb_output_new(config, "null", NULL, FLB_TRUE);
+    TEST_CHECK(o_syslog != NULL);
+    flb_output_set_property(o_syslog, "match", "*.syslog");
+
+    f_kube = flb_filter_new(config, "stdout", NULL);
+    TEST_CHECK(f_kube != NULL);
+    flb_filter_set_property(f_kube, "match", "kube.var.*");
+
+    entry.routes_mask = routes_mask;
+    TEST_CHECK(config->route_mask_size == 1);
+
+    /* no cache until the routes are set */
+    ret = flb_router_cache_get(config, "kube.var.log", 12, &entry);
+    TEST_CHECK(ret == -1);
+
+    ret = flb_router_cache_create(config);
+    TEST_CHECK(ret == 0);
+
+    /* lookup twice: calculate and then hit the cached entry */
+    ret = flb_router_cache_get(config, "kube.var.log", 12, &entry);
+    TEST_CHECK(ret == 0);
+    ret = flb_router_cache_get(config, "kube.var.log", 12, &entry);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_routes_mask_get_bit(entry.routes_mask, o_kube->id, config) == 1);
+    TEST_CHECK(flb_routes_mask_get_bit(entry.routes_mask, o_syslog->id, config) == 0);
+    TEST_CHECK(flb_router_cache_filter_match(&entry, f_kube->id) == FLB_TRUE);
+
+    ret = flb_router_cache_get(config, "host.syslog", 11, &entry);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_routes_mask_get_bit(entry.routes_mask, o_kube->id, config) == 0);
+    TEST_CHECK(flb_routes_mask_get_bit(entry.routes_mask, o_syslog->id, config) == 1);
+    TEST_CHECK(flb_router_cache_filter_match(&entry, f_kube->id) == FLB_FALSE);
+
+    flb_router_cache_destroy(config);
+    flb_filter_instance_destroy(f_kube);
+    flb_output_instance_destroy(o_kube);
+    flb_output_instance_destroy(o_syslog);
+    flb_config_exit(config);
+}
+
+/* The routes mask grows with the number of outputs */
+void test_router_many_outputs()
+{
+    int i;
+    int ret;
+    char match[32];
+    uint64_t *routes_mask;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct flb_config *config;
+    struct flb_output_instance *ins;
+    struct flb_router_cache_entry entry;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    for (i = 0; i < 300; i++) {
+        ins = flb_output_new(config, "null", NULL, FLB_TRUE);
+        TEST_CHECK(ins != NULL);
+        snprintf(match, sizeof(match), "tenant.%i", i % 100);
+        flb_output_set_property(ins, "match", match);
+    }
+    TEST_CHECK(config->route_mask_size == 5);
+
+    routes_mask = flb_calloc(1, flb_routes_mask_bytes(config));
+    TEST_CHECK(routes_mask != NULL);
+    TEST_CHECK(flb_routes_mask_is_empty(routes_mask, config) == FLB_TRUE);
+
+    ret = flb_router_cache_create(config);
+    TEST_CHECK(ret == 0);
+
+    entry.routes_mask = routes_mask;
+    ret = flb_router_cache_get(config, "tenant.99", 9, &entry);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_routes_mask_get_bit(routes_mask, 99, config) == 1);
+    TEST_CHECK(flb_routes_mask_get_bit(routes_mask, 199, config) == 1);
+    TEST_CHECK(flb_routes_mask_get_bit(routes_mask, 299, config) == 1);
+    TEST_CHECK(flb_routes_mask_get_bit(routes_mask, 298, config) == 0);
+
+    flb_routes_mask_clear_bit(routes_mask, 99, config);
+    flb_routes_mask_clear_bit(routes_mask, 199, config);
+    TEST_CHECK(flb_routes_mask_is_empty(routes_mask, config) == FLB_FALSE);
+    flb_routes_mask_clear_bit(routes_mask, 299, config);
+    TEST_CHECK(flb_routes_mask_is_empty(routes_mask, config) == FLB_TRUE);
+
+    /* the cached value is not affected */
+    ret = flb_router_cache_get(config, "tenant.99", 9, &entry);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flb_routes_mask_get_bit(routes_mask, 99, config) == 1);
+    TEST_CHECK(flb_routes_mask_get_bit(routes_mask, 199, config) == 1);
+    TEST_CHECK(flb_routes_mask_get_bit(routes_mask, 299, config) == 1);
+
+    flb_free(routes_mask);
+    flb_router_cache_destroy(config);
+    mk_list_foreach_safe(head, tmp, &config->outputs) {
+        ins = mk_list_entry(head, struct flb_output_instance, _head);
+        flb_output_instance_destroy(ins);
+    }
+    flb_config_exit(config);
 }
 
 TEST_LIST = {
     { "wildcard", test_router_wildcard},
+    { "cache"   , test_router_cache},
+    { "many_outputs", test_router_many_outputs},
     { 0 }
 };
@@ -659,8 +659,116 @@ void normalize()
     check_normalize("/./example", 10, "/example");
 }
 
+/* Sign a POST request, the payload after 'split' goes in body segments */
+static flb_sds_t sign_body(struct flb_config *config,
+                           struct flb_aws_provider *provider,
+                           char *content_type, char *body, size_t split)
+{
+    size_t len;
+    size_t half;
+    flb_sds_t signature;
+    struct flb_upstream *u;
+    struct flb_upstream_conn *u_conn;
+    struct flb_http_client *c;
+
+    u = flb_upstream_create(config, "127.0.0.1", 80, 0, NULL);
+    u_conn = flb_calloc(1, sizeof(struct flb_upstream_conn));
+    if (!u || !u_conn) {
+        return NULL;
+    }
+    u_conn->u = u;
+
+    c = flb_http_client(u_conn, FLB_HTTP_POST, "/", body, split,
+                        "example.amazonaws.com", 443, NULL, 0);
+    if (!c) {
+        flb_free(u_conn);
+        return NULL;
+    }
+
+    len = strlen(body) - split;
+    half = len / 2;
+    flb_http_add_body_segment(c, body + split, half);
+    flb_http_add_body_segment(c, body + split + half, len - half);
+    flb_http_add_header(c, "Content-Type", 12,
+                        content_type, strlen(content_type));
+
+    /* '20150830T123600Z' */
+    signature = flb_signv4_do(c, FLB_TRUE, FLB_TRUE, 1440938160,
+                              "us-east-1", "service", 0, provider);
+
+    flb_http_client_destroy(c);
+    flb_free(u_conn);
+    return signature;
+}
+
+static void check_body_segments(struct flb_config *config,
+                                struct flb_aws_provider *provider,
+                                char *content_type, char *body, char *other)
+{
+    size_t split;
+    flb_sds_t whole;
+    flb_sds_t signature;
+
+    whole = sign_body(config, provider, content_type, body, strlen(body));
+    TEST_CHECK(whole != NULL);
+    if (!whole) {
+        return;
+    }
+
+    /* the payload is the same no matter how it's split */
+    for (split = 0; split < strlen(body); split += 3) {
+        signature = sign_body(config, provider, content_type, body, split);
+        TEST_CHECK(signature != NULL && strcmp(signature, whole) == 0);
+        TEST_MSG("split at %zu", split);
+        flb_sds_destroy(signature);
+    }
+
+    /* ...and the segments are part of it */
+    signature = sign_body(config, provider, content_type, other, 0);
+    TEST_CHECK(signature != NULL && strcmp(signature, whole) != 0);
+    flb_sds_destroy(signature);
+
+    flb_sds_destroy(whole);
+}
+
+void body_segments()
+{
+    int ret;
+    struct flb_config *config;
+    struct flb_aws_provider *provider;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    ret = setenv(AWS_ACCESS_KEY_ID, "AKIDEXAMPLE", 1);
+    TEST_CHECK(ret == 0);
+    ret = setenv(AWS_SECRET_ACCESS_KEY,
+                 "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", 1);
+    TEST_CHECK(ret == 0);
+    provider = flb_aws_env_provider_create();
+    TEST_CHECK(provider != NULL);
+    if (!provider) {
+        flb_config_exit(config);
+        return;
+    }
+
+    /* hashed payload */
+    check_body_segments(config, provider, "application/json",
+                        "{\"key\": \"value\"}", "{\"key\": \"other\"}");
+
+    /* urlencoded parameters are part of the canonical request */
+    check_body_segments(config, provider,
+                        "application/x-www-form-urlencoded",
+                        "Param1=value1&Param2=value2",
+                        "Param1=value1&Param2=other");
+
+    flb_aws_provider_destroy(provider);
+    flb_config_exit(config);
+}
+
 TEST_LIST = {
     { "aws_test_suite", aws_test_suite},
     { "normalize", normalize},
+    { "body_segments", body_segments},
     { 0 }
 };
@@ -0,0 +1,103 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_task.h>
+#include <fluent-bit/flb_task_map.h>
+
+#include "flb_tests_internal.h"
+
+#define N_TASKS  5000
+
+/* IDs go past the old fixed size of 2048 slots and get reused */
+void test_grow()
+{
+    int i;
+    int id;
+    int *ids;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+
+    ids = flb_malloc(sizeof(int) * N_TASKS);
+    TEST_CHECK(ids != NULL);
+
+    for (i = 0; i < N_TASKS; i++) {
+        ids[i] = flb_task_map_get_id(config);
+        TEST_CHECK(ids[i] == i);
+        flb_task_map_set(config, ids[i], &ids[i]);
+    }
+    TEST_CHECK(config->tasks_count == N_TASKS);
+    TEST_CHECK(config->tasks_map_size >= N_TASKS);
+    TEST_CHECK(flb_task_map_get(config, 4000) == &ids[4000]);
+    TEST_CHECK(flb_task_map_get(config, -1) == NULL);
+    TEST_CHECK(flb_task_map_get(config, config->tasks_map_size) == NULL);
+
+    /* the last released ID is the first one taken again */
+    flb_task_map_release_id(config, 10);
+    flb_task_map_release_id(config, 3000);
+    TEST_CHECK(flb_task_map_get(config, 3000) == NULL);
+    TEST_CHECK(config->tasks_count == N_TASKS - 2);
+
+    id = flb_task_map_get_id(config);
+    TEST_CHECK(id == 3000);
+    id = flb_task_map_get_id(config);
+    TEST_CHECK(id == 10);
+
+    flb_free(ids);
+    flb_config_exit(config);
+}
+
+void test_hard_limit()
+{
+    int i;
+    int id;
+    struct flb_config *config;
+
+    config = flb_config_init();
+    TEST_CHECK(config != NULL);
+    config->task_hard_limit = 300;
+
+    for (i = 0; i < 300; i++) {
+        id = flb_task_map_get_id(config);
+        TEST_CHECK(id == i);
+    }
+    TEST_CHECK(config->tasks_map_size == 300);
+    TEST_CHECK(flb_task_map_get_id(config) == -1);
+
+    flb_task_map_release_id(config, 42);
+    TEST_CHECK(flb_task_map_get_id(config) == 42);
+    TEST_CHECK(flb_task_map_get_id(config) == -1);
+
+    flb_config_exit(config);
+}
+
+/* Task return events carry IDs wider than the former 14 bits */
+void test_event()
+{
+    uint64_t val;
+
+    val = FLB_TASK_EVENT(FLB_ENGINE_TASK, FLB_TASK_SET(FLB_RETRY, 70000, 9));
+    TEST_CHECK(FLB_TASK_EVENT_TYPE(val) == FLB_ENGINE_TASK);
+    TEST_CHECK(FLB_TASK_RET(val) == FLB_RETRY);
+    TEST_CHECK(FLB_TASK_ID(val) == 70000);
+    TEST_CHECK(FLB_TASK_OUT(val) == 9);
+
+    val = FLB_TASK_EVENT(FLB_ENGINE_TASK,
+                         FLB_TASK_SET(FLB_ERROR, FLB_TASK_ID_MAX,
+                                      FLB_TASK_ID_MAX));
+    TEST_CHECK(FLB_TASK_EVENT_TYPE(val) == FLB_ENGINE_TASK);
+    TEST_CHECK(FLB_TASK_RET(val) == FLB_ERROR);
+    TEST_CHECK(FLB_TASK_ID(val) == FLB_TASK_ID_MAX);
+    TEST_CHECK(FLB_TASK_OUT(val) == FLB_TASK_ID_MAX);
+}
+
+TEST_LIST = {
+    {"grow"      , test_grow},
+    {"hard_limit", test_hard_limit},
+    {"event"     , test_event},
+    { 0 }
+};
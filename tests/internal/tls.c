@@ -0,0 +1,288 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_sds.h>
+#include <fluent-bit/tls/flb_tls.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include "flb_tests_internal.h"
+
+/*
+ * Fake backend: a session is just the time it was established, the saved
+ * session is a copy of it. No handshake is done so the cache logic can be
+ * tested without a network.
+ */
+struct fake_session {
+    int id;
+    time_t start;
+};
+
+static int saved_count;
+static int resume_count;
+
+static void *fake_session_save(void *ptr_session)
+{
+    struct fake_session *saved;
+
+    saved = flb_malloc(sizeof(struct fake_session));
+    if (!saved) {
+        return NULL;
+    }
+    memcpy(saved, ptr_session, sizeof(struct fake_session));
+    saved_count++;
+
+    return saved;
+}
+
+static int fake_session_resume(void *ptr_session, void *saved)
+{
+    memcpy(ptr_session, saved, sizeof(struct fake_session));
+    resume_count++;
+    return 0;
+}
+
+static void fake_session_saved_destroy(void *saved)
+{
+    flb_free(saved);
+    saved_count--;
+}
+
+static time_t fake_session_time(void *saved)
+{
+    return ((struct fake_session *) saved)->start;
+}
+
+static struct flb_tls_backend fake_backend = {
+    .name                  = "fake",
+    .session_save          = fake_session_save,
+    .session_resume        = fake_session_resume,
+    .session_saved_destroy = fake_session_saved_destroy,
+    .session_time          = fake_session_time
+};
+
+static struct flb_tls *tls_cache_create()
+{
+    struct flb_tls *tls;
+
+    tls = flb_calloc(1, sizeof(struct flb_tls));
+    if (!tls) {
+        return NULL;
+    }
+    tls->session_cache = FLB_TRUE;
+    tls->session_lifetime = FLB_TLS_SESSION_LIFETIME;
+    mk_list_init(&tls->session_list);
+    pthread_mutex_init(&tls->session_mutex, NULL);
+    tls->api = &fake_backend;
+
+    saved_count = 0;
+    resume_count = 0;
+
+    return tls;
+}
+
+static struct flb_tls_cache_entry *cache_first(struct flb_tls *tls)
+{
+    if (mk_list_is_empty(&tls->session_list) == 0) {
+        return NULL;
+    }
+    return mk_list_entry_first(&tls->session_list,
+                               struct flb_tls_cache_entry, _head);
+}
+
+void test_session_cache_resume()
+{
+    int ret;
+    struct flb_tls *tls;
+    struct fake_session s1 = { 1, 0 };
+    struct fake_session s2 = { 0, 0 };
+
+    tls = tls_cache_create();
+    TEST_CHECK(tls != NULL);
+
+    s1.start = time(NULL);
+    flb_tls_session_cache_save(tls, &s1, "host:443");
+    TEST_CHECK(tls->session_count == 1);
+    TEST_CHECK(saved_count == 1);
+
+    /* unknown server */
+    ret = flb_tls_session_cache_resume(tls, &s2, "other:443");
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(resume_count == 0);
+
+    ret = flb_tls_session_cache_resume(tls, &s2, "host:443");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(resume_count == 1);
+    TEST_CHECK(s2.id == 1);
+
+    flb_tls_session_cache_remove(tls, "host:443");
+    TEST_CHECK(tls->session_count == 0);
+    TEST_CHECK(saved_count == 0);
+
+    flb_tls_destroy(tls);
+}
+
+void test_session_cache_expiry()
+{
+    int ret;
+    time_t now;
+    struct flb_tls *tls;
+    struct fake_session s1 = { 1, 0 };
+    struct fake_session s2 = { 0, 0 };
+
+    tls = tls_cache_create();
+    TEST_CHECK(tls != NULL);
+
+    /* the lifetime counts from the session start, not from the save */
+    now = time(NULL);
+    s1.start = now - FLB_TLS_SESSION_LIFETIME;
+    flb_tls_session_cache_save(tls, &s1, "host:443");
+    TEST_CHECK(tls->session_count == 1);
+    TEST_CHECK(cache_first(tls)->ts == s1.start);
+
+    ret = flb_tls_session_cache_resume(tls, &s2, "host:443");
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(resume_count == 0);
+    TEST_CHECK(tls->session_count == 0);
+    TEST_CHECK(saved_count == 0);
+
+    /* still valid until it expires */
+    s1.start = now - FLB_TLS_SESSION_LIFETIME + 2;
+    flb_tls_session_cache_save(tls, &s1, "host:443");
+    ret = flb_tls_session_cache_resume(tls, &s2, "host:443");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(resume_count == 1);
+
+    /* a backend without the session time uses the save time */
+    fake_backend.session_time = NULL;
+    s1.start = now - FLB_TLS_SESSION_LIFETIME;
+    flb_tls_session_cache_save(tls, &s1, "host:443");
+    TEST_CHECK(cache_first(tls)->ts >= now);
+    fake_backend.session_time = fake_session_time;
+
+    flb_tls_destroy(tls);
+    TEST_CHECK(saved_count == 0);
+}
+
+void test_session_cache_reused()
+{
+    int i;
+    int ret;
+    time_t start;
+    struct flb_tls *tls;
+    struct fake_session s1 = { 1, 0 };
+    struct fake_session s2;
+
+    tls = tls_cache_create();
+    TEST_CHECK(tls != NULL);
+
+    start = time(NULL) - FLB_TLS_SESSION_LIFETIME + 5;
+    s1.start = start;
+    flb_tls_session_cache_save(tls, &s1, "host:443");
+
+    /*
+     * Every connection resumes the session and saves it again: the entry
+     * must keep the original start time so it expires in the end.
+     */
+    for (i = 0; i < 3; i++) {
+        memset(&s2, 0, sizeof(s2));
+        ret = flb_tls_session_cache_resume(tls, &s2, "host:443");
+        TEST_CHECK(ret == 0);
+        flb_tls_session_cache_save(tls, &s2, "host:443");
+        TEST_CHECK(tls->session_count == 1);
+        TEST_CHECK(cache_first(tls)->ts == start);
+    }
+
+    /* move the session start past its lifetime */
+    cache_first(tls)->ts = start - 5;
+    ret = flb_tls_session_cache_resume(tls, &s2, "host:443");
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(tls->session_count == 0);
+
+    flb_tls_destroy(tls);
+    TEST_CHECK(saved_count == 0);
+}
+
+void test_session_cache_replace()
+{
+    int ret;
+    struct flb_tls *tls;
+    struct fake_session s1 = { 1, 0 };
+    struct fake_session s2 = { 2, 0 };
+    struct fake_session s3 = { 3, 0 };
+    struct fake_session out = { 0, 0 };
+
+    tls = tls_cache_create();
+    TEST_CHECK(tls != NULL);
+
+    s1.start = s2.start = s3.start = time(NULL);
+    flb_tls_session_cache_save(tls, &s1, "a:443");
+    flb_tls_session_cache_save(tls, &s2, "b:443");
+    TEST_CHECK(tls->session_count == 2);
+
+    /* a new session for the same server replaces the old one */
+    flb_tls_session_cache_save(tls, &s3, "a:443");
+    TEST_CHECK(tls->session_count == 2);
+    TEST_CHECK(saved_count == 2);
+
+    ret = flb_tls_session_cache_resume(tls, &out, "a:443");
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(out.id == 3);
+
+    /* the replaced entry is the newest one */
+    TEST_CHECK(strcmp(cache_first(tls)->key, "b:443") == 0);
+
+    flb_tls_destroy(tls);
+    TEST_CHECK(saved_count == 0);
+}
+
+void test_session_cache_max()
+{
+    int i;
+    int ret;
+    char key[32];
+    struct flb_tls *tls;
+    struct fake_session s1 = { 0, 0 };
+    struct fake_session out;
+
+    tls = tls_cache_create();
+    TEST_CHECK(tls != NULL);
+
+    s1.start = time(NULL);
+    for (i = 0; i < FLB_TLS_SESSION_CACHE_MAX + 1; i++) {
+        s1.id = i;
+        snprintf(key, sizeof(key), "host-%i:443", i);
+        flb_tls_session_cache_save(tls, &s1, key);
+    }
+    TEST_CHECK(tls->session_count == FLB_TLS_SESSION_CACHE_MAX);
+    TEST_CHECK(saved_count == FLB_TLS_SESSION_CACHE_MAX);
+
+    /* the oldest server was dropped */
+    ret = flb_tls_session_cache_resume(tls, &out, "host-0:443");
+    TEST_CHECK(ret == -1);
+
+    for (i = 1; i < FLB_TLS_SESSION_CACHE_MAX + 1; i++) {
+        snprintf(key, sizeof(key), "host-%i:443", i);
+        ret = flb_tls_session_cache_resume(tls, &out, key);
+        TEST_CHECK(ret == 0);
+        TEST_CHECK(out.id == i);
+    }
+
+    /* disabling the cache releases every session */
+    flb_tls_set_session_cache(tls, FLB_FALSE, FLB_TLS_SESSION_LIFETIME);
+    TEST_CHECK(tls->session_count == 0);
+    TEST_CHECK(saved_count == 0);
+
+    flb_tls_destroy(tls);
+}
+
+TEST_LIST = {
+    { "session_cache_resume", test_session_cache_resume },
+    { "session_cache_expiry", test_session_cache_expiry },
+    { "session_cache_reused", test_session_cache_reused },
+    { "session_cache_replace", test_session_cache_replace },
+    { "session_cache_max", test_session_cache_max },
+    { 0 }
+};
@@ -0,0 +1,320 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fluent-bit/flb_info.h>
+#include <fluent-bit/flb_mem.h>
+#include <fluent-bit/flb_coro.h>
+#include <fluent-bit/flb_engine.h>
+#include <fluent-bit/flb_config.h>
+#include <fluent-bit/flb_network.h>
+#include <fluent-bit/flb_socket.h>
+#include <fluent-bit/flb_upstream.h>
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_counter.h>
+
+#include <unistd.h>
+
+#include "flb_tests_internal.h"
+
+/*
+ * The connections pool with 'net.max_connections' set to 1: the listener
+ * never accepts, the kernel completes the connections in its backlog.
+ */
+
+#define TEST_HOST   "127.0.0.1"
+#define TEST_PORT   "41323"
+
+/* A coroutine that takes a connection and holds it until resumed */
+struct pool_coro {
+    int got;
+    int done;
+    struct flb_upstream *u;
+    struct flb_upstream_conn *conn;
+    struct flb_coro *coro;
+};
+
+struct pool_test {
+    flb_sockfd_t fd_server;
+    struct mk_event_loop *evl;
+    struct flb_config *config;
+    struct flb_upstream *u;
+    struct cmt *cmt;
+};
+
+static struct pool_coro *current;
+
+static void coro_entry()
+{
+    struct pool_coro *pc = current;
+
+    pc->conn = flb_upstream_conn_get(pc->u);
+    pc->got = FLB_TRUE;
+
+    if (pc->conn) {
+        flb_coro_yield(pc->coro, FLB_FALSE);
+        flb_upstream_conn_release(pc->conn);
+    }
+
+    pc->done = FLB_TRUE;
+    flb_coro_yield(pc->coro, FLB_TRUE);
+}
+
+static void pool_coro_start(struct pool_test *t, struct pool_coro *pc)
+{
+    size_t stack_size;
+
+    memset(pc, '\0', sizeof(struct pool_coro));
+    pc->u = t->u;
+    pc->coro = flb_coro_create(pc);
+    pc->coro->caller = co_active();
+    pc->coro->callee = co_create(t->config->coro_stack_size,
+                                 coro_entry, &stack_size);
+
+    current = pc;
+    flb_coro_resume(pc->coro);
+}
+
+static double gauge_get(struct cmt_gauge *g)
+{
+    double val = -1;
+    char *labels[] = {"test"};
+
+    cmt_gauge_get_val(g, 1, labels, &val);
+    return val;
+}
+
+static double counter_get(struct cmt_counter *c)
+{
+    double val = -1;
+    char *labels[] = {"test"};
+
+    cmt_counter_get_val(c, 1, labels, &val);
+    return val;
+}
+
+static int pool_setup(struct pool_test *t)
+{
+    struct flb_upstream *u;
+
+    memset(t, '\0', sizeof(struct pool_test));
+
+    flb_coro_init();
+    flb_engine_evl_init();
+
+    t->config = flb_config_init();
+    TEST_CHECK(t->config != NULL);
+    if (!t->config) {
+        return -1;
+    }
+
+    t->evl = mk_event_loop_create(16);
+    TEST_CHECK(t->evl != NULL);
+    flb_engine_evl_set(t->evl);
+
+    t->fd_server = flb_net_server(TEST_PORT, TEST_HOST);
+    TEST_CHECK(t->fd_server != -1);
+    if (t->fd_server == -1) {
+        return -1;
+    }
+
+    u = flb_upstream_create(t->config, TEST_HOST, atoi(TEST_PORT),
+                            FLB_IO_TCP, NULL);
+    TEST_CHECK(u != NULL);
+    if (!u) {
+        return -1;
+    }
+    u->net.max_connections = 1;
+    u->net.warmup_connections = 1;
+    t->u = u;
+
+    /* the metrics an output instance sets on its upstreams */
+    t->cmt = cmt_create();
+    TEST_CHECK(t->cmt != NULL);
+    u->cmt_name = "test";
+    u->cmt_busy = cmt_gauge_create(t->cmt, "fluentbit", "output",
+                                   "upstream_busy_connections", "busy",
+                                   1, (char *[]) {"name"});
+    u->cmt_idle = cmt_gauge_create(t->cmt, "fluentbit", "output",
+                                   "upstream_idle_connections", "idle",
+                                   1, (char *[]) {"name"});
+    u->cmt_waiters = cmt_gauge_create(t->cmt, "fluentbit", "output",
+                                      "upstream_waiters", "waiters",
+                                      1, (char *[]) {"name"});
+    u->cmt_waits = cmt_counter_create(t->cmt, "fluentbit", "output",
+                                      "upstream_waits_total", "waits",
+                                      1, (char *[]) {"name"});
+    u->cmt_wait_time = cmt_counter_create(t->cmt, "fluentbit", "output",
+                                          "upstream_wait_seconds_total",
+                                          "wait time", 1, (char *[]) {"name"});
+
+    return 0;
+}
+
+static void pool_teardown(struct pool_test *t)
+{
+    if (t->u) {
+        flb_upstream_destroy(t->u);
+    }
+    if (t->cmt) {
+        cmt_destroy(t->cmt);
+    }
+    if (t->fd_server != -1) {
+        flb_socket_close(t->fd_server);
+    }
+    flb_engine_evl_set(NULL);
+    if (t->evl) {
+        mk_event_loop_destroy(t->evl);
+    }
+    flb_config_exit(t->config);
+}
+
+/* warmup_connections opens an idle keepalive connection */
+void test_pool_warmup()
+{
+    int ret;
+    struct pool_test t;
+    struct pool_coro a;
+
+    ret = pool_setup(&t);
+    if (ret != 0) {
+        return;
+    }
+
+    /* never more than max_connections */
+    t.u->net.warmup_connections = 4;
+    ret = flb_upstream_conn_warmup(t.u);
+    TEST_CHECK(ret == 1);
+    TEST_CHECK(mk_list_size(&t.u->queue.av_queue) == 1);
+    TEST_CHECK(mk_list_size(&t.u->queue.busy_queue) == 0);
+    TEST_CHECK(gauge_get(t.u->cmt_idle) == 1);
+    TEST_CHECK(gauge_get(t.u->cmt_busy) == 0);
+
+    /* the first user recycles it */
+    pool_coro_start(&t, &a);
+    TEST_CHECK(a.got == FLB_TRUE && a.conn != NULL);
+    TEST_CHECK(a.conn && a.conn->ka_count == 1);
+    TEST_CHECK(gauge_get(t.u->cmt_idle) == 0);
+    TEST_CHECK(gauge_get(t.u->cmt_busy) == 1);
+
+    flb_coro_resume(a.coro);
+    TEST_CHECK(a.done == FLB_TRUE);
+    TEST_CHECK(gauge_get(t.u->cmt_idle) == 1);
+    TEST_CHECK(gauge_get(t.u->cmt_busy) == 0);
+    flb_coro_destroy(a.coro);
+
+    /* no keepalive, nothing to warm up */
+    t.u->net.keepalive = FLB_FALSE;
+    TEST_CHECK(flb_upstream_conn_warmup(t.u) == 0);
+
+    pool_teardown(&t);
+}
+
+/* A released connection is handed over to the coroutine waiting for it */
+void test_pool_handover()
+{
+    int ret;
+    struct pool_test t;
+    struct pool_coro a;
+    struct pool_coro b;
+    struct flb_upstream_conn *conn;
+
+    ret = pool_setup(&t);
+    if (ret != 0) {
+        return;
+    }
+    ret = flb_upstream_conn_warmup(t.u);
+    TEST_CHECK(ret == 1);
+
+    pool_coro_start(&t, &a);
+    TEST_CHECK(a.got == FLB_TRUE && a.conn != NULL);
+    conn = a.conn;
+
+    /* the pool is full: 'b' waits */
+    pool_coro_start(&t, &b);
+    TEST_CHECK(b.got == FLB_FALSE);
+    TEST_CHECK(mk_list_size(&t.u->queue.wait_queue) == 1);
+    TEST_CHECK(gauge_get(t.u->cmt_waiters) == 1);
+
+    /* nothing to resume until a connection is released */
+    TEST_CHECK(flb_upstream_conn_waiters_resume(t.u) == 0);
+
+    /* 'a' releases its connection, it stays busy for 'b' */
+    flb_coro_resume(a.coro);
+    TEST_CHECK(a.done == FLB_TRUE);
+    TEST_CHECK(mk_list_size(&t.u->queue.av_queue) == 0);
+    TEST_CHECK(gauge_get(t.u->cmt_busy) == 1);
+    TEST_CHECK(gauge_get(t.u->cmt_idle) == 0);
+    TEST_CHECK(b.got == FLB_FALSE);
+
+    TEST_CHECK(flb_upstream_conn_waiters_resume(t.u) == 1);
+    TEST_CHECK(b.got == FLB_TRUE);
+    TEST_CHECK(b.conn == conn);
+    TEST_CHECK(conn->ka_count == 2);
+    TEST_CHECK(mk_list_size(&t.u->queue.wait_queue) == 0);
+    TEST_CHECK(t.u->queue.reserved == 0);
+    TEST_CHECK(gauge_get(t.u->cmt_waiters) == 0);
+    TEST_CHECK(counter_get(t.u->cmt_waits) == 1);
+
+    flb_coro_resume(b.coro);
+    TEST_CHECK(b.done == FLB_TRUE);
+    TEST_CHECK(mk_list_size(&t.u->queue.av_queue) == 1);
+    TEST_CHECK(gauge_get(t.u->cmt_busy) == 0);
+    TEST_CHECK(gauge_get(t.u->cmt_idle) == 1);
+
+    flb_coro_destroy(a.coro);
+    flb_coro_destroy(b.coro);
+    pool_teardown(&t);
+}
+
+/* A coroutine waits up to net.connect_timeout for a connection */
+void test_pool_timeout()
+{
+    int ret;
+    struct pool_test t;
+    struct pool_coro a;
+    struct pool_coro b;
+
+    ret = pool_setup(&t);
+    if (ret != 0) {
+        return;
+    }
+    t.u->net.connect_timeout = 1;
+    ret = flb_upstream_conn_warmup(t.u);
+    TEST_CHECK(ret == 1);
+
+    pool_coro_start(&t, &a);
+    TEST_CHECK(a.conn != NULL);
+    pool_coro_start(&t, &b);
+    TEST_CHECK(b.got == FLB_FALSE);
+
+    /* not yet */
+    flb_upstream_conn_timeouts(&t.config->upstreams);
+    TEST_CHECK(flb_upstream_conn_waiters_resume(t.u) == 0);
+
+    sleep(1);
+    flb_upstream_conn_timeouts(&t.config->upstreams);
+    TEST_CHECK(flb_upstream_conn_waiters_resume(t.u) == 1);
+    TEST_CHECK(b.got == FLB_TRUE && b.conn == NULL);
+    TEST_CHECK(b.done == FLB_TRUE);
+    TEST_CHECK(gauge_get(t.u->cmt_waiters) == 0);
+    TEST_CHECK(counter_get(t.u->cmt_wait_time) >= 1);
+
+    /* the connection in use is not affected */
+    TEST_CHECK(gauge_get(t.u->cmt_busy) == 1);
+    flb_coro_resume(a.coro);
+    TEST_CHECK(a.done == FLB_TRUE);
+    TEST_CHECK(gauge_get(t.u->cmt_busy) == 0);
+    TEST_CHECK(gauge_get(t.u->cmt_idle) == 1);
+
+    flb_coro_destroy(a.coro);
+    flb_coro_destroy(b.coro);
+    pool_teardown(&t);
+}
+
+TEST_LIST = {
+    { "pool_warmup", test_pool_warmup },
+    { "pool_handover", test_pool_handover },
+    { "pool_timeout", test_pool_timeout },
+    { 0 }
+};
@@ -29,6 +29,7 @@ Approach for this tests is basing on filter_kubernetes tests
 #include <sys/types.h>
 #include <fcntl.h>
 #include <string.h>
+#include <stdarg.h>
 #include "flb_tests_runtime.h"
 
 
@@ -415,6 +416,371 @@ void flb_test_in_tail_skip_long_lines()
     unlink(path);
 }
 
+/*
+ * read_mode mmap: the short lines are consumed from a mapped window, the long
+ * line must be skipped by the read(2) path as it happens with read_mode read.
+ */
+void flb_test_in_tail_read_mode_mmap()
+{
+    int64_t ret;
+    flb_ctx_t    *ctx    = NULL;
+    int in_ffd;
+    int out_ffd;
+    int i;
+    char path[PATH_MAX];
+    struct tail_test_result result = {0};
+    int fd;
+
+    char *target = "read_mode_mmap";
+    int nBefore = 2048;
+    int nExpected = nBefore + 1;
+    int nExpectedNotMatched = 0;
+    int nExpectedLines = 2;
+
+    result.nMatched = 0;
+    result.target = target;
+
+    struct flb_lib_out_cb cb;
+    cb.cb   = cb_check_result;
+    cb.data = &result;
+
+    /* initialize */
+    set_result(0);
+
+    ctx = flb_create();
+
+    ret = flb_service_set(ctx,
+                          "Log_Level", "error",
+                          NULL);
+    TEST_CHECK_(ret == 0, "setting service options");
+
+    in_ffd = flb_input(ctx, "tail", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    TEST_CHECK(flb_input_set(ctx, in_ffd, "tag", "test", NULL) == 0);
+
+    /* Compose path based on target */
+    snprintf(path, sizeof(path) - 1, DPATH "/log/%s.log", target);
+    fd = creat(path, S_IRWXU | S_IRGRP);
+    TEST_CHECK(fd >= 0);
+
+    /* more content than buffer_chunk_size before the long line */
+    for (i = 0; i < nBefore; i++) {
+        write(fd, "before_long_line\n", strlen("before_long_line\n"));
+    }
+    write_long_lines(fd);
+    write(fd, "after_long_line\n", strlen("after_long_line\n"));
+    close(fd);
+
+    TEST_CHECK_(access(path, R_OK) == 0, "accessing log file: %s", path);
+
+    TEST_CHECK(flb_input_set(ctx, in_ffd,
+                             "path"          , path,
+                             "read_from_head", "true",
+                             "skip_long_lines", "on",
+                             "read_mode", "mmap",
+                             NULL) == 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "match", "test",
+                              "format", "json",
+                              NULL) == 0);
+
+    TEST_CHECK(flb_service_set(ctx, "Flush", "0.5",
+                                    "Grace", "1",
+                                    NULL) == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx);
+    TEST_CHECK_(ret == 0, "starting engine");
+
+    sleep(2);
+
+    TEST_CHECK(result.nMatched == nExpected);
+    TEST_MSG("result.nMatched: %i\nnExpected: %i", result.nMatched, nExpected);
+    TEST_CHECK(result.nNotMatched == nExpectedNotMatched);
+    TEST_MSG("result.nNotMatched: %i\nnExpectedNotMatched: %i", result.nNotMatched, nExpectedNotMatched);
+    TEST_CHECK(result.nLines == nExpectedLines);
+    TEST_MSG("result.nLines: %i\nnExpectedLines: %i", result.nLines, nExpectedLines);
+
+    ret = flb_stop(ctx);
+    TEST_CHECK_(ret == 0, "stopping engine");
+
+    if (ctx) {
+        flb_destroy(ctx);
+    }
+
+    unlink(path);
+}
+
+#define MMAP_WINDOW_LINE   "mmap_window_line\n"
+#define MMAP_WINDOW_LINES  4000
+
+static void mmap_window_write(const char *path, int flags)
+{
+    int i;
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | flags, S_IRWXU | S_IRGRP);
+    TEST_CHECK(fd >= 0);
+    for (i = 0; i < MMAP_WINDOW_LINES; i++) {
+        write(fd, MMAP_WINDOW_LINE, strlen(MMAP_WINDOW_LINE));
+    }
+    close(fd);
+}
+
+/*
+ * read_mode mmap with a small window: the file spans many windows and the
+ * lines cross their boundaries, no record is lost or repeated. The content
+ * appended once the file is in event mode is read through the buffer.
+ */
+void flb_test_in_tail_read_mode_mmap_window()
+{
+    int64_t ret;
+    flb_ctx_t    *ctx    = NULL;
+    int in_ffd;
+    int out_ffd;
+    char path[PATH_MAX];
+    struct tail_test_result result = {0};
+
+    char *target = "read_mode_mmap_window";
+    int nExpected = MMAP_WINDOW_LINES * 2;
+    int nExpectedNotMatched = 0;
+    int nExpectedLines = 1;
+
+    result.nMatched = 0;
+    result.target = target;
+
+    struct flb_lib_out_cb cb;
+    cb.cb   = cb_check_result;
+    cb.data = &result;
+
+    /* initialize */
+    set_result(0);
+
+    ctx = flb_create();
+
+    ret = flb_service_set(ctx,
+                          "Log_Level", "error",
+                          NULL);
+    TEST_CHECK_(ret == 0, "setting service options");
+
+    in_ffd = flb_input(ctx, "tail", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    TEST_CHECK(flb_input_set(ctx, in_ffd, "tag", "test", NULL) == 0);
+
+    snprintf(path, sizeof(path) - 1, DPATH "/log/%s.log", target);
+    mmap_window_write(path, O_TRUNC);
+
+    /* 17 bytes lines never end at a 4K window boundary */
+    TEST_CHECK(flb_input_set(ctx, in_ffd,
+                             "path"          , path,
+                             "read_from_head", "true",
+                             "read_mode", "mmap",
+                             "buffer_chunk_size", "4K",
+                             "mmap_window_size", "4K",
+                             NULL) == 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "match", "test",
+                              "format", "json",
+                              NULL) == 0);
+
+    TEST_CHECK(flb_service_set(ctx, "Flush", "0.5",
+                                    "Grace", "1",
+                                    NULL) == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx);
+    TEST_CHECK_(ret == 0, "starting engine");
+
+    sleep(2);
+
+    mmap_window_write(path, O_APPEND);
+    sleep(2);
+
+    TEST_CHECK(result.nMatched == nExpected);
+    TEST_MSG("result.nMatched: %i\nnExpected: %i", result.nMatched, nExpected);
+    TEST_CHECK(result.nNotMatched == nExpectedNotMatched);
+    TEST_MSG("result.nNotMatched: %i\nnExpectedNotMatched: %i", result.nNotMatched, nExpectedNotMatched);
+    TEST_CHECK(result.nLines == nExpectedLines);
+    TEST_MSG("result.nLines: %i\nnExpectedLines: %i", result.nLines, nExpectedLines);
+
+    ret = flb_stop(ctx);
+    TEST_CHECK_(ret == 0, "stopping engine");
+
+    if (ctx) {
+        flb_destroy(ctx);
+    }
+
+    unlink(path);
+}
+
+#define WORKERS_FILES    4
+#define WORKERS_RECORDS  3000
+
+static void workers_write(const char *target, const char *record, int flags)
+{
+    int i;
+    int f;
+    int fd;
+    char path[PATH_MAX];
+
+    for (f = 0; f < WORKERS_FILES; f++) {
+        snprintf(path, sizeof(path) - 1, DPATH "/log/%s_%i.log", target, f);
+        fd = open(path, O_WRONLY | O_CREAT | flags, S_IRWXU | S_IRGRP);
+        TEST_CHECK(fd >= 0);
+        for (i = 0; i < WORKERS_RECORDS; i++) {
+            write(fd, record, strlen(record));
+        }
+        close(fd);
+    }
+}
+
+/*
+ * workers: files are sharded across worker threads, no record is lost. With
+ * 'append' set, more records are written once the files are promoted to
+ * event mode. Extra properties are passed as key/value pairs.
+ */
+static void workers_test(const char *target, const char *record, int append,
+                         ...)
+{
+    int64_t ret;
+    flb_ctx_t    *ctx    = NULL;
+    int in_ffd;
+    int out_ffd;
+    int f;
+    va_list va;
+    char *key;
+    char *value;
+    char path[PATH_MAX];
+    struct tail_test_result result = {0};
+
+    int nExpected = WORKERS_FILES * WORKERS_RECORDS * (append ? 2 : 1);
+    int nExpectedNotMatched = 0;
+    int nExpectedLines = 1;
+
+    result.nMatched = 0;
+    result.target = target;
+
+    struct flb_lib_out_cb cb;
+    cb.cb   = cb_check_result;
+    cb.data = &result;
+
+    /* initialize */
+    set_result(0);
+
+    ctx = flb_create();
+
+    ret = flb_service_set(ctx,
+                          "Log_Level", "error",
+                          "Parsers_File", DPATH "/parsers.conf",
+                          NULL);
+    TEST_CHECK_(ret == 0, "setting service options");
+
+    in_ffd = flb_input(ctx, "tail", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    TEST_CHECK(flb_input_set(ctx, in_ffd, "tag", "test", NULL) == 0);
+
+    workers_write(target, record, O_TRUNC);
+
+    snprintf(path, sizeof(path) - 1, DPATH "/log/%s_*.log", target);
+    TEST_CHECK(flb_input_set(ctx, in_ffd,
+                             "path"          , path,
+                             "read_from_head", "true",
+                             "workers", "2",
+                             NULL) == 0);
+
+    va_start(va, append);
+    while ((key = va_arg(va, char *))) {
+        value = va_arg(va, char *);
+        TEST_CHECK(value != NULL);
+        TEST_CHECK(flb_input_set(ctx, in_ffd, key, value, NULL) == 0);
+    }
+    va_end(va);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    TEST_CHECK(flb_output_set(ctx, out_ffd,
+                              "match", "test",
+                              "format", "json",
+                              NULL) == 0);
+
+    TEST_CHECK(flb_service_set(ctx, "Flush", "0.5",
+                                    "Grace", "1",
+                                    NULL) == 0);
+
+    /* Start the engine */
+    ret = flb_start(ctx);
+    TEST_CHECK_(ret == 0, "starting engine");
+
+    sleep(2);
+
+    /* the files are in event mode now: new content goes to the workers */
+    if (append) {
+        workers_write(target, record, O_APPEND);
+        sleep(2);
+    }
+
+    TEST_CHECK(result.nMatched == nExpected);
+    TEST_MSG("result.nMatched: %i\nnExpected: %i", result.nMatched, nExpected);
+    TEST_CHECK(result.nNotMatched == nExpectedNotMatched);
+    TEST_MSG("result.nNotMatched: %i\nnExpectedNotMatched: %i", result.nNotMatched, nExpectedNotMatched);
+    TEST_CHECK(result.nLines == nExpectedLines);
+    TEST_MSG("result.nLines: %i\nnExpectedLines: %i", result.nLines, nExpectedLines);
+
+    ret = flb_stop(ctx);
+    TEST_CHECK_(ret == 0, "stopping engine");
+
+    if (ctx) {
+        flb_destroy(ctx);
+    }
+
+    for (f = 0; f < WORKERS_FILES; f++) {
+        snprintf(path, sizeof(path) - 1, DPATH "/log/%s_%i.log", target, f);
+        unlink(path);
+    }
+}
+
+#define WORKERS_DOCKER_RECORD                                                \
+    "{\"log\":\"one, \",\"stream\":\"stdout\","                              \
+    "\"time\":\"2021-02-01T01:40:03.534Z\"}\n"                               \
+    "{\"log\":\"two, \",\"stream\":\"stdout\","                              \
+    "\"time\":\"2021-02-01T01:40:03.535Z\"}\n"                               \
+    "{\"log\":\"three\\n\",\"stream\":\"stdout\","                           \
+    "\"time\":\"2021-02-01T01:40:03.536Z\"}\n"
+
+void flb_test_in_tail_workers()
+{
+    workers_test("workers", "worker_line\n", FLB_FALSE, NULL);
+}
+
+/* files promoted to event mode are read by the workers too */
+void flb_test_in_tail_workers_event()
+{
+    workers_test("workers", "worker_line\n", FLB_TRUE, NULL);
+}
+
+/* the multiline core state of every file lives in its worker */
+void flb_test_in_tail_workers_multiline()
+{
+    workers_test("workers_multiline", WORKERS_DOCKER_RECORD, FLB_TRUE,
+                 "multiline.parser", "docker",
+                 NULL);
+}
+
+/* docker_mode joins the partial messages in the workers */
+void flb_test_in_tail_workers_docker_mode()
+{
+    workers_test("workers_multiline", WORKERS_DOCKER_RECORD, FLB_TRUE,
+                 "docker_mode", "on",
+                 "parser", "docker",
+                 NULL);
+}
+
 /* 
  * test case for https://github.com/fluent/fluent-bit/issues/3943
  * 
@@ -496,10 +862,236 @@ void flb_test_in_tail_issue_3943()
     }
 }
 
+#ifdef FLB_HAVE_SQLDB
+#include <sqlite3.h>
+
+#define DB_LINE      "db_commit_line\n"
+#define DB_LINES     100
+
+static int cb_count_records(void *record, size_t size, void *data)
+{
+    int *count = data;
+
+    __sync_fetch_and_add(count, 1);
+    if (size > 0) {
+        flb_free(record);
+    }
+    return 0;
+}
+
+/* Offset of the file registered in the tail database, -1 if not found */
+static int64_t db_offset_get(const char *db_path, const char *file)
+{
+    int ret;
+    int64_t offset = -1;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+
+    ret = sqlite3_open(db_path, &db);
+    if (ret != SQLITE_OK) {
+        return -1;
+    }
+
+    ret = sqlite3_prepare_v2(db,
+                             "SELECT offset FROM in_tail_files WHERE name=@name;",
+                             -1, &stmt, NULL);
+    if (ret == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, file, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            offset = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+
+    return offset;
+}
+
+static flb_ctx_t *db_commit_start(const char *target, int *count,
+                                  char *path, char *db_path, size_t size,
+                                  const char *interval, const char *bytes)
+{
+    int i;
+    int fd;
+    int ret;
+    int in_ffd;
+    int out_ffd;
+    flb_ctx_t *ctx;
+    struct flb_lib_out_cb cb;
+
+    snprintf(path, size - 1, DPATH "/log/%s.log", target);
+    snprintf(db_path, size - 1, DPATH "/log/%s.db", target);
+    unlink(db_path);
+
+    fd = creat(path, S_IRWXU | S_IRGRP);
+    TEST_CHECK(fd >= 0);
+    for (i = 0; i < DB_LINES; i++) {
+        write(fd, DB_LINE, strlen(DB_LINE));
+    }
+    close(fd);
+
+    cb.cb = cb_count_records;
+    cb.data = count;
+
+    ctx = flb_create();
+    ret = flb_service_set(ctx,
+                          "Flush", "0.5",
+                          "Grace", "1",
+                          "Log_Level", "off",
+                          NULL);
+    TEST_CHECK(ret == 0);
+
+    in_ffd = flb_input(ctx, "tail", NULL);
+    TEST_CHECK(in_ffd >= 0);
+    TEST_CHECK(flb_input_set(ctx, in_ffd,
+                             "tag", "test",
+                             "path", path,
+                             "read_from_head", "true",
+                             "db", db_path,
+                             "db.commit_interval", interval,
+                             "db.commit_bytes", bytes,
+                             NULL) == 0);
+
+    out_ffd = flb_output(ctx, (char *) "lib", &cb);
+    TEST_CHECK(out_ffd >= 0);
+    TEST_CHECK(flb_output_set(ctx, out_ffd, "match", "test", NULL) == 0);
+
+    ret = flb_start(ctx);
+    TEST_CHECK_(ret == 0, "starting engine");
+
+    return ctx;
+}
+
+static void db_commit_stop(flb_ctx_t *ctx, const char *path,
+                           const char *db_path)
+{
+    flb_stop(ctx);
+    flb_destroy(ctx);
+    unlink(path);
+    unlink(db_path);
+}
+
+/* Offsets are kept in memory and written once per 'db.commit_interval' */
+void flb_test_in_tail_db_commit_interval()
+{
+    int count = 0;
+    int64_t offset;
+    char path[PATH_MAX];
+    char db_path[PATH_MAX];
+    flb_ctx_t *ctx;
+
+    ctx = db_commit_start("db_commit_interval", &count, path, db_path,
+                          sizeof(path), "3", "0");
+    sleep(1);
+
+    /* everything was read but the offset is still in the journal */
+    TEST_CHECK(count == DB_LINES);
+    offset = db_offset_get(db_path, path);
+    TEST_CHECK(offset == 0);
+    TEST_MSG("offset: %" PRId64 ", expected 0", offset);
+
+    sleep(3);
+    offset = db_offset_get(db_path, path);
+    TEST_CHECK(offset == DB_LINES * strlen(DB_LINE));
+    TEST_MSG("offset: %" PRId64 ", expected %zu",
+             offset, DB_LINES * strlen(DB_LINE));
+
+    db_commit_stop(ctx, path, db_path);
+}
+
+/* 'db.commit_bytes' forces a commit before the interval expires */
+void flb_test_in_tail_db_commit_bytes()
+{
+    int count = 0;
+    int64_t offset;
+    char path[PATH_MAX];
+    char db_path[PATH_MAX];
+    flb_ctx_t *ctx;
+
+    ctx = db_commit_start("db_commit_bytes", &count, path, db_path,
+                          sizeof(path), "60", "1");
+    sleep(1);
+
+    TEST_CHECK(count == DB_LINES);
+    offset = db_offset_get(db_path, path);
+    TEST_CHECK(offset == DB_LINES * strlen(DB_LINE));
+    TEST_MSG("offset: %" PRId64 ", expected %zu",
+             offset, DB_LINES * strlen(DB_LINE));
+
+    db_commit_stop(ctx, path, db_path);
+}
+
+/* A failed commit keeps the offsets for the next one */
+void flb_test_in_tail_db_commit_failure()
+{
+    int ret;
+    int i;
+    int fd;
+    int count = 0;
+    int64_t offset;
+    char path[PATH_MAX];
+    char db_path[PATH_MAX];
+    sqlite3 *db;
+    flb_ctx_t *ctx;
+
+    ctx = db_commit_start("db_commit_failure", &count, path, db_path,
+                          sizeof(path), "1", "0");
+    sleep(2);
+
+    offset = db_offset_get(db_path, path);
+    TEST_CHECK(offset == DB_LINES * strlen(DB_LINE));
+
+    /* hold the write lock: the commits fail while it's taken */
+    ret = sqlite3_open(db_path, &db);
+    TEST_CHECK(ret == SQLITE_OK);
+    ret = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL);
+    TEST_CHECK(ret == SQLITE_OK);
+
+    fd = open(path, O_WRONLY | O_APPEND);
+    TEST_CHECK(fd >= 0);
+    for (i = 0; i < DB_LINES; i++) {
+        write(fd, DB_LINE, strlen(DB_LINE));
+    }
+    close(fd);
+
+    sleep(3);
+    TEST_CHECK(count == DB_LINES * 2);
+
+    /* the failed commits were rolled back */
+    offset = db_offset_get(db_path, path);
+    TEST_CHECK(offset == DB_LINES * strlen(DB_LINE));
+    TEST_MSG("offset: %" PRId64 ", expected %zu",
+             offset, DB_LINES * strlen(DB_LINE));
+
+    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    sqlite3_close(db);
+
+    /* no new data, the next commit must write the kept offset */
+    sleep(2);
+    offset = db_offset_get(db_path, path);
+    TEST_CHECK(offset == DB_LINES * 2 * strlen(DB_LINE));
+    TEST_MSG("offset: %" PRId64 ", expected %zu",
+             offset, DB_LINES * 2 * strlen(DB_LINE));
+
+    db_commit_stop(ctx, path, db_path);
+}
+#endif
+
 /* Test list */
 TEST_LIST = {
     {"issue_3943", flb_test_in_tail_issue_3943},
     {"skip_long_lines", flb_test_in_tail_skip_long_lines},
+    {"read_mode_mmap", flb_test_in_tail_read_mode_mmap},
+    {"read_mode_mmap_window", flb_test_in_tail_read_mode_mmap_window},
+    {"workers", flb_test_in_tail_workers},
+    {"workers_event", flb_test_in_tail_workers_event},
+    {"workers_multiline", flb_test_in_tail_workers_multiline},
+    {"workers_docker_mode", flb_test_in_tail_workers_docker_mode},
+#ifdef FLB_HAVE_SQLDB
+    {"db_commit_interval", flb_test_in_tail_db_commit_interval},
+    {"db_commit_bytes", flb_test_in_tail_db_commit_bytes},
+    {"db_commit_failure", flb_test_in_tail_db_commit_failure},
+#endif
 #ifdef in_tail
     {"in_tail_dockermode",                          flb_test_in_tail_dockermode},
     {"in_tail_dockermode_splitted_line",            flb_test_in_tail_dockermode_splitted_line},